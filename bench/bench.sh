@@ -0,0 +1,131 @@
+#!/bin/bash
+
+# Compile-throughput benchmark, run by `make bench`. Compiles generated
+# corpora with -ftime-report=json, growing one size axis at a time, and
+# prints the median CPU time of every stage, lines per second, and how
+# the total scales with the token count (1.0 is linear, 2.0 quadratic).
+#
+#   bench/bench.sh [axis...]      axes: functions statements depth strings globals nesting
+#
+# RUNS sets the compiles per point (default 5).
+
+COMPILER=${COMPILER:-./k0}
+GENCORPUS=${GENCORPUS:-bench/gencorpus}
+RUNS=${RUNS:-5}
+PHASES="parse lower extract_symbols check_symbols collect_strings generate_code write_ic tac2asm"
+
+# reference corpus, and the values each axis is swept over with the others held there
+declare -A BASE=([functions]=20 [statements]=10 [depth]=4 [strings]=20 [globals]=10 [nesting]=2)
+declare -A SWEEP=(
+    [functions]="10 20 40 80"
+    [statements]="5 10 20 40"
+    [depth]="2 4 8 16"
+    [strings]="0 50 100 200"
+    [globals]="0 25 50 100"
+    [nesting]="0 2 4 8"
+)
+AXES="functions statements depth strings globals nesting"
+
+set -o pipefail
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# token count of $1, then the median cpu ms of each phase over RUNS compiles, in PHASES order
+measure() {
+    local file=$1
+    for ((run = 0; run < RUNS; run++)); do
+        if ! "$COMPILER" -ftime-report=json -c "$file" 2>"$WORK/err" >/dev/null; then
+            echo "Error: $COMPILER failed on $file:" >&2
+            grep -v '^{' "$WORK/err" >&2
+            exit 1
+        fi
+        grep '^{' "$WORK/err"
+    done | awk -v phases="$PHASES" '
+        {
+            if (match($0, /"tokens": [0-9]+/)) tokens = substr($0, RSTART + 10, RLENGTH - 10)
+            n = split(phases, name, " ")
+            for (i = 1; i <= n; i++) {
+                if (match($0, "\"" name[i] "\": {[^}]*\"cpu_ms\": [0-9.]+")) {
+                    s = substr($0, RSTART, RLENGTH)
+                    sub(/.* /, "", s)
+                    t[i, NR] = s
+                }
+            }
+        }
+        END {
+            printf "%d", tokens
+            for (i = 1; i <= n; i++) {
+                for (j = 1; j <= NR; j++) v[j] = t[i, j]
+                for (j = 2; j <= NR; j++) {
+                    x = v[j]
+                    for (k = j - 1; k >= 1 && v[k] > x; k--) v[k + 1] = v[k]
+                    v[k + 1] = x
+                }
+                printf " %s", (NR % 2 ? v[(NR + 1) / 2] : (v[NR / 2] + v[NR / 2 + 1]) / 2)
+            }
+            printf "\n"
+        }'
+}
+
+# generate the corpus for axis=value with every other axis at its base value
+generate() {
+    local axis=$1 value=$2 file=$3 args=""
+    for a in $AXES; do
+        args="$args -$a $([[ $a == "$axis" ]] && echo "$value" || echo "${BASE[$a]}")"
+    done
+    "$GENCORPUS" $args > "$file"
+}
+
+header() {
+    printf "  %-10s %7s %7s" "$1" "lines" "tokens"
+    for p in $PHASES; do printf " %9.9s" "$p"; done
+    printf " %9s %9s %7s\n" "total" "lines/s" "scaling"
+}
+
+# format "label lines tokens times..." lines as table rows; scaling compares each row with the one before
+table() {
+    awk '
+        {
+            total = 0
+            printf "  %-10s %7d %7d", $1, $2, $3
+            for (i = 4; i <= NF; i++) {
+                printf " %9.2f", $i
+                total += $i
+            }
+            scaling = "-"
+            if (NR > 1 && prev_total > 0 && total > 0 && $3 != prev_tokens) {
+                scaling = sprintf("%.2f", log(total / prev_total) / log($3 / prev_tokens))
+            }
+            printf " %9.2f %9.0f %7s\n", total, (total > 0 ? $2 / (total / 1000) : 0), scaling
+            fflush()
+            prev_tokens = $3
+            prev_total = total
+        }'
+}
+
+if [[ ! -x $COMPILER || ! -x $GENCORPUS ]]; then
+    echo "Error: build $COMPILER and $GENCORPUS first (make bench)" >&2
+    exit 1
+fi
+AXES_RUN=${*:-$AXES}
+
+echo "==== Compile throughput: cpu ms per stage, median of $RUNS runs ===="
+generate none 0 "$WORK/base.kt"
+header corpus
+times=$(measure "$WORK/base.kt") || exit 1
+echo "base $(wc -l < "$WORK/base.kt") $times" | table
+
+for axis in $AXES_RUN; do
+    if [[ -z ${SWEEP[$axis]} ]]; then
+        echo "Error: unknown axis $axis" >&2
+        exit 1
+    fi
+    echo
+    echo "==== Scaling with $axis ===="
+    header "$axis"
+    for value in ${SWEEP[$axis]}; do
+        generate "$axis" "$value" "$WORK/$axis-$value.kt"
+        times=$(measure "$WORK/$axis-$value.kt") || exit 1
+        echo "$value $(wc -l < "$WORK/$axis-$value.kt") $times"
+    done | table || exit 1
+done
@@ -0,0 +1,131 @@
+/*
+ * Generate a valid k0 program for benchmarking the compiler. Every size
+ * axis can be set on its own, and the same options and seed always give
+ * the same program:
+ *
+ *   gencorpus [-functions N] [-statements N] [-depth N] [-strings N]
+ *             [-globals N] [-nesting N] [-seed N]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int functions = 100;     // functions besides main
+static int statements = 20;     // assignments per function
+static int depth = 4;           // operators in each assignment's expression
+static int strings = 50;        // distinct string literals, spread over the functions
+static int globals = 10;        // global vals the expressions read
+static int nesting = 2;         // while loops nested in every function
+
+static unsigned long long state = 1;
+
+static int next_random(int n) {
+    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (int)((state >> 33) % (unsigned long long)n);
+}
+
+static void usage(void) {
+    fprintf(stderr, "Usage: gencorpus [-functions N] [-statements N] [-depth N] [-strings N] [-globals N] [-nesting N] [-seed N]\n");
+    exit(4);
+}
+
+static void leaf(void) {
+    switch (next_random(globals > 0 ? 5 : 4)) {
+        case 0: printf("a"); break;
+        case 1: printf("x"); break;
+        case 2: printf("y"); break;
+        case 3: printf("%d", next_random(100)); break;
+        default: printf("G%d", next_random(globals)); break;
+    }
+}
+
+// a chain of operators, which the grammar nests one level per operator; k0
+// cannot generate code for parentheses, and a '-' would start a new statement
+static void expression(int d) {
+    leaf();
+    for (int i = 0; i < d; i++) {
+        printf(" %s ", next_random(2) ? "+" : "*");
+        leaf();
+    }
+}
+
+static void indent(int level) {
+    for (int i = 0; i < level; i++) printf("    ");
+}
+
+static void loops(int level) {
+    indent(level + 1);
+    printf("w%d = 0;\n", level);
+    indent(level + 1);
+    printf("while (w%d < 2) {\n", level);
+    indent(level + 2);
+    printf("w%d = w%d + 1;\n", level, level);
+    if (level + 1 < nesting) {
+        loops(level + 1);
+    } else {
+        indent(level + 2);
+        printf("x = x + y;\n");
+    }
+    indent(level + 1);
+    printf("}\n");
+}
+
+static void function(int f) {
+    printf("fun f%d(a : Int, b : Int) : Int {\n", f);
+    printf("    var x : Int = a;\n");
+    printf("    var y : Int = b;\n");
+    for (int i = 0; i < nesting; i++) {
+        printf("    var w%d : Int = 0;\n", i);
+    }
+    // string literal s goes to function s % functions, between the assignments
+    int own = strings / functions + (f < strings % functions);
+    for (int i = 0; i < statements || i < own; i++) {
+        if (i < statements) {
+            printf("    %s = ", next_random(2) ? "x" : "y");
+            expression(depth);
+            printf(";\n");
+        }
+        if (i < own) {
+            printf("    println(\"literal %d\");\n", f + i * functions);
+        }
+    }
+    if (nesting > 0) loops(0);
+    if (f > 0) printf("    y = f%d(x, y);\n", f - 1);
+    printf("    return x;\n");
+    printf("}\n\n");
+}
+
+int main(int argc, char *argv[]) {
+    struct { const char *name; int *value; } options[] = {
+        { "-functions", &functions }, { "-statements", &statements }, { "-depth", &depth },
+        { "-strings", &strings }, { "-globals", &globals }, { "-nesting", &nesting },
+    };
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) usage();
+        if (strcmp(argv[i], "-seed") == 0) {
+            state = strtoull(argv[++i], NULL, 10);
+            continue;
+        }
+        int *value = NULL;
+        for (size_t j = 0; j < sizeof(options) / sizeof(options[0]); j++) {
+            if (strcmp(argv[i], options[j].name) == 0) value = options[j].value;
+        }
+        if (!value) usage();
+        *value = atoi(argv[++i]);
+        if (*value < 0) usage();
+    }
+    if (functions < 1) functions = 1;
+
+    for (int g = 0; g < globals; g++) {
+        printf("val G%d : Int = %d;\n", g, g + 1);
+    }
+    printf("\n");
+    for (int f = 0; f < functions; f++) {
+        function(f);
+    }
+    printf("fun main() {\n");
+    printf("    var r : Int = 0;\n");
+    printf("    r = f%d(1, 2);\n", functions - 1);
+    printf("}\n");
+    return 0;
+}
@@ -0,0 +1,85 @@
+#!/bin/bash
+
+# Lexer throughput benchmark, run by `make lexbench`. Scans generated
+# corpora of growing size with -tokens=count on each lexer engine and
+# prints the median parse-phase CPU time, which -tokens=count spends in
+# the scanner alone, tokens per second, and the fast engine's speedup.
+#
+#   bench/lexbench.sh [functions...]      corpus sizes, in functions (default 100 400 1600)
+#
+# RUNS sets the scans per point (default 5).
+
+COMPILER=${COMPILER:-./k0}
+GENCORPUS=${GENCORPUS:-bench/gencorpus}
+RUNS=${RUNS:-5}
+ENGINES="flex fast"
+
+set -o pipefail
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# token count of $1, then the median parse cpu ms over RUNS scans with engine $2
+measure() {
+    local file=$1 engine=$2
+    for ((run = 0; run < RUNS; run++)); do
+        if ! "$COMPILER" -ftime-report=json -lexer-engine="$engine" -tokens=count "$file" 2>"$WORK/err" >/dev/null; then
+            echo "Error: $COMPILER failed on $file with -lexer-engine=$engine:" >&2
+            grep -v '^{' "$WORK/err" >&2
+            exit 1
+        fi
+        grep '^{' "$WORK/err"
+    done | awk '
+        {
+            if (match($0, /"tokens": [0-9]+/)) tokens = substr($0, RSTART + 10, RLENGTH - 10)
+            if (match($0, /"parse": {[^}]*"cpu_ms": [0-9.]+/)) {
+                s = substr($0, RSTART, RLENGTH)
+                sub(/.* /, "", s)
+                v[NR] = s
+            }
+        }
+        END {
+            for (j = 2; j <= NR; j++) {
+                x = v[j]
+                for (k = j - 1; k >= 1 && v[k] > x; k--) v[k + 1] = v[k]
+                v[k + 1] = x
+            }
+            printf "%d %s\n", tokens, (NR % 2 ? v[(NR + 1) / 2] : (v[NR / 2] + v[NR / 2 + 1]) / 2)
+        }'
+}
+
+if [[ ! -x $COMPILER || ! -x $GENCORPUS ]]; then
+    echo "Error: build $COMPILER and $GENCORPUS first (make lexbench)" >&2
+    exit 1
+fi
+SIZES=${*:-100 400 1600}
+
+echo "==== Lexer throughput: cpu ms to scan, median of $RUNS runs ===="
+printf "  %-10s %9s %9s" functions bytes tokens
+for engine in $ENGINES; do printf " %9s %12s" "$engine" "tokens/s"; done
+printf " %8s\n" speedup
+
+for functions in $SIZES; do
+    file="$WORK/functions-$functions.kt"
+    "$GENCORPUS" -functions "$functions" > "$file"
+    row="$functions $(wc -c < "$file")"
+    tokens=""
+    for engine in $ENGINES; do
+        result=$(measure "$file" "$engine") || exit 1
+        read -r count ms <<< "$result"
+        if [[ -n $tokens && $count != "$tokens" ]]; then
+            echo "Error: -lexer-engine=$engine found $count tokens in $file, not $tokens" >&2
+            exit 1
+        fi
+        tokens=$count
+        row="$row $ms"
+    done
+    echo "$row $tokens"
+done | awk '
+    {
+        printf "  %-10d %9d %9d", $1, $2, $NF
+        for (i = 3; i < NF; i++) {
+            printf " %9.2f %12.0f", $i, ($i > 0 ? $NF / ($i / 1000) : 0)
+        }
+        printf " %7.2fx\n", ($(NF - 1) > 0 ? $3 / $(NF - 1) : 0)
+        fflush()
+    }'
@@ -0,0 +1,17 @@
+#include <stdio.h>
+
+int main(void) {
+    long i = 0;
+    long h = 7;
+    long p = 1;
+    while (i < 10000000) {
+        h = h * 3 + i;
+        h = h / 4;
+        p = p * 3 + h / 7;
+        p = p / 4;
+        i = i + 1;
+    }
+    printf("%ld\n", h);
+    printf("%ld\n", p);
+    return 0;
+}
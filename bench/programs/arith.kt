@@ -0,0 +1,14 @@
+fun main() {
+    var i : Int = 0;
+    var h : Int = 7;
+    var p : Int = 1;
+    while (i < 10000000) {
+        h = h * 3 + i;
+        h = h / 4;
+        p = p * 3 + h / 7;
+        p = p / 4;
+        i = i + 1;
+    }
+    println(h);
+    println(p);
+}
@@ -0,0 +1,22 @@
+#include <stdio.h>
+
+int main(void) {
+    long i = 0;
+    long a = 0;
+    long b = 0;
+    long c = 0;
+    while (i < 5000000) {
+        if (i % 3 == 0) {
+            a = a + 1;
+        } else if (i % 5 == 0) {
+            b = b + 2;
+        } else {
+            c = c + i / 7;
+        }
+        i = i + 1;
+    }
+    printf("%ld\n", a);
+    printf("%ld\n", b);
+    printf("%ld\n", c);
+    return 0;
+}
@@ -0,0 +1,19 @@
+fun main() {
+    var i : Int = 0;
+    var a : Int = 0;
+    var b : Int = 0;
+    var c : Int = 0;
+    while (i < 5000000) {
+        if (i % 3 == 0) {
+            a = a + 1;
+        } else if (i % 5 == 0) {
+            b = b + 2;
+        } else {
+            c = c + i / 7;
+        }
+        i = i + 1;
+    }
+    println(a);
+    println(b);
+    println(c);
+}
@@ -0,0 +1,12 @@
+fun fib(n : Int) : Int {
+    if (n < 2) {
+        return n;
+    }
+    return fib(n - 1) + fib(n - 2);
+}
+
+fun main() {
+    var r : Int = 0;
+    r = fib(32);
+    println(r);
+}
@@ -0,0 +1,17 @@
+#include <stdio.h>
+
+int main(void) {
+    long i = 0;
+    long j = 0;
+    long s = 0;
+    while (i < 3000) {
+        j = 0;
+        while (j < 3000) {
+            s = s + j;
+            j = j + 1;
+        }
+        i = i + 1;
+    }
+    printf("%ld\n", s);
+    return 0;
+}
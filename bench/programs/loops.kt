@@ -0,0 +1,14 @@
+fun main() {
+    var i : Int = 0;
+    var j : Int = 0;
+    var s : Int = 0;
+    while (i < 3000) {
+        j = 0;
+        while (j < 3000) {
+            s = s + j;
+            j = j + 1;
+        }
+        i = i + 1;
+    }
+    println(s);
+}
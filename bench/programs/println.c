@@ -0,0 +1,11 @@
+#include <stdio.h>
+
+int main(void) {
+    long i = 0;
+    while (i < 200000) {
+        printf("%ld\n", i);
+        printf("line\n");
+        i = i + 1;
+    }
+    return 0;
+}
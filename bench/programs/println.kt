@@ -0,0 +1,8 @@
+fun main() {
+    var i : Int = 0;
+    while (i < 200000) {
+        println(i);
+        println("line");
+        i = i + 1;
+    }
+}
@@ -0,0 +1,88 @@
+#!/bin/bash
+
+# Runtime benchmark, run by `make runbench`. Builds every program in
+# bench/programs with k0 and its C twin with gcc -O0 and -O2, checks that
+# the k0 executable prints what the C one does, and prints the median wall
+# time of each over RUNS runs (default 5) with k0's time relative to gcc.
+#
+#   bench/runbench.sh [program...]
+#
+# A k0 executable that crashes, prints something else, or runs past
+# TIMEOUT seconds (default 20) is reported instead of timed.
+
+COMPILER=$(realpath "${COMPILER:-./k0}")
+CC=${CC:-gcc}
+RUNS=${RUNS:-5}
+TIMEOUT=${TIMEOUT:-20}
+PROGRAMS_DIR=$(cd "$(dirname "$0")/programs" && pwd)
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# median wall ms over RUNS runs of $1, with its output discarded
+measure() {
+    for ((run = 0; run < RUNS; run++)); do
+        local start end
+        start=$(date +%s%N)
+        (timeout "$TIMEOUT" "$1" > /dev/null; exit $?) 2> /dev/null
+        end=$(date +%s%N)
+        echo $(((end - start) / 1000))
+    done | sort -n | awk '
+        { v[NR] = $1 }
+        END { printf "%.2f", (NR % 2 ? v[(NR + 1) / 2] : (v[NR / 2] + v[NR / 2 + 1]) / 2) / 1000 }'
+}
+
+if [[ ! -x $COMPILER ]]; then
+    echo "Error: build $COMPILER first (make runbench)" >&2
+    exit 1
+fi
+
+if [[ $# -gt 0 ]]; then
+    PROGRAMS="$*"
+else
+    PROGRAMS=$(cd "$PROGRAMS_DIR" && ls *.kt | sed 's/\.kt$//')
+fi
+
+echo "==== Runtime: wall ms, median of $RUNS runs ===="
+printf "  %-10s %14s %10s %10s %8s %8s\n" "program" "k0" "gcc -O0" "gcc -O2" "vs -O0" "vs -O2"
+for name in $PROGRAMS; do
+    if [[ ! -f $PROGRAMS_DIR/$name.kt || ! -f $PROGRAMS_DIR/$name.c ]]; then
+        echo "Error: no program $name in $PROGRAMS_DIR" >&2
+        exit 1
+    fi
+    mkdir "$WORK/$name"
+    cp "$PROGRAMS_DIR/$name.kt" "$WORK/$name/"
+    if ! "$CC" -O0 -o "$WORK/$name/c-O0" "$PROGRAMS_DIR/$name.c" ||
+       ! "$CC" -O2 -o "$WORK/$name/c-O2" "$PROGRAMS_DIR/$name.c"; then
+        echo "Error: $CC failed on $name.c" >&2
+        exit 1
+    fi
+    gcc_o0=$(measure "$WORK/$name/c-O0")
+    gcc_o2=$(measure "$WORK/$name/c-O2")
+
+    # k0 writes the executable next to where it runs
+    status=""
+    if ! (cd "$WORK/$name" && "$COMPILER" "$name.kt" > build.log 2>&1) || [[ ! -x $WORK/$name/$name ]]; then
+        status="compile failed"
+    else
+        "$WORK/$name/c-O0" > "$WORK/$name/expected"
+        (timeout "$TIMEOUT" "$WORK/$name/$name" > "$WORK/$name/actual"; exit $?) 2> /dev/null
+        code=$?
+        if [[ $code -eq 124 ]]; then
+            status="timed out"
+        elif [[ $code -gt 128 ]]; then
+            status="crashed"
+        elif ! cmp -s "$WORK/$name/expected" "$WORK/$name/actual"; then
+            status="wrong output"
+        fi
+    fi
+
+    if [[ -n $status ]]; then
+        printf "  %-10s %14s %10s %10s %8s %8s\n" "$name" "$status" "$gcc_o0" "$gcc_o2" "-" "-"
+    else
+        k0=$(measure "$WORK/$name/$name")
+        awk -v name="$name" -v k0="$k0" -v o0="$gcc_o0" -v o2="$gcc_o2" 'BEGIN {
+            printf "  %-10s %14.2f %10.2f %10.2f %7.2fx %7.2fx\n", name, k0, o0, o2, (o0 > 0 ? k0 / o0 : 0), (o2 > 0 ? k0 / o2 : 0)
+        }'
+    fi
+done
@@ -0,0 +1,324 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include "cache.h"
+
+#define DEFAULT_CACHE_SIZE (256L << 20)
+#define STATS_FILE "stats"
+
+static const int artifacts[] = { CACHE_IC, CACHE_ASM, CACHE_OBJ };
+static const char *extensions[] = { ".ic", ".S", ".o" };
+
+typedef struct cache_file {
+    char *name;
+    off_t size;
+    time_t used;
+} cache_file;
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t length) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= p[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// the cache directory, created on first use; NULL if it cannot be
+static const char *cache_dir(void) {
+    static char dir[PATH_MAX];
+    if (dir[0]) return dir;
+    const char *env = getenv("K0_CACHE_DIR");
+    const char *home = getenv("HOME");
+    if (env && *env) {
+        snprintf(dir, sizeof(dir), "%s", env);
+    } else if (home && *home) {
+        snprintf(dir, sizeof(dir), "%s/.cache", home);
+        mkdir(dir, 0755);
+        snprintf(dir, sizeof(dir), "%s/.cache/k0", home);
+    } else {
+        snprintf(dir, sizeof(dir), "/tmp/k0-cache-%d", (int)getuid());
+    }
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        dir[0] = '\0';
+        return NULL;
+    }
+    return dir;
+}
+
+static long cache_limit(void) {
+    const char *env = getenv("K0_CACHE_SIZE");
+    long limit = env ? strtol(env, NULL, 10) : 0;
+    return limit > 0 ? limit : DEFAULT_CACHE_SIZE;
+}
+
+static char *join(const char *a, const char *b, const char *c) {
+    char *s = malloc(strlen(a) + strlen(b) + strlen(c) + 2);
+    if (!s) {
+        perror("Memory allocation failed");
+        exit(4);
+    }
+    sprintf(s, "%s%s%s", a, b, c);
+    return s;
+}
+
+static bool copy_file(const char *from, const char *to) {
+    FILE *in = fopen(from, "rb");
+    if (!in) return false;
+    FILE *out = fopen(to, "wb");
+    if (!out) {
+        fclose(in);
+        return false;
+    }
+    char buf[65536];
+    size_t n;
+    bool ok = true;
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+        if (fwrite(buf, 1, n, out) != n) ok = false;
+    }
+    fclose(in);
+    return fclose(out) == 0 && ok;
+}
+
+void cache_key(const char *source, size_t length, const char *flags, char key[CACHE_KEY_SIZE]) {
+    // the k0 binary stands in for the compiler version: rebuilding it starts a fresh cache
+    char compiler[96] = "";
+    struct stat st;
+    if (stat("/proc/self/exe", &st) == 0) {
+        snprintf(compiler, sizeof(compiler), "%ld:%ld:%ld", (long)st.st_ino, (long)st.st_size, (long)st.st_mtime);
+    }
+    uint64_t lo = 0xcbf29ce484222325ULL;
+    uint64_t hi = fnv1a(lo, "k0 cache", 8);
+    const char *parts[] = { compiler, flags, source };
+    size_t sizes[] = { strlen(compiler) + 1, strlen(flags) + 1, length };
+    for (int i = 0; i < 3; i++) {
+        lo = fnv1a(lo, parts[i], sizes[i]);
+        hi = fnv1a(hi ^ lo, parts[i], sizes[i]);
+    }
+    snprintf(key, CACHE_KEY_SIZE, "%016llx%016llx", (unsigned long long)hi, (unsigned long long)lo);
+}
+
+// add to the hit or miss counter shared by every k0 using this cache
+static void count(const char *dir, bool hit) {
+    char *path = join(dir, "/", STATS_FILE);
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    free(path);
+    if (fd < 0) return;
+    flock(fd, LOCK_EX);
+    char buf[64] = "";
+    long hits = 0, misses = 0;
+    ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+    if (n > 0) {
+        buf[n] = '\0';
+        sscanf(buf, "%ld %ld", &hits, &misses);
+    }
+    if (hit) hits++; else misses++;
+    int len = snprintf(buf, sizeof(buf), "%ld %ld\n", hits, misses);
+    if (ftruncate(fd, 0) == 0 && pwrite(fd, buf, len, 0) != len) {
+        perror("Error updating cache statistics");
+    }
+    flock(fd, LOCK_UN);
+    close(fd);
+}
+
+bool cache_restore(const char *key, int mask, const char *base) {
+    const char *dir = cache_dir();
+    if (!dir) return false;
+    char *entry = join(dir, "/", key);
+    bool hit = true;
+    for (int i = 0; i < 3 && hit; i++) {
+        if (!(mask & artifacts[i])) continue;
+        char *cached = join(entry, extensions[i], "");
+        if (access(cached, R_OK) != 0) hit = false;
+        free(cached);
+    }
+    for (int i = 0; i < 3 && hit; i++) {
+        if (!(mask & artifacts[i])) continue;
+        char *cached = join(entry, extensions[i], "");
+        char *output = join(base, extensions[i], "");
+        hit = copy_file(cached, output);
+        // refresh the time eviction goes by
+        utime(cached, NULL);
+        free(cached);
+        free(output);
+    }
+    free(entry);
+    count(dir, hit);
+    return hit;
+}
+
+static int by_age(const void *a, const void *b) {
+    const cache_file *x = a, *y = b;
+    return (x->used > y->used) - (x->used < y->used);
+}
+
+// every artifact in dir, with the total size in *total
+static cache_file *list_files(const char *dir, int *nfiles, long *total) {
+    *nfiles = 0;
+    *total = 0;
+    DIR *d = opendir(dir);
+    if (!d) return NULL;
+    int cap = 64;
+    cache_file *files = malloc(cap * sizeof(cache_file));
+    struct dirent *e;
+    while (files && (e = readdir(d)) != NULL) {
+        if (e->d_name[0] == '.' || strcmp(e->d_name, STATS_FILE) == 0 || strstr(e->d_name, ".tmp")) continue;
+        char *path = join(dir, "/", e->d_name);
+        struct stat st;
+        if (stat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+            if (*nfiles == cap) {
+                cap *= 2;
+                files = realloc(files, cap * sizeof(cache_file));
+                if (!files) break;
+            }
+            files[*nfiles].name = path;
+            files[*nfiles].size = st.st_size;
+            files[*nfiles].used = st.st_mtime;
+            (*nfiles)++;
+            *total += st.st_size;
+        } else {
+            free(path);
+        }
+    }
+    closedir(d);
+    return files;
+}
+
+static void free_files(cache_file *files, int nfiles) {
+    for (int i = 0; i < nfiles; i++) {
+        free(files[i].name);
+    }
+    free(files);
+}
+
+// drop least recently used artifacts until the cache is back under 90% of its limit
+static void evict(const char *dir) {
+    long limit = cache_limit();
+    int nfiles;
+    long total;
+    cache_file *files = list_files(dir, &nfiles, &total);
+    if (files && total > limit) {
+        qsort(files, nfiles, sizeof(cache_file), by_age);
+        for (int i = 0; i < nfiles && total > limit / 10 * 9; i++) {
+            if (unlink(files[i].name) == 0) total -= files[i].size;
+        }
+    }
+    free_files(files, nfiles);
+}
+
+void cache_store(const char *key, int mask, const char *base) {
+    const char *dir = cache_dir();
+    if (!dir) return;
+    char *entry = join(dir, "/", key);
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%d.tmp", (int)getpid());
+    for (int i = 0; i < 3; i++) {
+        if (!(mask & artifacts[i])) continue;
+        char *output = join(base, extensions[i], "");
+        char *cached = join(entry, extensions[i], "");
+        char *temp = join(cached, suffix, "");
+        // concurrent compiles of the same source see either no artifact or a whole one
+        if (!copy_file(output, temp) || rename(temp, cached) != 0) {
+            unlink(temp);
+        }
+        free(output);
+        free(cached);
+        free(temp);
+    }
+    free(entry);
+    evict(dir);
+}
+
+char *cache_load(const char *key, const char *ext, size_t *length) {
+    const char *dir = cache_dir();
+    if (!dir) return NULL;
+    char *entry = join(dir, "/", key);
+    char *path = join(entry, ext, "");
+    free(entry);
+    FILE *fp = fopen(path, "rb");
+    struct stat st;
+    char *data = NULL;
+    if (fp && fstat(fileno(fp), &st) == 0 && (data = malloc(st.st_size + 1)) != NULL) {
+        if (fread(data, 1, st.st_size, fp) == (size_t)st.st_size) {
+            data[st.st_size] = '\0';
+            *length = st.st_size;
+            utime(path, NULL);
+        } else {
+            free(data);
+            data = NULL;
+        }
+    }
+    if (fp) fclose(fp);
+    free(path);
+    return data;
+}
+
+void cache_save(const char *key, const char *ext, const char *data, size_t length) {
+    const char *dir = cache_dir();
+    if (!dir) return;
+    char *entry = join(dir, "/", key);
+    char *path = join(entry, ext, "");
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%d.tmp", (int)getpid());
+    char *temp = join(path, suffix, "");
+    FILE *fp = fopen(temp, "wb");
+    if (fp) {
+        bool ok = fwrite(data, 1, length, fp) == length;
+        if (fclose(fp) != 0 || !ok || rename(temp, path) != 0) unlink(temp);
+    }
+    free(entry);
+    free(path);
+    free(temp);
+}
+
+static int by_name(const void *a, const void *b) {
+    return strcmp(((const cache_file *)a)->name, ((const cache_file *)b)->name);
+}
+
+void cache_stats(void) {
+    const char *dir = cache_dir();
+    if (!dir) {
+        fprintf(stderr, "Error: no cache directory\n");
+        exit(4);
+    }
+    int nfiles;
+    long total;
+    cache_file *files = list_files(dir, &nfiles, &total);
+
+    // artifacts of one entry share the key before the extension
+    int entries = 0;
+    if (files) {
+        qsort(files, nfiles, sizeof(cache_file), by_name);
+        for (int i = 0; i < nfiles; i++) {
+            const char *dot = strrchr(files[i].name, '.');
+            size_t key_len = dot - files[i].name;
+            if (i == 0 || strncmp(files[i].name, files[i - 1].name, key_len + 1) != 0) entries++;
+        }
+    }
+    free_files(files, nfiles);
+
+    long hits = 0, misses = 0;
+    char *path = join(dir, "/", STATS_FILE);
+    FILE *fp = fopen(path, "r");
+    free(path);
+    if (fp) {
+        if (fscanf(fp, "%ld %ld", &hits, &misses) != 2) hits = misses = 0;
+        fclose(fp);
+    }
+
+    printf("Cache directory: %s\n", dir);
+    printf("Entries:         %d (%d files)\n", entries, nfiles);
+    printf("Size:            %ld bytes (limit %ld)\n", total, cache_limit());
+    printf("Hits:            %ld\n", hits);
+    printf("Misses:          %ld\n", misses);
+    printf("Hit rate:        %.1f%%\n", hits + misses ? 100.0 * hits / (hits + misses) : 0.0);
+}
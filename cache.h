@@ -0,0 +1,44 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * On-disk cache of whole-file compile results. An entry is keyed by a hash
+ * of the source bytes, the k0 binary doing the compile and the action
+ * flags, and holds one file per artifact (.ic, .S, .o) in the cache
+ * directory: $K0_CACHE_DIR, or ~/.cache/k0. The least recently used
+ * artifacts are evicted once the directory grows past $K0_CACHE_SIZE
+ * bytes (default 256 MiB).
+ *
+ * The same directory holds smaller blobs under their own keys, such as the
+ * IC of single functions, which are evicted along with everything else.
+ */
+
+#define CACHE_KEY_SIZE 33
+
+/* Artifacts an entry can hold */
+#define CACHE_IC  1
+#define CACHE_ASM 2
+#define CACHE_OBJ 4
+
+/* Key for compiling source with the given action flags, written to key */
+void cache_key(const char *source, size_t length, const char *flags, char key[CACHE_KEY_SIZE]);
+
+/* Copy the artifacts in mask to base.ic/.S/.o if all are cached; counts a hit or miss */
+bool cache_restore(const char *key, int mask, const char *base);
+
+/* Store base.ic/.S/.o for the artifacts in mask, then evict down to the size limit */
+void cache_store(const char *key, int mask, const char *base);
+
+/* Contents of the blob key+ext, or NULL if it is not cached; the caller frees it */
+char *cache_load(const char *key, const char *ext, size_t *length);
+
+/* Store length bytes of data as the blob key+ext; eviction is left to cache_store() */
+void cache_save(const char *key, const char *ext, const char *data, size_t length);
+
+/* Print entry count, size and hit rate of the cache to stdout */
+void cache_stats(void);
+
+#endif
@@ -0,0 +1,267 @@
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdbool.h>
+#include "chunk.h"
+#include "k0ctx.h"
+#include "tree.h"
+#include "lower.h"
+#include "k0gram.h"
+#include "pool.h"
+#include "timing.h"
+#include "diag.h"
+#include "scanner.h"
+
+// a new chunk starts at the first function past this many bytes, so the cut,
+// and with it the work each thread gets, does not depend on the thread count
+#define CHUNK_BYTES 16384
+
+struct chunk {
+    const char *text;
+    size_t length;
+    int line;               // line of the chunk's first byte
+    struct tree *root;      // lowered; NULL unless the chunk parsed without errors
+    struct text_block *token_text;
+    int serial;             // node ids its parse used
+    long tokens;
+    int tail;               // first id made after the chunk's last token
+    int *ids;               // node id in the whole file, by id in the chunk
+};
+
+struct chunks {
+    struct chunk *chunks;
+    int count;
+    int max;
+    bool timed;
+};
+
+static void add_chunk(struct chunks *c, const char *text, size_t length, int line) {
+    if (c->count == c->max) {
+        c->max = c->max ? c->max * 2 : 8;
+        struct chunk *chunks = realloc(c->chunks, c->max * sizeof(struct chunk));
+        if (!chunks) {
+            perror("Memory allocation failed");
+            k0_fail(4);
+        }
+        c->chunks = chunks;
+    }
+    c->chunks[c->count++] = (struct chunk){text, length, line};
+}
+
+static bool starts_word(const char *p, const char *end, const char *word) {
+    size_t n = strlen(word);
+    return (size_t)(end - p) >= n && !strncmp(p, word, n)
+        && (p + n == end || !(isalnum((unsigned char)p[n]) || p[n] == '_'));
+}
+
+// step over n bytes, or up to end, counting the lines they end
+static const char *skip(const char *p, const char *end, size_t n, int *line) {
+    for (; n > 0 && p < end; n--, p++) {
+        if (*p == '\n') (*line)++;
+    }
+    return p;
+}
+
+// step past close; an unterminated comment or string runs to the end of the file
+static const char *skip_to(const char *p, const char *end, const char *close, bool escapes, int *line) {
+    size_t n = strlen(close);
+    while (p < end && !((size_t)(end - p) >= n && !strncmp(p, close, n))) {
+        p = skip(p, end, escapes && *p == '\\' ? 2 : 1, line);
+    }
+    return skip(p, end, n, line);
+}
+
+// cut source before the lines whose first token, outside any braces or
+// parentheses, is fun or tailrec; the first chunk keeps the imports and globals
+static void split_source(struct chunks *c, const char *source, size_t length) {
+    const char *p = source, *end = source + length;
+    const char *chunk_start = source, *line_begin = source;
+    int line = 1, chunk_line = 1, depth = 0;
+    bool line_start = true, seen_function = false;
+    while (p < end) {
+        char ch = *p;
+        if (ch == '\n') {
+            line++;
+            p++;
+            line_begin = p;
+            line_start = true;
+            continue;
+        }
+        if (ch == ' ' || ch == '\t' || ch == '\r') {
+            p++;
+            continue;
+        }
+        if (line_start && depth == 0 && (starts_word(p, end, "fun") || starts_word(p, end, "tailrec"))) {
+            if (seen_function && line_begin - chunk_start >= CHUNK_BYTES) {
+                add_chunk(c, chunk_start, line_begin - chunk_start, chunk_line);
+                chunk_start = line_begin;
+                chunk_line = line;
+            }
+            seen_function = true;
+        }
+        line_start = false;
+        if (ch == '/' && p + 1 < end && p[1] == '/') {
+            while (p < end && *p != '\n') p++;
+        } else if (ch == '/' && p + 1 < end && p[1] == '*') {
+            p = skip_to(p + 2, end, "*/", false, &line);
+        } else if (end - p >= 3 && !strncmp(p, "\"\"\"", 3)) {
+            p = skip_to(p + 3, end, "\"\"\"", false, &line);
+        } else if (ch == '"') {
+            p = skip_to(p + 1, end, "\"", true, &line);
+        } else if (ch == '\'') {
+            p = skip(p, end, p + 1 < end && p[1] == '\\' ? 4 : 3, &line);
+        } else {
+            if (ch == '{' || ch == '(') depth++;
+            if (ch == '}' || ch == ')') depth--;
+            p++;
+        }
+    }
+    add_chunk(c, chunk_start, end - chunk_start, chunk_line);
+}
+
+// the FunctionList of a chunk's TopLevelObjectList, NULL if it has no functions
+static struct tree *function_list(struct tree *root) {
+    struct tree *section = root->kids[2];
+    return section->nkids > 0 ? section->kids[0] : NULL;
+}
+
+// lex, parse and lower one chunk on a pool thread
+static void parse_chunk_task(int i, void *arg) {
+    struct chunks *c = arg;
+    struct chunk *chunk = &c->chunks[i];
+    k0_context *ctx = k0_get();
+    if (c->timed) timing_enable(ctx);
+    long tokens = count_value(ctx, COUNT_TOKENS);
+    ctx->serial = 0;
+    ctx->root = NULL;
+    ctx->recovering = true;
+    if (setjmp(ctx->recover) == 0) {
+        ctx->scanner = scanner_create(ctx);
+        scanner_source(ctx->scanner, chunk->text, chunk->length, false, chunk->line);
+        // any error sends the whole file back to one parse, which reports it
+        track_parse_nodes(ctx);
+        int result = yyparse(ctx->scanner, ctx);
+        untrack_parse_nodes(ctx);
+        if (result == 0 && ctx->errors == 0 && function_list(ctx->root)) {
+            // the Block of the last function is the first node made once the chunk is read
+            struct tree *list = function_list(ctx->root);
+            struct tree *last = list->kids[list->nkids - 1];
+            chunk->tail = last->kids[last->nkids - 1]->id;
+            chunk->root = lower_tree(ctx->root);
+            ctx->root = NULL;
+        }
+    }
+    ctx->recovering = false;
+    scanner_destroy(ctx->scanner);
+    ctx->scanner = NULL;
+    free_parse_nodes(ctx);
+    free_tree(ctx->root);
+    ctx->root = NULL;
+    diag_free(diag_take());
+    chunk->token_text = take_token_text();
+    chunk->serial = ctx->serial;
+    chunk->tokens = count_value(ctx, COUNT_TOKENS) - tokens;
+}
+
+static bool renumber_node(struct tree *node, int depth, void *arg) {
+    node->id = ((int *)arg)[node->id];
+    return true;
+}
+
+// give ids [from, to) of a chunk the next ids of the file, but for the ones marked dropped
+static void number_ids(struct chunk *chunk, int from, int to, int *next) {
+    for (int id = from; id < to; id++) {
+        if (chunk->ids[id] == -1) chunk->ids[id] = (*next)++;
+    }
+}
+
+// number the nodes as one parse of the file would have: a chunk numbers them in
+// the order it makes them, as that parse does, but at a cut that parse reads the
+// next chunk's first token before it reduces the Block (which takes the newlines
+// after its closing brace) and FunctionDeclaration of the function before it.
+// The sections around the later chunks' functions are dropped, and the first
+// chunk's FunctionSection and TopLevelObjectList are made last
+static int renumber(struct chunks *c) {
+    for (int i = 0; i < c->count; i++) {
+        struct chunk *chunk = &c->chunks[i];
+        chunk->ids = malloc((chunk->serial + 1) * sizeof(int));
+        if (!chunk->ids) {
+            perror("Memory allocation failed");
+            k0_fail(4);
+        }
+        for (int id = 0; id < chunk->serial; id++) chunk->ids[id] = -1;
+        struct tree *root = chunk->root;
+        chunk->ids[root->id] = chunk->ids[root->kids[2]->id] = -2;
+        if (i > 0) {
+            chunk->ids[root->kids[0]->id] = chunk->ids[root->kids[1]->id] = -2;
+            chunk->ids[function_list(root)->id] = -2;
+        }
+    }
+
+    int next = 0;
+    for (int i = 0; i < c->count; i++) {
+        struct chunk *chunk = &c->chunks[i];
+        if (i > 0) {
+            struct chunk *prev = &c->chunks[i - 1];
+            number_ids(chunk, 0, 1, &next);
+            number_ids(prev, prev->tail, prev->serial, &next);
+        }
+        number_ids(chunk, i > 0, chunk->tail, &next);
+    }
+    struct chunk *last = &c->chunks[c->count - 1];
+    number_ids(last, last->tail, last->serial, &next);
+    struct tree *root = c->chunks[0].root;
+    c->chunks[0].ids[root->kids[2]->id] = next++;
+    c->chunks[0].ids[root->id] = next++;
+    return next;
+}
+
+// give the nodes of one chunk their ids in the file, on a pool thread
+static void renumber_task(int i, void *arg) {
+    struct chunk *chunk = &((struct chunks *)arg)->chunks[i];
+    struct tree_visitor visitor = {renumber_node, NULL, chunk->ids};
+    walk_tree(chunk->root, &visitor, 1);
+}
+
+struct tree *parse_chunks(k0_context *ctx, const char *source, size_t length) {
+    struct chunks c = {NULL, 0, 0, ctx->timing != NULL};
+    split_source(&c, source, length);
+    struct tree *root = NULL;
+    if (c.count > 1) {
+        pool_run(ctx->threads, c.count, parse_chunk_task, &c);
+        bool parsed = true;
+        for (int i = 0; i < c.count; i++) {
+            parsed = parsed && c.chunks[i].root;
+        }
+        if (parsed) {
+            ctx->serial = renumber(&c);
+            pool_run(ctx->threads, c.count, renumber_task, &c);
+            root = c.chunks[0].root;
+            struct tree *list = function_list(root);
+            long tokens = 0;
+            for (int i = 0; i < c.count; i++) {
+                tokens += c.chunks[i].tokens;
+                keep_token_text(c.chunks[i].token_text);
+                c.chunks[i].token_text = NULL;
+                if (i == 0) continue;
+                struct tree *more = function_list(c.chunks[i].root);
+                for (int j = 0; j < more->nkids; j++) {
+                    addkids(list, 1, more->kids[j]);
+                }
+                more->nkids = 0;
+                free_tree(c.chunks[i].root);
+                c.chunks[i].root = NULL;
+            }
+            c.chunks[0].root = NULL;
+            count_event(COUNT_TOKENS, tokens);
+            count_event(COUNT_TREE_NODES, ctx->serial);
+        }
+    }
+    for (int i = 0; i < c.count; i++) {
+        free_tree(c.chunks[i].root);
+        free_token_text(c.chunks[i].token_text);
+        free(c.chunks[i].ids);
+    }
+    free(c.chunks);
+    return root;
+}
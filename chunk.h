@@ -0,0 +1,24 @@
+#ifndef CHUNK_H
+#define CHUNK_H
+
+#include <stddef.h>
+
+struct k0_context;
+struct tree;
+
+/*
+ * Parsing one file on several threads. The source is cut into chunks at
+ * the lines that start a top-level function, skipping strings and comments
+ * as the lexer does, and every chunk is lexed and parsed on a pool thread
+ * with a scanner of its own that starts at the chunk's line. The functions
+ * of the later chunks are then moved into the first chunk's FunctionList,
+ * and the node ids renumbered in the order a parse of the whole file would
+ * have made them, so the tree is the one yyparse() builds.
+ *
+ * Returns that tree, not lowered yet, or NULL when the file is too small to
+ * cut or a chunk had an error; the caller then parses the whole file, so
+ * the errors reported are the ones of a parse on one thread.
+ */
+struct tree *parse_chunks(struct k0_context *ctx, const char *source, size_t length);
+
+#endif
@@ -0,0 +1,147 @@
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include "diag.h"
+#include "k0ctx.h"
+
+static const char *kind_names[] = {"", "Lexical", "Syntax", "Semantic"};
+static const char *json_kinds[] = {"", "lexical", "syntax", "semantic"};
+
+// write s as a JSON string
+static void json_string(FILE *fp, const char *s) {
+    fputc('"', fp);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') fprintf(fp, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20) fprintf(fp, "\\u%04x", *s);
+        else fputc(*s, fp);
+    }
+    fputc('"', fp);
+}
+
+static void print_json(FILE *fp, const char *kind, const char *file, int line, const char *message) {
+    fprintf(fp, "{\"kind\": \"%s\", \"file\": ", kind);
+    json_string(fp, file);
+    fprintf(fp, ", \"line\": %d, \"message\": ", line);
+    json_string(fp, message);
+    fprintf(fp, "}\n");
+}
+
+// an error kept back on a pool thread
+struct diagnostic {
+    int kind;
+    int line;
+    char *file;
+    char *message;
+    long output;                // length of the context's output when it was kept
+    struct diagnostic *next;
+};
+
+// print one error and count it; reaching the limit ends the compile here
+static void report(k0_context *ctx, int kind, const char *file, int line, char *message, size_t size) {
+    if (ctx->errors++ == 0) ctx->first_error = kind;
+    if (ctx->diag_json) {
+        print_json(k0_diag(), json_kinds[kind], file, line, message);
+    } else {
+        fprintf(k0_diag(), "%s Error: %s\n", kind_names[kind], message);
+    }
+
+    if (ctx->error_limit > 0 && ctx->errors >= ctx->error_limit) {
+        // a limit of one is the plain stop at the first error
+        if (ctx->error_limit > 1) {
+            snprintf(message, size, "Stopping after %d errors (-ferror-limit=%d).", ctx->errors, ctx->error_limit);
+            if (ctx->diag_json) print_json(k0_diag(), "limit", file, 0, message);
+            else fprintf(k0_diag(), "%s\n", message);
+        }
+        k0_fail(ctx->first_error);
+    }
+    if (ctx->resume) {
+        longjmp(*ctx->resume, 1);
+    }
+}
+
+void diag_error(int kind, const char *file, int line, const char *format, ...) {
+    k0_context *ctx = k0_get();
+    char message[1024];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    if (!file) file = ctx->current_file ? ctx->current_file : "";
+
+    if (ctx->defer_diagnostics) {
+        struct diagnostic *d = malloc(sizeof(struct diagnostic));
+        if (!d) {
+            perror("Memory allocation failed");
+            k0_fail(4);
+        }
+        long output = ctx->out ? ftell(ctx->out) : 0;
+        *d = (struct diagnostic){kind, line, strdup(file), strdup(message), output, ctx->deferred};
+        ctx->deferred = d;
+        ctx->errors++;
+        if (ctx->resume) {
+            longjmp(*ctx->resume, 1);
+        }
+        return;
+    }
+    report(ctx, kind, file, line, message, sizeof(message));
+}
+
+struct diagnostic *diag_take(void) {
+    k0_context *ctx = k0_get();
+    // kept newest first
+    struct diagnostic *list = NULL;
+    while (ctx->deferred) {
+        struct diagnostic *d = ctx->deferred;
+        ctx->deferred = d->next;
+        d->next = list;
+        list = d;
+    }
+    ctx->errors = 0;
+    return list;
+}
+
+void diag_replay(struct diagnostic *list, const char *output, size_t length) {
+    k0_context *ctx = k0_get();
+    size_t written = 0;
+    while (list) {
+        struct diagnostic d = *list;
+        free(list);
+        list = d.next;
+        // what was printed before the error, which is all of it if the limit stops here
+        size_t upto = d.output >= 0 && (size_t)d.output < length ? (size_t)d.output : length;
+        if (upto > written) {
+            fwrite(output + written, 1, upto - written, k0_out());
+            written = upto;
+        }
+        // the limit ends the compile on this one, so nothing after it is reported
+        if (ctx->error_limit > 0 && ctx->errors + 1 >= ctx->error_limit) {
+            diag_free(list);
+            list = NULL;
+        }
+        char message[1024];
+        snprintf(message, sizeof(message), "%s", d.message);
+        free(d.message);
+        report(ctx, d.kind, d.file, d.line, message, sizeof(message));
+        free(d.file);
+    }
+    if (length > written) {
+        fwrite(output + written, 1, length - written, k0_out());
+    }
+}
+
+void diag_free(struct diagnostic *list) {
+    while (list) {
+        struct diagnostic *d = list;
+        list = d->next;
+        free(d->file);
+        free(d->message);
+        free(d);
+    }
+}
+
+void diag_check(void) {
+    k0_context *ctx = k0_get();
+    if (ctx->errors > 0) {
+        k0_fail(ctx->first_error);
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef DIAG_H
+#define DIAG_H
+
+#include <stddef.h>
+
+/*
+ * Error reporting for every front-end phase. Each error is counted on the
+ * current context and printed as text, or as one JSON object per line with
+ * -fdiagnostics-format=json. With the default -ferror-limit=1 the compile
+ * stops at the first error, as it always has. A larger limit (0 for none)
+ * lets it go on: the lexer skips the bad token, the parser resynchronizes
+ * on its error productions, and semantic checks resume at the next node.
+ * The compile then stops at the end of the phase with the exit code of the
+ * first error.
+ */
+
+/* Kinds of error, numbered as the exit codes they stop the compile with */
+#define DIAG_LEXICAL  1
+#define DIAG_SYNTAX   2
+#define DIAG_SEMANTIC 3
+
+/*
+ * Report an error at line of file; line 0 for none, and a NULL file for the
+ * file being compiled. Under the error limit this longjmps to the resume
+ * point of the context when one is set and otherwise returns.
+ */
+void diag_error(int kind, const char *file, int line, const char *format, ...)
+    __attribute__((format(printf, 4, 5)));
+
+/* Stop with the exit code of the first error if any were reported */
+void diag_check(void);
+
+/*
+ * On a context with defer_diagnostics set, as the pool threads have, errors
+ * are counted and kept instead of printed. diag_take() detaches the ones
+ * kept so far, oldest first; diag_replay() reports such a list on the
+ * current context as if its errors had happened there, and frees it. The
+ * length bytes at output, what the thread printed to k0_out() meanwhile, go
+ * to k0_out() in between the errors as they came, so an error that stops
+ * the compile cuts them off where it would have on one thread.
+ */
+struct diagnostic;
+struct diagnostic *diag_take(void);
+void diag_replay(struct diagnostic *list, const char *output, size_t length);
+void diag_free(struct diagnostic *list);
+
+#endif
@@ -0,0 +1,316 @@
+#include <stdlib.h>
+#include <string.h>
+#include <elf.h>
+#include "elfobj.h"
+#include "k0ctx.h"
+
+/* section header indices in the written file */
+enum {
+    SH_NULL, SH_TEXT, SH_DATA, SH_RODATA, SH_RELA_TEXT,
+    SH_SYMTAB, SH_STRTAB, SH_SHSTRTAB, SH_NOTE_STACK, SH_COUNT
+};
+
+static void *elf_alloc(size_t size) {
+    void *p = calloc(1, size);
+    if (!p) {
+        fprintf(k0_diag(), "Memory allocation failed for object file\n");
+        k0_fail(4);
+    }
+    return p;
+}
+
+void elf_init(elf_object *obj) {
+    memset(obj, 0, sizeof(*obj));
+}
+
+void elf_append(elf_buffer *buf, const void *bytes, size_t size) {
+    if (buf->size + size > buf->cap) {
+        size_t cap = buf->cap ? buf->cap : 256;
+        while (cap < buf->size + size) cap *= 2;
+        buf->bytes = realloc(buf->bytes, cap);
+        if (!buf->bytes) {
+            fprintf(k0_diag(), "Memory allocation failed for object file\n");
+            k0_fail(4);
+        }
+        buf->cap = cap;
+    }
+    if (bytes) memcpy(buf->bytes + buf->size, bytes, size);
+    else memset(buf->bytes + buf->size, 0, size);
+    buf->size += size;
+}
+
+void elf_align(elf_buffer *buf, size_t alignment) {
+    size_t pad = (alignment - buf->size % alignment) % alignment;
+    elf_append(buf, NULL, pad);
+}
+
+elf_buffer *elf_section(elf_object *obj, int section) {
+    switch (section) {
+        case ELF_TEXT: return &obj->text;
+        case ELF_DATA: return &obj->data;
+        case ELF_RODATA: return &obj->rodata;
+    }
+    return NULL;
+}
+
+void elf_define_symbol(elf_object *obj, const char *name, int section, size_t value, bool global) {
+    elf_symbol *sym = elf_alloc(sizeof(elf_symbol));
+    sym->name = strdup(name);
+    sym->section = section;
+    sym->value = value;
+    sym->global = global;
+    if (obj->symbols_tail) obj->symbols_tail->next = sym;
+    else obj->symbols = sym;
+    obj->symbols_tail = sym;
+    obj->nsymbols++;
+    free(obj->index);
+    obj->index = NULL;
+}
+
+static unsigned long hash_name(const char *s) {
+    unsigned long h = 5381;
+    while (*s) h = h * 33 + (unsigned char)*s++;
+    return h;
+}
+
+elf_symbol *elf_find_symbol(elf_object *obj, const char *name) {
+    if (!obj->index) {
+        obj->index_cap = 64;
+        while (obj->index_cap < 2 * obj->nsymbols) obj->index_cap *= 2;
+        obj->index = elf_alloc(obj->index_cap * sizeof(elf_symbol *));
+        for (elf_symbol *sym = obj->symbols; sym != NULL; sym = sym->next) {
+            size_t i = hash_name(sym->name) & (obj->index_cap - 1);
+            while (obj->index[i]) i = (i + 1) & (obj->index_cap - 1);
+            obj->index[i] = sym;
+        }
+    }
+    size_t i = hash_name(name) & (obj->index_cap - 1);
+    while (obj->index[i]) {
+        if (strcmp(obj->index[i]->name, name) == 0) return obj->index[i];
+        i = (i + 1) & (obj->index_cap - 1);
+    }
+    return NULL;
+}
+
+void elf_add_reloc(elf_object *obj, size_t offset, const char *symbol, int type, long addend) {
+    elf_reloc *rel = elf_alloc(sizeof(elf_reloc));
+    rel->offset = offset;
+    rel->symbol = strdup(symbol);
+    rel->type = type;
+    rel->addend = addend;
+    if (obj->relocs_tail) obj->relocs_tail->next = rel;
+    else obj->relocs = rel;
+    obj->relocs_tail = rel;
+}
+
+static size_t add_string(elf_buffer *strtab, const char *s) {
+    size_t offset = strtab->size;
+    elf_append(strtab, s, strlen(s) + 1);
+    return offset;
+}
+
+/* symbol name -> symbol table index, so relocation lookup stays linear */
+typedef struct symbol_slot {
+    const char *name;
+    elf_symbol *sym;
+    int index;
+} symbol_slot;
+
+static symbol_slot *slot_for(symbol_slot *table, size_t cap, const char *name) {
+    size_t i = hash_name(name) & (cap - 1);
+    while (table[i].name && strcmp(table[i].name, name) != 0) i = (i + 1) & (cap - 1);
+    return &table[i];
+}
+
+// assembler-local names (.L*) are not emitted; relocations use the section symbol instead
+static bool is_local_label(const char *name) {
+    return name[0] == '.' && name[1] == 'L';
+}
+
+void elf_write_stream(elf_object *obj, FILE *out) {
+    size_t nsyms = 0, nrelocs = 0, first_global = 0;
+    for (elf_symbol *s = obj->symbols; s; s = s->next) nsyms++;
+    for (elf_reloc *r = obj->relocs; r; r = r->next) nrelocs++;
+
+    size_t cap = 64;
+    while (cap < 2 * (nsyms + nrelocs + 1)) cap *= 2;
+    symbol_slot *table = elf_alloc(cap * sizeof(symbol_slot));
+    for (elf_symbol *s = obj->symbols; s; s = s->next) {
+        symbol_slot *slot = slot_for(table, cap, s->name);
+        if (slot->name) {
+            fprintf(k0_diag(), "Error: symbol '%s' is already defined\n", s->name);
+            k0_fail(4);
+        }
+        slot->name = s->name;
+        slot->sym = s;
+        slot->index = -1;
+    }
+    // anything referenced but not defined here is resolved by the linker
+    for (elf_reloc *r = obj->relocs; r; r = r->next) {
+        symbol_slot *slot = slot_for(table, cap, r->symbol);
+        if (!slot->name) {
+            slot->name = r->symbol;
+            slot->sym = NULL;
+            slot->index = -1;
+        }
+    }
+
+    elf_buffer strtab = { 0 }, symtab = { 0 }, rela = { 0 }, shstrtab = { 0 };
+    add_string(&strtab, "");
+    Elf64_Sym sym;
+    memset(&sym, 0, sizeof(sym));
+    elf_append(&symtab, &sym, sizeof(sym));
+    int index = 1;
+
+    // section symbols, then locals, then globals as the ELF spec requires
+    int section_sym[SH_COUNT] = { 0 };
+    int sections[] = { SH_TEXT, SH_DATA, SH_RODATA };
+    for (int i = 0; i < 3; i++) {
+        memset(&sym, 0, sizeof(sym));
+        sym.st_info = ELF64_ST_INFO(STB_LOCAL, STT_SECTION);
+        sym.st_shndx = sections[i];
+        elf_append(&symtab, &sym, sizeof(sym));
+        section_sym[sections[i]] = index++;
+    }
+    for (int pass = 0; pass < 2; pass++) {
+        bool want_global = pass == 1;
+        if (want_global) first_global = index;
+        for (elf_symbol *s = obj->symbols; s; s = s->next) {
+            if (s->global != want_global || is_local_label(s->name)) continue;
+            memset(&sym, 0, sizeof(sym));
+            sym.st_name = add_string(&strtab, s->name);
+            sym.st_info = ELF64_ST_INFO(s->global ? STB_GLOBAL : STB_LOCAL, STT_NOTYPE);
+            sym.st_shndx = s->section;
+            sym.st_value = s->value;
+            elf_append(&symtab, &sym, sizeof(sym));
+            slot_for(table, cap, s->name)->index = index++;
+        }
+        if (!want_global) continue;
+        for (size_t i = 0; i < cap; i++) {
+            if (!table[i].name || table[i].sym) continue;
+            memset(&sym, 0, sizeof(sym));
+            sym.st_name = add_string(&strtab, table[i].name);
+            sym.st_info = ELF64_ST_INFO(STB_GLOBAL, STT_NOTYPE);
+            sym.st_shndx = SHN_UNDEF;
+            elf_append(&symtab, &sym, sizeof(sym));
+            table[i].index = index++;
+        }
+    }
+
+    for (elf_reloc *r = obj->relocs; r; r = r->next) {
+        symbol_slot *slot = slot_for(table, cap, r->symbol);
+        Elf64_Rela rel;
+        rel.r_offset = r->offset;
+        rel.r_addend = r->addend;
+        // like gas, point relocations against local symbols at their section
+        if (slot->sym && !slot->sym->global) {
+            rel.r_info = ELF64_R_INFO(section_sym[slot->sym->section], r->type);
+            rel.r_addend += slot->sym->value;
+        } else {
+            rel.r_info = ELF64_R_INFO(slot->index, r->type);
+        }
+        elf_append(&rela, &rel, sizeof(rel));
+    }
+    free(table);
+
+    const char *names[SH_COUNT] = {
+        "", ".text", ".data", ".rodata", ".rela.text",
+        ".symtab", ".strtab", ".shstrtab", ".note.GNU-stack"
+    };
+    size_t name_offset[SH_COUNT];
+    for (int i = 0; i < SH_COUNT; i++) name_offset[i] = add_string(&shstrtab, names[i]);
+
+    elf_buffer *contents[SH_COUNT] = {
+        NULL, &obj->text, &obj->data, &obj->rodata, &rela,
+        &symtab, &strtab, &shstrtab, NULL
+    };
+    Elf64_Shdr shdr[SH_COUNT];
+    memset(shdr, 0, sizeof(shdr));
+    size_t offset = sizeof(Elf64_Ehdr);
+    for (int i = 1; i < SH_COUNT; i++) {
+        size_t align = (i == SH_TEXT) ? 16 : (i == SH_STRTAB || i == SH_SHSTRTAB || i == SH_NOTE_STACK) ? 1 : 8;
+        offset = (offset + align - 1) / align * align;
+        shdr[i].sh_name = name_offset[i];
+        shdr[i].sh_type = SHT_PROGBITS;
+        shdr[i].sh_offset = offset;
+        shdr[i].sh_size = contents[i] ? contents[i]->size : 0;
+        shdr[i].sh_addralign = align;
+        offset += shdr[i].sh_size;
+    }
+    shdr[SH_TEXT].sh_flags = SHF_ALLOC | SHF_EXECINSTR;
+    shdr[SH_DATA].sh_flags = SHF_ALLOC | SHF_WRITE;
+    shdr[SH_RODATA].sh_flags = SHF_ALLOC;
+    shdr[SH_RELA_TEXT].sh_type = SHT_RELA;
+    shdr[SH_RELA_TEXT].sh_flags = SHF_INFO_LINK;
+    shdr[SH_RELA_TEXT].sh_link = SH_SYMTAB;
+    shdr[SH_RELA_TEXT].sh_info = SH_TEXT;
+    shdr[SH_RELA_TEXT].sh_entsize = sizeof(Elf64_Rela);
+    shdr[SH_SYMTAB].sh_type = SHT_SYMTAB;
+    shdr[SH_SYMTAB].sh_link = SH_STRTAB;
+    shdr[SH_SYMTAB].sh_info = first_global;
+    shdr[SH_SYMTAB].sh_entsize = sizeof(Elf64_Sym);
+    shdr[SH_STRTAB].sh_type = SHT_STRTAB;
+    shdr[SH_SHSTRTAB].sh_type = SHT_STRTAB;
+    size_t shoff = (offset + 7) / 8 * 8;
+
+    Elf64_Ehdr ehdr;
+    memset(&ehdr, 0, sizeof(ehdr));
+    memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+    ehdr.e_ident[EI_CLASS] = ELFCLASS64;
+    ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+    ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+    ehdr.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+    ehdr.e_type = ET_REL;
+    ehdr.e_machine = EM_X86_64;
+    ehdr.e_version = EV_CURRENT;
+    ehdr.e_shoff = shoff;
+    ehdr.e_ehsize = sizeof(Elf64_Ehdr);
+    ehdr.e_shentsize = sizeof(Elf64_Shdr);
+    ehdr.e_shnum = SH_COUNT;
+    ehdr.e_shstrndx = SH_SHSTRTAB;
+
+    fwrite(&ehdr, sizeof(ehdr), 1, out);
+    for (int i = 1; i < SH_COUNT; i++) {
+        while ((size_t)ftell(out) < shdr[i].sh_offset) fputc(0, out);
+        if (contents[i] && contents[i]->size) fwrite(contents[i]->bytes, 1, contents[i]->size, out);
+    }
+    while ((size_t)ftell(out) < shoff) fputc(0, out);
+    fwrite(shdr, sizeof(Elf64_Shdr), SH_COUNT, out);
+
+    free(strtab.bytes);
+    free(symtab.bytes);
+    free(rela.bytes);
+    free(shstrtab.bytes);
+}
+
+void elf_write(elf_object *obj, const char *file_name) {
+    FILE *out = fopen(file_name, "wb");
+    if (!out) {
+        perror("Error opening object file");
+        k0_fail(4);
+    }
+    elf_write_stream(obj, out);
+    fclose(out);
+}
+
+void elf_free(elf_object *obj) {
+    free(obj->text.bytes);
+    free(obj->data.bytes);
+    free(obj->rodata.bytes);
+    elf_symbol *s = obj->symbols;
+    while (s) {
+        elf_symbol *next = s->next;
+        free(s->name);
+        free(s);
+        s = next;
+    }
+    elf_reloc *r = obj->relocs;
+    while (r) {
+        elf_reloc *next = r->next;
+        free(r->symbol);
+        free(r);
+        r = next;
+    }
+    free(obj->index);
+    elf_init(obj);
+}
@@ -0,0 +1,61 @@
+#ifndef ELFOBJ_H
+#define ELFOBJ_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Sections a k0 object file can define symbols in */
+#define ELF_UNDEF  0
+#define ELF_TEXT   1
+#define ELF_DATA   2
+#define ELF_RODATA 3
+
+typedef struct elf_buffer {
+    unsigned char *bytes;
+    size_t size;
+    size_t cap;
+} elf_buffer;
+
+typedef struct elf_symbol {
+    char *name;
+    int section;
+    size_t value;
+    bool global;
+    struct elf_symbol *next;
+} elf_symbol;
+
+/* relocations are always against .text */
+typedef struct elf_reloc {
+    size_t offset;
+    char *symbol;
+    int type;
+    long addend;
+    struct elf_reloc *next;
+} elf_reloc;
+
+typedef struct elf_object {
+    elf_buffer text;
+    elf_buffer data;
+    elf_buffer rodata;
+    elf_symbol *symbols;
+    elf_symbol *symbols_tail;
+    elf_reloc *relocs;
+    elf_reloc *relocs_tail;
+    elf_symbol **index;   /* name hash for elf_find_symbol, rebuilt on demand */
+    size_t index_cap;
+    size_t nsymbols;
+} elf_object;
+
+void elf_init(elf_object *obj);
+void elf_append(elf_buffer *buf, const void *bytes, size_t size);
+void elf_align(elf_buffer *buf, size_t alignment);
+elf_buffer *elf_section(elf_object *obj, int section);
+void elf_define_symbol(elf_object *obj, const char *name, int section, size_t value, bool global);
+elf_symbol *elf_find_symbol(elf_object *obj, const char *name);
+void elf_add_reloc(elf_object *obj, size_t offset, const char *symbol, int type, long addend);
+void elf_write_stream(elf_object *obj, FILE *out);
+void elf_write(elf_object *obj, const char *file_name);
+void elf_free(elf_object *obj);
+
+#endif
@@ -0,0 +1,794 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "fastlex.h"
+#include "k0ctx.h"
+#include "tree.h"
+#include "k0gram.h"
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
+extern void lexical_error(const char *format, const char *token, int line);
+
+// what a match is when it is not a token
+#define BLANKS  -1
+#define COMMENT -2
+#define SHEBANG -3
+
+struct fast_lexer {
+    k0_context *ctx;
+    char *start;        // first byte of the source, for the rules anchored with ^
+    char *end;          // the NUL past the source
+    char *cursor;       // next byte to scan
+    char *text;         // of the last token
+    char *held;         // where the NUL ending text was written, NULL if nowhere
+    char hold;          // the byte it replaced
+    char *copy;         // of a source that was not in place
+    int line;
+};
+
+struct match {
+    size_t length;
+    int category;       // token, BLANKS, COMMENT, or a category the error of a rejected match is kept under
+};
+
+// the longest match wins; of two as long, the one of the rule earlier in k0lex.l,
+// so every case of scan() considers its rules in that order
+static inline void consider(struct match *m, size_t length, int category) {
+    if (length > m->length) {
+        m->length = length;
+        m->category = category;
+    }
+}
+
+// the lexical error k0lex.l reports for a match, NULL when it is a token
+static const char *rejection(int category) {
+    switch (category) {
+        case SHEBANG: return "k0 does not support shebang lines. Found '%s' at line %d";
+        case BAD_RW: return "k0 does not support the following reserved word: found '%s' at line %d";
+        case BAD_MODIFIERS: return "k0 does not support the following modifier: found '%s' at line %d";
+        case BAD_OPS: return "k0 does not support the following operator: found '%s' at line %d";
+        case BAD_PUNC: return "k0 does not support the following punctuation: found '%s' at line %d";
+        case BinLiteral: return "k0 does not support binary literals. Found '%s' at line %d";
+        case OctalLiteral: return "k0 does not support octal literals. Found '%s' at line %d";
+        case UnsignedLiteral: return "k0 does not support unsigned literals. Found '%s' at line %d";
+        case RealScientificLiteral: return "k0 does not support the scientific/exponent. Found '%s' at line %d";
+        case InvalidCharacterLiteral: return "k0 does not support character literals with more than one character. Found '%s' at line %d";
+        case BAD_TOKEN: return "k0 does not recognize the following token: found '%s' at line %d";
+        default: return NULL;
+    }
+}
+
+// the rules whose matches can hold a newline; flex counts the lines of these alone
+static bool spans_lines(int category) {
+    switch (category) {
+        case NL: case COMMENT: case StringLiteral: case MultilineStringLiteral: case CharacterLiteral:
+        case InvalidCharacterLiteral: case ArrayLiteral: case BinLiteral:
+            return true;
+        default:
+            return false;
+    }
+}
+
+struct reserved {
+    const char *word;
+    int category;
+};
+
+// the words k0lex.l gives a rule of their own, in the slot reserved_slot() hashes them
+// to; no two share one, so looking a word up compares a single string
+static const struct reserved reserved[256] = {
+    [4] = {"typeof", BAD_RW},
+    [8] = {"data", BAD_MODIFIERS},
+    [11] = {"vararg", BAD_MODIFIERS},
+    [13] = {"if", IF},
+    [15] = {"catch", BAD_RW},
+    [16] = {"is", BAD_RW},
+    [18] = {"null", NullLiteral},
+    [21] = {"finally", BAD_RW},
+    [23] = {"reified", BAD_MODIFIERS},
+    [24] = {"crossinline", BAD_MODIFIERS},
+    [25] = {"internal", BAD_MODIFIERS},
+    [34] = {"else", ELSE},
+    [36] = {"super", BAD_RW},
+    [40] = {"typealias", BAD_RW},
+    [41] = {"String", TYPE},
+    [42] = {"inner", BAD_MODIFIERS},
+    [44] = {"sealed", BAD_MODIFIERS},
+    [46] = {"set", BAD_RW},
+    [51] = {"by", BAD_RW},
+    [52] = {"operator", BAD_MODIFIERS},
+    [58] = {"lateinit", BAD_MODIFIERS},
+    [59] = {"throw", BAD_RW},
+    [60] = {"enum", BAD_MODIFIERS},
+    [62] = {"Char", TYPE},
+    [63] = {"inline", BAD_MODIFIERS},
+    [65] = {"try", BAD_RW},
+    [70] = {"file", BAD_RW},
+    [72] = {"expect", BAD_MODIFIERS},
+    [77] = {"dynamic", BAD_RW},
+    [78] = {"property", BAD_RW},
+    [85] = {"Float", TYPE},
+    [91] = {"return", RETURN},
+    [95] = {"final", BAD_MODIFIERS},
+    [97] = {"setparam", BAD_RW},
+    [99] = {"for", FOR},
+    [100] = {"actual", BAD_MODIFIERS},
+    [101] = {"class", BAD_RW},
+    [105] = {"companion", BAD_MODIFIERS},
+    [107] = {"Boolean", TYPE},
+    [109] = {"Long", TYPE},
+    [119] = {"annotation", BAD_MODIFIERS},
+    [120] = {"get", BAD_RW},
+    [122] = {"open", BAD_MODIFIERS},
+    [124] = {"import", IMPORT},
+    [132] = {"do", DO},
+    [137] = {"while", WHILE},
+    [143] = {"public", BAD_MODIFIERS},
+    [147] = {"continue", CONTINUE},
+    [150] = {"package", BAD_RW},
+    [152] = {"delegate", BAD_RW},
+    [160] = {"private", BAD_MODIFIERS},
+    [162] = {"tailrec", TAILREC},
+    [163] = {"receiver", BAD_RW},
+    [164] = {"out", BAD_MODIFIERS},
+    [173] = {"in", IN},
+    [174] = {"Short", TYPE},
+    [175] = {"as", BAD_RW},
+    [186] = {"fun", FUN},
+    [187] = {"Array", ARRAY_TYPE},
+    [191] = {"external", BAD_MODIFIERS},
+    [192] = {"val", VAL},
+    [206] = {"noinline", BAD_MODIFIERS},
+    [208] = {"this", BAD_RW},
+    [209] = {"protected", BAD_MODIFIERS},
+    [210] = {"object", BAD_RW},
+    [215] = {"when", WHEN},
+    [216] = {"Int", TYPE},
+    [224] = {"param", BAD_RW},
+    [227] = {"var", VAR},
+    [228] = {"Double", TYPE},
+    [230] = {"false", BooleanLiteral},
+    [233] = {"true", BooleanLiteral},
+    [235] = {"const", CONST},
+    [236] = {"infix", BAD_MODIFIERS},
+    [238] = {"suspend", BAD_MODIFIERS},
+    [239] = {"init", BAD_RW},
+    [241] = {"Byte", TYPE},
+    [242] = {"break", BREAK},
+    [244] = {"abstract", BAD_MODIFIERS},
+    [246] = {"constructor", BAD_RW},
+    [247] = {"where", BAD_RW},
+    [251] = {"field", BAD_RW},
+    [252] = {"value", BAD_RW},
+};
+
+#define RESERVED_MIN 2
+#define RESERVED_MAX 11
+
+// the first two, last two and length of a word, seven bits each, multiplied by a
+// constant searched for to spread the words above over the slots without collisions
+static inline unsigned reserved_slot(const unsigned char *p, size_t n) {
+    uint32_t key = p[0] | p[1] << 7 | p[n - 2] << 14 | (uint32_t)p[n - 1] << 21 | (uint32_t)n << 28;
+    return (key * 0xa4719ed9u) >> 24;
+}
+
+static const struct reserved *find_reserved(const char *p, size_t n) {
+    if (n < RESERVED_MIN || n > RESERVED_MAX) return NULL;
+    const struct reserved *r = &reserved[reserved_slot((const unsigned char *)p, n)];
+    return r->word && !strncmp(r->word, p, n) && r->word[n] == '\0' ? r : NULL;
+}
+
+static inline bool is_blank(int c) { return c == ' ' || c == '\t' || c == '\r'; }
+static inline bool is_digit(int c) { return c >= '0' && c <= '9'; }
+static inline bool is_hex(int c) { return is_digit(c) || ((c | 0x20) >= 'a' && (c | 0x20) <= 'f'); }
+static inline bool is_octal(int c) { return c >= '0' && c <= '7'; }
+static inline bool is_binary(int c) { return c == '0' || c == '1'; }
+static inline bool is_word_start(int c) { return ((c | 0x20) >= 'a' && (c | 0x20) <= 'z') || c == '_'; }
+static inline bool is_word(int c) { return is_word_start(c) || is_digit(c); }
+
+// byte i of p, or -1 past end
+static inline int peek(const char *p, const char *end, size_t i) {
+    return (size_t)(end - p) > i ? (unsigned char)p[i] : -1;
+}
+
+// length of s if p starts with it
+static inline size_t fixed(const char *p, const char *end, const char *s) {
+    size_t n = strlen(s);
+    return (size_t)(end - p) >= n && !memcmp(p, s, n) ? n : 0;
+}
+
+// bitmasks of the bytes in a block of 16 (or 32) at p that are blanks, can
+// continue an identifier, or are a or b; a clear bit ends a span, a set one a search
+
+#ifdef __SSE2__
+static inline __m128i in_range16(__m128i v, char lo, char hi) {
+    __m128i offset = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+    return _mm_cmpeq_epi8(_mm_min_epu8(offset, _mm_set1_epi8(hi - lo)), offset);
+}
+
+static inline unsigned blank_mask16(const char *p) {
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    __m128i blank = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                    _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\t')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))));
+    return _mm_movemask_epi8(blank);
+}
+
+static inline unsigned word_mask16(const char *p) {
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    __m128i word = _mm_or_si128(in_range16(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z'),
+                   _mm_or_si128(in_range16(v, '0', '9'), _mm_cmpeq_epi8(v, _mm_set1_epi8('_'))));
+    return _mm_movemask_epi8(word);
+}
+
+static inline unsigned either_mask16(const char *p, char a, char b) {
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    return _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(a)), _mm_cmpeq_epi8(v, _mm_set1_epi8(b))));
+}
+#endif
+
+#ifdef __AVX2__
+static inline __m256i in_range32(__m256i v, char lo, char hi) {
+    __m256i offset = _mm256_sub_epi8(v, _mm256_set1_epi8(lo));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(offset, _mm256_set1_epi8(hi - lo)), offset);
+}
+
+static inline uint32_t blank_mask32(const char *p) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)p);
+    __m256i blank = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                    _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r'))));
+    return _mm256_movemask_epi8(blank);
+}
+
+static inline uint32_t word_mask32(const char *p) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)p);
+    __m256i word = _mm256_or_si256(in_range32(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 'z'),
+                   _mm256_or_si256(in_range32(v, '0', '9'), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'))));
+    return _mm256_movemask_epi8(word);
+}
+
+static inline uint32_t either_mask32(const char *p, char a, char b) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)p);
+    return _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(a)), _mm256_cmpeq_epi8(v, _mm256_set1_epi8(b))));
+}
+#endif
+
+// blocks are only loaded whole before end, so nothing past the source is read
+
+static size_t span_blanks(const char *p, const char *end) {
+    const char *q = p;
+#ifdef __AVX2__
+    for (; end - q >= 32; q += 32) {
+        uint32_t stop = ~blank_mask32(q);
+        if (stop) return q - p + __builtin_ctz(stop);
+    }
+#endif
+#ifdef __SSE2__
+    for (; end - q >= 16; q += 16) {
+        unsigned stop = ~blank_mask16(q) & 0xffff;
+        if (stop) return q - p + __builtin_ctz(stop);
+    }
+#endif
+    while (q < end && is_blank((unsigned char)*q)) q++;
+    return q - p;
+}
+
+static size_t span_word(const char *p, const char *end) {
+    const char *q = p;
+#ifdef __AVX2__
+    for (; end - q >= 32; q += 32) {
+        uint32_t stop = ~word_mask32(q);
+        if (stop) return q - p + __builtin_ctz(stop);
+    }
+#endif
+#ifdef __SSE2__
+    for (; end - q >= 16; q += 16) {
+        unsigned stop = ~word_mask16(q) & 0xffff;
+        if (stop) return q - p + __builtin_ctz(stop);
+    }
+#endif
+    while (q < end && is_word((unsigned char)*q)) q++;
+    return q - p;
+}
+
+// first a or b at or after p, end if there is none
+static const char *find_either(const char *p, const char *end, char a, char b) {
+#ifdef __AVX2__
+    for (; end - p >= 32; p += 32) {
+        uint32_t found = either_mask32(p, a, b);
+        if (found) return p + __builtin_ctz(found);
+    }
+#endif
+#ifdef __SSE2__
+    for (; end - p >= 16; p += 16) {
+        unsigned found = either_mask16(p, a, b);
+        if (found) return p + __builtin_ctz(found);
+    }
+#endif
+    while (p < end && *p != a && *p != b) p++;
+    return p;
+}
+
+static int count_lines(const char *p, const char *end) {
+    int lines = 0;
+    while ((p = memchr(p, '\n', end - p))) {
+        lines++;
+        p++;
+    }
+    return lines;
+}
+
+// the literals below return the length of their longest match at p, 0 for none
+
+// i past the (_?digit)* at p + i
+static size_t grouped(const char *p, const char *end, size_t i, bool (*digit)(int)) {
+    for (;;) {
+        if (digit(peek(p, end, i))) {
+            i++;
+        } else if (peek(p, end, i) == '_' && digit(peek(p, end, i + 1))) {
+            i += 2;
+        } else {
+            return i;
+        }
+    }
+}
+
+static size_t digits(const char *p, const char *end, size_t i) {
+    while (is_digit(peek(p, end, i))) i++;
+    return i;
+}
+
+// (0|[1-9](_?[0-9])*)[lL]? | 0x[0-9A-Fa-f](_?[0-9A-Fa-f])*[lL]?
+static size_t integer_literal(const char *p, const char *end) {
+    size_t i;
+    if (peek(p, end, 0) == '0') {
+        i = peek(p, end, 1) == 'x' && is_hex(peek(p, end, 2)) ? grouped(p, end, 3, is_hex) : 1;
+    } else if (is_digit(peek(p, end, 0))) {
+        i = grouped(p, end, 1, is_digit);
+    } else {
+        return 0;
+    }
+    return peek(p, end, i) == 'l' || peek(p, end, i) == 'L' ? i + 1 : i;
+}
+
+// [0-9]+(\.[0-9]+)?S? | \.[0-9]+S?, S one of the bytes of suffix
+static size_t real_literal(const char *p, const char *end, const char *suffix) {
+    size_t i = digits(p, end, 0);
+    if (peek(p, end, i) == '.' && is_digit(peek(p, end, i + 1))) {
+        i = digits(p, end, i + 1);
+    } else if (i == 0) {
+        return 0;
+    }
+    int c = peek(p, end, i);
+    return c > 0 && strchr(suffix, c) ? i + 1 : i;
+}
+
+// -?0[bB][01](_?[01])* | -?0[bB][^01_]*
+static size_t binary_literal(const char *p, const char *end) {
+    size_t i = peek(p, end, 0) == '-';
+    if (peek(p, end, i) != '0' || (peek(p, end, i + 1) != 'b' && peek(p, end, i + 1) != 'B')) return 0;
+    i += 2;
+    if (is_binary(peek(p, end, i))) return grouped(p, end, i + 1, is_binary);
+    while (peek(p, end, i) >= 0 && !is_binary(p[i]) && p[i] != '_') i++;
+    return i;
+}
+
+// -?0[oO][0-7](_?[0-7])* | -?0[0-9]+
+static size_t octal_literal(const char *p, const char *end) {
+    size_t i = peek(p, end, 0) == '-';
+    if (peek(p, end, i) != '0') return 0;
+    i++;
+    if ((peek(p, end, i) == 'o' || peek(p, end, i) == 'O') && is_octal(peek(p, end, i + 1))) {
+        return grouped(p, end, i + 2, is_octal);
+    }
+    size_t n = digits(p, end, i);
+    return n > i ? n : 0;
+}
+
+// [uU][lL]? after the digits ending at i
+static size_t unsigned_suffix(const char *p, const char *end, size_t i) {
+    if (peek(p, end, i) != 'u' && peek(p, end, i) != 'U') return 0;
+    return peek(p, end, i + 1) == 'l' || peek(p, end, i + 1) == 'L' ? i + 2 : i + 1;
+}
+
+// 0 | [1-9](_?[0-9])*U | 0x[0-9A-Fa-f](_?[0-9A-Fa-f])*U | 0b[01](_?[01])*U | 0o[0-7](_?[0-7])*U, U [uU][lL]?;
+// its lone 0, which binds as tightly as the IntegerLiteral before it, is left to that
+static size_t unsigned_literal(const char *p, const char *end) {
+    int c = peek(p, end, 0);
+    if (c != '0') return is_digit(c) ? unsigned_suffix(p, end, grouped(p, end, 1, is_digit)) : 0;
+    int radix = peek(p, end, 1);
+    bool (*digit)(int) = radix == 'x' ? is_hex : radix == 'b' ? is_binary : radix == 'o' ? is_octal : NULL;
+    return digit && digit(peek(p, end, 2)) ? unsigned_suffix(p, end, grouped(p, end, 3, digit)) : 0;
+}
+
+// -?[0-9]+(\.[0-9]+)?E | -?\.[0-9]+E, E [eE][+-]?[0-9]+[dDfF]?
+static size_t scientific_literal(const char *p, const char *end) {
+    size_t i = peek(p, end, 0) == '-';
+    size_t mantissa = real_literal(p + i, end, "");
+    if (!mantissa) return 0;
+    i += mantissa;
+    if (peek(p, end, i) != 'e' && peek(p, end, i) != 'E') return 0;
+    i++;
+    if (peek(p, end, i) == '+' || peek(p, end, i) == '-') i++;
+    if (!is_digit(peek(p, end, i))) return 0;
+    i = digits(p, end, i);
+    int c = peek(p, end, i);
+    return c > 0 && strchr("dDfF", c) ? i + 1 : i;
+}
+
+// '([^\\]|\\.)'
+static size_t character_literal(const char *p, const char *end) {
+    if (peek(p, end, 1) == '\\') {
+        return peek(p, end, 2) >= 0 && peek(p, end, 2) != '\n' && peek(p, end, 3) == '\'' ? 4 : 0;
+    }
+    return peek(p, end, 1) >= 0 && peek(p, end, 2) == '\'' ? 3 : 0;
+}
+
+// '([^\\']{2,}|[^\\]..)'
+static size_t invalid_character_literal(const char *p, const char *end) {
+    size_t length = 0, i = 1;
+    while (peek(p, end, i) >= 0 && p[i] != '\\' && p[i] != '\'') i++;
+    if (i >= 3 && peek(p, end, i) == '\'') length = i + 1;
+    int c = peek(p, end, 1), d = peek(p, end, 2), e = peek(p, end, 3);
+    if (length < 5 && c >= 0 && c != '\\' && d >= 0 && d != '\n' && e >= 0 && e != '\n' && peek(p, end, 4) == '\'') {
+        length = 5;
+    }
+    return length;
+}
+
+// the " closing a string body at p: any byte but " and \, or \ and a byte but a newline
+static const char *closing_quote(const char *p, const char *end) {
+    for (;;) {
+        p = find_either(p, end, '"', '\\');
+        if (p == end) return NULL;
+        if (*p == '"') return p;
+        if (end - p < 2 || p[1] == '\n') return NULL;
+        p += 2;
+    }
+}
+
+static size_t string_literal(const char *p, const char *end) {
+    const char *close = closing_quote(p + 1, end);
+    return close ? close + 1 - p : 0;
+}
+
+// a body as a string's, which therefore ends at its first unescaped "
+static size_t multiline_string_literal(const char *p, const char *end) {
+    if (end - p < 6 || p[1] != '"' || p[2] != '"') return 0;
+    const char *close = closing_quote(p + 3, end);
+    return close && end - close >= 3 && close[1] == '"' && close[2] == '"' ? close + 3 - p : 0;
+}
+
+// "/*"([^\*]|\*+[^*/])*\*+"/" ends at the first */ past the opening
+static size_t delimited_comment(const char *p, const char *end) {
+    for (const char *q = p + 2; (q = find_either(q, end, '*', '*')) < end; q++) {
+        if (end - q >= 2 && q[1] == '/') return q + 2 - p;
+    }
+    return 0;
+}
+
+static size_t line_comment(const char *p, const char *end) {
+    return find_either(p, end, '\n', '\n') - p;
+}
+
+// the TYPE at p, of n bytes, if it is one
+static bool type_name(const char *p, size_t n) {
+    const struct reserved *r = find_reserved(p, n);
+    return r && r->category == TYPE;
+}
+
+// "Array<"{TYPE}">", the n bytes of Array already matched
+static size_t array_type(const char *p, const char *end, size_t n) {
+    if (peek(p, end, n) != '<') return 0;
+    size_t type = span_word(p + n + 1, end);
+    return type_name(p + n + 1, type) && peek(p, end, n + 1 + type) == '>' ? n + type + 2 : 0;
+}
+
+// "("{TYPE}")"
+static size_t type_cast(const char *p, const char *end) {
+    size_t type = span_word(p + 1, end);
+    return type_name(p + 1, type) && peek(p, end, type + 1) == ')' ? type + 2 : 0;
+}
+
+// the run at p up to a blank or stop, if it all is one of the literals
+static const char *literal_run(const char *p, const char *end, char stop, bool real) {
+    const char *q = p;
+    while (q < end && !is_blank((unsigned char)*q) && *q != stop) q++;
+    size_t n = q - p;
+    bool whole = n > 0 && (integer_literal(p, q) == n ||
+        (real && (real_literal(p, q, "dD") == n || real_literal(p, q, "fF") == n)));
+    return whole ? q : NULL;
+}
+
+// {ARRAY_TYPE}{WS}"("{WS}{IntegerLiteral}{WS}")"{WS}"{"{WS}(Integer|Double|Float|String)Literal{WS}"}",
+// the Array<TYPE> of its first type bytes already matched. The literals cannot hold the blank
+// or bracket after them, but for a string, so they end at the first one
+static size_t array_literal(const char *p, const char *end, size_t type) {
+    const char *q = p + type;
+    q += span_blanks(q, end);
+    if (q == end || *q != '(') return 0;
+    q++;
+    q += span_blanks(q, end);
+    if (!(q = literal_run(q, end, ')', false))) return 0;
+    q += span_blanks(q, end);
+    if (q == end || *q != ')') return 0;
+    q++;
+    q += span_blanks(q, end);
+    if (q == end || *q != '{') return 0;
+    q++;
+    q += span_blanks(q, end);
+    if (q < end && *q == '"') {
+        size_t n = string_literal(q, end);
+        if (!n) return 0;
+        q += n;
+    } else if (!(q = literal_run(q, end, '}', true))) {
+        return 0;
+    }
+    q += span_blanks(q, end);
+    return q < end && *q == '}' ? q + 1 - p : 0;
+}
+
+// a word: a reserved one, a type, an identifier, or the start of an array type
+static void scan_word(struct match *m, const char *p, const char *end) {
+    size_t n = span_word(p, end);
+    const struct reserved *r = find_reserved(p, n);
+    if (r && r->category == ARRAY_TYPE) {
+        size_t type = array_type(p, end, n);
+        consider(m, type, ARRAY_TYPE);
+        consider(m, n, Identifier);
+        consider(m, type ? array_literal(p, end, type) : 0, ArrayLiteral);
+        return;
+    }
+    if (r) {
+        consider(m, n, r->category);
+        bool question = peek(p, end, n) == '?';
+        consider(m, question && !strcmp(r->word, "as") ? n + 1 : 0, BAD_RW);
+        consider(m, question && r->category == TYPE ? n + 1 : 0, NULLABLE);
+    }
+    consider(m, n, Identifier);
+}
+
+static void scan_number(struct match *m, const char *p, const char *end) {
+    // a run of digits that nothing can continue is an IntegerLiteral, as it mostly is
+    size_t n = digits(p, end, 0);
+    int next = peek(p, end, n);
+    if (!is_word(next) && next != '.' && (*p != '0' || n == 1)) {
+        consider(m, n, IntegerLiteral);
+        return;
+    }
+    consider(m, integer_literal(p, end), IntegerLiteral);
+    consider(m, real_literal(p, end, "dD"), DoubleLiteral);
+    consider(m, real_literal(p, end, "fF"), FloatLiteral);
+    consider(m, binary_literal(p, end), BinLiteral);
+    consider(m, octal_literal(p, end), OctalLiteral);
+    consider(m, unsigned_literal(p, end), UnsignedLiteral);
+    consider(m, scientific_literal(p, end), RealScientificLiteral);
+}
+
+// the match of k0lex.l at p, by its first byte
+static struct match scan(struct fast_lexer *lexer, const char *p) {
+    const char *end = lexer->end;
+    bool line_start = p == lexer->start || p[-1] == '\n';
+    struct match m = {0, BAD_TOKEN};
+    switch (*p) {
+        case ' ': case '\t': case '\r':
+            consider(&m, span_blanks(p, end), BLANKS);
+            break;
+        case '\n':
+            consider(&m, 1, NL);
+            break;
+        case '/':
+            consider(&m, peek(p, end, 1) == '/' ? line_comment(p, end) : 0, COMMENT);
+            consider(&m, peek(p, end, 1) == '*' ? delimited_comment(p, end) : 0, COMMENT);
+            consider(&m, 1, DIV);
+            consider(&m, fixed(p, end, "/="), BAD_OPS);
+            break;
+        case '#':
+            consider(&m, line_start && peek(p, end, 1) == '!' ? line_comment(p, end) : 0, SHEBANG);
+            consider(&m, 1, BAD_PUNC);
+            break;
+        case '!':
+            consider(&m, fixed(p, end, "!in"), BAD_RW);
+            consider(&m, fixed(p, end, "!is"), BAD_RW);
+            consider(&m, fixed(p, end, "!="), NOT_EQ);
+            consider(&m, fixed(p, end, "!=="), NOT_EQEQ);
+            consider(&m, 1, NOT);
+            consider(&m, fixed(p, end, "!!"), NOT_NULL_ASSERTION);
+            break;
+        case '=':
+            consider(&m, 1, ASSIGNMENT);
+            consider(&m, fixed(p, end, "=="), EQEQ);
+            consider(&m, fixed(p, end, "==="), EQEQEQ);
+            break;
+        case '+':
+            consider(&m, fixed(p, end, "+="), ADD_ASSIGNMENT);
+            consider(&m, 1, ADD);
+            consider(&m, fixed(p, end, "++"), INCR);
+            break;
+        case '-':
+            consider(&m, fixed(p, end, "-="), SUB_ASSIGNMENT);
+            consider(&m, 1, SUB);
+            consider(&m, fixed(p, end, "--"), DECR);
+            consider(&m, binary_literal(p, end), BinLiteral);
+            consider(&m, octal_literal(p, end), OctalLiteral);
+            consider(&m, scientific_literal(p, end), RealScientificLiteral);
+            break;
+        case '*':
+            consider(&m, 1, MULT);
+            consider(&m, fixed(p, end, "*="), BAD_OPS);
+            break;
+        case '%':
+            consider(&m, 1, MOD);
+            consider(&m, fixed(p, end, "%="), BAD_OPS);
+            break;
+        case '<':
+            consider(&m, 1, LANGLE);
+            consider(&m, fixed(p, end, "<="), LE);
+            consider(&m, fixed(p, end, "<<"), BAD_OPS);
+            consider(&m, fixed(p, end, "<<="), BAD_OPS);
+            break;
+        case '>':
+            consider(&m, 1, RANGLE);
+            consider(&m, fixed(p, end, ">="), GE);
+            consider(&m, fixed(p, end, ">>"), BAD_OPS);
+            consider(&m, fixed(p, end, ">>="), BAD_OPS);
+            break;
+        case '&':
+            consider(&m, fixed(p, end, "&&"), CONJ);
+            consider(&m, fixed(p, end, "&="), BAD_OPS);
+            consider(&m, 1, BAD_OPS);
+            break;
+        case '|':
+            consider(&m, fixed(p, end, "||"), DISJ);
+            consider(&m, fixed(p, end, "|="), BAD_OPS);
+            consider(&m, 1, BAD_OPS);
+            break;
+        case '^':
+            consider(&m, fixed(p, end, "^="), BAD_OPS);
+            consider(&m, 1, BAD_OPS);
+            break;
+        case '~':
+            consider(&m, 1, BAD_OPS);
+            break;
+        case '[':
+            consider(&m, fixed(p, end, "[ ]."), SUBSCRIPT_DOT);
+            consider(&m, 1, LSQUARE);
+            break;
+        case '?':
+            consider(&m, fixed(p, end, "?."), SAFE_CALL);
+            consider(&m, fixed(p, end, "?:"), ELVIS);
+            break;
+        case '.':
+            consider(&m, fixed(p, end, ".."), RANGE);
+            consider(&m, fixed(p, end, "..<"), RANGE_UNTIL);
+            consider(&m, 1, DOT);
+            consider(&m, real_literal(p, end, "dD"), DoubleLiteral);
+            consider(&m, real_literal(p, end, "fF"), FloatLiteral);
+            consider(&m, scientific_literal(p, end), RealScientificLiteral);
+            break;
+        case '(':
+            consider(&m, type_cast(p, end), TYPE_CAST);
+            consider(&m, 1, LPAREN);
+            break;
+        case ')': consider(&m, 1, RPAREN); break;
+        case ',': consider(&m, 1, COMMA); break;
+        case ']': consider(&m, 1, RSQUARE); break;
+        case '{': consider(&m, 1, LCURL); break;
+        case '}': consider(&m, 1, RCURL); break;
+        case ':':
+            consider(&m, 1, COLON);
+            consider(&m, fixed(p, end, "::"), BAD_PUNC);
+            break;
+        case ';':
+            consider(&m, 1, SEMICOLON);
+            consider(&m, fixed(p, end, ";;"), BAD_PUNC);
+            break;
+        case '@': case '\\': case '`':
+            consider(&m, 1, BAD_PUNC);
+            break;
+        case '$':
+            // ^$.{Identifier}: a $, any byte but a newline, and an identifier
+            consider(&m, 1, BAD_PUNC);
+            consider(&m, line_start && peek(p, end, 1) >= 0 && p[1] != '\n' && is_word_start(peek(p, end, 2))
+                ? 2 + span_word(p + 2, end) : 0, FieldIdentifier);
+            break;
+        case '\'':
+            consider(&m, character_literal(p, end), CharacterLiteral);
+            consider(&m, invalid_character_literal(p, end), InvalidCharacterLiteral);
+            break;
+        case '"':
+            consider(&m, string_literal(p, end), StringLiteral);
+            consider(&m, multiline_string_literal(p, end), MultilineStringLiteral);
+            break;
+        default:
+            if (is_word_start((unsigned char)*p)) {
+                scan_word(&m, p, end);
+            } else if (is_digit(*p)) {
+                scan_number(&m, p, end);
+            }
+            break;
+    }
+    // UNKNOWN: any other byte
+    consider(&m, 1, BAD_TOKEN);
+    return m;
+}
+
+struct fast_lexer *fast_lexer_create(k0_context *ctx) {
+    struct fast_lexer *lexer = calloc(1, sizeof(struct fast_lexer));
+    if (!lexer) {
+        perror("Memory allocation failed");
+        k0_fail(4);
+    }
+    lexer->ctx = ctx;
+    lexer->line = 1;
+    return lexer;
+}
+
+void fast_lexer_destroy(struct fast_lexer *lexer) {
+    if (!lexer) return;
+    free(lexer->copy);
+    free(lexer);
+}
+
+void fast_lexer_source(struct fast_lexer *lexer, const char *source, size_t length, bool in_place, int line) {
+    free(lexer->copy);
+    lexer->copy = NULL;
+    char *text = (char *)source;
+    if (!in_place) {
+        text = lexer->copy = malloc(length + 2);
+        if (!text) {
+            perror("Memory allocation failed");
+            k0_fail(4);
+        }
+        memcpy(text, source, length);
+        text[length] = text[length + 1] = '\0';
+    }
+    lexer->start = lexer->cursor = lexer->text = text;
+    lexer->end = text + length;
+    lexer->held = NULL;
+    lexer->line = line;
+}
+
+int fast_lex(YYSTYPE *lval, struct fast_lexer *lexer) {
+    for (;;) {
+        if (lexer->held) {
+            *lexer->held = lexer->hold;
+            lexer->held = NULL;
+        }
+        char *p = lexer->cursor;
+        if (p == lexer->end) {
+            // <<EOF>>: the text is empty, as the NUL at end leaves it
+            lexer->text = p;
+            lexer->ctx->last_token = 0;
+            return 0;
+        }
+        struct match m = scan(lexer, p);
+        char *next = p + m.length;
+        lexer->cursor = next;
+        if (m.category == BLANKS) continue;
+        // flex counts the lines of a match before its action runs
+        if (spans_lines(m.category)) lexer->line += count_lines(p, next);
+        if (m.category == COMMENT) continue;
+        lexer->text = p;
+        lexer->held = next;
+        lexer->hold = *next;
+        *next = '\0';
+        const char *error = rejection(m.category);
+        if (error) {
+            // under the error limit the bad match is skipped
+            lexical_error(error, p, lexer->line);
+            continue;
+        }
+        return alctoken(lexer->ctx, &lval->treeptr, m.category, p, lexer->line);
+    }
+}
+
+char *fast_lexer_text(struct fast_lexer *lexer) {
+    return lexer->text;
+}
+
+int fast_lexer_line(struct fast_lexer *lexer) {
+    return lexer->line;
+}
@@ -0,0 +1,39 @@
+#ifndef FASTLEX_H
+#define FASTLEX_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+struct k0_context;
+union YYSTYPE;
+
+/*
+ * A hand-written scanner for k0, chosen with -lexer-engine=fast. It follows
+ * the rules of k0lex.l as flex applies them: the longest match wins, and of
+ * two rules that match as much the earlier one. It returns the tokens, texts
+ * and line numbers the flex scanner does and reports the same lexical
+ * errors, but dispatches on the first byte of a token instead of running a
+ * DFA, looks words up in a perfect hash of the reserved words, and scans
+ * blanks, identifiers, comments and string bodies 16 bytes at a time with
+ * SSE2 (32 with AVX2 when built for it).
+ *
+ * Like flex, it ends each token's text with a NUL written into the buffer,
+ * putting the byte back on the next call; a source that is not in place is
+ * copied first.
+ */
+struct fast_lexer;
+
+struct fast_lexer *fast_lexer_create(struct k0_context *ctx);
+void fast_lexer_destroy(struct fast_lexer *lexer);
+
+/* Scan the length bytes at source, as k0_parse() describes in_place, from line */
+void fast_lexer_source(struct fast_lexer *lexer, const char *source, size_t length, bool in_place, int line);
+
+/* Next token, as yylex() returns it; 0 at the end of the source */
+int fast_lex(union YYSTYPE *lval, struct fast_lexer *lexer);
+
+/* Text of the last token and the line the scanner is on, as yyget_text() and yyget_lineno() */
+char *fast_lexer_text(struct fast_lexer *lexer);
+int fast_lexer_line(struct fast_lexer *lexer);
+
+#endif
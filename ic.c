@@ -1,86 +1,79 @@
 #include "ic.h"
+#include "interp.h"
+#include "k0ctx.h"
+#include "cache.h"
+#include "timing.h"
+#include "memstat.h"
+#include "pool.h"
 
 extern SymbolTableEntry find_symbol(SymbolTable tab, const char *symbolText);
 extern SymbolTable find_symbol_table(ListSymbolTables, char *);
 extern char* typeint_to_name(int);
-StringTable string_table = {.count = 0, .current_offset = 0};
-
-char *CURRENT_SCOPE_NAME;
-char type_hint[64];
-int CURRENT_BRANCH_NUM;
-int STRING_NUM = 0;
-
-// rewrite output file with .string section
-void write_string_section(char *filename) {
-    FILE *file = fopen(filename, "r+");
-    if (!file) {
-        perror("Failed to open file");
-        return;
-    }
-
-    // read the whole file into memory
-    fseek(file, 0, SEEK_END);
-    long filesize = ftell(file);
-    rewind(file);
-
-    char *buffer = (char *)malloc(filesize + 1);
-    if (!buffer) {
-        perror("Failed to allocate memory");
-        fclose(file);
-        return;
-    }
-
-    fread(buffer, 1, filesize, file);
-    buffer[filesize] = '\0'; // null terminate
-
-    // find the end of the .string section
-    char *string_section_end = strstr(buffer, ".data");
-    if (!string_section_end) {
-        printf(".data section not found.\n");
-        free(buffer);
-        fclose(file);
-        return;
+struct generated_functions;
+static void free_generated_functions(struct ic_state *state);
+
+struct ic_state {
+    StringTable strings;
+    char *current_scope_name;
+    char type_hint[64];
+    int current_branch_num;
+    char *current_entry_label; // re-entry point for tail self-calls of the current function
+    int string_num;
+    int literal_count;              // string table entries that came from collect_strings()
+    char literal_digest[CACHE_KEY_SIZE];
+    bool reuse_functions;           // splice unchanged functions in from the build cache
+    bool strings_collected;         // string literals already collected by create_symtabs()
+    struct generated_functions *generated;  // functions made on the pool, for gen_function_decl() to splice
+};
+
+// code generation state lives on the current context
+static struct ic_state *ic(void)
+{
+    k0_context *ctx = k0_get();
+    if (!ctx->ic)
+    {
+        ctx->ic = calloc(1, sizeof(struct ic_state));
+        if (!ctx->ic)
+        {
+            perror("Failed to allocate memory");
+            k0_fail(4);
+        }
     }
+    return ctx->ic;
+}
 
-    // find where to insert (before .data)
-    long insert_position = string_section_end - buffer;
+#define string_table (ic()->strings)
+#define CURRENT_SCOPE_NAME (ic()->current_scope_name)
+#define type_hint (ic()->type_hint)
+#define CURRENT_BRANCH_NUM (ic()->current_branch_num)
+#define CURRENT_ENTRY_LABEL (ic()->current_entry_label)
+#define STRING_NUM (ic()->string_num)
+#define LITERAL_COUNT (ic()->literal_count)
 
-    // prepare the new strings to insert
-    FILE *temp = tmpfile();
-    if (!temp) {
-        perror("Failed to create temporary file");
-        free(buffer);
-        fclose(file);
+void ic_state_free(struct ic_state *state)
+{
+    if (!state)
         return;
+    for (int i = 0; i < state->strings.count; i++)
+    {
+        free(state->strings.entries[i].data);
+        free(state->strings.entries[i].name);
     }
+    free_generated_functions(state);
+    free(state);
+}
 
-    // write up to `.data`
-    fwrite(buffer, 1, insert_position, temp);
-
-    // insert each string
-    string_section(temp);
-
-    // write the rest of the original file (from ".data" onward)
-    fwrite(buffer + insert_position, 1, filesize - insert_position, temp);
-
-    // rewrite the original file
-    rewind(file);
-    rewind(temp);
-
-    // copy temp back into original file
-    char ch;
-    while (fread(&ch, 1, 1, temp) == 1) {
-        fwrite(&ch, 1, 1, file);
-    }
-
-    // truncate leftover content if needed
-    fflush(file);
-    ftruncate(fileno(file), ftell(file));
-
-    // cleanup
-    free(buffer);
-    fclose(file);
-    fclose(temp);
+// add a printf format string to the string table, returning its name
+static char *add_format_string(const char *data, size_t length) {
+    string_table.entries[string_table.count].data = strndup(data, length);
+    string_table.entries[string_table.count].offset = string_table.current_offset;
+    char *name = malloc(sizeof(char) * 8);
+    sprintf(name, "s%d", STRING_NUM);
+    STRING_NUM++;
+    string_table.entries[string_table.count].name = name;
+    string_table.current_offset += length + 1;
+    string_table.count++;
+    return name;
 }
 
 // get type category for println arg
@@ -104,15 +97,7 @@ char *handle_println_arg(struct token *arg) {
             printf("debug: unknown category in ic handle_println_arg\n");
             return NULL;
     }
-    // update str table
-    string_table.entries[string_table.count].data = strdup(str_output);
-    string_table.entries[string_table.count].offset = string_table.current_offset;
-    char *name = malloc(sizeof(char) * 8);
-    sprintf(name, "s%d", STRING_NUM);
-    STRING_NUM++;
-    string_table.entries[string_table.count].name = name;
-    string_table.current_offset += strlen(str_output) + 1;
-    string_table.count++;
+    add_format_string(str_output, strlen(str_output));
 
     // char *name = malloc(8);
     // snprintf(name, 8, "s%d", STRING_NUM);
@@ -125,13 +110,13 @@ char *handle_println_arg(struct token *arg) {
 // isolate println arg
 char *handle_println(struct tree* t) {
     struct token *arg = NULL;
-    if (t->kids[2]->leaf == NULL) {
+    if (CALL_ARGS(t)->leaf == NULL) {
         // printf("debug: ic println arg is node\n");
-        arg = t->kids[2]->kids[0]->leaf;
+        arg = CALL_ARGS(t)->kids[0]->leaf;
     }
     else {
         // printf("debug: ic println arg is leaf\n");
-        arg = t->kids[2]->leaf;
+        arg = CALL_ARGS(t)->leaf;
     }
     if (arg == NULL) {
         printf("debug: unexpected println arg in ic.c\n");
@@ -169,24 +154,35 @@ void free_string_table() {
         free(string_table.entries[i].data);
         free(string_table.entries[i].name);
     }
+    string_table.count = 0;
+    ic()->strings_collected = false;
 }
 
-void collect_strings(struct tree *t)
+// data of the string constant called name, or NULL
+const char *find_string_data(const char *name)
 {
-    if (!t)
-        return;
+    for (int i = 0; i < string_table.count; i++)
+    {
+        if (strcmp(string_table.entries[i].name, name) == 0)
+            return string_table.entries[i].data;
+    }
+    return NULL;
+}
 
+// add a string literal to the string table unless it is there already
+static bool collect_string(struct tree *t, int depth, void *arg)
+{
     if (t->leaf &&
         (t->leaf->category == StringLiteral || t->leaf->category == MultilineStringLiteral))
     {
-        const char *str = t->leaf->sval;
+        const char *str = token_sval(t->leaf);
 
         if (!str)
-            return;
+            return true;
         for (int i = 0; i < string_table.count; i++)
         {
             if (strcmp(string_table.entries[i].data, str) == 0)
-                return;
+                return true;
         }
 
         if (string_table.count < 1000)
@@ -203,11 +199,21 @@ void collect_strings(struct tree *t)
             string_table.count++;
         }
     }
+    return true;
+}
 
-    for (int i = 0; i < t->nkids; i++)
-    {
-        collect_strings(t->kids[i]);
-    }
+// visitor that collects the string literals, for fusing into an earlier tree walk;
+// write_ic() then skips its own collect_strings()
+struct tree_visitor string_collector(void)
+{
+    ic()->strings_collected = true;
+    return (struct tree_visitor){collect_string, NULL, NULL};
+}
+
+void collect_strings(struct tree *t)
+{
+    struct tree_visitor visitor = string_collector();
+    walk_tree(t, &visitor, 1);
 }
 
 
@@ -268,14 +274,15 @@ void free_data_decls(struct data_decl *head)
     while (head)
     {
         struct data_decl *next = head->next;
-        free(head);
+        mem_free(MEM_IC, head);
         head = next;
     }
 }
 
 struct instr *create_instr(int opcode, struct addr *dest, struct addr *src1, struct addr *src2)
 {
-    struct instr *instruction = malloc(sizeof(struct instr));
+    struct instr *instruction = mem_alloc(MEM_IC, sizeof(struct instr));
+    count_event(COUNT_IC_INSTRS, 1);
     instruction->opcode = opcode;
     instruction->dest = NULL;
     instruction->src1 = NULL;
@@ -312,7 +319,7 @@ char *find_string(char *s) {
 
 struct addr *create_addr(int region, int offset, char *s)
 {
-    struct addr *naddr = malloc(sizeof(struct addr));
+    struct addr *naddr = mem_alloc(MEM_IC, sizeof(struct addr));
     naddr->region = region;
     if (s != NULL)
     {
@@ -320,7 +327,7 @@ struct addr *create_addr(int region, int offset, char *s)
             char *s_name = find_string(s);
             if (s_name != NULL) s = s_name;
         }
-        naddr->u.name = strdup(s);
+        naddr->u.name = mem_strdup(MEM_IC, s);
     } else {
         naddr->u.offset = offset;
     }
@@ -445,53 +452,59 @@ struct addr* gen_expression(struct tree* t, struct instr* ics, ListSymbolTables
     struct addr *left, *right;
     
     if (strcmp(t->symbolname, "ADD") == 0) {
-        left = gen_expression(t->kids[0], ics, tables, labels);
-        right = gen_expression(t->kids[2], ics, tables, labels);
+        left = gen_expression(EXPR_LEFT(t), ics, tables, labels);
+        right = gen_expression(EXPR_RIGHT(t), ics, tables, labels);
         append_instr(ics, create_instr(O_ADD, result, left, right));
         return result;
+    } else if (strcmp(t->symbolname, "SUB") == 0) {
+        left = gen_expression(EXPR_LEFT(t), ics, tables, labels);
+        right = gen_expression(EXPR_RIGHT(t), ics, tables, labels);
+        append_instr(ics, create_instr(O_SUB, result, left, right));
+        return result;
     } else if (strcmp(t->symbolname, "UMINUS") == 0) {
-        left = gen_expression(t->kids[0], ics, tables, labels);
-        right = gen_expression(t->kids[2], ics, tables, labels);
+        // UMINUS has only the operator and its operand
+        left = gen_expression(EXPR_LEFT(t), ics, tables, labels);
+        right = gen_expression(EXPR_RIGHT(t), ics, tables, labels);
         append_instr(ics, create_instr(O_SUB, result, left, right));
         return result;
     } else if (strcmp(t->symbolname, "MULT") == 0) {
-        left = gen_expression(t->kids[0], ics, tables, labels);
-        right = gen_expression(t->kids[2], ics, tables, labels);
+        left = gen_expression(EXPR_LEFT(t), ics, tables, labels);
+        right = gen_expression(EXPR_RIGHT(t), ics, tables, labels);
         append_instr(ics, create_instr(O_MUL, result, left, right));
         return result;
     } else if (strcmp(t->symbolname, "DIV") == 0) {
-        left = gen_expression(t->kids[0], ics, tables, labels);
-        right = gen_expression(t->kids[2], ics, tables, labels);
+        left = gen_expression(EXPR_LEFT(t), ics, tables, labels);
+        right = gen_expression(EXPR_RIGHT(t), ics, tables, labels);
         append_instr(ics, create_instr(O_DIV, result, left, right));
         return result;
     } else if (strcmp(t->symbolname, "LANGLE") == 0) {
-        left = gen_expression(t->kids[0], ics, tables, labels);
-        right = gen_expression(t->kids[2], ics, tables, labels);
+        left = gen_expression(EXPR_LEFT(t), ics, tables, labels);
+        right = gen_expression(EXPR_RIGHT(t), ics, tables, labels);
         append_instr(ics, create_instr(O_BLT, result, left, right));
         return result;
     } else if (strcmp(t->symbolname, "RANGLE") == 0) {
-        left = gen_expression(t->kids[0], ics, tables, labels);
-        right = gen_expression(t->kids[2], ics, tables, labels);
+        left = gen_expression(EXPR_LEFT(t), ics, tables, labels);
+        right = gen_expression(EXPR_RIGHT(t), ics, tables, labels);
         append_instr(ics, create_instr(O_BGT, result, left, right));
         return result;
     } else if (strcmp(t->symbolname, "LE") == 0) {
-        left = gen_expression(t->kids[0], ics, tables, labels);
-        right = gen_expression(t->kids[2], ics, tables, labels);
+        left = gen_expression(EXPR_LEFT(t), ics, tables, labels);
+        right = gen_expression(EXPR_RIGHT(t), ics, tables, labels);
         append_instr(ics, create_instr(O_BLE, result, left, right));
         return result;
     } else if (strcmp(t->symbolname, "GE") == 0) {
-        left = gen_expression(t->kids[0], ics, tables, labels);
-        right = gen_expression(t->kids[2], ics, tables, labels);
+        left = gen_expression(EXPR_LEFT(t), ics, tables, labels);
+        right = gen_expression(EXPR_RIGHT(t), ics, tables, labels);
         append_instr(ics, create_instr(O_BGE, result, left, right));
         return result;
     } else if (strcmp(t->symbolname, "NOT_EQ") == 0) {
-        left = gen_expression(t->kids[0], ics, tables, labels);
-        right = gen_expression(t->kids[2], ics, tables, labels);
+        left = gen_expression(EXPR_LEFT(t), ics, tables, labels);
+        right = gen_expression(EXPR_RIGHT(t), ics, tables, labels);
         append_instr(ics, create_instr(O_BNE, result, left, right));
         return result;
     } else if (strcmp(t->symbolname, "EQEQ") == 0) {
-        left = gen_expression(t->kids[0], ics, tables, labels);
-        right = gen_expression(t->kids[2], ics, tables, labels);
+        left = gen_expression(EXPR_LEFT(t), ics, tables, labels);
+        right = gen_expression(EXPR_RIGHT(t), ics, tables, labels);
         append_instr(ics, create_instr(O_BEQ, result, left, right));
         return result;
     } else {
@@ -502,35 +515,572 @@ struct addr* gen_expression(struct tree* t, struct instr* ics, ListSymbolTables
     // should never get here but just in case i guess
     if (result) {
         if (result->region == R_NAME && result->u.name) {
-            free(result->u.name);
+            mem_free(MEM_IC, result->u.name);
         }
-        free(result);
+        mem_free(MEM_IC, result);
     }
     return NULL;
 }
 
+// true if mark_tail_calls flagged a self-call anywhere in the subtree
+bool has_tail_call(struct tree *t) {
+    if (t == NULL || t->leaf != NULL) return false;
+    if (t->prodrule == FUNCTIONCALL_RULE && t->tail_call) return true;
+    for (int i = 0; i < t->nkids; i++) {
+        if (has_tail_call(t->kids[i])) return true;
+    }
+    return false;
+}
+
+// the argument expressions of a funcCallParamList, in source order, stored in
+// args unless it is NULL; returns how many there are
+int collect_call_args(struct tree *t, struct tree **args) {
+    if (t == NULL) return 0;
+    if (t->prodrule == FUNCARGLIST_RULE) {
+        for (int i = 0; args && i < t->nkids; i++) {
+            args[i] = t->kids[i];
+        }
+        return t->nkids;
+    }
+    if (args) args[0] = t;
+    return 1;
+}
+
+// tail self-call: stage the new arguments, copy them over the parameters and jump back to the entry
+void gen_tail_call(struct tree* t, struct instr* ics, ListSymbolTables tables, struct instr* labels) {
+    SymbolTable func_table = find_symbol_table(tables, CURRENT_SCOPE_NAME);
+    SymbolTableEntry function_info = find_symbol(func_table, CURRENT_SCOPE_NAME);
+    int nargs = collect_call_args(CALL_ARGS(t), NULL);
+    struct tree **args = malloc((nargs + 1) * sizeof(struct tree *));
+    int *staged = malloc((nargs + 1) * sizeof(int));
+    if (!args || !staged) {
+        perror("Failed to allocate memory");
+        k0_fail(4);
+    }
+    collect_call_args(CALL_ARGS(t), args);
+    // arguments may read the parameters they replace, so evaluate all of them first
+    for (int i = 0; i < nargs; i++) {
+        staged[i] = func_table->current_offset;
+        func_table->current_offset += 8;
+        append_instr(ics, create_instr(O_ASN, create_addr(R_LOCAL, staged[i], NULL), gen_expression(args[i], ics, tables, labels), NULL));
+    }
+    paramlist param = function_info->type->u.f.parameters;
+    for (int i = 0; i < nargs && param != NULL; i++) {
+        append_instr(ics, create_instr(O_ASN, create_addr(R_LOCAL, find_location(tables, CURRENT_SCOPE_NAME, param->name), NULL), create_addr(R_LOCAL, staged[i], NULL), NULL));
+        param = param->next;
+    }
+    free(args);
+    free(staged);
+    append_instr(ics, create_instr(O_GOTO, create_addr(R_LABEL, -1, CURRENT_ENTRY_LABEL), NULL, NULL));
+}
+
 void gen_return(struct tree* t, struct instr* ics, ListSymbolTables tables, struct instr* labels) {
-    struct addr* result = gen_expression(t->kids[1], ics, tables, labels);
+    struct tree *value = RETURN_VALUE(t);
+    if (value->leaf == NULL && value->prodrule == FUNCTIONCALL_RULE && value->tail_call) {
+        gen_tail_call(value, ics, tables, labels);
+        return;
+    }
+    struct addr* result = gen_expression(value, ics, tables, labels);
     append_instr(ics, create_instr(O_RET, result, create_addr(R_NONE, -1, type_hint), NULL));
 }
 
-void gen_function_decl(struct tree* t, struct instr* ics, ListSymbolTables tables, struct instr* labels) {
+static void gen_function_code(struct tree* t, struct instr* ics, ListSymbolTables tables, struct instr* labels) {
     struct tree* identifier = find_child(t, Identifier);
     if (!identifier) return;
     char* func_name = identifier->leaf->text;
     SymbolTableEntry function_info = find_symbol(tables->table, func_name);
     append_instr(ics, create_instr(D_LABEL, create_addr(R_GLOBAL, -1, func_name), NULL, NULL));
     CURRENT_SCOPE_NAME = func_name;
-    for (int i = 0; i < t->nkids; i++) {
-        if (t->kids[i]->prodrule == BLOCK_RULE) {
-            generate_code(t->kids[i], ics, tables, labels);
-            break;
-        }
+    CURRENT_ENTRY_LABEL = NULL;
+    if (has_tail_call(t)) {
+        CURRENT_ENTRY_LABEL = create_label_name();
+        append_instr(ics, create_instr(D_LABEL, create_addr(R_GLOBAL, -1, CURRENT_ENTRY_LABEL), NULL, NULL));
     }
+    generate_code(FUNC_BODY(t), ics, tables, labels);
     if (function_info->type->u.f.returntype->basetype == UNIT_TYPE) {
         append_instr(ics, create_instr(O_RET, NULL, NULL, NULL));
     }
     CURRENT_SCOPE_NAME = "global scope";
+    free(CURRENT_ENTRY_LABEL);
+    CURRENT_ENTRY_LABEL = NULL;
+}
+
+/*
+ * Per-function IC cache. A function's IC only depends on its own subtree,
+ * the globals it refers to and the file's string literals, so that is what
+ * its key hashes. The cached fragment is the function's code and branch
+ * blocks as IC text, with label numbers relative to the function and string
+ * names replaced by references that are resolved again on every splice:
+ *
+ *   k0fn <labels> <formats> <refs> <code bytes> <block bytes>
+ *   <length> <data>          one line per println format string it adds
+ *   L <length> <data>        one line per string reference: a literal,
+ *   F <index>                one of the function's format strings,
+ *   H                        or the first string of the table
+ *   <code><blocks>
+ *
+ * Inside the text, FRAGMENT_MARK L<n> FRAGMENT_MARK is label n of the
+ * function and FRAGMENT_MARK S<n> FRAGMENT_MARK is string reference n.
+ */
+#define FRAGMENT_MARK '\001'
+
+// describe t, and the signature of every global it names, for its cache key
+static void describe_tree(FILE *fp, struct tree *t, SymbolTable scope) {
+    if (!t) {
+        fputs("-\n", fp);
+        return;
+    }
+    fprintf(fp, "%d %d %d", t->prodrule, t->nkids, t->tail_call);
+    if (t->leaf) {
+        const char *text = t->leaf->text ? t->leaf->text : "";
+        fprintf(fp, " %d %zu:%s", t->leaf->category, strlen(text), text);
+        SymbolTableEntry entry = t->leaf->category == Identifier ? find_symbol(scope, text) : NULL;
+        if (entry && entry->scope != scope && entry->type) {
+            fprintf(fp, " global %d %d", entry->type->basetype, entry->memloc);
+            if (entry->type->basetype == FUNC_TYPE) {
+                typeptr returns = entry->type->u.f.returntype;
+                fprintf(fp, " %d %d", entry->type->u.f.nparams, returns ? returns->basetype : -1);
+            }
+        }
+    }
+    fputc('\n', fp);
+    for (int i = 0; i < t->nkids; i++) {
+        describe_tree(fp, t->kids[i], scope);
+    }
+}
+
+static int by_data(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// constants that match a string literal become references to it, so every key covers the set of literals
+static void digest_literals(void) {
+    char **data = malloc((LITERAL_COUNT + 1) * sizeof(char *));
+    char *text = NULL;
+    size_t length = 0;
+    FILE *fp = open_memstream(&text, &length);
+    if (!data || !fp) {
+        perror("Failed to allocate memory");
+        k0_fail(4);
+    }
+    for (int i = 0; i < LITERAL_COUNT; i++) {
+        data[i] = string_table.entries[i].data;
+    }
+    qsort(data, LITERAL_COUNT, sizeof(char *), by_data);
+    for (int i = 0; i < LITERAL_COUNT; i++) {
+        fprintf(fp, "%zu:%s\n", strlen(data[i]), data[i]);
+    }
+    fclose(fp);
+    cache_key(text, length, "k0 literals", ic()->literal_digest);
+    free(text);
+    free(data);
+}
+
+static void function_key(struct tree *t, ListSymbolTables tables, char *func_name, char key[CACHE_KEY_SIZE]) {
+    char *text = NULL;
+    size_t length = 0;
+    FILE *fp = open_memstream(&text, &length);
+    if (!fp) {
+        perror("Failed to allocate memory");
+        k0_fail(4);
+    }
+    fprintf(fp, "%s\n", ic()->literal_digest);
+    describe_tree(fp, t, find_symbol_table(tables, func_name));
+    fclose(fp);
+    cache_key(text, length, "k0 function ic", key);
+    free(text);
+}
+
+// index of the string table entry called name, or -1
+static int string_index(const char *name) {
+    for (int i = 0; i < string_table.count; i++) {
+        if (strcmp(string_table.entries[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+typedef struct fragment_refs {
+    FILE *fp;           // the string references written so far
+    int count;
+    int first_label;    // labels first_label up to CURRENT_BRANCH_NUM belong to the function
+    int first_string;   // as do the string table entries from first_string on
+} fragment_refs;
+
+// replace labels and string names in a with marks; false if the fragment would depend on other functions
+static bool mark_addr(struct addr *a, fragment_refs *refs) {
+    if (!a || a->region == R_LOCAL || a->region == R_NONE || a->region == R_CLASS) return true;
+    char *name = a->u.name;
+    if (!name || name[0] == FRAGMENT_MARK) return true;
+    char mark[32];
+    int number, end = 0;
+    int i = a->region == R_STRING || a->region == R_CONST ? string_index(name) : -1;
+    if (i == 0 && LITERAL_COUNT == 0) {
+        // without literals, println's format operand is whichever format string the file added first
+        fputs("H\n", refs->fp);
+    } else if (i >= 0 && i < LITERAL_COUNT) {
+        const char *data = string_table.entries[i].data;
+        fprintf(refs->fp, "L %zu %s\n", strlen(data), data);
+    } else if (i >= refs->first_string) {
+        fprintf(refs->fp, "F %d\n", i - refs->first_string);
+    } else if (i >= 0) {
+        return false;
+    } else if ((a->region == R_LABEL || a->region == R_GLOBAL) && sscanf(name, "label%d%n", &number, &end) == 1 &&
+               name[end] == '\0' && number >= refs->first_label && number < CURRENT_BRANCH_NUM) {
+        snprintf(mark, sizeof(mark), "%cL%d%c", FRAGMENT_MARK, number - refs->first_label, FRAGMENT_MARK);
+        mem_free(MEM_IC, a->u.name);
+        a->u.name = mem_strdup(MEM_IC, mark);
+        return true;
+    } else {
+        return strchr(name, FRAGMENT_MARK) == NULL;
+    }
+    snprintf(mark, sizeof(mark), "%cS%d%c", FRAGMENT_MARK, refs->count++, FRAGMENT_MARK);
+    mem_free(MEM_IC, a->u.name);
+    a->u.name = mem_strdup(MEM_IC, mark);
+    return true;
+}
+
+static bool mark_instrs(struct instr *ics, fragment_refs *refs) {
+    for (; ics; ics = ics->next) {
+        if (!mark_addr(ics->dest, refs) || !mark_addr(ics->src1, refs) || !mark_addr(ics->src2, refs)) return false;
+    }
+    return true;
+}
+
+// the cache fragment for a function just generated into code and blocks, or NULL if it cannot be cached
+static char *make_fragment(struct instr *code, struct instr *blocks, int first_label, int first_string, size_t *length) {
+    char *ref_text = NULL, *code_text = NULL, *block_text = NULL, *fragment = NULL;
+    size_t ref_len = 0, code_len = 0, block_len = 0;
+    fragment_refs refs = { open_memstream(&ref_text, &ref_len), 0, first_label, first_string };
+    bool ok = mark_instrs(code, &refs) && mark_instrs(blocks, &refs);
+    fclose(refs.fp);
+    if (ok) {
+        FILE *fp = open_memstream(&code_text, &code_len);
+        write_instr(fp, code);
+        fclose(fp);
+        fp = open_memstream(&block_text, &block_len);
+        write_instr(fp, blocks);
+        fclose(fp);
+
+        fp = open_memstream(&fragment, length);
+        fprintf(fp, "k0fn %d %d %d %zu %zu\n", CURRENT_BRANCH_NUM - first_label, string_table.count - first_string,
+                refs.count, code_len, block_len);
+        for (int i = first_string; i < string_table.count; i++) {
+            const char *data = string_table.entries[i].data;
+            fprintf(fp, "%zu %s\n", strlen(data), data);
+        }
+        fwrite(ref_text, 1, ref_len, fp);
+        fwrite(code_text, 1, code_len, fp);
+        fwrite(block_text, 1, block_len, fp);
+        fclose(fp);
+    }
+    free(ref_text);
+    free(code_text);
+    free(block_text);
+    return fragment;
+}
+
+// read "<length> <data>\n" at *p, leaving *p after it
+static const char *fragment_string(const char **p, const char *end, size_t *length) {
+    char *rest;
+    unsigned long n = strtoul(*p, &rest, 10);
+    if (rest == *p || *rest != ' ' || (size_t)(end - rest) < n + 2 || rest[n + 1] != '\n') return NULL;
+    *length = n;
+    *p = rest + n + 2;
+    return rest + 1;
+}
+
+// whether every mark in text is whole and in range
+static bool marks_valid(const char *text, size_t length, int nlabels, int nrefs) {
+    const char *end = text + length;
+    while ((text = memchr(text, FRAGMENT_MARK, end - text)) != NULL) {
+        const char *close = memchr(text + 1, FRAGMENT_MARK, end - text - 1);
+        if (!close || close - text < 3 || (text[1] != 'L' && text[1] != 'S')) return false;
+        int n = 0;
+        for (const char *d = text + 2; d < close; d++) {
+            if (!isdigit((unsigned char)*d) || n > 100000000) return false;
+            n = n * 10 + (*d - '0');
+        }
+        if (n >= (text[1] == 'L' ? nlabels : nrefs)) return false;
+        text = close + 1;
+    }
+    return true;
+}
+
+// copy text to a D_TEXT instruction on ics, turning marks into this compile's labels and string names
+static void splice_text(struct instr *ics, const char *text, size_t length, char **names) {
+    char *out = NULL;
+    size_t out_len = 0;
+    FILE *fp = open_memstream(&out, &out_len);
+    const char *end = text + length;
+    while (text < end) {
+        const char *mark = memchr(text, FRAGMENT_MARK, end - text);
+        if (!mark) mark = end;
+        fwrite(text, 1, mark - text, fp);
+        if (mark == end) break;
+        int n = atoi(mark + 2);
+        if (mark[1] == 'L') {
+            fprintf(fp, "label%d", CURRENT_BRANCH_NUM + n);
+        } else {
+            fputs(names[n], fp);
+        }
+        text = memchr(mark + 1, FRAGMENT_MARK, end - mark - 1) + 1;
+    }
+    fclose(fp);
+    append_instr(ics, create_instr(D_TEXT, create_addr(R_NAME, -1, out), NULL, NULL));
+    free(out);
+}
+
+// splice a cached function into ics and labels; false, with nothing changed, if the fragment does not fit
+static bool splice_fragment(const char *fragment, size_t length, struct instr *ics, struct instr *labels) {
+    const char *p = fragment, *end = fragment + length;
+    int nlabels, nformats, nrefs, header = 0;
+    size_t code_len, block_len;
+    if (sscanf(p, "k0fn %d %d %d %zu %zu%n", &nlabels, &nformats, &nrefs, &code_len, &block_len, &header) != 5 ||
+        p[header] != '\n' || nlabels < 0 || nformats < 0 || nrefs < 0 || string_table.count + nformats > 1000) {
+        return false;
+    }
+    p += header + 1;
+
+    const char **formats = calloc(nformats + 1, sizeof(char *));
+    size_t *format_lens = calloc(nformats + 1, sizeof(size_t));
+    char **names = calloc(nrefs + 1, sizeof(char *));
+    int *format_refs = calloc(nrefs + 1, sizeof(int));
+    bool ok = formats && format_lens && names && format_refs;
+    for (int i = 0; ok && i < nformats; i++) {
+        ok = (formats[i] = fragment_string(&p, end, &format_lens[i])) != NULL;
+    }
+    // every literal has to be in this file's string table before anything is added to it
+    bool head = false;
+    for (int i = 0; ok && i < nrefs; i++) {
+        size_t n;
+        const char *data;
+        format_refs[i] = -1;
+        if (p + 1 < end && p[0] == 'H' && p[1] == '\n') {
+            head = true;
+            p += 2;
+        } else if (p < end && p[0] == 'F' && p[1] == ' ') {
+            char *rest;
+            format_refs[i] = (int)strtol(p + 2, &rest, 10);
+            ok = *rest == '\n' && format_refs[i] >= 0 && format_refs[i] < nformats;
+            p = rest + 1;
+        } else if (p < end && p[0] == 'L' && p[1] == ' ' && (p += 2, data = fragment_string(&p, end, &n))) {
+            ok = false;
+            for (int j = 0; j < LITERAL_COUNT && !ok; j++) {
+                if (strlen(string_table.entries[j].data) == n && memcmp(string_table.entries[j].data, data, n) == 0) {
+                    names[i] = string_table.entries[j].name;
+                    ok = true;
+                }
+            }
+        } else {
+            ok = false;
+        }
+    }
+    ok = ok && (!head || string_table.count + nformats > 0) && (size_t)(end - p) == code_len + block_len &&
+         marks_valid(p, code_len, nlabels, nrefs) && marks_valid(p + code_len, block_len, nlabels, nrefs);
+
+    if (ok) {
+        int first_string = string_table.count;
+        for (int i = 0; i < nformats; i++) {
+            add_format_string(formats[i], format_lens[i]);
+        }
+        for (int i = 0; i < nrefs; i++) {
+            if (format_refs[i] >= 0) names[i] = string_table.entries[first_string + format_refs[i]].name;
+            else if (!names[i]) names[i] = string_table.entries[0].name;
+        }
+        splice_text(ics, p, code_len, names);
+        splice_text(labels, p + code_len, block_len, names);
+        CURRENT_BRANCH_NUM += nlabels;
+    }
+    free(formats);
+    free(format_lens);
+    free(names);
+    free(format_refs);
+    return ok;
+}
+
+// generate a function into code and blocks and return its fragment, or NULL if it cannot be made one
+static char *function_fragment(struct tree* t, ListSymbolTables tables, struct instr *code, struct instr *blocks, size_t *length) {
+    int first_label = CURRENT_BRANCH_NUM;
+    int first_string = string_table.count;
+    int string_num = STRING_NUM;
+    int string_offset = string_table.current_offset;
+    gen_function_code(t, code, tables, blocks);
+    char *fragment = make_fragment(code, blocks, first_label, first_string, length);
+    if (fragment) {
+        // take back what generating it allocated, so the fragment goes in the same way a cached one does
+        for (int i = first_string; i < string_table.count; i++) {
+            free(string_table.entries[i].data);
+            free(string_table.entries[i].name);
+        }
+        string_table.count = first_string;
+        STRING_NUM = string_num;
+        string_table.current_offset = string_offset;
+        CURRENT_BRANCH_NUM = first_label;
+    }
+    return fragment;
+}
+
+// generate a function, or splice in its IC from the cache when the function is unchanged
+static void gen_cached_function(struct tree* t, struct instr* ics, ListSymbolTables tables, struct instr* labels) {
+    struct tree* identifier = find_child(t, Identifier);
+    if (!identifier) return;
+    char key[CACHE_KEY_SIZE];
+    function_key(t, tables, identifier->leaf->text, key);
+    size_t length;
+    char *fragment = cache_load(key, ".fn", &length);
+    bool spliced = fragment && splice_fragment(fragment, length, ics, labels);
+    free(fragment);
+    if (spliced) return;
+
+    struct instr *code = create_instr(O_BEGIN, NULL, NULL, NULL);
+    struct instr *blocks = create_instr(O_BEGIN, NULL, NULL, NULL);
+    fragment = function_fragment(t, tables, code, blocks, &length);
+    if (fragment) {
+        if (splice_fragment(fragment, length, ics, labels)) {
+            cache_save(key, ".fn", fragment, length);
+            free_instr(code);
+            free_instr(blocks);
+            free(fragment);
+            return;
+        }
+        fprintf(k0_diag(), "Error: cached IC of %s does not splice\n", identifier->leaf->text);
+        k0_fail(4);
+    }
+    append_instr(ics, code->next);
+    append_instr(labels, blocks->next);
+    mem_free(MEM_IC, code);
+    mem_free(MEM_IC, blocks);
+}
+
+/*
+ * With -j on one file, every function is generated on the pool before the
+ * tree walk. A thread makes the function's fragment with labels and format
+ * strings numbered from its own state, and gen_function_decl() splices the
+ * fragments in source order, numbering them as generating the functions one
+ * after another would have.
+ */
+struct generated_function {
+    struct tree *t;
+    char *fragment;     // NULL if the function has to be generated in line
+    size_t length;
+    long instrs;        // what generating it in line would have counted
+};
+
+struct generated_functions {
+    struct generated_function *functions;
+    int count;
+    int max;
+    int next;           // the first one gen_function_decl() has not reached yet
+    struct ic_state *file;
+    ListSymbolTables tables;
+};
+
+// the functions generate_code() reaches from t, in the order it reaches them
+static void find_functions(struct tree *t, struct generated_functions *gen) {
+    if (!t) return;
+    if (t->prodrule != FUNCTIONDECL_RULE) {
+        for (int i = 0; i < t->nkids; i++) {
+            find_functions(t->kids[i], gen);
+        }
+        return;
+    }
+    if (gen->count == gen->max) {
+        gen->max = gen->max ? gen->max * 2 : 64;
+        gen->functions = realloc(gen->functions, gen->max * sizeof(struct generated_function));
+        if (!gen->functions) {
+            perror("Failed to allocate memory");
+            k0_fail(4);
+        }
+    }
+    gen->functions[gen->count++] = (struct generated_function){t, NULL, 0, 0};
+}
+
+// a function refers to no strings but the file's literals and its own format strings, so a thread only needs those
+static void copy_literals(struct ic_state *file) {
+    for (int i = 0; i < file->literal_count; i++) {
+        string_table.entries[i].data = strdup(file->strings.entries[i].data);
+        string_table.entries[i].name = strdup(file->strings.entries[i].name);
+        string_table.entries[i].offset = file->strings.entries[i].offset;
+    }
+    string_table.count = LITERAL_COUNT = file->literal_count;
+    string_table.current_offset = file->strings.current_offset;
+    STRING_NUM = file->string_num;
+    ic()->strings_collected = true;
+}
+
+static long count_instrs(struct instr *ics) {
+    long n = 0;
+    for (; ics; ics = ics->next) n++;
+    return n;
+}
+
+// generate one function on a pool thread
+static void generate_function_task(int i, void *arg) {
+    struct generated_functions *gen = arg;
+    struct generated_function *f = &gen->functions[i];
+    k0_context *ctx = k0_get();
+    if (!ic()->strings_collected) copy_literals(gen->file);
+    // a function that fails here is generated again in line, which reports the failure in order
+    ctx->recovering = true;
+    if (setjmp(ctx->recover) == 0) {
+        struct instr *code = create_instr(O_BEGIN, NULL, NULL, NULL);
+        struct instr *blocks = create_instr(O_BEGIN, NULL, NULL, NULL);
+        f->fragment = function_fragment(f->t, gen->tables, code, blocks, &f->length);
+        f->instrs = count_instrs(code->next) + count_instrs(blocks->next);
+        free_instr(code);
+        free_instr(blocks);
+    }
+    ctx->recovering = false;
+}
+
+static void generate_functions(struct tree *t, ListSymbolTables tables, int threads) {
+    struct generated_functions *gen = calloc(1, sizeof(struct generated_functions));
+    if (!gen) {
+        perror("Failed to allocate memory");
+        k0_fail(4);
+    }
+    gen->file = ic();
+    gen->tables = tables;
+    find_functions(t, gen);
+    pool_run(threads, gen->count, generate_function_task, gen);
+    ic()->generated = gen;
+}
+
+static void free_generated_functions(struct ic_state *state) {
+    struct generated_functions *gen = state->generated;
+    if (!gen) return;
+    for (int i = 0; i < gen->count; i++) {
+        free(gen->functions[i].fragment);
+    }
+    free(gen->functions);
+    free(gen);
+    state->generated = NULL;
+}
+
+// splice in t as the pool generated it; false if it has to be generated in line
+static bool splice_generated(struct tree *t, struct instr *ics, struct instr *labels) {
+    struct generated_functions *gen = ic()->generated;
+    for (int i = gen->next; i < gen->count; i++) {
+        if (gen->functions[i].t != t) continue;
+        struct generated_function *f = &gen->functions[i];
+        gen->next = i + 1;
+        if (!f->fragment || !splice_fragment(f->fragment, f->length, ics, labels)) return false;
+        // less the two D_TEXT instructions it went in as, which are counted already
+        count_event(COUNT_IC_INSTRS, f->instrs - 2);
+        return true;
+    }
+    return false;
+}
+
+void gen_function_decl(struct tree* t, struct instr* ics, ListSymbolTables tables, struct instr* labels) {
+    if (ic()->generated && splice_generated(t, ics, labels)) {
+        return;
+    }
+    if (ic()->reuse_functions) {
+        gen_cached_function(t, ics, tables, labels);
+    } else {
+        gen_function_code(t, ics, tables, labels);
+    }
 }
 
 void gen_function_call(struct tree* t, struct instr* ics, ListSymbolTables tables, struct instr* labels) {
@@ -545,11 +1095,11 @@ void gen_function_call(struct tree* t, struct instr* ics, ListSymbolTables table
         format_string = handle_println(t);
     }
 
-    struct tree *func_arg_list_node = t->kids[2];
+    struct tree *func_arg_list_node = CALL_ARGS(t);
     if (func_arg_list_node->prodrule != FUNCARGLIST_RULE) {
         append_instr(ics, create_instr(O_PARM, gen_expression(func_arg_list_node, ics, tables, labels), NULL, NULL));
     } else {
-        for (int i = func_arg_list_node->nkids - 1; i >= 0; i -= 2) {
+        for (int i = func_arg_list_node->nkids - 1; i >= 0; i--) {
             append_instr(ics, create_instr(O_PARM, gen_expression(func_arg_list_node->kids[i], ics, tables, labels), NULL, NULL));
         }
     }
@@ -564,23 +1114,25 @@ void gen_function_call(struct tree* t, struct instr* ics, ListSymbolTables table
 }
 
 void gen_assignment(struct tree* t, struct instr* ics, ListSymbolTables tables, struct instr* labels) {
-    append_instr(ics, create_instr(O_ASN, create_addr(R_LOCAL,find_location(tables, CURRENT_SCOPE_NAME, find_child(t, Identifier)->leaf->text), NULL), gen_expression(t->kids[2], ics, tables, labels), NULL));
+    append_instr(ics, create_instr(O_ASN, create_addr(R_LOCAL,find_location(tables, CURRENT_SCOPE_NAME, find_child(t, Identifier)->leaf->text), NULL), gen_expression(ASSIGN_VALUE(t), ics, tables, labels), NULL));
 }
 
 void gen_declaration(struct tree *t, struct instr* ics, ListSymbolTables tables, struct instr* labels) {
-    if (t->nkids >= 4) {
-        if (t->kids[3]->kids[1]->leaf != NULL) {
-            if (t->kids[3]->kids[1]->leaf->category != StringLiteral && t->kids[3]->kids[1]->leaf->category != MultilineStringLiteral) {
-                append_instr(ics, create_instr(O_ADDR, create_addr(R_LOCAL, find_location(tables, CURRENT_SCOPE_NAME, t->kids[1]->leaf->text), NULL), create_addr(R_CONST, -1, t->kids[3]->kids[1]->leaf->text), NULL));
+    char *name = DECL_NAME(t)->leaf->text;
+    if (DECL_INIT(t)) {
+        struct tree *value = ASSIGN_VALUE(DECL_INIT(t));
+        if (value->leaf != NULL) {
+            if (value->leaf->category != StringLiteral && value->leaf->category != MultilineStringLiteral) {
+                append_instr(ics, create_instr(O_ADDR, create_addr(R_LOCAL, find_location(tables, CURRENT_SCOPE_NAME, name), NULL), create_addr(R_CONST, -1, value->leaf->text), NULL));
             } else {
-                append_instr(ics, create_instr(O_ADDR, create_addr(R_LOCAL, find_location(tables, CURRENT_SCOPE_NAME, t->kids[1]->leaf->text), NULL), create_addr(R_STRING, -1, find_string_name(t->kids[3]->kids[1]->leaf->text, false)), NULL));
+                append_instr(ics, create_instr(O_ADDR, create_addr(R_LOCAL, find_location(tables, CURRENT_SCOPE_NAME, name), NULL), create_addr(R_STRING, -1, find_string_name(value->leaf->text, false)), NULL));
             }
         } else {
-            gen_expression(t->kids[3]->kids[1], ics, tables, labels);
-            append_instr(ics, create_instr(O_ADDR, create_addr(R_LOCAL, find_location(tables, CURRENT_SCOPE_NAME, t->kids[1]->leaf->text), NULL), create_addr(R_NAME, -1, "temp"), NULL));
+            gen_expression(value, ics, tables, labels);
+            append_instr(ics, create_instr(O_ADDR, create_addr(R_LOCAL, find_location(tables, CURRENT_SCOPE_NAME, name), NULL), create_addr(R_NAME, -1, "temp"), NULL));
         }
     } else {
-        append_instr(ics, create_instr(O_ADDR, create_addr(R_LOCAL, find_location(tables, CURRENT_SCOPE_NAME, t->kids[1]->leaf->text), NULL), NULL, NULL));
+        append_instr(ics, create_instr(O_ADDR, create_addr(R_LOCAL, find_location(tables, CURRENT_SCOPE_NAME, name), NULL), NULL, NULL));
     }
 }
 
@@ -601,16 +1153,15 @@ void gen_branch(struct tree* t, struct instr* ics, ListSymbolTables tables, stru
     // if section
     char* label = gen_label(t, ics, tables, labels);
     char *return_label = gen_label(t, ics, tables, NULL);
-    struct addr* result = gen_expression(t->kids[1]->kids[1], ics, tables, labels);
-    //gen_expression(t->kids[2]->kids[1], labels, tables, labels);
-    generate_code(t->kids[2]->kids[1], labels, tables, labels);
+    struct addr* result = gen_expression(IF_COND(t), ics, tables, labels);
+    generate_code(BLOCK_BODY(IF_BODY(t)), labels, tables, labels);
     append_instr(labels, create_instr(O_GOTO, create_addr(R_LABEL, -1, return_label), NULL, NULL));
     append_instr(ics, create_instr(O_BIF, result, NULL, NULL));
     append_instr(ics, create_instr(O_GOTO, create_addr(R_LABEL, -1, label), NULL, NULL));
     // else section
-    if (t->kids[4]->nkids != 0) {
+    if (IF_ELSE(t)->nkids != 0) {
         label = gen_label(t, ics, tables, labels);
-        generate_code(t->kids[4]->kids[1]->kids[1], labels, tables, labels);
+        generate_code(BLOCK_BODY(ELSE_BODY(IF_ELSE(t))), labels, tables, labels);
         append_instr(labels, create_instr(O_GOTO, create_addr(R_LABEL, -1, return_label), NULL, NULL));
         append_instr(ics, create_instr(O_BNIF, NULL, NULL, NULL));
         append_instr(ics, create_instr(O_GOTO, create_addr(R_LABEL, -1, label), NULL, NULL));
@@ -621,20 +1172,19 @@ void gen_branch(struct tree* t, struct instr* ics, ListSymbolTables tables, stru
 }
 
 void gen_range(struct tree *t, struct instr* ics, ListSymbolTables tables, struct instr *labels){
-    append_instr(ics, create_instr(O_BEQ, create_addr(R_LOCAL, find_location(tables, CURRENT_SCOPE_NAME, t->kids[0]->leaf->text), NULL), gen_expression(t->kids[4], ics, tables, labels), NULL));
+    append_instr(ics, create_instr(O_BEQ, create_addr(R_LOCAL, find_location(tables, CURRENT_SCOPE_NAME, RANGE_VAR(t)->leaf->text), NULL), gen_expression(RANGE_TO(t), ics, tables, labels), NULL));
 }
 
 void gen_while(struct tree *t, struct instr* ics, ListSymbolTables tables, struct instr*labels) {
     char* begin_label = gen_label(t, ics, tables, NULL);
     append_instr(ics, create_instr(D_LABEL, create_addr(R_GLOBAL, -1, begin_label), NULL, NULL));
-    struct addr* result = gen_expression(t->kids[1]->kids[1], ics, tables, labels);
+    struct addr* result = gen_expression(LOOP_COND(t), ics, tables, labels);
     append_instr(ics, create_instr(O_BIF, result, NULL, NULL));
     char *block_label = gen_label(t, ics, tables, labels);
     append_instr(ics, create_instr(O_GOTO, create_addr(R_LABEL, -1, block_label), NULL, NULL));
 
-    generate_code(t->kids[2]->kids[1], labels, tables, labels);
+    generate_code(BLOCK_BODY(LOOP_BODY(t)), labels, tables, labels);
     append_instr(labels, create_instr(O_GOTO, create_addr(R_LABEL, -1, begin_label), NULL, NULL));
-    //struct addr* result = gen_expression(t->kids[1]->kids[1], ics, tables, labels);
 }
 
 void gen_for(struct tree *t, struct instr* ics, ListSymbolTables tables, struct instr *labels) {
@@ -642,11 +1192,11 @@ void gen_for(struct tree *t, struct instr* ics, ListSymbolTables tables, struct
     append_instr(ics, create_instr(D_LABEL, create_addr(R_GLOBAL, -1, begin_label), NULL, NULL));
 
     char *block_label = gen_label(t, ics, tables, labels);
-    generate_code(t->kids[2], labels, tables, labels);
-    append_instr(labels, create_instr(O_ADD, create_addr(R_LOCAL, find_location(tables, CURRENT_SCOPE_NAME, t->kids[1]->kids[1]->kids[0]->leaf->text), NULL), create_addr(R_CONST, -1, "1"), NULL));
+    generate_code(LOOP_BODY(t), labels, tables, labels);
+    append_instr(labels, create_instr(O_ADD, create_addr(R_LOCAL, find_location(tables, CURRENT_SCOPE_NAME, RANGE_VAR(FOR_RANGE(t))->leaf->text), NULL), create_addr(R_CONST, -1, "1"), NULL));
     append_instr(labels, create_instr(O_GOTO, create_addr(R_LABEL, -1, begin_label), NULL, NULL));
 
-    gen_range(t->kids[1]->kids[1], ics, tables, labels);
+    gen_range(FOR_RANGE(t), ics, tables, labels);
     append_instr(ics, create_instr(O_GOTO, create_addr(R_LABEL, -1, block_label), NULL, NULL));
 }
 
@@ -657,7 +1207,8 @@ void generate_code(struct tree* t, struct instr* ics, ListSymbolTables tables, s
             gen_function_decl(t, ics, tables, labels);
             break;
         case FUNCTIONCALL_RULE:
-            gen_function_call(t, ics, tables, labels);
+            if (t->tail_call) gen_tail_call(t, ics, tables, labels);
+            else gen_function_call(t, ics, tables, labels);
             break;
         case EXPRESSION_RULE:
             gen_expression(t, ics, tables, labels);
@@ -750,6 +1301,10 @@ void write_instr(FILE *fp, struct instr* ics) {
                 fwrite(buffer, sizeof(char), strlen(buffer), fp);
                 break;
             }
+            case D_TEXT: {
+                fputs(ics->dest->u.name, fp);
+                break;
+            }
             case O_ASN: {
                 format_instruction(ics, fp, "asn");
                 break;
@@ -835,84 +1390,135 @@ void free_addr(struct addr *a) {
          a->region == R_NAME || a->region == R_GLOBAL || a->region == R_STRING) &&
         a->u.name != NULL)
     {
-        free(a->u.name);
+        mem_free(MEM_IC, a->u.name);
     }
 
-    free(a);
+    mem_free(MEM_IC, a);
 }
 
-// Very basic pointer deduplication helper
-bool addr_freed(struct addr **freed_addrs, int count, struct addr *a) {
-    for (int i = 0; i < count; i++) {
-        if (freed_addrs[i] == a) return true;
-    }
-    return false;
+static int by_address(const void *a, const void *b) {
+    uintptr_t x = (uintptr_t)*(struct addr *const *)a;
+    uintptr_t y = (uintptr_t)*(struct addr *const *)b;
+    return (x > y) - (x < y);
 }
 
+// instructions share addresses, so gather them all and free each one once
 void free_instr(struct instr *head) {
-    struct addr *freed_addrs[1000]; // Simple fixed-size dedup list
-    int freed_count = 0;
+    size_t count = 0, cap = 256;
+    struct addr **addrs = malloc(cap * sizeof(struct addr *));
+    if (!addrs) {
+        perror("Memory allocation failed");
+        k0_fail(4);
+    }
 
     while (head) {
         struct instr *next = head->next;
-
-        if (head->dest && !addr_freed(freed_addrs, freed_count, head->dest)) {
-            free_addr(head->dest);
-            freed_addrs[freed_count++] = head->dest;
-        }
-        if (head->src1 && !addr_freed(freed_addrs, freed_count, head->src1)) {
-            free_addr(head->src1);
-            freed_addrs[freed_count++] = head->src1;
-        }
-        if (head->src2 && !addr_freed(freed_addrs, freed_count, head->src2)) {
-            free_addr(head->src2);
-            freed_addrs[freed_count++] = head->src2;
+        struct addr *used[] = { head->dest, head->src1, head->src2 };
+        for (int i = 0; i < 3; i++) {
+            if (!used[i]) continue;
+            if (count == cap) {
+                cap *= 2;
+                struct addr **bigger = realloc(addrs, cap * sizeof(struct addr *));
+                if (!bigger) {
+                    perror("Memory allocation failed");
+                    k0_fail(4);
+                }
+                addrs = bigger;
+            }
+            addrs[count++] = used[i];
         }
-
-        free(head);
+        mem_free(MEM_IC, head);
         head = next;
     }
+
+    qsort(addrs, count, sizeof(struct addr *), by_address);
+    for (size_t i = 0; i < count; i++) {
+        if (i == 0 || addrs[i] != addrs[i - 1]) free_addr(addrs[i]);
+    }
+    free(addrs);
 }
 
 
-// create and populate intermediate code file
-void create_ic(char *ic_file, ListSymbolTables tables, struct tree *node)
+// write the .string, .data and .code sections for the tree to fp
+void write_ic(FILE *fp, ListSymbolTables tables, struct tree *node)
 {
-    // open ic file
-    FILE *fp = fopen(ic_file, "w");
-    if (!fp)
-    {
-        perror("Failed to open file");
-        exit(4);
-    }
-
-    // .data section
     struct data_decl *decl_list = create_data_decls(tables);
-    print_data_section(fp, decl_list);
-
-    // .code section
 
-    collect_strings(node);
+    if (!ic()->strings_collected)
+    {
+        phase_begin(PHASE_COLLECT_STRINGS);
+        collect_strings(node);
+        phase_end(PHASE_COLLECT_STRINGS);
+    }
+    LITERAL_COUNT = string_table.count;
+    ic()->reuse_functions = k0_get()->function_cache;
+    if (ic()->reuse_functions) digest_literals();
 
     struct instr *ics = create_instr(O_BEGIN, NULL, NULL, NULL);
     struct instr *labels = create_instr(O_BEGIN, NULL, NULL, NULL);
     CURRENT_SCOPE_NAME = "global scope";
     CURRENT_BRANCH_NUM = 0;
+    phase_begin(PHASE_GENERATE_CODE);
+    // the pool gives back text, which only the .ic file can take; the cache keeps its own order
+    int threads = k0_get()->threads;
+    if (threads > 1 && !ic()->reuse_functions) generate_functions(node, tables, threads);
     generate_code(node, ics, tables, labels);
+    free_generated_functions(ic());
+    phase_end(PHASE_GENERATE_CODE);
+    ic()->reuse_functions = false;
+
+    // println adds format strings while generating code, so the .string section comes last
+    phase_begin(PHASE_WRITE_IC);
+    string_section(fp);
+    print_data_section(fp, decl_list);
     fwrite("\n.code", sizeof(char), 6, fp);
     write_instr(fp, ics);
     write_instr(fp, labels);
+    phase_end(PHASE_WRITE_IC);
 
-    // close file
+    // free memory
+    free_instr(ics);
+    free_instr(labels);
+    free_string_table();
+    free_data_decls(decl_list);
+    free_symtab(tables);
+}
+
+// create and populate intermediate code file
+void create_ic(char *ic_file, ListSymbolTables tables, struct tree *node)
+{
+    // open ic file
+    FILE *fp = fopen(ic_file, "w");
+    if (!fp)
+    {
+        perror("Failed to open file");
+        k0_fail(4);
+    }
+    write_ic(fp, tables, node);
     fclose(fp);
+}
+// generate code into memory and run it with the interpreter instead of writing an .ic file
+int interpret_ic(ListSymbolTables tables, struct tree *node)
+{
+    if (!ic()->strings_collected)
+    {
+        phase_begin(PHASE_COLLECT_STRINGS);
+        collect_strings(node);
+        phase_end(PHASE_COLLECT_STRINGS);
+    }
 
-    // .string section
-    write_string_section(ic_file);
+    struct instr *ics = create_instr(O_BEGIN, NULL, NULL, NULL);
+    struct instr *labels = create_instr(O_BEGIN, NULL, NULL, NULL);
+    CURRENT_SCOPE_NAME = "global scope";
+    CURRENT_BRANCH_NUM = 0;
+    phase_begin(PHASE_GENERATE_CODE);
+    generate_code(node, ics, tables, labels);
+    phase_end(PHASE_GENERATE_CODE);
+    int status = interp_run(ics, labels, tables);
 
-    // free memory
     free_instr(ics);
     free_instr(labels);
     free_string_table();
-    free_data_decls(decl_list);
     free_symtab(tables);
-}
\ No newline at end of file
+    return status;
+}
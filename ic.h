@@ -3,6 +3,7 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 #include <ctype.h>
 #include <stdlib.h>
@@ -25,12 +26,17 @@ typedef struct {
     int current_offset;
 } StringTable;
 
-extern StringTable string_table;
+void write_ic(FILE *fp, ListSymbolTables tables, struct tree *node);
 void create_ic(char *ic_file, ListSymbolTables tables, struct tree *node);
+int interpret_ic(ListSymbolTables tables, struct tree *node);
 struct data_decl *create_data_decls(ListSymbolTables list);
 void print_data_section(FILE *fp, struct data_decl *decl_list);
 void collect_strings(struct tree* t);
+struct tree_visitor string_collector(void);
 void string_section(FILE* out);
+void write_instr(FILE *fp, struct instr* ics);
+void free_instr(struct instr *head);
+const char *find_string_data(const char *name);
 void intermediate_code(struct tree* t, FILE* out);
 bool needs_first_label(int prodrule);
 void assign_first(struct tree *t);
@@ -39,5 +45,9 @@ void assign_follow(struct tree *t);
 bool needs_condition_labels(int prodrule);
 void assign_condition(struct tree *t);
 void print_labels(struct tree *t, int depth);
+char* create_label_name();
+bool has_tail_call(struct tree *t);
+int collect_call_args(struct tree *t, struct tree **args);
+void gen_tail_call(struct tree* t, struct instr* ics, ListSymbolTables tables, struct instr* labels);
 void generate_code(struct tree* t, struct instr* ics, ListSymbolTables tables, struct instr *labels);
 #endif
@@ -0,0 +1,573 @@
+#include <time.h>
+#include "interp.h"
+#include "ic.h"
+#include "k0ctx.h"
+
+extern SymbolTableEntry find_symbol(SymbolTable tab, const char *symbolText);
+extern SymbolTable find_symbol_table(ListSymbolTables, char *);
+
+#define TEMP_SLOT 0
+#define ZERO_CONST -1          /* consts[0] is always Int 0: missing operands read it */
+#define INTERP_STACK_SLOTS (1 << 20)
+#define INTERP_MAX_DEPTH 65536
+#define INTERP_MAX_ARGS 256
+
+enum interp_op {
+    I_ADD, I_SUB, I_MUL, I_DIV, I_ASN,
+    I_LT, I_LE, I_GT, I_GE, I_EQ, I_NE,
+    I_GUARD, I_IF, I_ELSE, I_GOTO, I_PARM, I_CALL, I_PRINTLN, I_RET,
+    I_NOPS
+};
+
+typedef struct interp_label {
+    const char *name;
+    int index;
+} interp_label;
+
+typedef struct interp_labels {
+    interp_label *slots;
+    size_t cap;
+} interp_labels;
+
+typedef struct interp_frame {
+    interp_instr *pc;
+    k0_value *fp;
+} interp_frame;
+
+static void runtime_error(const char *message) {
+    fflush(stdout);
+    fprintf(k0_diag(), "Runtime Error: %s\n", message);
+    k0_fail(4);
+}
+
+static size_t hash_name(const char *s) {
+    size_t h = 5381;
+    while (*s) h = h * 33 + (unsigned char)*s++;
+    return h;
+}
+
+static void label_define(interp_labels *labels, const char *name, int index) {
+    size_t i = hash_name(name) & (labels->cap - 1);
+    while (labels->slots[i].name && strcmp(labels->slots[i].name, name) != 0) i = (i + 1) & (labels->cap - 1);
+    labels->slots[i].name = name;
+    labels->slots[i].index = index;
+}
+
+static int label_find(interp_labels *labels, const char *name) {
+    size_t i = hash_name(name) & (labels->cap - 1);
+    while (labels->slots[i].name) {
+        if (strcmp(labels->slots[i].name, name) == 0) return labels->slots[i].index;
+        i = (i + 1) & (labels->cap - 1);
+    }
+    return -1;
+}
+
+// println format strings are passed as R_STRING parms; the builtin does not need them
+static bool decodes_to_nothing(struct instr *i) {
+    return i->opcode == O_BEGIN || i->opcode == D_LABEL ||
+           (i->opcode == O_PARM && i->dest && i->dest->region == R_STRING);
+}
+
+static int add_const(interp_program *prog, k0_value v) {
+    prog->consts = realloc(prog->consts, (prog->nconsts + 1) * sizeof(k0_value));
+    prog->consts[prog->nconsts] = v;
+    return -1 - prog->nconsts++;
+}
+
+// decode the escapes the lexer leaves in string and char literals
+static char *unescape(const char *text, size_t len) {
+    char *out = malloc(len + 1);
+    size_t n = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (text[i] != '\\' || i + 1 == len) {
+            out[n++] = text[i];
+            continue;
+        }
+        switch (text[++i]) {
+            case 'n': out[n++] = '\n'; break;
+            case 't': out[n++] = '\t'; break;
+            case 'r': out[n++] = '\r'; break;
+            case 'b': out[n++] = '\b'; break;
+            case '0': out[n++] = '\0'; break;
+            default: out[n++] = text[i]; break;
+        }
+    }
+    out[n] = '\0';
+    return out;
+}
+
+static int string_const(interp_program *prog, const char *text, size_t len) {
+    k0_value v = { .kind = V_STRING };
+    v.u.s = unescape(text, len);
+    return add_const(prog, v);
+}
+
+// literal text as ic.c leaves it in R_CONST operands
+static int literal_const(interp_program *prog, const char *text) {
+    k0_value v = { .kind = V_INT };
+    size_t len = strlen(text);
+    const char *data = find_string_data(text);
+    if (data) return string_const(prog, data, strlen(data));
+    if (len >= 2 && text[0] == '"') return string_const(prog, text + 1, len - 2);
+    if (len >= 3 && text[0] == '\'') {
+        char *c = unescape(text + 1, len - 2);
+        v.kind = V_CHAR;
+        v.u.i = (unsigned char)c[0];
+        free(c);
+        return add_const(prog, v);
+    }
+    if (strcmp(text, "true") == 0 || strcmp(text, "false") == 0) {
+        v.u.i = text[0] == 't';
+        return add_const(prog, v);
+    }
+    // Kotlin allows digit separators and L/f suffixes
+    char digits[64];
+    size_t n = 0;
+    for (size_t i = 0; i < len && n < sizeof(digits) - 1; i++) {
+        if (text[i] != '_' && text[i] != 'L' && text[i] != 'f' && text[i] != 'F') digits[n++] = text[i];
+    }
+    digits[n] = '\0';
+    bool hex = n > 1 && digits[0] == '0' && (digits[1] == 'x' || digits[1] == 'X');
+    if (!hex && strpbrk(digits, ".eE")) {
+        v.kind = V_DOUBLE;
+        v.u.d = strtod(digits, NULL);
+    } else {
+        v.u.i = strtol(digits, NULL, 0);
+    }
+    return add_const(prog, v);
+}
+
+static void use_slot(interp_program *prog, int slot) {
+    if (slot >= prog->frame_size) prog->frame_size = slot + 1;
+}
+
+static int decode_operand(interp_program *prog, struct addr *a) {
+    if (a == NULL) return ZERO_CONST;
+    switch (a->region) {
+        case R_LOCAL:
+            use_slot(prog, a->u.offset / 8 + 1);
+            return a->u.offset / 8 + 1;
+        case R_NAME:
+            return TEMP_SLOT;
+        case R_CONST:
+            return literal_const(prog, a->u.name);
+        case R_STRING: {
+            const char *data = a->u.name ? find_string_data(a->u.name) : NULL;
+            return string_const(prog, data ? data : "", data ? strlen(data) : 0);
+        }
+    }
+    fprintf(k0_diag(), "interp: unsupported operand region %d\n", a->region);
+    k0_fail(4);
+}
+
+static int decode_dest(interp_program *prog, struct addr *a) {
+    int slot = decode_operand(prog, a);
+    if (slot < 0) {
+        fprintf(k0_diag(), "interp: constant used as a destination\n");
+        k0_fail(4);
+    }
+    return slot;
+}
+
+static int find_function(interp_program *prog, const char *name) {
+    for (int i = 0; i < prog->nfuncs; i++) {
+        if (strcmp(prog->funcs[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+static void add_function(interp_program *prog, ListSymbolTables tables, char *name, int entry) {
+    SymbolTableEntry info = find_symbol(tables->table, name);
+    SymbolTable scope = find_symbol_table(tables, name);
+    prog->funcs = realloc(prog->funcs, (prog->nfuncs + 1) * sizeof(interp_function));
+    interp_function *f = &prog->funcs[prog->nfuncs++];
+    f->name = name;
+    f->entry = entry;
+    f->nparams = 0;
+    f->params = malloc((info->type->u.f.nparams + 1) * sizeof(int));
+    for (paramlist p = info->type->u.f.parameters; p != NULL; p = p->next) {
+        SymbolTableEntry param = scope ? find_symbol(scope, p->name) : NULL;
+        if (!param) continue;
+        f->params[f->nparams] = param->memloc / 8 + 1;
+        use_slot(prog, f->params[f->nparams++]);
+    }
+}
+
+static bool is_function_name(ListSymbolTables tables, const char *name) {
+    SymbolTableEntry entry = find_symbol(tables->table, name);
+    return entry && entry->kind == FUNCTION && !entry->built_in;
+}
+
+static int compare_op(int opcode) {
+    switch (opcode) {
+        case O_BLT: return I_LT;
+        case O_BLE: return I_LE;
+        case O_BGT: return I_GT;
+        case O_BGE: return I_GE;
+        case O_BEQ: return I_EQ;
+        default: return I_NE;
+    }
+}
+
+static void decode_instr(interp_program *prog, struct instr *i, interp_labels *labels, interp_instr *out) {
+    memset(out, 0, sizeof(*out));
+    out->a = out->b = ZERO_CONST;
+    switch (i->opcode) {
+        case O_ADD:
+        case O_SUB:
+        case O_MUL:
+        case O_DIV:
+            out->op = i->opcode == O_ADD ? I_ADD : i->opcode == O_SUB ? I_SUB : i->opcode == O_MUL ? I_MUL : I_DIV;
+            out->dest = decode_dest(prog, i->dest);
+            // the for-loop step is the two-operand form: dest op= src1
+            if (i->src2) {
+                out->a = decode_operand(prog, i->src1);
+                out->b = decode_operand(prog, i->src2);
+            } else {
+                out->a = out->dest;
+                out->b = decode_operand(prog, i->src1);
+            }
+            break;
+        case O_ASN:
+        case O_ADDR:
+            out->op = I_ASN;
+            out->dest = decode_dest(prog, i->dest);
+            out->a = decode_operand(prog, i->src1);
+            break;
+        case O_BLT:
+        case O_BLE:
+        case O_BGT:
+        case O_BGE:
+        case O_BEQ:
+        case O_BNE:
+            if (i->src2) {
+                out->op = compare_op(i->opcode);
+                out->dest = decode_dest(prog, i->dest);
+                out->a = decode_operand(prog, i->src1);
+                out->b = decode_operand(prog, i->src2);
+            } else {
+                // gen_range: loop variable and range end; leaves the loop once the variable passes the end
+                out->op = I_GUARD;
+                out->a = decode_operand(prog, i->dest);
+                out->b = decode_operand(prog, i->src1);
+            }
+            break;
+        case O_BIF:
+            out->op = I_IF;
+            out->a = decode_operand(prog, i->dest);
+            break;
+        case O_BNIF:
+            out->op = I_ELSE;
+            break;
+        case O_GOTO:
+            out->op = I_GOTO;
+            out->target = label_find(labels, i->dest->u.name);
+            if (out->target < 0) {
+                fprintf(k0_diag(), "interp: undefined label '%s'\n", i->dest->u.name);
+                k0_fail(4);
+            }
+            break;
+        case O_PARM:
+            out->op = I_PARM;
+            out->a = decode_operand(prog, i->dest);
+            break;
+        case O_CALL:
+            if (strcmp(i->dest->u.name, "println") == 0) {
+                out->op = I_PRINTLN;
+                break;
+            }
+            out->op = I_CALL;
+            out->target = find_function(prog, i->dest->u.name);
+            if (out->target < 0) {
+                fprintf(k0_diag(), "interp: call to undefined function '%s'\n", i->dest->u.name);
+                k0_fail(4);
+            }
+            break;
+        case O_RET:
+            out->op = I_RET;
+            out->a = decode_operand(prog, i->dest);
+            break;
+        default:
+            fprintf(k0_diag(), "interp: unhandled opcode %d\n", i->opcode);
+            k0_fail(4);
+    }
+}
+
+void interp_decode(interp_program *prog, struct instr *code, struct instr *blocks, ListSymbolTables tables) {
+    memset(prog, 0, sizeof(*prog));
+    prog->frame_size = TEMP_SLOT + 1;
+    k0_value zero = { .kind = V_INT };
+    add_const(prog, zero);
+
+    // first pass: instruction indices of labels and function entries
+    size_t nlabels = 0;
+    int count = 0;
+    struct instr *lists[] = { code, blocks };
+    for (int l = 0; l < 2; l++) {
+        for (struct instr *i = lists[l]; i != NULL; i = i->next) {
+            if (i->opcode == D_LABEL) nlabels++;
+            else if (!decodes_to_nothing(i)) count++;
+        }
+    }
+    interp_labels labels = { .cap = 16 };
+    while (labels.cap < nlabels * 2) labels.cap *= 2;
+    labels.slots = calloc(labels.cap, sizeof(interp_label));
+    count = 0;
+    for (int l = 0; l < 2; l++) {
+        for (struct instr *i = lists[l]; i != NULL; i = i->next) {
+            if (i->opcode == D_LABEL) {
+                label_define(&labels, i->dest->u.name, count);
+                if (is_function_name(tables, i->dest->u.name)) add_function(prog, tables, i->dest->u.name, count);
+            } else if (!decodes_to_nothing(i)) {
+                count++;
+            }
+        }
+    }
+
+    // second pass: decode, plus a final return for code that runs off the end
+    prog->code = malloc((count + 1) * sizeof(interp_instr));
+    for (int l = 0; l < 2; l++) {
+        for (struct instr *i = lists[l]; i != NULL; i = i->next) {
+            if (!decodes_to_nothing(i)) decode_instr(prog, i, &labels, &prog->code[prog->ncode++]);
+        }
+    }
+    memset(&prog->code[prog->ncode], 0, sizeof(interp_instr));
+    prog->code[prog->ncode].op = I_RET;
+    prog->code[prog->ncode].a = ZERO_CONST;
+    prog->ncode++;
+    free(labels.slots);
+}
+
+static bool truthy(k0_value v) {
+    return v.kind == V_DOUBLE ? v.u.d != 0.0 : v.kind == V_STRING ? v.u.s != NULL : v.u.i != 0;
+}
+
+// mixed and Double operands; the all-Int case is inline in the dispatch loop
+static k0_value arith_slow(int op, k0_value x, k0_value y) {
+    k0_value r = { .kind = V_DOUBLE };
+    if (x.kind == V_STRING || y.kind == V_STRING) runtime_error("arithmetic on a String");
+    if (x.kind != V_DOUBLE && y.kind != V_DOUBLE) {
+        // Char operands behave as their code
+        r.kind = V_INT;
+        switch (op) {
+            case I_ADD: r.u.i = x.u.i + y.u.i; break;
+            case I_SUB: r.u.i = x.u.i - y.u.i; break;
+            case I_MUL: r.u.i = x.u.i * y.u.i; break;
+            default:
+                if (y.u.i == 0) runtime_error("division by zero");
+                r.u.i = x.u.i / y.u.i;
+                break;
+        }
+        return r;
+    }
+    double a = x.kind == V_DOUBLE ? x.u.d : (double)x.u.i;
+    double b = y.kind == V_DOUBLE ? y.u.d : (double)y.u.i;
+    switch (op) {
+        case I_ADD: r.u.d = a + b; break;
+        case I_SUB: r.u.d = a - b; break;
+        case I_MUL: r.u.d = a * b; break;
+        default: r.u.d = a / b; break;
+    }
+    return r;
+}
+
+static bool compare_slow(int op, k0_value x, k0_value y) {
+    if (x.kind == V_STRING || y.kind == V_STRING) {
+        int c = x.kind == y.kind ? strcmp(x.u.s, y.u.s) : 1;
+        if (op == I_EQ) return c == 0;
+        if (op == I_NE) return c != 0;
+        runtime_error("ordering comparison on a String");
+    }
+    double a = x.kind == V_DOUBLE ? x.u.d : (double)x.u.i;
+    double b = y.kind == V_DOUBLE ? y.u.d : (double)y.u.i;
+    switch (op) {
+        case I_LT: return a < b;
+        case I_LE: return a <= b;
+        case I_GT: return a > b;
+        case I_GE: return a >= b;
+        case I_EQ: return a == b;
+        default: return a != b;
+    }
+}
+
+static void println_value(k0_value v) {
+    switch (v.kind) {
+        case V_DOUBLE: printf("%f\n", v.u.d); break;
+        case V_CHAR: printf("%c\n", (int)v.u.i); break;
+        case V_STRING: printf("%s\n", v.u.s); break;
+        default: printf("%ld\n", v.u.i); break;
+    }
+}
+
+int interp_execute(interp_program *prog, long *executed) {
+    static const void *dispatch[I_NOPS] = {
+        [I_ADD] = &&op_add, [I_SUB] = &&op_sub, [I_MUL] = &&op_mul, [I_DIV] = &&op_div,
+        [I_ASN] = &&op_asn,
+        [I_LT] = &&op_lt, [I_LE] = &&op_le, [I_GT] = &&op_gt, [I_GE] = &&op_ge,
+        [I_EQ] = &&op_eq, [I_NE] = &&op_ne,
+        [I_GUARD] = &&op_guard, [I_IF] = &&op_if, [I_ELSE] = &&op_else, [I_GOTO] = &&op_goto,
+        [I_PARM] = &&op_parm, [I_CALL] = &&op_call, [I_PRINTLN] = &&op_println, [I_RET] = &&op_ret
+    };
+    int main_index = find_function(prog, "main");
+    if (main_index < 0) {
+        fprintf(k0_diag(), "Error: no main function to run\n");
+        k0_fail(4);
+    }
+    for (int i = 0; i < prog->ncode; i++) prog->code[i].handler = dispatch[prog->code[i].op];
+
+    interp_instr *code = prog->code;
+    k0_value *consts = prog->consts;
+    interp_function *funcs = prog->funcs;
+    int frame_size = prog->frame_size;
+    k0_value *stack = calloc(INTERP_STACK_SLOTS, sizeof(k0_value));
+    k0_value *stack_limit = stack + INTERP_STACK_SLOTS - frame_size;
+    interp_frame *calls = malloc(INTERP_MAX_DEPTH * sizeof(interp_frame));
+    k0_value args[INTERP_MAX_ARGS];
+    int nargs = 0;
+    int depth = 0;
+    bool cond = false;
+    long count = 0;
+    k0_value *fp = stack;
+    interp_instr *pc = code + funcs[main_index].entry;
+    k0_value x, y, result;
+
+#define VAL(r) ((r) >= 0 ? fp[(r)] : consts[-1 - (r)])
+#define DISPATCH() do { count++; goto *pc->handler; } while (0)
+#define BINARY_INT(op_name, expr) \
+    op_name: \
+        x = VAL(pc->a); \
+        y = VAL(pc->b); \
+        if (x.kind == V_INT && y.kind == V_INT) { \
+            fp[pc->dest].kind = V_INT; \
+            fp[pc->dest].u.i = (expr); \
+        } else { \
+            fp[pc->dest] = arith_slow(pc->op, x, y); \
+        } \
+        pc++; \
+        DISPATCH();
+#define COMPARE(op_name, rel) \
+    op_name: \
+        x = VAL(pc->a); \
+        y = VAL(pc->b); \
+        fp[pc->dest].kind = V_INT; \
+        fp[pc->dest].u.i = x.kind == V_INT && y.kind == V_INT ? x.u.i rel y.u.i : compare_slow(pc->op, x, y); \
+        pc++; \
+        DISPATCH();
+
+    DISPATCH();
+
+    // wrap like the native 64-bit instructions instead of overflowing a signed long
+    BINARY_INT(op_add, (long)((unsigned long)x.u.i + (unsigned long)y.u.i))
+    BINARY_INT(op_sub, (long)((unsigned long)x.u.i - (unsigned long)y.u.i))
+    BINARY_INT(op_mul, (long)((unsigned long)x.u.i * (unsigned long)y.u.i))
+op_div:
+    x = VAL(pc->a);
+    y = VAL(pc->b);
+    if (x.kind == V_INT && y.kind == V_INT) {
+        if (y.u.i == 0) runtime_error("division by zero");
+        fp[pc->dest].kind = V_INT;
+        fp[pc->dest].u.i = y.u.i == -1 ? (long)(0UL - (unsigned long)x.u.i) : x.u.i / y.u.i;
+    } else {
+        fp[pc->dest] = arith_slow(I_DIV, x, y);
+    }
+    pc++;
+    DISPATCH();
+op_asn:
+    fp[pc->dest] = VAL(pc->a);
+    pc++;
+    DISPATCH();
+    COMPARE(op_lt, <)
+    COMPARE(op_le, <=)
+    COMPARE(op_gt, >)
+    COMPARE(op_ge, >=)
+    COMPARE(op_eq, ==)
+    COMPARE(op_ne, !=)
+op_guard:
+    pc += compare_slow(I_GT, VAL(pc->a), VAL(pc->b)) ? 2 : 1;
+    DISPATCH();
+op_if:
+    // "if c" guards the goto that follows it
+    cond = truthy(VAL(pc->a));
+    pc += cond ? 1 : 2;
+    DISPATCH();
+op_else:
+    pc += cond ? 2 : 1;
+    DISPATCH();
+op_goto:
+    pc = code + pc->target;
+    DISPATCH();
+op_parm:
+    if (nargs == INTERP_MAX_ARGS) runtime_error("too many call arguments");
+    args[nargs++] = VAL(pc->a);
+    pc++;
+    DISPATCH();
+op_call: {
+    interp_function *f = &funcs[pc->target];
+    if (depth == INTERP_MAX_DEPTH || fp + frame_size > stack_limit) runtime_error("stack overflow");
+    calls[depth].pc = pc + 1;
+    calls[depth].fp = fp;
+    depth++;
+    fp += frame_size;
+    memset(fp, 0, frame_size * sizeof(k0_value));
+    // parms arrive last argument first
+    for (int i = 0; i < f->nparams && i < nargs; i++) fp[f->params[i]] = args[nargs - 1 - i];
+    nargs = 0;
+    pc = code + f->entry;
+    DISPATCH();
+}
+op_println:
+    if (nargs > 0) println_value(args[0]);
+    else putchar('\n');
+    nargs = 0;
+    pc++;
+    DISPATCH();
+op_ret:
+    result = VAL(pc->a);
+    if (depth == 0) goto done;
+    depth--;
+    fp = calls[depth].fp;
+    pc = calls[depth].pc;
+    fp[TEMP_SLOT] = result;
+    DISPATCH();
+
+#undef VAL
+#undef DISPATCH
+#undef BINARY_INT
+#undef COMPARE
+
+done:
+    fflush(stdout);
+    free(stack);
+    free(calls);
+    *executed = count;
+    return result.kind == V_DOUBLE || result.kind == V_STRING ? 0 : (int)result.u.i;
+}
+
+void interp_free(interp_program *prog) {
+    for (int i = 0; i < prog->nconsts; i++) {
+        if (prog->consts[i].kind == V_STRING) free((char *)prog->consts[i].u.s);
+    }
+    for (int i = 0; i < prog->nfuncs; i++) free(prog->funcs[i].params);
+    free(prog->consts);
+    free(prog->funcs);
+    free(prog->code);
+}
+
+static double seconds_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int interp_run(struct instr *code, struct instr *blocks, ListSymbolTables tables) {
+    interp_program prog;
+    interp_decode(&prog, code, blocks, tables);
+    long executed = 0;
+    double start = seconds_now();
+    int status = interp_execute(&prog, &executed);
+    double elapsed = seconds_now() - start;
+    fprintf(k0_diag(), "interp: %ld instructions in %.3f s (%.0f instructions/s)\n",
+            executed, elapsed, elapsed > 0 ? executed / elapsed : 0.0);
+    interp_free(&prog);
+    return status;
+}
@@ -0,0 +1,56 @@
+#ifndef INTERP_H
+#define INTERP_H
+
+#include <stdbool.h>
+#include "tac.h"
+#include "symtab.h"
+
+/* Values held in interpreter frames */
+#define V_INT    0
+#define V_DOUBLE 1
+#define V_CHAR   2
+#define V_STRING 3
+
+typedef struct k0_value {
+    union {
+        long i;
+        double d;
+        const char *s;
+    } u;
+    int kind;
+} k0_value;
+
+/* Pre-decoded instruction: operands are frame slots (>= 0) or constants (-1 - index) */
+typedef struct interp_instr {
+    const void *handler;   /* dispatch target, filled in when the program starts */
+    int op;
+    int dest, a, b;
+    int target;            /* instruction index for jumps, function index for calls */
+} interp_instr;
+
+typedef struct interp_function {
+    char *name;
+    int entry;
+    int nparams;
+    int *params;           /* frame slot of each parameter, in source order */
+} interp_function;
+
+typedef struct interp_program {
+    interp_instr *code;
+    int ncode;
+    k0_value *consts;
+    int nconsts;
+    interp_function *funcs;
+    int nfuncs;
+    int frame_size;
+} interp_program;
+
+/* Decode the instruction lists generate_code() produced (code first, then the block list) */
+void interp_decode(interp_program *prog, struct instr *code, struct instr *blocks, ListSymbolTables tables);
+/* Run main and return its result; counts executed instructions into *executed */
+int interp_execute(interp_program *prog, long *executed);
+void interp_free(interp_program *prog);
+/* Decode, run and report instructions per second on stderr */
+int interp_run(struct instr *code, struct instr *blocks, ListSymbolTables tables);
+
+#endif
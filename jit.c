@@ -0,0 +1,197 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <elf.h>
+#include <sys/mman.h>
+#include "jit.h"
+#include "k0ctx.h"
+
+#define STUB_SIZE 16
+
+/* entry thunk: keeps the callee-saved registers k0 code clobbers and realigns the stack */
+static const unsigned char entry_prologue[] = {
+    0x53,                   /* push %rbx */
+    0x55,                   /* push %rbp */
+    0x41, 0x54,             /* push %r12 */
+    0x41, 0x55,             /* push %r13 */
+    0x41, 0x56,             /* push %r14 */
+    0x41, 0x57,             /* push %r15 */
+    0x48, 0x83, 0xec, 0x08, /* sub $8, %rsp */
+    0xe8                    /* call main (rel32 follows) */
+};
+
+static const unsigned char entry_epilogue[] = {
+    0x48, 0x83, 0xc4, 0x08, /* add $8, %rsp */
+    0x41, 0x5f,             /* pop %r15 */
+    0x41, 0x5e,             /* pop %r14 */
+    0x41, 0x5d,             /* pop %r13 */
+    0x41, 0x5c,             /* pop %r12 */
+    0x5d,                   /* pop %rbp */
+    0x5b,                   /* pop %rbx */
+    0xc3                    /* ret */
+};
+
+#define ENTRY_SIZE (sizeof(entry_prologue) + 4 + sizeof(entry_epilogue))
+
+typedef struct jit_stub {
+    const char *name;
+    unsigned char *addr;
+    struct jit_stub *next;
+} jit_stub;
+
+static size_t page_round(size_t size) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    return (size + page - 1) / page * page;
+}
+
+// runtime symbols k0 code may call; anything else is looked up in the process
+static void *resolve_runtime(const char *name) {
+    if (strcmp(name, "printf") == 0) return (void *)printf;
+    return dlsym(RTLD_DEFAULT, name);
+}
+
+static jit_stub *find_stub(jit_stub *stubs, const char *name) {
+    for (; stubs != NULL; stubs = stubs->next) {
+        if (strcmp(stubs->name, name) == 0) return stubs;
+    }
+    return NULL;
+}
+
+static void patch32(unsigned char *at, long value, const char *symbol) {
+    if (value < -2147483648L || value > 2147483647L) {
+        fprintf(k0_diag(), "Error: relocation against '%s' out of range\n", symbol);
+        k0_fail(4);
+    }
+    int v = (int)value;
+    memcpy(at, &v, 4);
+}
+
+// branch labels come from create_label_name(); anything else in .text is a function
+static bool is_function_symbol(elf_symbol *sym) {
+    int n;
+    char c;
+    return sym->section == ELF_TEXT && sscanf(sym->name, "label%d%c", &n, &c) != 1;
+}
+
+// /tmp/perf-<pid>.map lets perf report name JIT-compiled functions
+static void write_perf_map(elf_object *obj, unsigned char *entry, unsigned char *text) {
+    char name[64];
+    snprintf(name, sizeof(name), "/tmp/perf-%d.map", getpid());
+    FILE *map = fopen(name, "w");
+    if (!map) {
+        perror("Error opening perf map");
+        return;
+    }
+    fprintf(map, "%lx %lx k0_entry\n", (unsigned long)entry, (unsigned long)ENTRY_SIZE);
+    for (elf_symbol *sym = obj->symbols; sym != NULL; sym = sym->next) {
+        if (!is_function_symbol(sym)) continue;
+        size_t end = obj->text.size;
+        for (elf_symbol *other = obj->symbols; other != NULL; other = other->next) {
+            if (is_function_symbol(other) && other->value > sym->value && other->value < end) end = other->value;
+        }
+        fprintf(map, "%lx %lx %s\n", (unsigned long)(text + sym->value), (unsigned long)(end - sym->value), sym->name);
+    }
+    fclose(map);
+}
+
+int jit_run(elf_object *obj, bool perf_map) {
+    elf_symbol *main_sym = elf_find_symbol(obj, "main");
+    if (!main_sym || main_sym->section != ELF_TEXT) {
+        fprintf(k0_diag(), "Error: no main function to run\n");
+        k0_fail(4);
+    }
+
+    // one stub per external symbol, so calls reach it with a rel32 whatever its address
+    jit_stub *stubs = NULL;
+    size_t nstubs = 0;
+    for (elf_reloc *r = obj->relocs; r != NULL; r = r->next) {
+        if (elf_find_symbol(obj, r->symbol) || find_stub(stubs, r->symbol)) continue;
+        jit_stub *stub = calloc(1, sizeof(jit_stub));
+        stub->name = r->symbol;
+        stub->next = stubs;
+        stubs = stub;
+        nstubs++;
+    }
+
+    // absolute R_X86_64_32S references need everything in the low 2GB
+    size_t code_size = page_round(ENTRY_SIZE + obj->text.size + nstubs * STUB_SIZE);
+    size_t rodata_size = page_round(obj->rodata.size);
+    size_t data_size = page_round(obj->data.size);
+    size_t total = code_size + rodata_size + data_size;
+    unsigned char *base = mmap(NULL, total, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+    if (base == MAP_FAILED) {
+        perror("Error mapping JIT memory");
+        k0_fail(4);
+    }
+    unsigned char *entry = base;
+    unsigned char *text = base + ENTRY_SIZE;
+    unsigned char *stub_area = text + obj->text.size;
+    unsigned char *rodata = base + code_size;
+    unsigned char *data = rodata + rodata_size;
+    memcpy(text, obj->text.bytes, obj->text.size);
+    if (obj->rodata.size) memcpy(rodata, obj->rodata.bytes, obj->rodata.size);
+    if (obj->data.size) memcpy(data, obj->data.bytes, obj->data.size);
+
+    unsigned char *p = entry;
+    memcpy(p, entry_prologue, sizeof(entry_prologue));
+    p += sizeof(entry_prologue);
+    patch32(p, (long)(text + main_sym->value) - (long)(p + 4), "main");
+    p += 4;
+    memcpy(p, entry_epilogue, sizeof(entry_epilogue));
+
+    unsigned char *stub_at = stub_area;
+    for (jit_stub *stub = stubs; stub != NULL; stub = stub->next, stub_at += STUB_SIZE) {
+        void *target = resolve_runtime(stub->name);
+        if (!target) {
+            fprintf(k0_diag(), "Error: undefined symbol '%s'\n", stub->name);
+            k0_fail(4);
+        }
+        // jmp *0(%rip) followed by the 64-bit target
+        static const unsigned char jmp_indirect[] = { 0xff, 0x25, 0x00, 0x00, 0x00, 0x00 };
+        memcpy(stub_at, jmp_indirect, sizeof(jmp_indirect));
+        memcpy(stub_at + sizeof(jmp_indirect), &target, sizeof(target));
+        stub->addr = stub_at;
+    }
+
+    unsigned char *section_base[] = { NULL, text, data, rodata };
+    for (elf_reloc *r = obj->relocs; r != NULL; r = r->next) {
+        elf_symbol *sym = elf_find_symbol(obj, r->symbol);
+        long s = sym ? (long)(section_base[sym->section] + sym->value) : (long)find_stub(stubs, r->symbol)->addr;
+        unsigned char *at = text + r->offset;
+        switch (r->type) {
+            case R_X86_64_32S:
+                patch32(at, s + r->addend, r->symbol);
+                break;
+            case R_X86_64_PC32:
+            case R_X86_64_PLT32:
+                patch32(at, s + r->addend - (long)at, r->symbol);
+                break;
+            default:
+                fprintf(k0_diag(), "Error: unsupported relocation type %d\n", r->type);
+                k0_fail(4);
+        }
+    }
+
+    if (mprotect(base, code_size, PROT_READ | PROT_EXEC) != 0 ||
+        (rodata_size && mprotect(rodata, rodata_size, PROT_READ) != 0)) {
+        perror("Error protecting JIT memory");
+        k0_fail(4);
+    }
+    if (perf_map) write_perf_map(obj, entry, text);
+
+    int (*run)(void) = (int (*)(void))entry;
+    int status = run();
+    fflush(stdout);
+
+    munmap(base, total);
+    while (stubs) {
+        jit_stub *next = stubs->next;
+        free(stubs);
+        stubs = next;
+    }
+    return status;
+}
@@ -0,0 +1,10 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <stdbool.h>
+#include "elfobj.h"
+
+/* Load an encoded object into executable memory, run its main and return the exit code */
+int jit_run(elf_object *obj, bool perf_map);
+
+#endif
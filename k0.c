@@ -0,0 +1,215 @@
+#include <stdlib.h>
+#include <string.h>
+#include "k0ctx.h"
+#include "tree.h"
+#include "lower.h"
+#include "k0gram.h"
+#include "symtab.h"
+#include "ic.h"
+#include "elfobj.h"
+#include "timing.h"
+#include "diag.h"
+#include "chunk.h"
+#include "scanner.h"
+
+extern struct symbol_table_list* create_symtabs(struct tree*, int print, int free);
+extern void tac2asm_stream(FILE *ic, FILE *S);
+extern void tac2elf_stream(FILE *ic, elf_object *obj);
+
+_Thread_local k0_context *k0_current = NULL;
+
+void k0_use(k0_context *ctx) {
+    k0_current = ctx;
+}
+
+k0_context *k0_get(void) {
+    if (!k0_current) k0_current = k0_create();
+    return k0_current;
+}
+
+FILE *k0_diag(void) {
+    return k0_current && k0_current->diag ? k0_current->diag : stderr;
+}
+
+FILE *k0_out(void) {
+    return k0_current && k0_current->out ? k0_current->out : stdout;
+}
+
+void k0_fail(int code) {
+    if (k0_current && k0_current->recovering) {
+        longjmp(k0_current->recover, code);
+    }
+    exit(code);
+}
+
+// report errors from k0lex.l
+// under the error limit the lexer goes on after the bad token
+void lexical_error(const char *format, const char *token, int line) {
+    char message[512];
+    snprintf(message, sizeof(message), format, token, line);
+    diag_error(DIAG_LEXICAL, NULL, line, "%s in file %s.", message, k0_get()->current_file);
+}
+
+// report errors from k0gram.y; under the error limit bison recovers on its error productions
+void syntax_error(const char *token, int yychar, int line) {
+    diag_error(DIAG_SYNTAX, NULL, line, "Unexpected token '%s' (code %d) on line %d in file %s.", token, yychar, line, k0_get()->current_file);
+}
+
+k0_context *k0_create(void) {
+    k0_context *ctx = calloc(1, sizeof(k0_context));
+    if (!ctx) {
+        perror("Memory allocation failed");
+        exit(4);
+    }
+    ctx->require_main = true;
+    ctx->error_limit = 1;
+    return ctx;
+}
+
+// drop everything the previous compilation on ctx produced
+static void k0_reset(k0_context *ctx) {
+    for (int i = 0; i < 4; i++) {
+        if (ctx->streams[i]) fclose(ctx->streams[i]);
+        ctx->streams[i] = NULL;
+    }
+    scanner_destroy(ctx->scanner);
+    ctx->scanner = NULL;
+    if (ctx->diag) fclose(ctx->diag);
+    ctx->diag = NULL;
+    free(ctx->diag_buf);
+    free(ctx->ic_buf);
+    free(ctx->asm_buf);
+    free(ctx->obj_buf);
+    ctx->diag_buf = ctx->ic_buf = ctx->asm_buf = ctx->obj_buf = NULL;
+    ctx->diag_len = ctx->ic_len = ctx->asm_len = ctx->obj_len = 0;
+    // a parse that failed left its nodes on bison's stack
+    free_parse_nodes(ctx);
+    free_tree(ctx->root);
+    ctx->root = NULL;
+    free_symtab(ctx->symtabs);
+    free_token_text(ctx->token_text);
+    ctx->token_text = NULL;
+    ctx->token_file = NULL;
+    ic_state_free(ctx->ic);
+    ctx->ic = NULL;
+    tac2asm_state_free(ctx->tac2asm);
+    ctx->tac2asm = NULL;
+    ctx->serial = 0;
+    ctx->labelcounter = 0;
+    ctx->errors = 0;
+    ctx->first_error = 0;
+    ctx->resume = NULL;
+    diag_free(ctx->deferred);
+    ctx->deferred = NULL;
+}
+
+void k0_destroy(k0_context *ctx) {
+    if (!ctx) return;
+    k0_context *saved = k0_current;
+    k0_use(ctx);
+    k0_reset(ctx);
+    free(ctx->current_file);
+    timing_state_free(ctx->timing);
+    k0_use(saved == ctx ? NULL : saved);
+    free(ctx);
+}
+
+struct tree *k0_parse(k0_context *ctx, const char *source, size_t length, bool in_place) {
+    int result = 0;
+    phase_begin(PHASE_PARSE);
+    // with threads the functions are parsed and lowered in chunks; a file that cannot be is parsed whole
+    struct tree *lowered = ctx->threads > 1 ? parse_chunks(ctx, source, length) : NULL;
+    if (!lowered) {
+        ctx->scanner = scanner_create(ctx);
+        scanner_source(ctx->scanner, source, length, in_place, 1);
+        track_parse_nodes(ctx);
+        result = yyparse(ctx->scanner, ctx);
+        untrack_parse_nodes(ctx);
+        scanner_destroy(ctx->scanner);
+        ctx->scanner = NULL;
+    }
+    phase_end(PHASE_PARSE);
+    // the tree of a file with errors is not worth checking
+    diag_check();
+    if (result != 0) {
+        fprintf(k0_diag(), "Parsing failed for file: %s\n", ctx->current_file);
+        k0_fail(2);
+    }
+    ctx->root = lowered ? lowered : lower_tree(ctx->root);
+    return ctx->root;
+}
+
+// the memory stream is closed on success, or by k0_reset() after a failure
+static FILE *open_stream(k0_context *ctx, int slot, char **buf, size_t *len) {
+    FILE *fp = open_memstream(buf, len);
+    if (!fp) {
+        perror("Error opening memory stream");
+        k0_fail(4);
+    }
+    ctx->streams[slot] = fp;
+    return fp;
+}
+
+static void close_stream(k0_context *ctx, int slot) {
+    fclose(ctx->streams[slot]);
+    ctx->streams[slot] = NULL;
+}
+
+int k0_compile(k0_context *ctx, const char *file_name, const char *source, size_t length, int emit) {
+    k0_context *saved = k0_current;
+    k0_use(ctx);
+    k0_reset(ctx);
+    free(ctx->current_file);
+    ctx->current_file = strdup(file_name);
+    ctx->diag = open_memstream(&ctx->diag_buf, &ctx->diag_len);
+
+    int code = setjmp(ctx->recover);
+    if (code == 0) {
+        ctx->recovering = true;
+        k0_parse(ctx, source, length, false);
+        ListSymbolTables tables = create_symtabs(ctx->root, 0, 0);
+        write_ic(open_stream(ctx, 0, &ctx->ic_buf, &ctx->ic_len), tables, ctx->root);
+        close_stream(ctx, 0);
+        if (emit & K0_EMIT_ASM) {
+            ctx->streams[1] = fmemopen(ctx->ic_buf, ctx->ic_len, "r");
+            tac2asm_stream(ctx->streams[1], open_stream(ctx, 2, &ctx->asm_buf, &ctx->asm_len));
+            close_stream(ctx, 1);
+            close_stream(ctx, 2);
+        }
+        if (emit & K0_EMIT_OBJ) {
+            elf_object obj;
+            elf_init(&obj);
+            ctx->streams[1] = fmemopen(ctx->ic_buf, ctx->ic_len, "r");
+            tac2elf_stream(ctx->streams[1], &obj);
+            elf_write_stream(&obj, open_stream(ctx, 3, &ctx->obj_buf, &ctx->obj_len));
+            elf_free(&obj);
+            close_stream(ctx, 1);
+            close_stream(ctx, 3);
+        }
+    }
+    ctx->recovering = false;
+    fflush(ctx->diag);
+    k0_use(saved);
+    return code;
+}
+
+const char *k0_ic(k0_context *ctx, size_t *length) {
+    if (length) *length = ctx->ic_len;
+    return ctx->ic_buf;
+}
+
+const char *k0_asm(k0_context *ctx, size_t *length) {
+    if (length) *length = ctx->asm_len;
+    return ctx->asm_buf;
+}
+
+const char *k0_object(k0_context *ctx, size_t *length) {
+    if (length) *length = ctx->obj_len;
+    return ctx->obj_buf;
+}
+
+const char *k0_diagnostics(k0_context *ctx, size_t *length) {
+    if (ctx->diag) fflush(ctx->diag);
+    if (length) *length = ctx->diag_len;
+    return ctx->diag_buf;
+}
@@ -0,0 +1,32 @@
+#ifndef K0_H
+#define K0_H
+
+#include <stddef.h>
+
+/*
+ * libk0: compile k0 source held in memory to intermediate code and assembly
+ * held in memory. Each k0_context owns all state of one compilation, so
+ * separate contexts may be used concurrently from different threads.
+ */
+typedef struct k0_context k0_context;
+
+/* Outputs k0_compile() can produce; the IC is always produced */
+#define K0_EMIT_IC  1
+#define K0_EMIT_ASM 2
+#define K0_EMIT_OBJ 4
+
+k0_context *k0_create(void);
+void k0_destroy(k0_context *ctx);
+
+/*
+ * Compile one source buffer. Returns 0 on success, otherwise the exit code
+ * the k0 command would use: 1 lexical, 2 syntax, 3 semantic, 4 other.
+ * Outputs and diagnostics stay valid until the next call on ctx.
+ */
+int k0_compile(k0_context *ctx, const char *file_name, const char *source, size_t length, int emit);
+const char *k0_ic(k0_context *ctx, size_t *length);
+const char *k0_asm(k0_context *ctx, size_t *length);
+const char *k0_object(k0_context *ctx, size_t *length);
+const char *k0_diagnostics(k0_context *ctx, size_t *length);
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef K0CTX_H
+#define K0CTX_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <setjmp.h>
+#include "k0.h"
+
+struct tree;
+struct ic_state;
+struct tac2asm_state;
+struct timing_state;
+struct diagnostic;
+struct scanner;
+struct symbol_table_list;
+
+/* Everything one compilation used to keep in process globals */
+struct k0_context {
+    struct scanner *scanner;        /* while parsing, see scanner.h */
+    struct tree *root;              /* syntax tree from the last parse */
+    struct symbol_table_list *symtabs; /* from create_symtabs() until free_symtab() */
+    struct text_block *token_text;  /* owned by tree.c; text of the tokens of root */
+    char *token_file;               /* current_file as kept in token_text */
+    struct tree **parse_nodes;      /* owned by tree.c; nodes of the parse running, see tree.h */
+    int nparse_nodes;
+    int maxparse_nodes;
+    bool tracking_nodes;
+    char *current_file;             /* file name recorded in tokens and diagnostics */
+    int serial;                     /* next tree node id */
+    int labelcounter;               /* next IC label number */
+    int last_token;                 /* lookahead token, for syntax errors */
+    bool require_main;
+    bool function_cache;            /* reuse the IC of unchanged functions from the build cache */
+    struct ic_state *ic;            /* owned by ic.c */
+    struct tac2asm_state *tac2asm;  /* owned by tac2asm.c */
+    struct timing_state *timing;    /* owned by timing.c; NULL unless -ftime-report */
+
+    FILE *diag;                     /* diagnostics; NULL writes to stderr */
+    FILE *out;                      /* what semantic checks print; NULL writes to stdout */
+    char *diag_buf;
+    size_t diag_len;
+    char *ic_buf;
+    size_t ic_len;
+    char *asm_buf;
+    size_t asm_len;
+    char *obj_buf;
+    size_t obj_len;
+    FILE *streams[4];               /* memory streams to close if compilation fails */
+
+    bool recovering;                /* k0_fail() returns to recover instead of exiting */
+    jmp_buf recover;
+
+    int error_limit;                /* errors before the compile stops; 0 for no limit */
+    int errors;                     /* errors reported so far, see diag.h */
+    int first_error;                /* exit code of the first of them */
+    bool diag_json;                 /* -fdiagnostics-format=json */
+    jmp_buf *resume;                /* where diag_error() goes on after an error under the limit */
+    bool defer_diagnostics;         /* keep errors for diag_take() instead of printing them */
+    struct diagnostic *deferred;
+    int threads;                    /* threads for per-function work; 1 or less runs it in line */
+    int lexer_engine;               /* LEXER_FLEX or LEXER_FAST, see scanner.h */
+};
+
+/* Context of the compilation running on this thread */
+extern _Thread_local k0_context *k0_current;
+
+/* Make ctx the current context; k0_get() creates one if none is set */
+void k0_use(k0_context *ctx);
+k0_context *k0_get(void);
+
+/* Where error messages and the output of semantic checks go, and how a compilation stops after an error */
+FILE *k0_diag(void);
+FILE *k0_out(void);
+void k0_fail(int code) __attribute__((noreturn));
+
+/*
+ * Parse the length bytes at source into ctx->root. With in_place they are
+ * writable and followed by two NUL bytes, as a mapped file is, and the
+ * scanner reads them where they are instead of from a copy.
+ */
+struct tree *k0_parse(k0_context *ctx, const char *source, size_t length, bool in_place);
+
+void ic_state_free(struct ic_state *state);
+void tac2asm_state_free(struct tac2asm_state *state);
+void timing_state_free(struct timing_state *state);
+
+#endif
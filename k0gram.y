@@ -1,24 +1,43 @@
+%code requires {
+#ifndef YY_TYPEDEF_YY_SCANNER_T
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void *yyscan_t;
+#endif
+struct k0_context;
+}
+
 %{
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "tree.h"
-
-extern int yylex();
-extern int yylineno;
-extern char *yytext;
-void yyerror(const char *s);
-extern void syntax_error(const char *token, int yychar, int line);
-struct tree *root; // root of the syntax tree
+#include "k0ctx.h"
+#include "diag.h"
 %}
 
+%define api.pure full
+%param {yyscan_t scanner}
+%parse-param {struct k0_context *ctx}
+
 %union {
    struct tree *treeptr;
 };
 
-%token <treeptr> NL BREAK CONTINUE DO ELSE FOR FUN IF IN RETURN VAL VAR WHEN WHILE IMPORT CONST TYPE ARRAY_TYPE BAD_RW BAD_MODIFIERS DOT COMMA LPAREN RPAREN LSQUARE RSQUARE LCURL RCURL COLON SEMICOLON BAD_PUNC ASSIGNMENT ADD_ASSIGNMENT SUB_ASSIGNMENT ADD SUB MULT DIV MOD INCR DECR EQEQ NOT_EQ LANGLE RANGLE LE GE EQEQEQ NOT_EQEQ CONJ DISJ NOT NOT_NULL_ASSERTION SUBSCRIPT_DOT SAFE_CALL ELVIS NULLABLE RANGE RANGE_UNTIL TYPE_CAST BAD_OPS BAD_TOKEN BooleanLiteral NullLiteral IntegerLiteral DoubleLiteral FloatLiteral CharacterLiteral StringLiteral MultilineStringLiteral Identifier FieldIdentifier ArrayLiteral BinLiteral OctalLiteral UnsignedLiteral RealScientificLiteral InvalidCharacterLiteral
+// subtrees dropped while recovering from a syntax error
+%destructor { free_tree($$); } <treeptr>
 
-%type <treeptr> program topLevelObjectList importSection importList importDeclaration importName functionSection functionList functionDeclaration funcParamSection funcParamList funcParam typeDeclaration type block statements statement globalVarsSection globalVarsList controlStructure ifStruc controlCondition elseIfList else whileLoop forLoop forCondition range rangeParam returnStatement declaration assignment varDec expression functionCall safeCall funcCallParamList memberAccess eol optionalSemi nl_star
+%code {
+#include "scanner.h"
+// scanner is the struct scanner of scanner.h, on either lexer engine
+#define yylex scanner_lex
+void yyerror(yyscan_t scanner, struct k0_context *ctx, const char *s);
+extern void syntax_error(const char *token, int yychar, int line);
+}
+
+%token NL
+%token <treeptr> BREAK CONTINUE DO ELSE FOR FUN IF IN RETURN VAL VAR WHEN WHILE IMPORT CONST TAILREC TYPE ARRAY_TYPE BAD_RW BAD_MODIFIERS DOT COMMA LPAREN RPAREN LSQUARE RSQUARE LCURL RCURL COLON SEMICOLON BAD_PUNC ASSIGNMENT ADD_ASSIGNMENT SUB_ASSIGNMENT ADD SUB MULT DIV MOD INCR DECR EQEQ NOT_EQ LANGLE RANGLE LE GE EQEQEQ NOT_EQEQ CONJ DISJ NOT NOT_NULL_ASSERTION SUBSCRIPT_DOT SAFE_CALL ELVIS NULLABLE RANGE RANGE_UNTIL TYPE_CAST BAD_OPS BAD_TOKEN BooleanLiteral NullLiteral IntegerLiteral DoubleLiteral FloatLiteral CharacterLiteral StringLiteral MultilineStringLiteral Identifier FieldIdentifier ArrayLiteral BinLiteral OctalLiteral UnsignedLiteral RealScientificLiteral InvalidCharacterLiteral
+
+%type <treeptr> topLevelObjectList importSection importList importDeclaration importName functionSection functionList functionDeclaration funcParamSection funcParamList funcParam typeDeclaration type block statements statement globalVarsSection globalVarsList controlStructure ifStruc controlCondition elseIfList else whileLoop forLoop forCondition range rangeParam returnStatement declaration assignment varDec expression functionCall safeCall funcCallParamList memberAccess eol optionalSemi
 
 // silence conflicts
 %expect 59
@@ -36,7 +55,7 @@ struct tree *root; // root of the syntax tree
 %%
 
 program:
-    topLevelObjectList { root = $1; }
+    topLevelObjectList { ctx->root = $1; }
     ;
 
 topLevelObjectList:
@@ -49,7 +68,7 @@ importSection:
     ;
 
 importList:
-    importList importDeclaration eol { $$ = alctree(IMPORTLIST_RULE, "ImportList", 3, $1, $2, $3); }
+    importList importDeclaration eol { $$ = addkids($1, 2, $2, $3); }
     | importDeclaration eol { $$ = alctree(IMPORTLIST_RULE, "ImportList", 2, $1, $2); }
     ;
 
@@ -69,17 +88,19 @@ functionSection:
     ;
 
 functionList:
-    functionList functionDeclaration { $$ = alctree(FUNCTIONLIST_RULE, "FunctionList", 2, $1, $2); }
+    functionList functionDeclaration { $$ = addkids($1, 1, $2); }
     | functionDeclaration nl_star { $$ = alctree(FUNCTIONLIST_RULE, "FunctionList", 1, $1); }
     ;
 
 functionDeclaration:
     FUN Identifier LPAREN funcParamSection RPAREN typeDeclaration block { $$ = alctree(FUNCTIONDECL_RULE, "FunctionDeclaration", 7, $1, $2, $3, $4, $5, $6, $7); }
+    | TAILREC FUN Identifier LPAREN funcParamSection RPAREN typeDeclaration block { $$ = alctree(FUNCTIONDECL_RULE, "TailrecFunctionDeclaration", 7, $2, $3, $4, $5, $6, $7, $8); free_tree($1); }
     | FUN Identifier LPAREN funcParamSection RPAREN typeDeclaration ASSIGNMENT expression
     {
-        fprintf(stderr, "Syntax Error: Expression-bodied functions are not allowed in k0. Use curly braces.\n");
-        syntax_error(0, 0, 0);
+        diag_error(DIAG_SYNTAX, NULL, scanner_line(scanner), "Expression-bodied functions are not allowed in k0. Use curly braces.");
+        $$ = alctree(FUNCTIONDECL_RULE, "FunctionDeclaration", 8, $1, $2, $3, $4, $5, $6, $7, $8);
     }
+    | FUN error RCURL { $$ = NULL; free_tree($1); free_tree($3); yyerrok; }
     ;
 
 funcParamSection:
@@ -111,15 +132,15 @@ type:
 block:
     nl_star LCURL nl_star statements RCURL nl_star { $$ = alctree(BLOCK_RULE, "Block", 3, $2, $4, $5); }
     | nl_star LCURL nl_star RCURL
-    { 
-        fprintf(stderr, "Syntax Error: k0 does not support empty blocks (line %d).\n", yylineno);
-        syntax_error(0, 0, 0);
+    {
+        diag_error(DIAG_SYNTAX, NULL, scanner_line(scanner), "k0 does not support empty blocks (line %d).", scanner_line(scanner));
+        $$ = alctree(BLOCK_RULE, "Block", 2, $2, $4);
     }
     ;
 
 statements:
     statement { $$ = alctree(STATEMENTS_RULE, "Statements", 1, $1); }
-    | statements statement { $$ = alctree(STATEMENTS_RULE, "Statements", 2, $1, $2); }
+    | statements statement { $$ = addkids($1, 1, $2); }
     ;
 
 statement:
@@ -128,6 +149,8 @@ statement:
     | declaration eol { $$ = alctree(STATEMENT_RULE, "Declaration", 2, $1, $2); }
     | assignment eol { $$ = alctree(STATEMENT_RULE, "Assignment", 2, $1, $2); }
     | expression eol { $$ = alctree(STATEMENT_RULE, "Expression", 2, $1, $2); }
+    | error NL { $$ = NULL; yyerrok; }
+    | error SEMICOLON { $$ = NULL; free_tree($2); yyerrok; }
     ;
 
 globalVarsSection:
@@ -138,8 +161,8 @@ globalVarsSection:
 globalVarsList:
     declaration eol { $$ = alctree(GLOBALVARSLIST_RULE, "Declaration", 2, $1, $2); }
     | assignment eol { $$ = alctree(GLOBALVARSLIST_RULE, "Assignment", 2, $1, $2); }
-    | globalVarsList declaration eol { $$ = alctree(GLOBALVARSLIST_RULE, "Declaration", 3, $1, $2, $3); }
-    | globalVarsList assignment eol { $$ = alctree(GLOBALVARSLIST_RULE, "Declaration", 3, $1, $2, $3); }
+    | globalVarsList declaration eol { $$ = addkids($1, 2, $2, $3); }
+    | globalVarsList assignment eol { $$ = addkids($1, 2, $2, $3); }
     ;
 
 controlStructure:
@@ -256,7 +279,15 @@ safeCall:
 
 funcCallParamList:
     /* empty */ { $$ = alctree(FUNCARGLIST_RULE, "FuncArgList", 0); }
-    | funcCallParamList COMMA expression { $$ = alctree(FUNCARGLIST_RULE, "FuncArgList", 3, $1, $2, $3); }
+    | funcCallParamList COMMA expression
+    {
+        // a single argument is the bare expression until a second one turns it into a list
+        if ($1->leaf == NULL && $1->prodrule == FUNCARGLIST_RULE) {
+            $$ = addkids($1, 2, $2, $3);
+        } else {
+            $$ = alctree(FUNCARGLIST_RULE, "FuncArgList", 3, $1, $2, $3);
+        }
+    }
     | expression { $$ = $1; }
     ;
 
@@ -276,14 +307,14 @@ optionalSemi:
     ;
 
 nl_star:
-    /* empty */ { $$ = NULL; }
-    | nl_star NL { $$ = NULL; }
+    /* empty */ { }
+    | nl_star NL { }
     ;
 
 %%
 
-void yyerror(const char *s) {
-    syntax_error(yytext, yychar, yylineno);
+void yyerror(yyscan_t scanner, struct k0_context *ctx, const char *s) {
+    syntax_error(scanner_text(scanner), ctx->last_token, scanner_line(scanner));
 }
 
 const char* token_name(int t) {
@@ -0,0 +1,119 @@
+#include <string.h>
+#include "lower.h"
+#include "k0gram.h"
+#include "k0ctx.h"
+#include "timing.h"
+
+// tokens that only steer the parser; dropped from the rules they appear in below
+static bool syntax_only(int category)
+{
+    switch (category)
+    {
+    case LPAREN:
+    case RPAREN:
+    case LCURL:
+    case RCURL:
+    case LSQUARE:
+    case RSQUARE:
+    case COLON:
+    case COMMA:
+    case ASSIGNMENT:
+    case IF:
+    case ELSE:
+    case WHILE:
+    case FOR:
+    case IN:
+        return true;
+    }
+    return false;
+}
+
+// rules whose syntax-only tokens can go; expressions, imports and member access keep theirs
+static bool drops_tokens(int prodrule)
+{
+    switch (prodrule)
+    {
+    case FUNCTIONDECL_RULE:
+    case FUNCVALPARAMSLIST_RULE:
+    case TYPE_RULE:
+    case BLOCK_RULE:
+    case IFSTRUC_RULE:
+    case ELSEIFLIST_RULE:
+    case ELSE_RULE:
+    case WHILELOOP_RULE:
+    case FORLOOP_RULE:
+    case CONDITION_RULE:
+    case RANGE_RULE:
+    case ASSIGNMENT_RULE:
+    case FUNCTIONCALL_RULE:
+    case FUNCARGLIST_RULE:
+        return true;
+    }
+    return false;
+}
+
+// the child a wrapper stands for, or NULL if t is not a wrapper
+static struct tree *wrapped(struct tree *t)
+{
+    if (t->leaf)
+    {
+        return NULL;
+    }
+    switch (t->prodrule)
+    {
+    case STATEMENT_RULE:
+    case CONTROLESTRUC_RULE:
+        return t->kids[0];
+    case CONDITION_RULE:
+        // already down to the condition, or the range of a for loop
+        return t->nkids == 1 ? t->kids[0] : NULL;
+    case EXPRESSION_RULE:
+        return strcmp(t->symbolname, "ParenthesizedExpression") == 0 ? t->kids[1] : NULL;
+    }
+    return NULL;
+}
+
+// children are lowered before their parent, so only t's own kids are left to rewrite
+static void lower_node(struct tree *t, int depth, void *arg)
+{
+    int n = 0;
+    for (int i = 0; i < t->nkids; i++)
+    {
+        struct tree *kid = t->kids[i];
+        if (!kid)
+        {
+            continue;
+        }
+        if ((kid->leaf && drops_tokens(t->prodrule) && syntax_only(kid->leaf->category)) ||
+            (!kid->leaf && kid->prodrule == OPSEMI_RULE))
+        {
+            free_tree(kid);
+            continue;
+        }
+        struct tree *inner;
+        while ((inner = wrapped(kid)) != NULL)
+        {
+            // detach what the wrapper holds before freeing the rest of it
+            for (int j = 0; j < kid->nkids; j++)
+            {
+                if (kid->kids[j] == inner)
+                {
+                    kid->kids[j] = NULL;
+                }
+            }
+            free_tree(kid);
+            kid = inner;
+        }
+        t->kids[n++] = kid;
+    }
+    t->nkids = n;
+}
+
+struct tree *lower_tree(struct tree *root)
+{
+    phase_begin(PHASE_LOWER);
+    struct tree_visitor visitor = {NULL, lower_node, NULL};
+    walk_tree(root, &visitor, 1);
+    phase_end(PHASE_LOWER);
+    return root;
+}
@@ -0,0 +1,14 @@
+#ifndef LOWER_H
+#define LOWER_H
+
+#include "tree.h"
+
+/*
+ * Lowering of the parse tree to the slim tree every later phase reads.
+ * Syntax-only tokens and wrapper nodes are freed, and the remaining
+ * children follow the layouts listed in tree.h. Runs once, right after
+ * parsing.
+ */
+struct tree *lower_tree(struct tree *root);
+
+#endif
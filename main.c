@@ -1,24 +1,42 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "tree.h"
 #include "symtab.h"
 #include "ic.h"
 #include "k0gram.h"
 #include "tac2asm.h"
+#include "jit.h"
+#include "k0ctx.h"
+#include "server.h"
+#include "cache.h"
+#include "timing.h"
+#include "memstat.h"
+#include "scanner.h"
+#include "diag.h"
 
-extern int yylex();
-extern int yyparse();
-extern void yy_scan_string(const char *str);
-extern int yylex_destroy();
-extern FILE *yyin;
-extern int yylineno;
-extern char *yytext;
-char *current_file = NULL;
-extern struct tree *root;
 extern void print_graph(struct tree *t, char *file_name);
 extern struct symbol_table_list* create_symtabs(struct tree*, int print, int free);
 extern void tac2asm(char *);
+extern void tac2obj(char *, char *);
+extern void tac2elf(char *, elf_object *);
+bool VIA_ASSEMBLER = false;
+bool PERF_MAP = false;
+bool CLIENT = false;
+bool CACHE = false;
+bool MEM_REPORT = false;
+bool VERBOSE = true;
+int JOBS = 1;
+int THREADS = 1; // for the functions of a single input file
+int TIME_REPORT = 0; // 1 for a table, 2 for JSON
+int ERROR_LIMIT = 1; // errors reported before a compile stops; 0 for no limit
+bool DIAG_JSON = false;
+int LEXER_ENGINE = LEXER_FLEX;
 
 // for usage
 enum ACTION {
@@ -30,45 +48,57 @@ enum ACTION {
     SYNTAX_TREE = 5,
     DOT_TREE = 6,
     LEXER = 7,
-    PRINT_ERRORS = 8
+    PRINT_ERRORS = 8,
+    RUN = 9,
+    INTERP = 10
 };
 
-// report errors from k0lex.l
-void lexical_error(const char *format, const char *token, int line) {
-    fprintf(stderr, "Lexical Error: ");
-    fprintf(stderr, format, token, line);
-    fprintf(stderr, " in file %s.\n", current_file);
-    exit(1);
-}
-
-// report errors from k0gram.y
-void syntax_error(const char *token, int yychar, int line) {
-    if (token != 0 && line != 0) {
-        fprintf(stderr, "Syntax Error: ");
-        fprintf(stderr, "Unexpected token '%s' (code %d) on line %d in file %s.\n", token, yychar, line, current_file);
-    }
-    exit(2);
-}
-
-// usage message for supported use cases
 void print_usage() {
-    fprintf(stderr, "Usage: ./k0 <input-files.kt>\n");
+    fprintf(stderr, "Usage: ./k0 [-j N] <input-files.kt>\n");
     fprintf(stderr, "       ./k0 -s <input-files.kt>\n");
     fprintf(stderr, "       ./k0 -c <input-files.kt>\n");
     fprintf(stderr, "       ./k0 -ic <input-files.kt>\n");
     fprintf(stderr, "       ./k0 -symtab <input-file.kt>\n");
     fprintf(stderr, "       ./k0 -tree <input-file.kt>\n");
     fprintf(stderr, "       ./k0 -dot <input-file.kt>\n");
+    fprintf(stderr, "       ./k0 -via-as [-c] <input-files.kt>\n");
+    fprintf(stderr, "       ./k0 -run [-perf-map] <input-file.kt>\n");
+    fprintf(stderr, "       ./k0 -interp <input-file.kt>\n");
+    fprintf(stderr, "       ./k0 -server [-j N] [socket]\n");
+    fprintf(stderr, "       ./k0 -client [-s | -c | -ic] <input-file.kt>\n");
+    fprintf(stderr, "       ./k0 -cache [-s | -c | -ic] <input-files.kt>\n");
+    fprintf(stderr, "       ./k0 -cache-stats\n");
+    fprintf(stderr, "       ./k0 -ftime-report[=json] [-s | -c | -ic] <input-files.kt>\n");
+    fprintf(stderr, "       ./k0 -mem-report [-s | -c | -ic] <input-files.kt>\n");
+    fprintf(stderr, "       ./k0 -ferror-limit=N [-fdiagnostics-format=json] [-s | -c | -ic] <input-files.kt>\n");
+    fprintf(stderr, "       ./k0 -lexer-engine=fast [-s | -c | -ic | -tree] <input-files.kt>\n");
+    fprintf(stderr, "       ./k0 -tokens[=count] <input-file.kt>\n");
     fprintf(stderr, "       ./k0 -lexer\n");
     fprintf(stderr, "       ./k0 -h\n\n");
     fprintf(stderr, "Options:\n");
     fprintf(stderr, "  NONE        Compile to executable (performs all steps)\n");
     fprintf(stderr, "  -s          Generate assembler (.s file)\n");
     fprintf(stderr, "  -c          Produce object file (.o file)\n");
+    fprintf(stderr, "  -j N        Compile up to N input files in parallel, then link them together;\n");
+    fprintf(stderr, "              with one input file, parse, check and generate its functions on N threads\n");
+    fprintf(stderr, "  -via-as     Write the .S file and assemble it with gcc instead of the built-in encoder\n");
     fprintf(stderr, "  -ic         Generate intermediate code (.ic file)\n");
+    fprintf(stderr, "  -run        Compile into memory and run main, exiting with its status\n");
+    fprintf(stderr, "  -perf-map   With -run, write /tmp/perf-<pid>.map for perf\n");
+    fprintf(stderr, "  -interp     Interpret the intermediate code and report instructions/second\n");
     fprintf(stderr, "  -symtab     Print symbol table\n");
     fprintf(stderr, "  -tree       Print syntax tree\n");
     fprintf(stderr, "  -dot        Generate DOT representation of the syntax tree\n");
+    fprintf(stderr, "  -server     Serve compile requests on a UNIX socket ($K0_SOCKET, else k0.sock in $XDG_RUNTIME_DIR or /tmp/k0-<uid>)\n");
+    fprintf(stderr, "  -client     Send the compile to a running server, compiling locally if none answers\n");
+    fprintf(stderr, "  -cache      Reuse the .ic/.S/.o of an unchanged source from $K0_CACHE_DIR (default ~/.cache/k0)\n");
+    fprintf(stderr, "  -cache-stats Report cache size and hit rate\n");
+    fprintf(stderr, "  -mem-report Print bytes, allocations and live peak per compiler subsystem, and peak RSS, to stderr\n");
+    fprintf(stderr, "  -ftime-report Print time per compiler phase and counts of what each produced to stderr; =json for JSON\n");
+    fprintf(stderr, "  -ferror-limit=N Report up to N errors before stopping (default 1, 0 for no limit)\n");
+    fprintf(stderr, "  -fdiagnostics-format=json Print each error as a JSON object on its own line\n");
+    fprintf(stderr, "  -lexer-engine=E Lex with flex (the default) or fast, the hand-written scanner\n");
+    fprintf(stderr, "  -tokens     Print the tokens of a file with their lines; =count prints how many, for timing\n");
     fprintf(stderr, "  -lexer      Begin lexer loop (to test tokens)\n");
     fprintf(stderr, "  -h          Display usage message\n");
     exit(4);
@@ -132,6 +162,7 @@ const char* get_token_name(int token) {
         case WHILE: return "WHILE";
         case IMPORT: return "IMPORT";
         case CONST: return "CONST";
+        case TAILREC: return "TAILREC";
         case TYPE: return "TYPE";
         case ARRAY_TYPE: return "ARRAY_TYPE";
         case DOT: return "DOT";
@@ -189,7 +220,11 @@ const char* get_token_name(int token) {
 
 void lexer_loop() {
     char input[256];
-    current_file = NULL;
+    // no current file: alctoken() only classifies tokens
+    k0_context *ctx = k0_get();
+    ctx->lexer_engine = LEXER_ENGINE;
+    struct scanner *scanner = scanner_create(ctx);
+    YYSTYPE lval;
     printf("Lexer Loop - Enter text to tokenize (type 'exit' to quit)\n");
     while (1) {
         printf("\n>>> ");
@@ -202,15 +237,13 @@ void lexer_loop() {
             printf("Exiting lexer...\n");
             break;
         }
-        yy_scan_string(input);
+        scanner_source(scanner, input, strlen(input), false, 1);
         int token;
-        while ((token = yylex()) != 0) {
-            printf("Token: %s, Text: %s\n", get_token_name(token), yytext);
+        while ((token = scanner_lex(&lval, scanner)) != 0) {
+            printf("Token: %s, Text: %s\n", get_token_name(token), scanner_text(scanner));
         }
     }
-    free_tree(root);
-    yylex_destroy();
-    free(current_file);
+    scanner_destroy(scanner);
     exit(0);
 }
 
@@ -239,7 +272,7 @@ char* generate_ic(struct tree* ast_root, char* source_file) {
         sprintf(ic_file, "%s.ic", source_file);
     }
     
-    printf("Generating intermediate code: %s\n", ic_file);
+    if (VERBOSE) printf("Generating intermediate code: %s\n", ic_file);
     create_ic(ic_file, tables, ast_root);
     
     return ic_file;
@@ -300,7 +333,9 @@ char* generate_obj(char* asm_file) {
     char cmd_buffer[512];
     sprintf(cmd_buffer, "gcc -c -o %s %s", obj_file, asm_file);
     
+    phase_begin(PHASE_ASSEMBLE);
     int result = system(cmd_buffer);
+    phase_end(PHASE_ASSEMBLE);
     if (result != 0) {
         fprintf(stderr, "Error: Assembling failed\n");
         exit(4);
@@ -309,8 +344,40 @@ char* generate_obj(char* asm_file) {
     return obj_file;
 }
 
-void generate_executable(char* obj_file) {
-    char* base_name = strdup(obj_file);
+char* encode_obj(char* ic_file) {
+    char* obj_file = malloc(strlen(ic_file) + 3);
+    if (!obj_file) {
+        perror("Memory allocation failed");
+        exit(4);
+    }
+    
+    strcpy(obj_file, ic_file);
+    char* ext = strrchr(obj_file, '.');
+    if (ext) {
+        ext[1] = 'o';
+        ext[2] = '\0';
+    } else {
+        strcat(obj_file, ".o");
+    }
+    
+    printf("Generating object file: %s\n", obj_file);
+    tac2obj(ic_file, obj_file);
+    
+    return obj_file;
+}
+
+// compile into executable memory and call main, no files besides the .ic
+int run_jit(char* ic_file) {
+    elf_object obj;
+    elf_init(&obj);
+    tac2elf(ic_file, &obj);
+    int status = jit_run(&obj, PERF_MAP);
+    elf_free(&obj);
+    return status;
+}
+
+void generate_executable(char** obj_files, int count) {
+    char* base_name = strdup(obj_files[0]);
     char* ext = strrchr(base_name, '.');
     if (ext) {
         *ext = '\0';
@@ -321,10 +388,26 @@ void generate_executable(char* obj_file) {
     
     printf("Generating executable: %s\n", exe_file);
     
-    char cmd_buffer[512];
-    sprintf(cmd_buffer, "gcc -no-pie -o %s %s -lm", exe_file, obj_file);
+    size_t cmd_len = strlen(exe_file) + 64;
+    for (int i = 0; i < count; i++) {
+        cmd_len += strlen(obj_files[i]) + 1;
+    }
+    char* cmd_buffer = malloc(cmd_len);
+    if (!cmd_buffer) {
+        perror("Memory allocation failed");
+        exit(4);
+    }
+    sprintf(cmd_buffer, "gcc -no-pie -o %s", exe_file);
+    for (int i = 0; i < count; i++) {
+        strcat(cmd_buffer, " ");
+        strcat(cmd_buffer, obj_files[i]);
+    }
+    strcat(cmd_buffer, " -lm");
     
+    phase_begin(PHASE_LINK);
     int result = system(cmd_buffer);
+    phase_end(PHASE_LINK);
+    free(cmd_buffer);
     if (result != 0) {
         fprintf(stderr, "Error: Linking failed\n");
         free(base_name);
@@ -335,16 +418,48 @@ void generate_executable(char* obj_file) {
     free(base_name);
 }
 
-void process_source_file(int action) {
-    if (yyparse() != 0) {
-        fprintf(stderr, "Parsing failed for file: %s\n", current_file);
-        if (yylval.treeptr) {
-            free_tree(yylval.treeptr);
-            yylval.treeptr = NULL;
-        }
-        exit(2);
+// print what -ftime-report recorded for ctx, in one write so -j workers do not interleave
+void report_time(k0_context *ctx) {
+    if (!TIME_REPORT) {
+        return;
     }
-    
+    char* text = NULL;
+    size_t length = 0;
+    FILE* report = open_memstream(&text, &length);
+    if (!report) {
+        perror("Error opening memory stream");
+        exit(4);
+    }
+    time_report(ctx, report, TIME_REPORT == 2);
+    fclose(report);
+    fflush(stdout);
+    fwrite(text, 1, length, stderr);
+    free(text);
+}
+
+// print the -mem-report for this process, in one write like report_time()
+void report_memory() {
+    if (!MEM_REPORT) {
+        return;
+    }
+    char* text = NULL;
+    size_t length = 0;
+    FILE* report = open_memstream(&text, &length);
+    if (!report) {
+        perror("Error opening memory stream");
+        exit(4);
+    }
+    mem_report(report);
+    fclose(report);
+    fflush(stdout);
+    fwrite(text, 1, length, stderr);
+    free(text);
+}
+
+void process_source_file(k0_context *ctx, int action) {
+    struct tree *root = ctx->root;
+    char *current_file = ctx->current_file;
+
     switch (action) {
         case SYMBOL_TABLE:
             create_symtabs(root, 1, 1);
@@ -370,6 +485,26 @@ void process_source_file(int action) {
             printf("No errors found.\n");
             break;
             
+        case RUN:
+            {
+                char* ic_file = generate_ic(root, current_file);
+                int status = run_jit(ic_file);
+                free(ic_file);
+                report_time(ctx);
+                report_memory();
+                exit(status);
+            }
+            break;
+
+        case INTERP:
+            {
+                int status = interpret_ic(create_symtabs(root, 0, 0), root);
+                report_time(ctx);
+                report_memory();
+                exit(status);
+            }
+            break;
+
         case IC:
         case ASSEMBLER:
         case OBJECT:
@@ -378,41 +513,393 @@ void process_source_file(int action) {
                 char* ic_file = generate_ic(root, current_file);
                 
                 char* asm_file = NULL;
-                if (action != IC) {
+                if (action == ASSEMBLER || (action != IC && VIA_ASSEMBLER)) {
                     asm_file = generate_asm(ic_file);
-                    free(ic_file);
                 }
                 
                 char* obj_file = NULL;
-                if (action != IC && action != ASSEMBLER) {
-                    obj_file = generate_obj(asm_file);
-                    free(asm_file);
+                if (action == OBJECT || action == COMPILE_EXECUTABLE) {
+                    obj_file = asm_file ? generate_obj(asm_file) : encode_obj(ic_file);
                 }
+                free(asm_file);
+                free(ic_file);
                 
                 if (action == COMPILE_EXECUTABLE) {
-                    generate_executable(obj_file);
-                    free(obj_file);
+                    generate_executable(&obj_file, 1);
                 }
+                free(obj_file);
             }
             break;
     }
 }
 
+// the .o that compiling source_file leaves next to it
+char* object_name(char* source_file) {
+    char* obj_file = malloc(strlen(source_file) + 3);
+    if (!obj_file) {
+        perror("Memory allocation failed");
+        exit(4);
+    }
+    strcpy(obj_file, source_file);
+    char* ext = strrchr(obj_file, '.');
+    if (ext && !strchr(ext, '/')) {
+        strcpy(ext, ".o");
+    } else {
+        strcat(obj_file, ".o");
+    }
+    return obj_file;
+}
+
+// artifacts action leaves next to source_file, or 0 if its result is not cached
+int cache_mask(char* source_file, int action) {
+    char* ext = strrchr(source_file, '.');
+    if (!CACHE || !ext || strcmp(ext, ".kt") != 0) {
+        return 0;
+    }
+    switch (action) {
+        case IC:
+            return CACHE_IC;
+        case ASSEMBLER:
+            return CACHE_IC | CACHE_ASM;
+        case OBJECT:
+        case COMPILE_EXECUTABLE:
+            return CACHE_IC | CACHE_OBJ | (VIA_ASSEMBLER ? CACHE_ASM : 0);
+        default:
+            return 0;
+    }
+}
+
+// a source file mapped into memory, followed by the two NUL bytes the scanner
+// stops at so it can read the file where it is
+struct source_file {
+    char *text;
+    size_t length;
+    size_t size;    // of the mapping, or 0 if the file was read into a buffer
+};
+
+// map path, or read it when it cannot be mapped (a pipe, say); NULL text if it cannot be opened
+void open_source(const char *path, struct source_file *src) {
+    src->text = NULL;
+    src->length = src->size = 0;
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0) return;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        // zeroed pages past the end of the file provide the NUL bytes
+        long page = sysconf(_SC_PAGESIZE);
+        size_t length = st.st_size;
+        size_t size = (length + 2 + page - 1) / page * page;
+        char *text = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (text != MAP_FAILED && (length == 0 ||
+            mmap(text, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) != MAP_FAILED)) {
+            src->text = text;
+            src->length = length;
+            src->size = size;
+            close(fd);
+            return;
+        }
+        if (text != MAP_FAILED) munmap(text, size);
+    }
+    size_t cap = 4096;
+    ssize_t n;
+    char *text = malloc(cap);
+    while (text && (n = read(fd, text + src->length, cap - src->length - 2)) > 0) {
+        src->length += n;
+        if (src->length + 2 == cap) {
+            cap *= 2;
+            text = realloc(text, cap);
+        }
+    }
+    close(fd);
+    if (!text) {
+        perror("Memory allocation failed");
+        exit(4);
+    }
+    text[src->length] = text[src->length + 1] = '\0';
+    src->text = text;
+}
+
+void close_source(struct source_file *src) {
+    if (src->size) {
+        munmap(src->text, src->size);
+    } else {
+        free(src->text);
+    }
+    src->text = NULL;
+}
+
+// key of the cache entry for compiling src; it holds every flag that can change
+// the outputs or whether the compile succeeds (only successes are stored, so the
+// flags that only shape diagnostics need not be in it)
+void source_cache_key(struct source_file *src, int mask, char key[CACHE_KEY_SIZE]) {
+    char flags[64];
+    snprintf(flags, sizeof(flags), "artifacts=%d via-as=%d require-main=%d", mask, VIA_ASSEMBLER, k0_get()->require_main);
+    cache_key(src->text, src->length, flags, key);
+}
+
+// print each token of a file on a line of its own, with its line number; with
+// count_only just how many there are, so -ftime-report times the scanner alone
+void print_tokens(char* file_name, bool count_only) {
+    k0_context *ctx = k0_get();
+    ctx->current_file = strdup(file_name);
+    ctx->error_limit = ERROR_LIMIT;
+    ctx->diag_json = DIAG_JSON;
+    ctx->lexer_engine = LEXER_ENGINE;
+    if (TIME_REPORT) timing_enable(ctx);
+
+    struct source_file src;
+    open_source(ctx->current_file, &src);
+    if (!src.text) {
+        perror("Error opening file");
+        exit(4);
+    }
+    struct scanner *scanner = scanner_create(ctx);
+    scanner_source(scanner, src.text, src.length, true, 1);
+    YYSTYPE lval;
+    long tokens = 0;
+    phase_begin(PHASE_PARSE);
+    for (int token; (token = scanner_lex(&lval, scanner)) != 0; tokens++) {
+        if (token == NL) {
+            if (!count_only) printf("%d NL\n", scanner_line(scanner));
+            continue;
+        }
+        if (!count_only) printf("%d %s %s\n", scanner_line(scanner), get_token_name(token), scanner_text(scanner));
+        free_tree(lval.treeptr);
+    }
+    phase_end(PHASE_PARSE);
+    scanner_destroy(scanner);
+    close_source(&src);
+    if (count_only) printf("%ld tokens\n", tokens);
+    report_time(ctx);
+    diag_check();
+    k0_destroy(ctx);
+    exit(0);
+}
+
+void compile_file(char* file_name, int action) {
+    k0_context *ctx = k0_get();
+    ctx->current_file = check_extension(file_name, action);
+    ctx->error_limit = ERROR_LIMIT;
+    ctx->diag_json = DIAG_JSON;
+    ctx->threads = THREADS;
+    ctx->lexer_engine = LEXER_ENGINE;
+    if (TIME_REPORT) timing_enable(ctx);
+    
+    struct source_file src;
+    open_source(ctx->current_file, &src);
+    if (!src.text) {
+        perror("Error opening file");
+        exit(4);
+    }
+    
+    // an unchanged source skips every stage but linking
+    int mask = cache_mask(ctx->current_file, action);
+    char key[CACHE_KEY_SIZE];
+    char* base = NULL;
+    if (mask) {
+        source_cache_key(&src, mask, key);
+        base = strdup(ctx->current_file);
+        *strrchr(base, '.') = '\0';
+        if (cache_restore(key, mask, base)) {
+            if (VERBOSE) printf("Using cached build of %s\n", ctx->current_file);
+            if (action == COMPILE_EXECUTABLE) {
+                char* obj_file = object_name(ctx->current_file);
+                generate_executable(&obj_file, 1);
+                free(obj_file);
+            }
+            free(base);
+            close_source(&src);
+            report_time(ctx);
+            k0_destroy(ctx);
+            report_memory();
+            return;
+        }
+    }
+    
+    // otherwise only the functions that changed are generated again
+    ctx->function_cache = mask != 0;
+    k0_parse(ctx, src.text, src.length, true);
+    process_source_file(ctx, action);
+    if (mask) {
+        cache_store(key, mask, base);
+        free(base);
+    }
+    close_source(&src);
+    report_time(ctx);
+    k0_destroy(ctx);
+    report_memory();
+}
+
+// the front end keeps its state in globals, so each file is compiled in its own process
+pid_t start_worker(char* file_name, int action) {
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("Error starting compile job");
+        exit(4);
+    }
+    if (pid == 0) {
+        compile_file(file_name, action);
+        exit(0);
+    }
+    return pid;
+}
+
+// compile files on up to JOBS workers, then link every object into one executable
+void compile_files(char** files, int nfiles, int action) {
+    int worker_action = action == COMPILE_EXECUTABLE ? OBJECT : action;
+    k0_get()->require_main = false;
+    pid_t* pids = calloc(nfiles, sizeof(pid_t));
+    int* status = calloc(nfiles, sizeof(int));
+    if (!pids || !status) {
+        perror("Memory allocation failed");
+        exit(4);
+    }
+    int next = 0;
+    int running = 0;
+    while (next < nfiles || running > 0) {
+        if (next < nfiles && running < JOBS) {
+            pids[next] = start_worker(files[next], worker_action);
+            next++;
+            running++;
+            continue;
+        }
+        int wstatus;
+        pid_t pid = wait(&wstatus);
+        if (pid < 0) {
+            perror("Error waiting for compile job");
+            exit(4);
+        }
+        running--;
+        for (int i = 0; i < next; i++) {
+            if (pids[i] == pid) {
+                status[i] = WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : 4;
+            }
+        }
+    }
+    
+    // report the first failing file in command-line order
+    int failed = 0;
+    for (int i = 0; i < nfiles && failed == 0; i++) {
+        failed = status[i];
+    }
+    free(pids);
+    free(status);
+    if (failed) {
+        exit(failed);
+    }
+    
+    if (action == COMPILE_EXECUTABLE) {
+        if (TIME_REPORT) timing_enable(k0_get());
+        char** obj_files = malloc(nfiles * sizeof(char*));
+        for (int i = 0; i < nfiles; i++) {
+            char* source_file = check_extension(files[i], action);
+            obj_files[i] = object_name(source_file);
+            free(source_file);
+        }
+        generate_executable(obj_files, nfiles);
+        for (int i = 0; i < nfiles; i++) {
+            free(obj_files[i]);
+        }
+        free(obj_files);
+        report_time(k0_get());
+    }
+}
+
 int main(int argc, char *argv[]) {
     int file_arg_num;
     int action = COMPILE_EXECUTABLE;
 
+    // -via-as, -perf-map, -client, -cache, -ftime-report, -mem-report, the diagnostics options, -lexer-engine and -j modify the action, so take them out before it is parsed
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "-j", 2) == 0) {
+            // -j N or -jN
+            int used = argv[i][2] ? 1 : 2;
+            char* count = argv[i][2] ? argv[i] + 2 : (i + 1 < argc ? argv[i + 1] : "");
+            char* end;
+            long jobs = strtol(count, &end, 10);
+            if (*count == '\0' || *end != '\0' || jobs < 1) {
+                fprintf(stderr, "Error: -j needs a positive job count\n");
+                print_usage();
+            }
+            JOBS = (int)jobs;
+            for (int j = i; j < argc - used; j++) argv[j] = argv[j + used];
+            argc -= used;
+            i--;
+            continue;
+        }
+        if (strcmp(argv[i], "-ftime-report") == 0 || strcmp(argv[i], "-ftime-report=json") == 0) {
+            TIME_REPORT = argv[i][13] ? 2 : 1;
+            for (int j = i; j < argc - 1; j++) argv[j] = argv[j + 1];
+            argc--;
+            i--;
+            continue;
+        }
+        if (strncmp(argv[i], "-ferror-limit=", 14) == 0) {
+            char* end;
+            long limit = strtol(argv[i] + 14, &end, 10);
+            if (argv[i][14] == '\0' || *end != '\0' || limit < 0) {
+                fprintf(stderr, "Error: -ferror-limit needs a count, 0 for no limit\n");
+                print_usage();
+            }
+            ERROR_LIMIT = (int)limit;
+            for (int j = i; j < argc - 1; j++) argv[j] = argv[j + 1];
+            argc--;
+            i--;
+            continue;
+        }
+        if (strncmp(argv[i], "-lexer-engine=", 14) == 0) {
+            if (strcmp(argv[i] + 14, "flex") != 0 && strcmp(argv[i] + 14, "fast") != 0) {
+                fprintf(stderr, "Error: -lexer-engine is flex or fast\n");
+                print_usage();
+            }
+            LEXER_ENGINE = strcmp(argv[i] + 14, "fast") == 0 ? LEXER_FAST : LEXER_FLEX;
+            for (int j = i; j < argc - 1; j++) argv[j] = argv[j + 1];
+            argc--;
+            i--;
+            continue;
+        }
+        bool *flag = strcmp(argv[i], "-via-as") == 0 ? &VIA_ASSEMBLER :
+                     strcmp(argv[i], "-perf-map") == 0 ? &PERF_MAP :
+                     strcmp(argv[i], "-client") == 0 ? &CLIENT :
+                     strcmp(argv[i], "-cache") == 0 ? &CACHE :
+                     strcmp(argv[i], "-mem-report") == 0 ? &MEM_REPORT :
+                     strcmp(argv[i], "-fdiagnostics-format=json") == 0 ? &DIAG_JSON : NULL;
+        if (flag) {
+            *flag = true;
+            for (int j = i; j < argc - 1; j++) argv[j] = argv[j + 1];
+            argc--;
+            i--;
+        }
+    }
+
     if (argc < 2) {
         print_usage();
     }
+    mem_accounting(MEM_REPORT);
     
 
     if (argc == 2 && (strcmp(argv[1], "-lexer") == 0)) {
         lexer_loop();
     }
+    else if (argc == 3 && (strcmp(argv[1], "-tokens") == 0 || strcmp(argv[1], "-tokens=count") == 0)) {
+        print_tokens(argv[2], argv[1][7] == '=');
+    }
     else if (argc == 2 && (strcmp(argv[1], "-h") == 0)) {
         print_usage();
     }
+    else if (argc == 2 && (strcmp(argv[1], "-cache-stats") == 0)) {
+        cache_stats();
+        exit(0);
+    }
+    else if (strcmp(argv[1], "-server") == 0) {
+        if (argc > 3) {
+            print_usage();
+        }
+        int workers = JOBS > 1 ? JOBS : (int)sysconf(_SC_NPROCESSORS_ONLN);
+        exit(serve(argc == 3 ? argv[2] : server_socket_path(), workers > 0 ? workers : 1));
+    }
     
     // Parse action flags
     if (argc >= 3 && argv[1][0] == '-') {
@@ -434,6 +921,13 @@ int main(int argc, char *argv[]) {
         else if (strcmp(argv[1], "-c") == 0) {
             action = OBJECT;
         }
+        else if (strcmp(argv[1], "-run") == 0) {
+            action = RUN;
+            VERBOSE = false;
+        }
+        else if (strcmp(argv[1], "-interp") == 0) {
+            action = INTERP;
+        }
         else {
             fprintf(stderr, "Unknown option: %s\n", argv[1]);
             print_usage();
@@ -448,21 +942,30 @@ int main(int argc, char *argv[]) {
         print_usage();
     }
 
-    current_file = check_extension(argv[file_arg_num], action);
-    
-    yyin = fopen(current_file, "r");
-    if (!yyin) {
-        perror("Error opening file");
-        free(current_file);
-        exit(4);
+    int nfiles = argc - file_arg_num;
+    if (nfiles > 1) {
+        if (action == RUN || action == INTERP) {
+            fprintf(stderr, "Error: %s takes a single input file\n", argv[1]);
+            print_usage();
+        }
+        compile_files(argv + file_arg_num, nfiles, action);
+    } else {
+        // the server covers the file-producing actions; anything else, or no server, runs here
+        bool served = action == IC || action == ASSEMBLER || action == OBJECT || action == COMPILE_EXECUTABLE;
+        if (CLIENT && served && !VIA_ASSEMBLER) {
+            char* source_file = check_extension(argv[file_arg_num], action);
+            char* ext = strrchr(source_file, '.');
+            int status = strcmp(ext, ".kt") != 0 ? -1 :
+                         client_compile(server_socket_path(), file_arg_num == 2 ? argv[1] : "", source_file);
+            free(source_file);
+            if (status >= 0) {
+                exit(status);
+            }
+        }
+        // with one file, -j spreads its functions over threads instead
+        THREADS = JOBS;
+        compile_file(argv[file_arg_num], action);
     }
     
-    process_source_file(action);
-    
-    free_tree(root);
-    fclose(yyin);
-    yylex_destroy();
-    free(current_file);
-    
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,81 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <malloc.h>
+#include <sys/resource.h>
+#include "memstat.h"
+
+typedef struct mem_counts {
+    atomic_long bytes;      // allocated in total
+    atomic_long allocs;
+    atomic_long frees;
+    atomic_long live;       // bytes allocated and not yet freed
+    atomic_long peak;       // high-water of live
+} mem_counts;
+
+static bool accounting = false;
+static mem_counts counts[NSUBSYSTEMS];
+
+static const char *subsystem_names[NSUBSYSTEMS] = {
+    "tree", "symtab", "type", "ic", "tac2asm"
+};
+
+void mem_accounting(bool on) {
+    accounting = on;
+}
+
+// sizes come from the allocator, so a free takes back exactly what its allocation added
+static void *counted(int subsystem, void *p) {
+    if (!p || !accounting) return p;
+    long size = (long)malloc_usable_size(p);
+    mem_counts *c = &counts[subsystem];
+    atomic_fetch_add(&c->bytes, size);
+    atomic_fetch_add(&c->allocs, 1);
+    long live = atomic_fetch_add(&c->live, size) + size;
+    long peak = atomic_load(&c->peak);
+    while (live > peak && !atomic_compare_exchange_weak(&c->peak, &peak, live)) {
+    }
+    return p;
+}
+
+void *mem_alloc(int subsystem, size_t size) {
+    return counted(subsystem, malloc(size));
+}
+
+void *mem_zalloc(int subsystem, size_t size) {
+    return counted(subsystem, calloc(1, size));
+}
+
+char *mem_strdup(int subsystem, const char *s) {
+    return counted(subsystem, strdup(s));
+}
+
+void mem_free(int subsystem, void *p) {
+    if (p && accounting) {
+        atomic_fetch_sub(&counts[subsystem].live, (long)malloc_usable_size(p));
+        atomic_fetch_add(&counts[subsystem].frees, 1);
+    }
+    free(p);
+}
+
+void mem_report(FILE *fp) {
+    long bytes = 0, allocs = 0, frees = 0, live = 0, peak = 0;
+    fprintf(fp, "Memory report\n");
+    fprintf(fp, "  %-10s %14s %10s %10s %14s %14s\n", "subsystem", "bytes", "allocs", "frees", "live", "live peak");
+    for (int i = 0; i < NSUBSYSTEMS; i++) {
+        mem_counts *c = &counts[i];
+        fprintf(fp, "  %-10s %14ld %10ld %10ld %14ld %14ld\n", subsystem_names[i], atomic_load(&c->bytes),
+                atomic_load(&c->allocs), atomic_load(&c->frees), atomic_load(&c->live), atomic_load(&c->peak));
+        bytes += atomic_load(&c->bytes);
+        allocs += atomic_load(&c->allocs);
+        frees += atomic_load(&c->frees);
+        live += atomic_load(&c->live);
+        peak += atomic_load(&c->peak);
+    }
+    // the subsystems peak at different times, so their sum only bounds the combined peak
+    fprintf(fp, "  %-10s %14ld %10ld %10ld %14ld %14ld\n", "total", bytes, allocs, frees, live, peak);
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        fprintf(fp, "  peak RSS   %14ld\n", usage.ru_maxrss * 1024L);
+    }
+}
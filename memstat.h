@@ -0,0 +1,35 @@
+#ifndef MEMSTAT_H
+#define MEMSTAT_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Allocation accounting for -mem-report. The compiler's own data structures
+ * are allocated and freed through these wrappers, tagged with the subsystem
+ * that owns them. While accounting is off they are plain malloc and free.
+ * Counts are per process, so each -j worker reports its own.
+ */
+
+enum mem_subsystem {
+    MEM_TREE,       /* syntax tree nodes and tokens */
+    MEM_SYMTAB,     /* symbol tables and their entries */
+    MEM_TYPE,       /* type descriptors and parameter lists */
+    MEM_IC,         /* IC instructions, addresses and data declarations */
+    MEM_TAC2ASM,    /* IC re-read by the back end */
+    NSUBSYSTEMS
+};
+
+/* Start counting allocations made from here on */
+void mem_accounting(bool on);
+
+void *mem_alloc(int subsystem, size_t size);
+void *mem_zalloc(int subsystem, size_t size);
+char *mem_strdup(int subsystem, const char *s);
+void mem_free(int subsystem, void *p);
+
+/* Bytes, allocation counts and live high-water per subsystem, and the process peak RSS */
+void mem_report(FILE *fp);
+
+#endif
@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "peephole.h"
+
+#define LIVENESS_SCAN_LIMIT 32
+
+// scan forward for the next use of reg; anything we can't see past counts as live
+bool reg_dead_after(x86_instr instr, int reg) {
+    int steps = 0;
+    for (x86_instr i = instr->next; i != NULL && steps < LIVENESS_SCAN_LIMIT; i = i->next, steps++) {
+        if (x86_reads(i, reg)) return false;
+        if (x86_writes(i, reg)) return true;
+        if (x86_is_jump(i->opcode)) return false;
+        if (i->opcode == X86_RET) return true;
+    }
+    return false;
+}
+
+static bool fits_imm32(x86_operand *op) {
+    return op->kind != X_IMM || (op->imm >= -2147483648L && op->imm <= 2147483647L);
+}
+
+static void drop_first(x86_list *list, x86_instr *w) {
+    x86_remove(list, w[0]);
+}
+
+static void drop_second(x86_list *list, x86_instr *w) {
+    x86_remove(list, w[1]);
+}
+
+// movq %rax, %rax
+static bool match_self_move(x86_instr *w) {
+    return w[0]->src.kind == X_REG && x86_operand_equal(&w[0]->src, &w[0]->dst);
+}
+
+// movq A, B ; movq A, B
+static bool match_duplicate_move(x86_instr *w) {
+    return x86_operand_equal(&w[0]->src, &w[1]->src) &&
+           x86_operand_equal(&w[0]->dst, &w[1]->dst) &&
+           !x86_operand_equal(&w[0]->src, &w[0]->dst);
+}
+
+// movq A, B ; movq B, A
+static bool match_move_back(x86_instr *w) {
+    return x86_operand_equal(&w[0]->dst, &w[1]->src) &&
+           x86_operand_equal(&w[0]->src, &w[1]->dst);
+}
+
+// movq %reg, X ; movq X, D  ->  movq %reg, X ; movq %reg, D
+static bool match_store_to_load(x86_instr *w) {
+    return w[0]->src.kind == X_REG &&
+           x86_operand_equal(&w[0]->dst, &w[1]->src) &&
+           !x86_operand_equal(&w[0]->src, &w[1]->dst);
+}
+
+static void forward_stored_value(x86_list *list, x86_instr *w) {
+    x86_clear_operand(&w[1]->src);
+    w[1]->src = w[0]->src;
+}
+
+// movq S, %reg ; movq %reg, D  ->  movq S, D when %reg is not needed afterwards
+static bool match_move_chain(x86_instr *w) {
+    if (w[0]->dst.kind != X_REG || !x86_operand_equal(&w[0]->dst, &w[1]->src)) return false;
+    if (x86_operand_equal(&w[1]->dst, &w[0]->dst)) return false;
+    // x86 has no memory to memory move
+    if (x86_is_memory(&w[0]->src) && x86_is_memory(&w[1]->dst)) return false;
+    if (w[1]->dst.kind != X_REG && !fits_imm32(&w[0]->src)) return false;
+    if (w[0]->src.kind == X_DIMM) return false;
+    return reg_dead_after(w[1], w[0]->dst.reg);
+}
+
+static void fold_move_chain(x86_list *list, x86_instr *w) {
+    w[1]->src = w[0]->src;
+    // the symbol name now belongs to the surviving instruction
+    w[0]->src = x86_none();
+    x86_remove(list, w[0]);
+}
+
+// movq S, %reg ; <overwrites %reg without reading it>
+static bool match_overwritten_move(x86_instr *w) {
+    return w[0]->dst.kind == X_REG &&
+           !x86_reads(w[1], w[0]->dst.reg) &&
+           x86_writes(w[1], w[0]->dst.reg);
+}
+
+// movq $0, %reg  ->  xorl %reg32, %reg32 when the flags are dead
+static bool match_zero_idiom(x86_instr *w) {
+    return w[0]->src.kind == X_IMM && w[0]->src.imm == 0 &&
+           w[0]->dst.kind == X_REG &&
+           reg_dead_after(w[0], FLAGS);
+}
+
+static void use_xor_zero(x86_list *list, x86_instr *w) {
+    int reg = w[0]->dst.reg;
+    w[0]->opcode = X86_XORL;
+    w[0]->src = x86_reg_sized(reg, 4);
+    w[0]->dst = x86_reg_sized(reg, 4);
+}
+
+// jmp L ; [labels...] L:
+static bool match_jump_to_next(x86_instr *w) {
+    for (x86_instr i = w[0]->next; i != NULL && i->opcode == X86_LABEL; i = i->next) {
+        if (strcmp(i->dst.sym, w[0]->dst.sym) == 0) return true;
+    }
+    return false;
+}
+
+// anything between an unconditional transfer and the next label is unreachable
+static bool match_unreachable(x86_instr *w) {
+    return (w[0]->opcode == X86_JMP || w[0]->opcode == X86_RET) &&
+           w[1]->opcode != X86_LABEL;
+}
+
+static const peephole_rule rules[] = {
+    { "self-move",       1, { X86_MOVQ,    ANY_OPCODE }, match_self_move,      drop_first },
+    { "duplicate-move",  2, { X86_MOVQ,    X86_MOVQ },   match_duplicate_move, drop_second },
+    { "move-back",       2, { X86_MOVQ,    X86_MOVQ },   match_move_back,      drop_second },
+    { "move-chain",      2, { X86_MOVQ,    X86_MOVQ },   match_move_chain,     fold_move_chain },
+    { "store-to-load",   2, { X86_MOVQ,    X86_MOVQ },   match_store_to_load,  forward_stored_value },
+    { "overwritten-move",2, { X86_MOVQ,    ANY_OPCODE }, match_overwritten_move, drop_first },
+    { "self-move",       1, { X86_MOVSD,   ANY_OPCODE }, match_self_move,      drop_first },
+    { "move-back",       2, { X86_MOVSD,   X86_MOVSD },  match_move_back,      drop_second },
+    { "move-chain",      2, { X86_MOVSD,   X86_MOVSD },  match_move_chain,     fold_move_chain },
+    { "overwritten-move",2, { X86_MOVSD,   ANY_OPCODE }, match_overwritten_move, drop_first },
+    { "zero-idiom",      1, { X86_MOVQ,    ANY_OPCODE }, match_zero_idiom,     use_xor_zero },
+    { "jump-to-next",    1, { X86_JMP,     ANY_OPCODE }, match_jump_to_next,   drop_first },
+    { "unreachable",     2, { ANY_OPCODE,  ANY_OPCODE }, match_unreachable,    drop_second },
+};
+
+#define NRULES (int)(sizeof(rules) / sizeof(rules[0]))
+
+static _Thread_local int rule_hits[NRULES];
+
+static bool window_matches(const peephole_rule *rule, x86_instr start, x86_instr *w) {
+    x86_instr i = start;
+    for (int k = 0; k < rule->window; k++) {
+        if (i == NULL) return false;
+        if (rule->opcodes[k] != ANY_OPCODE && rule->opcodes[k] != i->opcode) return false;
+        w[k] = i;
+        i = i->next;
+    }
+    return rule->match(w);
+}
+
+// rewrite the list to a fixed point; returns the number of rewrites
+int peephole(x86_list *list) {
+    int rewrites = 0;
+    x86_instr current = list->head;
+    while (current != NULL) {
+        x86_instr w[PEEPHOLE_MAX_WINDOW];
+        bool fired = false;
+        for (int r = 0; r < NRULES; r++) {
+            if (window_matches(&rules[r], current, w)) {
+                // rules never touch anything before the window, so resume just before it
+                x86_instr resume = current->prev;
+                rules[r].rewrite(list, w);
+                rule_hits[r]++;
+                rewrites++;
+                current = resume ? resume : list->head;
+                fired = true;
+                break;
+            }
+        }
+        if (!fired) current = current->next;
+    }
+    return rewrites;
+}
+
+void print_peephole_stats(FILE *out) {
+    for (int r = 0; r < NRULES; r++) {
+        fprintf(out, "%-16s %d\n", rules[r].name, rule_hits[r]);
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include <stdbool.h>
+#include "x86.h"
+
+#define PEEPHOLE_MAX_WINDOW 2
+#define ANY_OPCODE -1
+
+/*
+ * A rule fires on a window of consecutive instructions whose opcodes match
+ * `opcodes` (ANY_OPCODE matches anything) and for which `match` holds.
+ * `rewrite` may edit the window in place or remove its instructions, but
+ * must not touch anything before the window.
+ */
+typedef struct peephole_rule {
+    const char *name;
+    int window;
+    int opcodes[PEEPHOLE_MAX_WINDOW];
+    bool (*match)(x86_instr *w);
+    void (*rewrite)(x86_list *list, x86_instr *w);
+} peephole_rule;
+
+bool reg_dead_after(x86_instr instr, int reg);
+int peephole(x86_list *list);
+void print_peephole_stats(FILE *out);
+
+#endif
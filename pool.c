@@ -0,0 +1,53 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "pool.h"
+#include "k0ctx.h"
+
+struct pool {
+    void (*task)(int i, void *arg);
+    void *arg;
+    int n;
+    atomic_int next;
+    k0_context *parent;
+};
+
+static void *pool_worker(void *arg) {
+    struct pool *pool = arg;
+    k0_context *ctx = k0_create();
+    ctx->current_file = pool->parent->current_file ? strdup(pool->parent->current_file) : NULL;
+    ctx->error_limit = pool->parent->error_limit;
+    ctx->diag_json = pool->parent->diag_json;
+    ctx->lexer_engine = pool->parent->lexer_engine;
+    ctx->defer_diagnostics = true;
+    k0_use(ctx);
+    for (int i; (i = atomic_fetch_add(&pool->next, 1)) < pool->n; ) {
+        pool->task(i, pool->arg);
+    }
+    k0_destroy(ctx);
+    return NULL;
+}
+
+void pool_run(int threads, int n, void (*task)(int i, void *arg), void *arg) {
+    struct pool pool = {task, arg, n, 0, k0_get()};
+    if (threads > n) threads = n;
+    pthread_t *ids = calloc(threads, sizeof(pthread_t));
+    if (!ids) {
+        perror("Memory allocation failed");
+        k0_fail(4);
+    }
+    int started = 0;
+    for (; started < threads; started++) {
+        if (pthread_create(&ids[started], NULL, pool_worker, &pool) != 0) break;
+    }
+    if (started == 0) {
+        // no threads to be had; run the tasks here, still with a context of their own
+        pool_worker(&pool);
+        k0_use(pool.parent);
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(ids[i], NULL);
+    }
+    free(ids);
+}
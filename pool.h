@@ -0,0 +1,14 @@
+#ifndef POOL_H
+#define POOL_H
+
+/*
+ * Per-function work spread over threads. pool_run() calls task(i, arg) for
+ * every i in [0, n) on up to threads threads and returns once all are done.
+ * Each thread has its own k0_context current, made with the file name and
+ * diagnostics options of the caller's, whose diagnostics are kept back for
+ * the caller to replay in order (see diag_take()). Tasks are handed out one
+ * at a time, so uneven functions balance across the threads.
+ */
+void pool_run(int threads, int n, void (*task)(int i, void *arg), void *arg);
+
+#endif
@@ -0,0 +1,68 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "scanner.h"
+#include "fastlex.h"
+#include "k0ctx.h"
+#include "k0gram.h"
+
+extern int yylex(YYSTYPE *lval, yyscan_t scanner);
+extern int yylex_init_extra(struct k0_context *extra, yyscan_t *scanner);
+extern struct yy_buffer_state *yy_scan_buffer(char *base, size_t size, yyscan_t scanner);
+extern struct yy_buffer_state *yy_scan_bytes(const char *bytes, int length, yyscan_t scanner);
+extern void yyset_lineno(int line, yyscan_t scanner);
+extern int yyget_lineno(yyscan_t scanner);
+extern char *yyget_text(yyscan_t scanner);
+extern int yylex_destroy(yyscan_t scanner);
+
+struct scanner {
+    yyscan_t flex;              // NULL when the fast engine scans
+    struct fast_lexer *fast;
+};
+
+struct scanner *scanner_create(k0_context *ctx) {
+    struct scanner *scanner = calloc(1, sizeof(struct scanner));
+    if (!scanner) {
+        perror("Memory allocation failed");
+        k0_fail(4);
+    }
+    if (ctx->lexer_engine == LEXER_FAST) {
+        scanner->fast = fast_lexer_create(ctx);
+    } else if (yylex_init_extra(ctx, &scanner->flex) != 0) {
+        perror("Error creating scanner");
+        k0_fail(4);
+    }
+    return scanner;
+}
+
+void scanner_destroy(struct scanner *scanner) {
+    if (!scanner) return;
+    if (scanner->flex) yylex_destroy(scanner->flex);
+    fast_lexer_destroy(scanner->fast);
+    free(scanner);
+}
+
+void scanner_source(struct scanner *scanner, const char *source, size_t length, bool in_place, int line) {
+    if (scanner->fast) {
+        fast_lexer_source(scanner->fast, source, length, in_place, line);
+        return;
+    }
+    if (in_place) {
+        yy_scan_buffer((char *)source, length + 2, scanner->flex);
+    } else {
+        yy_scan_bytes(source, (int)length, scanner->flex);
+    }
+    // the line number lives in flex's buffer, which yy_scan_buffer() leaves unset
+    yyset_lineno(line, scanner->flex);
+}
+
+int scanner_lex(YYSTYPE *lval, struct scanner *scanner) {
+    return scanner->fast ? fast_lex(lval, scanner->fast) : yylex(lval, scanner->flex);
+}
+
+char *scanner_text(struct scanner *scanner) {
+    return scanner->fast ? fast_lexer_text(scanner->fast) : yyget_text(scanner->flex);
+}
+
+int scanner_line(struct scanner *scanner) {
+    return scanner->fast ? fast_lexer_line(scanner->fast) : yyget_lineno(scanner->flex);
+}
@@ -0,0 +1,41 @@
+#ifndef SCANNER_H
+#define SCANNER_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+struct k0_context;
+union YYSTYPE;
+
+/* Lexer engines, chosen with -lexer-engine */
+enum lexer_engine {
+    LEXER_FLEX,             /* generated from k0lex.l */
+    LEXER_FAST              /* hand-written, see fastlex.h */
+};
+
+/*
+ * The scanner yyparse() reads its tokens from, on the engine that
+ * ctx->lexer_engine names. Both give the same tokens, texts and line
+ * numbers, and report the same lexical errors, so the choice only changes
+ * how fast a file is lexed.
+ */
+struct scanner;
+
+struct scanner *scanner_create(struct k0_context *ctx);
+void scanner_destroy(struct scanner *scanner);
+
+/*
+ * Scan the length bytes at source, numbering lines from line. With in_place
+ * they are writable and followed by two NUL bytes, as for k0_parse(), and
+ * are scanned where they are; otherwise the scanner copies them.
+ */
+void scanner_source(struct scanner *scanner, const char *source, size_t length, bool in_place, int line);
+
+/* Next token, 0 at the end of the source; yylex() to the parser */
+int scanner_lex(union YYSTYPE *lval, struct scanner *scanner);
+
+/* Text of the last token, and the line the scanner is on */
+char *scanner_text(struct scanner *scanner);
+int scanner_line(struct scanner *scanner);
+
+#endif
@@ -0,0 +1,414 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "server.h"
+#include "k0.h"
+
+extern char **environ;
+
+#define MAX_REQUEST_STRINGS 4
+#define MAX_STRING_SIZE (1u << 30)
+
+const char *server_socket_path(void) {
+    static char path[PATH_MAX];
+    const char *env = getenv("K0_SOCKET");
+    if (env && *env) {
+        return env;
+    }
+    const char *runtime = getenv("XDG_RUNTIME_DIR");
+    if (runtime && *runtime) {
+        snprintf(path, sizeof(path), "%s/k0.sock", runtime);
+    } else {
+        snprintf(path, sizeof(path), "/tmp/k0-%d/k0.sock", (int)getuid());
+    }
+    return path;
+}
+
+// true if the other end of fd runs as this user
+static bool same_user(int fd) {
+    struct ucred cred;
+    socklen_t size = sizeof(cred);
+    return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &size) == 0 && cred.uid == getuid();
+}
+
+// the directory of socket_path, made if it is missing; it must belong to this
+// user and be closed to everyone else, so no one else can reach or replace the socket
+static bool private_directory(const char *socket_path) {
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s", socket_path);
+    char *slash = strrchr(dir, '/');
+    if (!slash) strcpy(dir, ".");
+    else if (slash == dir) slash[1] = '\0';
+    else *slash = '\0';
+    if (mkdir(dir, 0700) < 0 && errno != EEXIST) {
+        fprintf(stderr, "Error creating %s: %s\n", dir, strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if (lstat(dir, &st) < 0 || !S_ISDIR(st.st_mode) || st.st_uid != getuid() || (st.st_mode & 077)) {
+        fprintf(stderr, "Error: %s must be a directory of yours that only you can open (mode 0700)\n", dir);
+        return false;
+    }
+    return true;
+}
+
+// remove a socket a server of this user left behind; anything else at the path is kept
+static bool remove_stale_socket(const char *socket_path, struct sockaddr_un *addr) {
+    struct stat st;
+    if (lstat(socket_path, &st) < 0) {
+        return errno == ENOENT;
+    }
+    if (!S_ISSOCK(st.st_mode) || st.st_uid != getuid()) {
+        fprintf(stderr, "Error: %s exists and is not a socket of yours\n", socket_path);
+        return false;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    bool live = fd >= 0 && connect(fd, (struct sockaddr *)addr, sizeof(*addr)) == 0;
+    if (fd >= 0) close(fd);
+    if (live) {
+        fprintf(stderr, "Error: a server is already listening on %s\n", socket_path);
+        return false;
+    }
+    return unlink(socket_path) == 0 || errno == ENOENT;
+}
+
+static bool write_all(int fd, const void *data, size_t size) {
+    const char *p = data;
+    while (size > 0) {
+        ssize_t n = write(fd, p, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool read_all(int fd, void *data, size_t size) {
+    char *p = data;
+    while (size > 0) {
+        ssize_t n = read(fd, p, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool put_string(int fd, const char *s, size_t length) {
+    uint32_t n = (uint32_t)length;
+    return write_all(fd, &n, sizeof(n)) && write_all(fd, s, length);
+}
+
+// NUL-terminated copy of the next string on fd, or NULL
+static char *get_string(int fd, size_t *length) {
+    uint32_t n;
+    if (!read_all(fd, &n, sizeof(n)) || n > MAX_STRING_SIZE) return NULL;
+    char *s = malloc(n + 1);
+    if (!s) return NULL;
+    if (!read_all(fd, s, n)) {
+        free(s);
+        return NULL;
+    }
+    s[n] = '\0';
+    *length = n;
+    return s;
+}
+
+// path with its extension replaced by ext, the way the k0 driver names outputs
+static char *with_extension(const char *path, const char *ext) {
+    char *name = malloc(strlen(path) + strlen(ext) + 1);
+    if (!name) {
+        perror("Memory allocation failed");
+        exit(4);
+    }
+    strcpy(name, path);
+    char *dot = strrchr(name, '.');
+    if (dot && !strchr(dot, '/')) *dot = '\0';
+    strcat(name, ext);
+    return name;
+}
+
+// dir/name unless name is already absolute
+static char *resolve(const char *dir, const char *name) {
+    char *path = malloc(strlen(dir) + strlen(name) + 2);
+    if (!path) {
+        perror("Memory allocation failed");
+        exit(4);
+    }
+    if (name[0] == '/') {
+        strcpy(path, name);
+    } else {
+        sprintf(path, "%s/%s", dir, name);
+    }
+    return path;
+}
+
+static char *read_file(const char *path, size_t *length) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return NULL;
+    size_t cap = 4096, len = 0;
+    char *text = malloc(cap);
+    size_t n;
+    while (text && (n = fread(text + len, 1, cap - len, fp)) > 0) {
+        len += n;
+        if (len == cap) {
+            cap *= 2;
+            char *bigger = realloc(text, cap);
+            if (!bigger) free(text);
+            text = bigger;
+        }
+    }
+    fclose(fp);
+    *length = len;
+    return text;
+}
+
+static bool write_file(const char *path, const char *data, size_t length, FILE *err) {
+    FILE *fp = fopen(path, "wb");
+    if (!fp) {
+        fprintf(err, "Error writing %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    fwrite(data, 1, length, fp);
+    fclose(fp);
+    return true;
+}
+
+static bool link_executable(const char *obj_file, const char *exe_file) {
+    char *argv[] = { "gcc", "-no-pie", "-o", (char *)exe_file, (char *)obj_file, "-lm", NULL };
+    pid_t pid;
+    if (posix_spawnp(&pid, "gcc", NULL, NULL, argv, environ) != 0) return false;
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) return false;
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// do what `k0 action file` does in cwd, with the driver's messages going to out and err
+static int compile_request(k0_context *ctx, const char *action, const char *cwd, const char *file,
+                           const char *source, size_t length, FILE *out, FILE *err) {
+    bool executable = action[0] == '\0';
+    int emit = strcmp(action, "-ic") == 0 ? K0_EMIT_IC :
+               strcmp(action, "-s") == 0 ? K0_EMIT_ASM :
+               strcmp(action, "-c") == 0 || executable ? K0_EMIT_OBJ : 0;
+    if (!emit) {
+        fprintf(err, "Error: the compile server does not handle %s\n", action);
+        return 4;
+    }
+
+    char *path = resolve(cwd, file);
+    char *text = NULL;
+    if (!source) {
+        text = read_file(path, &length);
+        if (!text) {
+            fprintf(err, "Error opening file: %s\n", strerror(errno));
+            free(path);
+            return 4;
+        }
+        source = text;
+    }
+    int status = k0_compile(ctx, file, source, length, emit);
+    free(text);
+
+    size_t n;
+    const char *diagnostics = k0_diagnostics(ctx, &n);
+    fwrite(diagnostics, 1, n, err);
+    if (status != 0) {
+        free(path);
+        return status;
+    }
+
+    // name the outputs as the driver does, but write them next to the source
+    struct { int emit; const char *ext; const char *what; } outputs[] = {
+        { K0_EMIT_IC, ".ic", "intermediate code" },
+        { K0_EMIT_ASM, ".S", "assembly code" },
+        { K0_EMIT_OBJ, ".o", "object file" },
+    };
+    for (int i = 0; i < 3 && status == 0; i++) {
+        if (i > 0 && !(emit & outputs[i].emit)) continue;
+        const char *data = i == 0 ? k0_ic(ctx, &n) : i == 1 ? k0_asm(ctx, &n) : k0_object(ctx, &n);
+        char *name = with_extension(file, outputs[i].ext);
+        char *out_path = with_extension(path, outputs[i].ext);
+        fprintf(out, "Generating %s: %s\n", outputs[i].what, name);
+        if (!write_file(out_path, data, n, err)) status = 4;
+        free(name);
+        free(out_path);
+    }
+
+    if (status == 0 && executable) {
+        char *base = with_extension(file, "");
+        char *slash = strrchr(base, '/');
+        char *exe_file = resolve(cwd, slash ? slash + 1 : base);
+        char *obj_file = with_extension(path, ".o");
+        fprintf(out, "Generating executable: %s\n", slash ? slash + 1 : base);
+        if (link_executable(obj_file, exe_file)) {
+            fprintf(out, "Successfully generated executable: %s\n", slash ? slash + 1 : base);
+        } else {
+            fprintf(err, "Error: Linking failed\n");
+            status = 4;
+        }
+        free(base);
+        free(exe_file);
+        free(obj_file);
+    }
+    free(path);
+    return status;
+}
+
+static void handle_request(k0_context *ctx, int fd) {
+    uint32_t count;
+    char *field[MAX_REQUEST_STRINGS] = { NULL };
+    size_t length[MAX_REQUEST_STRINGS] = { 0 };
+    if (!read_all(fd, &count, sizeof(count)) || count < 3 || count > MAX_REQUEST_STRINGS) return;
+    for (uint32_t i = 0; i < count; i++) {
+        field[i] = get_string(fd, &length[i]);
+        if (!field[i]) goto done;
+    }
+
+    char *out_text = NULL, *err_text = NULL;
+    size_t out_len = 0, err_len = 0;
+    FILE *out = open_memstream(&out_text, &out_len);
+    FILE *err = open_memstream(&err_text, &err_len);
+    if (!out || !err) {
+        perror("Error opening memory stream");
+        exit(4);
+    }
+    uint32_t status = compile_request(ctx, field[0], field[1], field[2], field[3], length[3], out, err);
+    fclose(out);
+    fclose(err);
+    if (write_all(fd, &status, sizeof(status)) && put_string(fd, out_text, out_len)) {
+        put_string(fd, err_text, err_len);
+    }
+    free(out_text);
+    free(err_text);
+
+done:
+    for (int i = 0; i < MAX_REQUEST_STRINGS; i++) {
+        free(field[i]);
+    }
+}
+
+// each worker keeps one context warm and takes connections straight off the socket
+static void *worker(void *arg) {
+    int listen_fd = *(int *)arg;
+    k0_context *ctx = k0_create();
+    for (;;) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            perror("Error accepting compile request");
+            break;
+        }
+        // requests write files as this user, so only this user may send them
+        if (!same_user(fd)) {
+            close(fd);
+            continue;
+        }
+        handle_request(ctx, fd);
+        close(fd);
+    }
+    k0_destroy(ctx);
+    return NULL;
+}
+
+int serve(const char *socket_path, int workers) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Error: socket path too long: %s\n", socket_path);
+        return 4;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    // a client that goes away must not take the server with it
+    signal(SIGPIPE, SIG_IGN);
+
+    if (!private_directory(socket_path) || !remove_stale_socket(socket_path, &addr)) {
+        return 4;
+    }
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        perror("Error creating socket");
+        return 4;
+    }
+    // only the user may open the socket; set before any worker thread could race the umask
+    mode_t mask = umask(0077);
+    int bound = bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(mask);
+    if (bound < 0 || listen(listen_fd, 64) < 0) {
+        perror("Error listening on socket");
+        close(listen_fd);
+        return 4;
+    }
+
+    pthread_t *threads = calloc(workers, sizeof(pthread_t));
+    if (!threads) {
+        perror("Memory allocation failed");
+        exit(4);
+    }
+    printf("k0 server listening on %s with %d workers\n", socket_path, workers);
+    fflush(stdout);
+    for (int i = 0; i < workers; i++) {
+        if (pthread_create(&threads[i], NULL, worker, &listen_fd) != 0) {
+            perror("Error starting worker");
+            exit(4);
+        }
+    }
+    for (int i = 0; i < workers; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    close(listen_fd);
+    unlink(socket_path);
+    return 4;
+}
+
+int client_compile(const char *socket_path, const char *action, const char *source_file) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) return -1;
+    strcpy(addr.sun_path, socket_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    // a socket some other user put there is no server of ours; compile locally
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || !same_user(fd)) {
+        close(fd);
+        return -1;
+    }
+
+    char cwd[PATH_MAX];
+    uint32_t count = 3;
+    uint32_t status;
+    char *out_text = NULL, *err_text = NULL;
+    size_t out_len, err_len;
+    bool ok = getcwd(cwd, sizeof(cwd)) != NULL &&
+              write_all(fd, &count, sizeof(count)) &&
+              put_string(fd, action, strlen(action)) &&
+              put_string(fd, cwd, strlen(cwd)) &&
+              put_string(fd, source_file, strlen(source_file)) &&
+              read_all(fd, &status, sizeof(status)) &&
+              (out_text = get_string(fd, &out_len)) != NULL &&
+              (err_text = get_string(fd, &err_len)) != NULL;
+    close(fd);
+    if (ok) {
+        fwrite(out_text, 1, out_len, stdout);
+        fwrite(err_text, 1, err_len, stderr);
+    }
+    free(out_text);
+    free(err_text);
+    return ok ? (int)status : -1;
+}
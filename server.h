@@ -0,0 +1,28 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+/*
+ * Compile server: worker threads, each with its own k0_context, accept
+ * requests on a UNIX domain socket so a compile skips process startup.
+ *
+ * A request is a list of strings: the action flag ("-ic", "-s", "-c" or ""
+ * for an executable), the client's working directory, the absolute source
+ * path, and optionally the source text itself. Every string is a 32-bit
+ * length followed by its bytes, and the list is preceded by its count.
+ * The reply is the exit status, then the text for stdout and for stderr.
+ *
+ * The socket's directory must belong to the user and be mode 0700, only
+ * the user can open the socket, and both ends check that the other runs as the
+ * same user, since a request writes files with the server's permissions.
+ */
+
+/* $K0_SOCKET, or k0.sock in $XDG_RUNTIME_DIR or else in /tmp/k0-<uid> */
+const char *server_socket_path(void);
+
+/* Serve requests on socket_path with workers threads; returns only on error */
+int serve(const char *socket_path, int workers);
+
+/* Forward one compile to the server; returns its exit status, or -1 if no server answers */
+int client_compile(const char *socket_path, const char *action, const char *source_file);
+
+#endif
@@ -1,6 +1,14 @@
 #include "symtab.h"
 #include "type.h"
+#include "k0ctx.h"
+#include "timing.h"
+#include "memstat.h"
+#include "diag.h"
+#include "pool.h"
 #include <stdarg.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <pthread.h>
 
 extern typeptr null_typeptr;
 extern typeptr integer_typeptr;
@@ -8,6 +16,7 @@ extern typeptr double_typeptr;
 extern typeptr boolean_typeptr;
 extern typeptr char_typeptr;
 extern typeptr unit_typeptr;
+extern struct tree_visitor string_collector(void);
 
 //int current_offset = 0;
 
@@ -24,76 +33,79 @@ enum sem_errors {
     INVALID_OP,
     BAD_UMINUS,
     DIV_ZERO,
-    NO_MAIN
+    NO_MAIN,
+    FUNC_NOT_TAILREC
 };
 
 void semantic_error(int error, int lineno, char *filename, ...) {
     va_list args;
     va_start(args, filename);
-    fprintf(stderr, "Semantic Error: ");
     const char *func_name, *val_name, *type1, *type2, *msg, *op;
     switch(error) {
         case FUNC_REDECL:
             func_name = va_arg(args, const char *);
-            fprintf(stderr, "Function '%s' redeclared in %s on line %d.\n", func_name, filename, lineno);
+            diag_error(DIAG_SEMANTIC, filename, lineno, "Function '%s' redeclared in %s on line %d.", func_name, filename, lineno);
             break;
         case FUNC_UNDECL:
             func_name = va_arg(args, const char *);
-            fprintf(stderr, "Function '%s' undeclared before use in %s on line %d.\n", func_name, filename, lineno);
+            diag_error(DIAG_SEMANTIC, filename, lineno, "Function '%s' undeclared before use in %s on line %d.", func_name, filename, lineno);
             break;
         case VAR_REDECL:
             val_name = va_arg(args, const char *);
-            fprintf(stderr, "Variable '%s' redeclared in %s on line %d.\n", val_name, filename, lineno);
+            diag_error(DIAG_SEMANTIC, filename, lineno, "Variable '%s' redeclared in %s on line %d.", val_name, filename, lineno);
             break;
         case VAR_UNDECL:
             val_name = va_arg(args, const char *);
-            fprintf(stderr, "Variable '%s' undeclared before use in %s on line %d.\n", val_name, filename, lineno);
+            diag_error(DIAG_SEMANTIC, filename, lineno, "Variable '%s' undeclared before use in %s on line %d.", val_name, filename, lineno);
             break;
         case TYPE_MISMATCH:
             type1 = va_arg(args, const char *);
             type2 = va_arg(args, const char *);
-            fprintf(stderr, "Type mismatch! Expected type <%s> but got <%s>. Line %d in file %s.\n", type1, type2, lineno, filename);
+            diag_error(DIAG_SEMANTIC, filename, lineno, "Type mismatch! Expected type <%s> but got <%s>. Line %d in file %s.", type1, type2, lineno, filename);
             break;
         case INVALID_OP:
             type1 = va_arg(args, const char *);
             type2 = va_arg(args, const char *);
-            fprintf(stderr, "Invalid operation between <%s> and <%s> types. Found on line %d in file %s.\n", type1, type2, lineno, filename);
+            diag_error(DIAG_SEMANTIC, filename, lineno, "Invalid operation between <%s> and <%s> types. Found on line %d in file %s.", type1, type2, lineno, filename);
             break;
         case DIV_ZERO:
-            fprintf(stderr, "Expression on line %d contains division by zero in file %s.\n", lineno, filename);
+            diag_error(DIAG_SEMANTIC, filename, lineno, "Expression on line %d contains division by zero in file %s.", lineno, filename);
             break;
         case FUNC_BAD_ARGS:
             func_name = va_arg(args, const char *);
             msg = va_arg(args, const char *);
-            fprintf(stderr, "Error in function call for '%s': %s. Found on line %d in file %s.\n", func_name, msg, lineno, filename);
+            diag_error(DIAG_SEMANTIC, filename, lineno, "Error in function call for '%s': %s. Found on line %d in file %s.", func_name, msg, lineno, filename);
             break;
         case BAD_UMINUS:
             op = va_arg(args, const char *);
             type1 = va_arg(args, const char *);
-            fprintf(stderr, "Cannot use operator '%s' with type <%s>. Found on line %d in file %s.\n", op, type1, lineno, filename);
+            diag_error(DIAG_SEMANTIC, filename, lineno, "Cannot use operator '%s' with type <%s>. Found on line %d in file %s.", op, type1, lineno, filename);
             break;
         case FUNC_NO_RET:
             func_name = va_arg(args, const char *);
             type1 = va_arg(args, const char *);
-            fprintf(stderr, "Function '%s' declares return type <%s>, but no return statement found. Found on line %d in file %s.\n", func_name, type1, lineno, filename);
+            diag_error(DIAG_SEMANTIC, filename, lineno, "Function '%s' declares return type <%s>, but no return statement found. Found on line %d in file %s.", func_name, type1, lineno, filename);
             break;
         case FUNC_INCOMP_RET:
             func_name = va_arg(args, const char *);
-            fprintf(stderr, "Function '%s' has return statement but no value was given. Found on line %d in file %s.\n", func_name, lineno, filename);
+            diag_error(DIAG_SEMANTIC, filename, lineno, "Function '%s' has return statement but no value was given. Found on line %d in file %s.", func_name, lineno, filename);
             break;
         case FUNC_RET_TYPE_MISMATCH:
             func_name = va_arg(args, const char *);
             type1 = va_arg(args, const char *);
             type2 = va_arg(args, const char *);
-            fprintf(stderr, "Function '%s' has expected return type <%s> but got <%s>. Found on line %d in file %s.\n", func_name, type1, type2, lineno, filename);
+            diag_error(DIAG_SEMANTIC, filename, lineno, "Function '%s' has expected return type <%s> but got <%s>. Found on line %d in file %s.", func_name, type1, type2, lineno, filename);
             break;
         case NO_MAIN:
-            fprintf(stderr, "Function 'main' not found.\n");
+            diag_error(DIAG_SEMANTIC, filename, lineno, "Function 'main' not found.");
+            break;
+        case FUNC_NOT_TAILREC:
+            func_name = va_arg(args, const char *);
+            diag_error(DIAG_SEMANTIC, filename, lineno, "Function '%s' is marked tailrec but calls itself outside tail position. Found on line %d in file %s.", func_name, lineno, filename);
             break;
 
     }
     va_end(args);
-    exit(3);
 }
 
 void print_table_header(SymbolTable table)
@@ -217,17 +229,17 @@ void print_tables(ListSymbolTables tables)
 
 SymbolTable mksymtab(SymbolTable parent)
 {
-    SymbolTable ntab = malloc(sizeof(struct sym_table));
+    SymbolTable ntab = mem_zalloc(MEM_SYMTAB, sizeof(struct sym_table));
     if (ntab == NULL)
     {
         perror("Memory allocation failed");
-        exit(4);
+        k0_fail(4);
     }
     ntab->nBuckets = 50;
     ntab->nEntries = 0;
     ntab->current_offset = 0;
     ntab->parent = parent;
-    ntab->tbl = calloc(ntab->nBuckets, sizeof(SymbolTableEntry));
+    ntab->tbl = mem_zalloc(MEM_SYMTAB, ntab->nBuckets * sizeof(SymbolTableEntry));
     ntab->function = false;
     ntab->package = false;
     ntab->class = false;
@@ -236,12 +248,13 @@ SymbolTable mksymtab(SymbolTable parent)
 
 SymbolTableEntry create_nentry(char *text, SymbolTable tab, typeptr type)
 {
-    SymbolTableEntry nentry = calloc(1, sizeof(struct sym_entry));
+    SymbolTableEntry nentry = mem_zalloc(MEM_SYMTAB, sizeof(struct sym_entry));
     nentry->s = text;
     nentry->scope = tab;
     nentry->type = type;
     nentry->next = NULL;
     nentry->built_in = false;
+    count_event(COUNT_SYMBOLS, 1);
     // if (type->basetype != FUNC_TYPE) {
     //     nentry->memloc = tab->current_offset;
     //     tab->current_offset += 8;
@@ -266,11 +279,11 @@ SymbolTableEntry create_nentry(char *text, SymbolTable tab, typeptr type)
 
 ListSymbolTables add_symbol_table(ListSymbolTables list, SymbolTable table)
 {
-    ListSymbolTables newListEntry = malloc(sizeof(struct symbol_table_list));
+    ListSymbolTables newListEntry = mem_alloc(MEM_SYMTAB, sizeof(struct symbol_table_list));
     if (newListEntry == NULL)
     {
         perror("Memory allocation failed");
-        exit(4);
+        k0_fail(4);
     }
     newListEntry->table = table;
     newListEntry->next = NULL;
@@ -308,20 +321,20 @@ SymbolTableEntry find_symbol(SymbolTable tab, const char *symbolText)
     }
     if (tab->tbl == NULL)
     {
-        printf("ERROR: tab->tbl is NULL!\n");
-        exit(4);
+        fprintf(k0_out(), "ERROR: tab->tbl is NULL!\n");
+        k0_fail(4);
     }
     if (tab->nBuckets <= 0)
     {
-        printf("ERROR: nBuckets is zero or negative!\n");
-        exit(4);
+        fprintf(k0_out(), "ERROR: nBuckets is zero or negative!\n");
+        k0_fail(4);
     }
 
     int bucket = hash(tab, symbolText);
     if (bucket < 0 || bucket >= tab->nBuckets)
     {
-        printf("ERROR: Invalid bucket index %d!\n", bucket);
-        exit(4);
+        fprintf(k0_out(), "ERROR: Invalid bucket index %d!\n", bucket);
+        k0_fail(4);
     }
 
     SymbolTableEntry entry = tab->tbl[bucket];
@@ -364,7 +377,7 @@ void insert_builtin_function(SymbolTable tab, char *symbolText, int type, int np
     paramlist *curr = &head;
     for (int i = 0; i < nparams; i++) {
         char *paramType = va_arg(args, char*);  // get next parameter type
-        *curr = malloc(sizeof(struct param));
+        *curr = mem_alloc(MEM_TYPE, sizeof(struct param));
         (*curr)->name = NULL;  // optionally set a name
         (*curr)->type = alctype(name_to_typeint(paramType));
         (*curr)->next = NULL;
@@ -429,9 +442,9 @@ paramlist process_parameter(struct tree *node)
 {
     if (node == NULL)
         return NULL;
-    paramlist parameter = malloc(sizeof(struct param));
-    char *name = node->kids[0]->leaf->text;
-    char *type = node->kids[1]->kids[1]->leaf->text;
+    paramlist parameter = mem_alloc(MEM_TYPE, sizeof(struct param));
+    char *name = PARAM_NAME(node)->leaf->text;
+    char *type = TYPE_NAME(PARAM_TYPE(node))->leaf->text;
     typeptr ptr = alctype(name_to_typeint(type));       // handles singleton/shared
     parameter->type = ptr;
     parameter->name = name;
@@ -500,14 +513,15 @@ typeptr process_array_type(struct tree *node)
 // validates ret val inside ret statement to match func ret type
 void validate_return_statement(SymbolTable scope, struct tree* return_node) {
     // get lineno/filename for errors
-    int lineno = return_node->kids[0]->leaf->lineno;
-    char *filename = return_node->kids[0]->leaf->filename;
+    int lineno = RETURN_KEYWORD(return_node)->leaf->lineno;
+    char *filename = RETURN_KEYWORD(return_node)->leaf->filename;
+    struct tree *value = RETURN_VALUE(return_node);
     // get current func
     SymbolTableEntry entry = find_symbol(scope, scope->table_name);
     int var_type = 0;
     // ret val is token
-    if (return_node->kids[1]->leaf != NULL) {
-        switch(return_node->kids[1]->leaf->category) {
+    if (value->leaf != NULL) {
+        switch(value->leaf->category) {
             case IntegerLiteral:
                 var_type = INT_TYPE;
                 break;
@@ -524,7 +538,7 @@ void validate_return_statement(SymbolTable scope, struct tree* return_node) {
                 var_type = STRING_TYPE;
                 break;
             case ArrayLiteral:
-                printf("TODO: validate returns with arrays\n");
+                fprintf(k0_out(), "TODO: validate returns with arrays\n");
                 break;
             case BooleanLiteral:
                 var_type = BOOL_TYPE;
@@ -533,7 +547,7 @@ void validate_return_statement(SymbolTable scope, struct tree* return_node) {
                 var_type = NULL_TYPE;
                 break;
             case Identifier:
-                char *var_text = return_node->kids[1]->leaf->text;
+                char *var_text = value->leaf->text;
                 SymbolTableEntry var_entry = find_symbol(scope, var_text);
                 // undeclared var
                 if (var_entry == NULL) {
@@ -557,14 +571,14 @@ void validate_return_statement(SymbolTable scope, struct tree* return_node) {
                 }
                 return; // passed, can go back
             default:
-                printf("debug: unexpected return arg: got token category %d\n", return_node->kids[1]->leaf->category);
+                fprintf(k0_out(), "debug: unexpected return arg: got token category %d\n", value->leaf->category);
                 break;
         }
     }
     // ret val is node
     else {
-        var_type = check_expression(return_node->kids[1], scope);
-        printf("node is %s\n", typeint_to_name(var_type));
+        var_type = check_expression(value, scope);
+        fprintf(k0_out(), "node is %s\n", typeint_to_name(var_type));
 
     }
     if (var_type != entry->type->u.f.returntype->basetype) {
@@ -581,33 +595,28 @@ void validate_return_statement(SymbolTable scope, struct tree* return_node) {
 
 // make sure function has return statement; does not validate type
 void check_function_has_return_statement(struct tree *func_node, char *func_name, char *ret_type) {
-    // block node is last child
-    int i = func_node->nkids - 1;
-    struct tree *block_node = func_node->kids[i];
-    // check statements
-    struct tree* statements_node = block_node->kids[1];
-    i = statements_node->nkids - 1; // return should be last child node
+    struct tree* statements_node = BLOCK_BODY(FUNC_BODY(func_node));
+    // return should be the last statement
+    struct tree *ret_statement_node = statements_node->kids[statements_node->nkids - 1];
+    if (ret_statement_node->leaf != NULL && ret_statement_node->leaf->category == RETURN) {
+        // incomplete return statement; ie only has `return`. no var given
+        semantic_error(
+            FUNC_INCOMP_RET,
+            ret_statement_node->leaf->lineno,
+            ret_statement_node->leaf->filename,
+            func_name
+        );
+    }
     // check return statement exists
-    if (strcmp(statements_node->kids[i]->symbolname, "ReturnStatement") != 0) {
+    if (ret_statement_node->leaf != NULL || ret_statement_node->prodrule != RETURN_RULE) {
         semantic_error(
             FUNC_NO_RET,
-            func_node->kids[0]->leaf->lineno,
-            func_node->kids[0]->leaf->filename,
+            FUNC_KEYWORD(func_node)->leaf->lineno,
+            FUNC_KEYWORD(func_node)->leaf->filename,
             func_name,
             ret_type
         );
     }
-    // check return statement is complete
-    struct tree *ret_statement_node = statements_node->kids[i];
-    if (ret_statement_node->kids[0]->leaf != NULL) {
-        // incomplete return statement; ie only has `return`. no var given
-        semantic_error(
-            FUNC_INCOMP_RET,
-            ret_statement_node->kids[0]->leaf->lineno,
-            ret_statement_node->kids[0]->leaf->filename,
-            func_name
-        );
-    }
 }
 
 typeptr process_function_return_type(char *s, struct tree *node, char *func_name)
@@ -636,7 +645,7 @@ char *extract_fun_name(struct tree *node)
 SymbolTable process_function_declaration(struct tree *node, SymbolTable outer_scope)
 {
     SymbolTable functionScope = mksymtab(outer_scope);
-    struct tree *param_head = node->kids[3];
+    struct tree *param_head = FUNC_PARAMS(node);
     char *func_name = NULL;
     char *ret_type_str = NULL;
     struct tree *type_node = NULL;
@@ -646,8 +655,8 @@ SymbolTable process_function_declaration(struct tree *node, SymbolTable outer_sc
     {
         semantic_error(
             FUNC_REDECL,
-            node->kids[1]->leaf->lineno,
-            node->kids[1]->leaf->filename,
+            FUNC_NAME(node)->leaf->lineno,
+            FUNC_NAME(node)->leaf->filename,
             func_name
         );
     }
@@ -659,7 +668,7 @@ SymbolTable process_function_declaration(struct tree *node, SymbolTable outer_sc
             if (node->kids[i]->nkids == 0) {
                 break;
             }
-            ret_type_str = node->kids[i]->kids[1]->leaf->text;
+            ret_type_str = TYPE_NAME(node->kids[i])->leaf->text;
             type_node = node;
         }
         else if (node->kids[i]->leaf != NULL && node->kids[i]->leaf->category == ARRAY_TYPE)
@@ -668,7 +677,7 @@ SymbolTable process_function_declaration(struct tree *node, SymbolTable outer_sc
             type_node = node;
         }
     }
-    typeptr func_info = malloc(sizeof(struct typeinfo));
+    typeptr func_info = mem_alloc(MEM_TYPE, sizeof(struct typeinfo));
     func_info->basetype = FUNC_TYPE;
     func_info->u.f.nparams = 0;
     func_info->u.f.parameters = NULL;
@@ -693,33 +702,35 @@ SymbolTable process_function_declaration(struct tree *node, SymbolTable outer_sc
 void process_arg_node(struct tree *node, SymbolTable scope, paramlist *currentParam, int *argCount, int lineno, char *filename, char *funcName) {
     if (node == NULL) return;
 
-    if (node->symbolname && strcmp(node->symbolname, "FuncArgList") == 0 && node->nkids == 3) {
+    if (node->symbolname && strcmp(node->symbolname, "FuncArgList") == 0 && node->nkids >= 1) {
         process_arg_node(node->kids[0], scope, currentParam, argCount, lineno, filename, funcName);
-        struct tree *argExpr = node->kids[2];
-        (*argCount)++;
+        for (int i = 1; i < node->nkids; i++) {
+            struct tree *argExpr = node->kids[i];
+            (*argCount)++;
 
-        if (*currentParam == NULL) {
-            semantic_error(
-                FUNC_BAD_ARGS,
-                lineno,
-                filename,
-                funcName,
-                "too many args"
-            );
-        }
-        else {
-            printf("here1\n");
-            int argType = check_expression(argExpr, scope);
-            if (argType != (*currentParam)->type->basetype) {
+            if (*currentParam == NULL) {
                 semantic_error(
                     FUNC_BAD_ARGS,
                     lineno,
                     filename,
                     funcName,
-                    "arg type mismatch"
+                    "too many args"
                 );
             }
-            *currentParam = (*currentParam)->next;
+            else {
+                fprintf(k0_out(), "here1\n");
+                int argType = check_expression(argExpr, scope);
+                if (argType != (*currentParam)->type->basetype) {
+                    semantic_error(
+                        FUNC_BAD_ARGS,
+                        lineno,
+                        filename,
+                        funcName,
+                        "arg type mismatch"
+                    );
+                }
+                *currentParam = (*currentParam)->next;
+            }
         }
     }
     else if (node->leaf != NULL) {
@@ -764,13 +775,25 @@ void process_arg_node(struct tree *node, SymbolTable scope, paramlist *currentPa
 
     }
     else {
-        printf("debug: unexpected args in funcCall\n");
+        fprintf(k0_out(), "debug: unexpected args in funcCall\n");
     }
 }
 
 
 void check_argument_list(struct tree *arg_node, paramlist expectedParams, SymbolTable scope, int lineno, char *filename, char *funcName) {
-    if (strcmp(funcName, "println") == 0) return;
+    // println takes one argument of any type
+    if (strcmp(funcName, "println") == 0) {
+        if (strcmp(arg_node->symbolname, "FuncArgList") == 0) {
+            semantic_error(
+                FUNC_BAD_ARGS,
+                lineno,
+                filename,
+                funcName,
+                "too many args"
+            );
+        }
+        return;
+    }
     paramlist currentParam = expectedParams;
     int argCount = 0;
     process_arg_node(arg_node, scope, &currentParam, &argCount, lineno, filename, funcName);
@@ -787,9 +810,9 @@ void check_argument_list(struct tree *arg_node, paramlist expectedParams, Symbol
 
 // check args are right amount and type
 int validate_function_call(struct tree *node, SymbolTable scope) {
-    int lineno = node->kids[0]->leaf->lineno;
-    char *filename = node->kids[0]->leaf->filename;
-    char *funcName = node->kids[0]->leaf->text;
+    int lineno = CALL_NAME(node)->leaf->lineno;
+    char *filename = CALL_NAME(node)->leaf->filename;
+    char *funcName = CALL_NAME(node)->leaf->text;
     SymbolTableEntry entry = find_symbol(scope, funcName);
     // func undeclared
     if (entry == NULL) {
@@ -797,13 +820,13 @@ int validate_function_call(struct tree *node, SymbolTable scope) {
             FUNC_UNDECL,
             lineno,
             filename,
-            node->kids[0]->leaf->text
+            funcName
         );
     }
     // check arguments
-    struct tree *arg_node = node->kids[2];
+    struct tree *arg_node = CALL_ARGS(node);
     // list of args
-    if (node->kids[2]->symbolname != NULL) {
+    if (arg_node->symbolname != NULL) {
         check_argument_list(
             arg_node,
             entry->type->u.f.parameters,
@@ -816,6 +839,16 @@ int validate_function_call(struct tree *node, SymbolTable scope) {
     // only one arg
     else {
         paramlist expected = entry->type->u.f.parameters;
+        if (expected == NULL || expected->next != NULL) {
+            semantic_error(
+                FUNC_BAD_ARGS,
+                lineno,
+                filename,
+                funcName,
+                expected == NULL ? "too many args" : "too few args"
+            );
+            return 0;
+        }
         int argType = check_expression(arg_node, scope);
         if (expected->type->basetype == ANY_TYPE) return 0;
         if (argType != expected->type->basetype) {
@@ -833,7 +866,7 @@ int validate_function_call(struct tree *node, SymbolTable scope) {
 
 typeptr process_declaration_type(struct tree *node, SymbolTable scope)
 {
-    typeptr type;
+    typeptr type = alctype(ANY_TYPE);
     // for (int i = 0; i < node->nkids; i++) {
     //     if (node->kids[i]->prodrule == TYPE_RULE) {
     //         if (node->kids[i]->nkids == 0) {
@@ -845,22 +878,25 @@ typeptr process_declaration_type(struct tree *node, SymbolTable scope)
     //     }
     // }
         // type explicitly declared
-    if (node->kids[2]->prodrule == TYPE_RULE && node->kids[2]->nkids != 0)
+    if (DECL_TYPE(node)->prodrule == TYPE_RULE && DECL_TYPE(node)->nkids != 0)
     {
-        struct tree *type_node = node->kids[2];
-        char *var_type = type_node->kids[1]->leaf->text;
+        struct token *type_leaf = TYPE_NAME(DECL_TYPE(node))->leaf;
+        char *var_type = type_leaf->text;
         if (name_to_typeint(var_type) == -1)
         {
-            printf("Semantic Error: Unknown value type '%s'.\n", var_type);
-            exit(3);
+            diag_error(DIAG_SEMANTIC, type_leaf->filename, type_leaf->lineno, "Unknown value type '%s'.", var_type);
         }
         // printf("type: %s\n", var_type);
         type = alctype(name_to_typeint(var_type));
     }
-    // implicit
+    // implicit; only a literal's type is inferred
+    else if (ASSIGN_VALUE(DECL_INIT(node))->leaf == NULL)
+    {
+        struct token *name_leaf = DECL_NAME(node)->leaf;
+        diag_error(DIAG_SEMANTIC, name_leaf->filename, name_leaf->lineno, "Cannot infer the type of '%s'; declare it.", name_leaf->text);
+    }
     else {
-        struct tree *assign_node = node->kids[3];
-        int category = assign_node->kids[1]->leaf->category;
+        int category = ASSIGN_VALUE(DECL_INIT(node))->leaf->category;
         switch(category) {
             case BooleanLiteral:
                 type = alctype(name_to_typeint("Boolean"));
@@ -884,14 +920,14 @@ typeptr process_declaration_type(struct tree *node, SymbolTable scope)
                 type = alctype(name_to_typeint("String"));
                 break;
             case Identifier:
-                printf("add Identifier support for assignment\n");
+                fprintf(k0_out(), "add Identifier support for assignment\n");
                 break;
             case ArrayLiteral:
-                printf("add ArrayLiteral support for assignment\n");
+                fprintf(k0_out(), "add ArrayLiteral support for assignment\n");
                 break;
             default:
-                fprintf(stderr, "Unknown var assignment");
-                exit(4);   
+                fprintf(k0_diag(), "Unknown var assignment");
+                k0_fail(4);   
         }
     }
     return type;
@@ -899,23 +935,23 @@ typeptr process_declaration_type(struct tree *node, SymbolTable scope)
 
 void process_variable_declaration(struct tree *node, SymbolTable scope)
 {
-    char *name = node->kids[1]->leaf->text;
+    char *name = DECL_NAME(node)->leaf->text;
     if (find_symbol(scope, name) != NULL)
     {
         semantic_error(
             VAR_REDECL,
-            node->kids[1]->leaf->lineno,
-            node->kids[1]->leaf->filename,
+            DECL_NAME(node)->leaf->lineno,
+            DECL_NAME(node)->leaf->filename,
             name
         );
     }
-    else if (node->kids[0]->leaf->category == VAL)
+    else if (DECL_KIND(node)->leaf->category == VAL)
     {
         SymbolTableEntry nentry = create_nentry(name, scope, process_declaration_type(node, scope));
         nentry->kind = CONSTANT;
         insert_symbol(scope, name, nentry);
     }
-    else if (node->kids[0]->leaf->category == VAR)
+    else if (DECL_KIND(node)->leaf->category == VAR)
     {
         SymbolTableEntry nentry = create_nentry(name, scope, process_declaration_type(node, scope));
         nentry->kind = VARIABLE;
@@ -926,7 +962,7 @@ void process_variable_declaration(struct tree *node, SymbolTable scope)
 
 void process_assignment(struct tree *node, SymbolTable scope)
 {
-    struct token *var = node->kids[0]->leaf;
+    struct token *var = ASSIGN_TARGET(node)->leaf;
     // for (int i = 0; i < node->nkids; i++)
     // {
     //     if (node->kids[i] != NULL && node->kids[i]->leaf != NULL)
@@ -979,75 +1015,83 @@ void process_assignment(struct tree *node, SymbolTable scope)
 //     }
 // }
 
-void extract_symbols(struct tree *node, SymbolTable currentScope, ListSymbolTables list, struct tree *parent)
-{
-    if (node == NULL)
-        return;
+// scope a symbol table walk is in; functions and imports open a new one for their children
+struct scope_walk {
+    SymbolTable scope;
+    ListSymbolTables list;
+};
 
-    // if (node->prodrule == EXPRESSION_RULE)
-    // {
-    //     // this block is never accessed, maybe delete
-    //     process_expression(node, currentScope);
-    // }
+static bool extract_node(struct tree *node, int depth, void *arg)
+{
+    struct scope_walk *walk = arg;
+    SymbolTable currentScope = walk->scope;
 
     if (node->prodrule == FUNCTIONDECL_RULE)
     {
         SymbolTable funcScope = process_function_declaration(node, currentScope);
         funcScope->function = true;
         funcScope->table_name = extract_fun_name(node);
-        add_symbol_table(list, funcScope);
-        for (int i = 0; i < node->nkids; i++)
-        {
-            extract_symbols(node->kids[i], funcScope, list, node);
-        }
-        return;
+        add_symbol_table(walk->list, funcScope);
+        walk->scope = funcScope;
+        return true;
     }
     else if (node->prodrule == IMPORTDECL_RULE)
     {
-        SymbolTable packageScope = process_import_declaration(node, currentScope, list);
-
-        for (int i = 0; i < node->nkids; i++)
-        {
-            extract_symbols(node->kids[i], packageScope, list, node);
-        }
-        return;
+        walk->scope = process_import_declaration(node, currentScope, walk->list);
+        return true;
     }
     else if (node->prodrule == ASSIGNMENT_RULE)
     {
         process_assignment(node, currentScope);
-        return;
+        return false;
     }
     else if (node->prodrule == FUNCTIONCALL_RULE)
     {
         //validate_function_call(node, currentScope);
-        return;
+        return false;
     }
     else if (node->prodrule == DECLARATION_RULE)
     {
         process_variable_declaration(node, currentScope);
-        return;
+        return false;
     }
     else if (node->prodrule == RETURN_RULE) {
         validate_return_statement(currentScope, node);
-        return;
+        return false;
     }
     else if (node->leaf != NULL && node->leaf->category == Identifier)
     {
-        insert_symbol(currentScope, node->leaf->text, NULL);
-        return;
+        // a use, not a declaration; check_symbols() reports it if it is undeclared
+        return false;
     } else if (node->prodrule == FORLOOP_RULE) {
-        insert_symbol(currentScope, node->kids[1]->kids[1]->kids[0]->leaf->text, create_nentry(node->kids[1]->kids[1]->kids[0]->leaf->text, currentScope, integer_typeptr));
-        return;
+        char *name = RANGE_VAR(FOR_RANGE(node))->leaf->text;
+        insert_symbol(currentScope, name, create_nentry(name, currentScope, integer_typeptr));
+        return false;
     }
-    for (int i = 0; i < node->nkids; i++)
+    return true;
+}
+
+// back out of the scope a function or import opened
+static void leave_scope(struct tree *node, int depth, void *arg)
+{
+    struct scope_walk *walk = arg;
+    if (node->prodrule == FUNCTIONDECL_RULE || node->prodrule == IMPORTDECL_RULE)
     {
-        extract_symbols(node->kids[i], currentScope, list, node);
+        walk->scope = walk->scope->parent;
     }
 }
 
+void extract_symbols(struct tree *node, SymbolTable currentScope, ListSymbolTables list, struct tree *parent)
+{
+    struct scope_walk walk = {currentScope, list};
+    struct tree_visitor visitor = {extract_node, leave_scope, &walk};
+    walk_tree(node, &visitor, 1);
+}
+
 SymbolTable find_symbol_table(ListSymbolTables list, char *name) {
     while (list != NULL) {
-        if (strcmp(list->table->table_name, name) == 0) {
+        // import scopes have no name
+        if (list->table->table_name && strcmp(list->table->table_name, name) == 0) {
             return list->table;
         }
         list = list->next;
@@ -1089,11 +1133,11 @@ int check_expression(struct tree *node, SymbolTable tab) {
                 return STRING_TYPE;
             case LPAREN:
             case RPAREN:
-                printf("can't handle parens yet: lineno %d\n", node->leaf->lineno);
-                exit(4);
+                fprintf(k0_out(), "can't handle parens yet: lineno %d\n", node->leaf->lineno);
+                k0_fail(4);
             default:
-                printf("expression err: %s, lineno %d\n", node->leaf->text, node->leaf->lineno);
-                exit(4);
+                fprintf(k0_out(), "expression err: %s, lineno %d\n", node->leaf->text, node->leaf->lineno);
+                k0_fail(4);
             // case ARRAY_INT_TYPE:
             //     printf("expression not supported yet: arra_int_type\n");
             //     exit(4);
@@ -1132,13 +1176,9 @@ int check_expression(struct tree *node, SymbolTable tab) {
     }
     // printf("%d\n", lineno);
     char *expression_type = node->symbolname;
-    // parenthesis
-    if (strcmp(expression_type, "ParenthesizedExpression") == 0) {
-        return check_expression(node->kids[1], tab);
-    }
     // unary minus
     if (strcmp(expression_type, "UMINUS") == 0) {
-        int numType = check_expression(node->kids[1], tab);
+        int numType = check_expression(UNARY_OPERAND(node), tab);
         switch(numType){
             case INT_TYPE:
             case N_INT_TYPE:
@@ -1156,13 +1196,10 @@ int check_expression(struct tree *node, SymbolTable tab) {
             typeint_to_name(numType)
         );
     }
-    // other expressions
-    int type1 = check_expression(node->kids[0], tab);
-    int type2 = check_expression(node->kids[2], tab);
     if (strcmp(expression_type, "FunctionCall") == 0) {
+        // the arguments are checked against the parameters
         validate_function_call(node, tab);
-        // get the function identifier node, first kid
-        struct tree *func_id_node = node->kids[0];
+        struct tree *func_id_node = CALL_NAME(node);
         if (func_id_node->leaf && func_id_node->leaf->category == Identifier) {
             SymbolTableEntry entry = find_symbol(tab, func_id_node->leaf->text);
             if (entry->type->basetype == FUNC_TYPE) {
@@ -1170,11 +1207,15 @@ int check_expression(struct tree *node, SymbolTable tab) {
                 return entry->type->u.f.returntype->basetype;
             }
             else {
-                printf("debug: failed to get func ret type\n");
+                fprintf(k0_out(), "debug: failed to get func ret type\n");
             }
         }
+        return -1;
     }
-    else if (strcmp(expression_type, "ADD") == 0) {
+    // other expressions
+    int type1 = check_expression(EXPR_LEFT(node), tab);
+    int type2 = check_expression(EXPR_RIGHT(node), tab);
+    if (strcmp(expression_type, "ADD") == 0) {
         switch(type1){
             case STRING_TYPE:
             case N_STRING_TYPE:
@@ -1277,8 +1318,8 @@ int check_expression(struct tree *node, SymbolTable tab) {
     else if (strcmp(expression_type, "DIV") == 0) {
         // printf("%d\n", node->kids[2]->id);
         // todo: div by node
-        if (node->kids[2]->leaf == NULL) return type1;
-        if (strcmp(node->kids[2]->leaf->text, "0") == 0) {
+        if (EXPR_RIGHT(node)->leaf == NULL) return type1;
+        if (strcmp(EXPR_RIGHT(node)->leaf->text, "0") == 0) {
             semantic_error(DIV_ZERO, node->leaf->lineno, node->leaf->filename);
         }
         switch(type1){
@@ -1471,13 +1512,13 @@ int check_expression(struct tree *node, SymbolTable tab) {
     else if (strcmp(expression_type, "NOT_EQ") == 0) {
         if (type1 == type2) return BOOL_TYPE;
         else {
-            fprintf(stderr, "Semantic Error: Comparison between two operands of different types\n");
+            diag_error(DIAG_SEMANTIC, node->kids[1]->leaf->filename, node->kids[1]->leaf->lineno, "Comparison between two operands of different types");
         }
     }
     else if (strcmp(expression_type, "EQEQ") == 0) {
         if (type1 == type2) return BOOL_TYPE;
         else {
-            fprintf(stderr, "Semantic Error: Comparison between two operands of different types\n");
+            diag_error(DIAG_SEMANTIC, node->kids[1]->leaf->filename, node->kids[1]->leaf->lineno, "Comparison between two operands of different types");
         }
     }
     return -1;
@@ -1703,15 +1744,15 @@ void check_assignment(SymbolTableEntry var, struct tree *node, SymbolTable tab)
     }
     else if (node->prodrule == FUNCTIONCALL_RULE) {
         validate_function_call(node, tab);
-        SymbolTableEntry function = find_symbol(tab, node->kids[0]->leaf->text);
+        SymbolTableEntry function = find_symbol(tab, CALL_NAME(node)->leaf->text);
         // check_functioncall_parameters(function, node, tab);
         if (var->type->basetype == function->type->u.f.returntype->basetype) {
             return;
         } else {
             semantic_error(
                 TYPE_MISMATCH,
-                node->kids[0]->leaf->lineno,
-                node->kids[0]->leaf->filename,
+                CALL_NAME(node)->leaf->lineno,
+                CALL_NAME(node)->leaf->filename,
                 typeint_to_name(var->type->basetype),
                 typeint_to_name(function->type->u.f.returntype->basetype)
             );
@@ -1719,22 +1760,25 @@ void check_assignment(SymbolTableEntry var, struct tree *node, SymbolTable tab)
     }
     else {
         struct tree *assgn_node = NULL;
-        if (node->nkids == 2) {
+        if (node->prodrule == ASSIGNMENT_RULE) {
+            // a declaration's initializer
+            assgn_node = ASSIGN_VALUE(node);
+        } else if (node->nkids == 2) {
             assgn_node = node->kids[1];
         } else {
             assgn_node = node;
         }
         if (assgn_node->prodrule == FUNCTIONCALL_RULE) {
-            validate_function_call(node->kids[1], tab);
-            SymbolTableEntry function = find_symbol(tab, assgn_node->kids[0]->leaf->text);
+            validate_function_call(assgn_node, tab);
+            SymbolTableEntry function = find_symbol(tab, CALL_NAME(assgn_node)->leaf->text);
             // check_functioncall_parameters(function, assgn_node, tab);
             if (var->type->basetype == function->type->u.f.returntype->basetype) {
                 return;
             } else {
                 semantic_error(
                     TYPE_MISMATCH,
-                    assgn_node->kids[0]->leaf->lineno,
-                    assgn_node->kids[0]->leaf->filename,
+                    CALL_NAME(assgn_node)->leaf->lineno,
+                    CALL_NAME(assgn_node)->leaf->filename,
                     typeint_to_name(var->type->basetype),
                     typeint_to_name(function->type->u.f.returntype->basetype)
                 );
@@ -1856,8 +1900,7 @@ void check_assignment(SymbolTableEntry var, struct tree *node, SymbolTable tab)
                 }
             }
             else {
-                fprintf(stderr, "Semantic Error: Invalid operands for operator %s\n", assgn_node->symbolname);
-                exit(3);
+                diag_error(DIAG_SEMANTIC, NULL, 0, "Invalid operands for operator %s", assgn_node->symbolname);
             }
         }
         else {
@@ -1892,36 +1935,83 @@ void check_assignment(SymbolTableEntry var, struct tree *node, SymbolTable tab)
     }
 }
 
-void check_symbols(struct tree *node, SymbolTable currentScope, ListSymbolTables list, struct tree *parent) {
-    if (node == NULL) return;
-    if (node->prodrule == FUNCTIONDECL_RULE) {
-        char *func_name = extract_fun_name(node);
-        for (int i = 0; i < node->nkids; i++) {
-            if (node->kids[i]->prodrule == BLOCK_RULE) {
-                check_symbols(node->kids[i], find_symbol_table(list, func_name), list, node);
+// flag self-calls in tail position; tailrec functions may not recurse anywhere else
+void mark_tail_calls(struct tree *node, char *func_name, bool tail, bool tailrec) {
+    if (node == NULL || node->leaf != NULL) return;
+    switch (node->prodrule) {
+        case FUNCTIONCALL_RULE:
+            if (strcmp(CALL_NAME(node)->leaf->text, func_name) == 0) {
+                if (tail) {
+                    node->tail_call = true;
+                }
+                else if (tailrec) {
+                    semantic_error(
+                        FUNC_NOT_TAILREC,
+                        CALL_NAME(node)->leaf->lineno,
+                        CALL_NAME(node)->leaf->filename,
+                        func_name
+                    );
+                }
             }
-        }
-        return;
+            // arguments are evaluated before the call, never in tail position
+            mark_tail_calls(CALL_ARGS(node), func_name, false, tailrec);
+            return;
+        case RETURN_RULE:
+            mark_tail_calls(RETURN_VALUE(node), func_name, RETURN_VALUE(node)->prodrule == FUNCTIONCALL_RULE, tailrec);
+            return;
+        case STATEMENTS_RULE:
+            // only the last statement of a list can finish the function
+            for (int i = 0; i < node->nkids; i++) {
+                mark_tail_calls(node->kids[i], func_name, tail && i == node->nkids - 1, tailrec);
+            }
+            return;
+        case BLOCK_RULE:
+            mark_tail_calls(BLOCK_BODY(node), func_name, tail, tailrec);
+            return;
+        case IFSTRUC_RULE:
+            mark_tail_calls(IF_COND(node), func_name, false, tailrec);
+            mark_tail_calls(IF_BODY(node), func_name, tail, tailrec);
+            mark_tail_calls(IF_ELSEIFS(node), func_name, tail, tailrec);
+            mark_tail_calls(IF_ELSE(node), func_name, tail, tailrec);
+            return;
+        case ELSEIFLIST_RULE:
+            if (node->nkids == 0) return;
+            mark_tail_calls(ELSEIF_PREV(node), func_name, tail, tailrec);
+            mark_tail_calls(ELSEIF_COND(node), func_name, false, tailrec);
+            mark_tail_calls(ELSEIF_BODY(node), func_name, tail, tailrec);
+            return;
+        case ELSE_RULE:
+            if (node->nkids == 0) return;
+            mark_tail_calls(ELSE_BODY(node), func_name, tail, tailrec);
+            return;
+        default:
+            for (int i = 0; i < node->nkids; i++) {
+                mark_tail_calls(node->kids[i], func_name, false, tailrec);
+            }
+            return;
+    }
+}
+
+static bool check_node(struct tree *node, int depth, void *arg) {
+    struct scope_walk *walk = arg;
+    SymbolTable currentScope = walk->scope;
+    if (node->prodrule == FUNCTIONDECL_RULE) {
+        walk->scope = find_symbol_table(walk->list, extract_fun_name(node));
+        return true;
     }
     if (node->prodrule == DECLARATION_RULE) {
-        SymbolTableEntry variable = find_symbol(currentScope, node->kids[1]->leaf->text);
-        struct tree *assigned_to = node->kids[3];
-        check_assignment(variable, assigned_to, currentScope);
-        return;
+        SymbolTableEntry variable = find_symbol(currentScope, DECL_NAME(node)->leaf->text);
+        check_assignment(variable, DECL_INIT(node), currentScope);
+        return false;
     }
     if (node->prodrule == ASSIGNMENT_RULE) {
-        SymbolTableEntry variable = find_symbol(currentScope, node->kids[0]->leaf->text);
-        if (variable->type->basetype == ARRAY_INT_TYPE || variable->type->basetype == ARRAY_STRING_TYPE) {
-            check_assignment(variable, node->kids[5], currentScope);
-        }
-        else {
-            check_assignment(variable, node->kids[2], currentScope);
-        }
-        return;
+        SymbolTableEntry variable = find_symbol(currentScope, ASSIGN_TARGET(node)->leaf->text);
+        check_assignment(variable, ASSIGN_VALUE(node), currentScope);
+        return false;
     }
     if (node->prodrule == FUNCTIONCALL_RULE) {
         validate_function_call(node, currentScope);
-        return;
+        return false;
     }
     if (node->prodrule == EXPRESSION_RULE) {
         // int check = check_expression(node, currentScope);
@@ -1937,19 +2027,267 @@ void check_symbols(struct tree *node, SymbolTable currentScope, ListSymbolTables
                         break;
                     }
                 }
-            fprintf(stderr, "Semantic Error: Expression on line %d contains invalid operators\n", lineno);
-            exit(3);
+            diag_error(DIAG_SEMANTIC, NULL, lineno, "Expression on line %d contains invalid operators", lineno);
         }
+        return false;
+    }
+    return true;
+}
+
+// a function's body is checked; go back to the outer scope and mark its tail calls
+static void check_function_done(struct tree *node, int depth, void *arg) {
+    struct scope_walk *walk = arg;
+    if (node->prodrule != FUNCTIONDECL_RULE) return;
+    SymbolTable scope = walk->scope;
+    walk->scope = scope->parent;
+    char *func_name = extract_fun_name(node);
+    bool tailrec = strcmp(node->symbolname, "TailrecFunctionDeclaration") == 0;
+    // a trailing call statement is only a tail call when there is no value to return
+    bool returns_unit = find_symbol(scope, func_name)->type->u.f.returntype->basetype == UNIT_TYPE;
+    mark_tail_calls(FUNC_BODY(node), func_name, returns_unit, tailrec);
+}
+
+// a visitor that goes on past semantic errors while -ferror-limit allows more
+struct guarded_visitor {
+    struct tree_visitor inner;
+    bool skip_post;         // the last pre callback did not finish
+};
+
+static bool guarded_pre(struct tree *node, int depth, void *arg) {
+    struct guarded_visitor *guard = arg;
+    k0_context *ctx = k0_get();
+    guard->skip_post = true;
+    if (node->erroneous) {
+        return false;
+    }
+    jmp_buf resume;
+    jmp_buf *outer = ctx->resume;
+    volatile bool descend = false;
+    ctx->resume = &resume;
+    if (setjmp(resume) == 0) {
+        descend = guard->inner.pre(node, depth, guard->inner.arg);
+        guard->skip_post = false;
+    } else {
+        // reported; leave the rest of the node, and its children, unchecked
+        node->erroneous = true;
+    }
+    ctx->resume = outer;
+    return descend;
+}
+
+static void guarded_post(struct tree *node, int depth, void *arg) {
+    struct guarded_visitor *guard = arg;
+    k0_context *ctx = k0_get();
+    if (guard->skip_post) {
+        // a failed pre kept out of the children, so its own post comes next
+        guard->skip_post = false;
         return;
     }
-    for (int i = 0; i < node->nkids; i++)
-    {
-        check_symbols(node->kids[i], currentScope, list, node);
+    jmp_buf resume;
+    jmp_buf *outer = ctx->resume;
+    ctx->resume = &resume;
+    if (setjmp(resume) == 0) {
+        guard->inner.post(node, depth, guard->inner.arg);
+    }
+    ctx->resume = outer;
+}
+
+// visitor itself with the default error limit of one, where the first error stops the compile
+static struct tree_visitor guard_visitor(struct guarded_visitor *guard, struct tree_visitor visitor) {
+    if (k0_get()->error_limit == 1) {
+        return visitor;
+    }
+    *guard = (struct guarded_visitor){visitor, false};
+    return (struct tree_visitor){guarded_pre, visitor.post ? guarded_post : NULL, guard};
+}
+
+// function bodies to check on the pool; each reads the tables but only writes its own nodes
+struct function_checks {
+    struct scope_walk walk;             // global scope, for everything outside functions
+    struct tree **functions;            // in source order
+    int nfunctions;
+    int maxfunctions;
+    struct diagnostic **diagnostics;    // what checking each function reported
+    char **outputs;                     // and what it printed, output_lengths[i] bytes
+    size_t *output_lengths;
+    int *failed;                        // exit code of a function whose checks hit an internal error
+
+    // functions before stop reach the error limit, so a compile on one thread ends
+    // before the others; they are not checked, or not to the end if under way
+    atomic_int stop;
+    pthread_mutex_t lock;               // guards the three below
+    int *error_counts;                  // errors in each function checked, -1 until it is
+    int settled;                        // every function before this one is checked
+    int settled_errors;                 // errors reported before function settled
+};
+
+// stands for the error count of a function whose checks stopped the compile outright
+#define STOPPED INT_MAX
+
+// count the errors of function i, moving stop up to where the functions settled reach the limit
+static void settle_function(struct function_checks *checks, int i, int errors) {
+    int limit = k0_get()->error_limit;
+    pthread_mutex_lock(&checks->lock);
+    checks->error_counts[i] = errors;
+    while (checks->settled < checks->nfunctions && checks->error_counts[checks->settled] >= 0) {
+        int count = checks->error_counts[checks->settled++];
+        if (count != STOPPED) {
+            checks->settled_errors += count;
+        }
+        if (count == STOPPED || (limit > 0 && checks->settled_errors >= limit)) {
+            atomic_store(&checks->stop, checks->settled);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&checks->lock);
+}
+
+// a visitor that leaves the rest of its function once the function is past stop
+struct stoppable_visitor {
+    struct tree_visitor inner;
+    bool skip_post;         // the last pre callback did not run
+    struct function_checks *checks;
+    int function;
+};
+
+static bool stoppable_pre(struct tree *node, int depth, void *arg) {
+    struct stoppable_visitor *stopper = arg;
+    stopper->skip_post = stopper->function >= atomic_load(&stopper->checks->stop);
+    return !stopper->skip_post && stopper->inner.pre(node, depth, stopper->inner.arg);
+}
+
+static void stoppable_post(struct tree *node, int depth, void *arg) {
+    struct stoppable_visitor *stopper = arg;
+    if (stopper->skip_post) {
+        stopper->skip_post = false;
+        return;
+    }
+    if (stopper->inner.post) {
+        stopper->inner.post(node, depth, stopper->inner.arg);
+    }
+}
+
+// check what lies outside functions, and set the functions aside
+static bool check_outside_functions(struct tree *node, int depth, void *arg) {
+    struct function_checks *checks = arg;
+    if (node->prodrule != FUNCTIONDECL_RULE) {
+        return check_node(node, depth, &checks->walk);
+    }
+    if (checks->nfunctions == checks->maxfunctions) {
+        checks->maxfunctions = checks->maxfunctions ? checks->maxfunctions * 2 : 64;
+        struct tree **functions = mem_alloc(MEM_SYMTAB, checks->maxfunctions * sizeof(struct tree *));
+        if (!functions) {
+            perror("Memory allocation failed");
+            k0_fail(4);
+        }
+        if (checks->nfunctions) memcpy(functions, checks->functions, checks->nfunctions * sizeof(struct tree *));
+        mem_free(MEM_SYMTAB, checks->functions);
+        checks->functions = functions;
+    }
+    checks->functions[checks->nfunctions++] = node;
+    return false;
+}
+
+// check one function on a pool thread
+static void check_function_task(int i, void *arg) {
+    struct function_checks *checks = arg;
+    if (i >= atomic_load(&checks->stop)) {
+        return;
+    }
+    k0_context *ctx = k0_get();
+    struct scope_walk walk = checks->walk;
+    struct guarded_visitor guard;
+    struct stoppable_visitor stopper = {
+        guard_visitor(&guard, (struct tree_visitor){check_node, check_function_done, &walk}), false, checks, i
+    };
+    struct tree_visitor visitor = {stoppable_pre, stoppable_post, &stopper};
+    // kept for check_symbols to print in source order; if no stream can be had it goes out as it comes
+    char *output = NULL;
+    size_t length = 0;
+    ctx->out = open_memstream(&output, &length);
+    ctx->recovering = true;
+    int code = setjmp(ctx->recover);
+    if (code == 0) {
+        // with the default limit the first error ends this function's checks, as it would the compile
+        jmp_buf stop;
+        ctx->resume = &stop;
+        if (setjmp(stop) == 0) {
+            walk_tree(checks->functions[i], &visitor, 1);
+        }
+    }
+    ctx->resume = NULL;
+    ctx->recovering = false;
+    if (ctx->out) {
+        fclose(ctx->out);
+        ctx->out = NULL;
+    }
+    checks->outputs[i] = output;
+    checks->output_lengths[i] = length;
+    int errors = ctx->errors;
+    checks->failed[i] = code;
+    checks->diagnostics[i] = diag_take();
+    settle_function(checks, i, code ? STOPPED : errors);
+}
+
+void check_symbols(struct tree *node, SymbolTable currentScope, ListSymbolTables list, struct tree *parent) {
+    struct scope_walk walk = {currentScope, list};
+    struct guarded_visitor guard;
+    int threads = k0_get()->threads;
+    if (threads <= 1) {
+        struct tree_visitor visitor = guard_visitor(&guard, (struct tree_visitor){check_node, check_function_done, &walk});
+        walk_tree(node, &visitor, 1);
+        return;
+    }
+
+    struct function_checks checks = {walk};
+    struct tree_visitor visitor = guard_visitor(&guard, (struct tree_visitor){check_outside_functions, NULL, &checks});
+    walk_tree(node, &visitor, 1);
+    int n = checks.nfunctions;
+    checks.diagnostics = mem_zalloc(MEM_SYMTAB, (n + 1) * sizeof(struct diagnostic *));
+    checks.outputs = mem_zalloc(MEM_SYMTAB, (n + 1) * sizeof(char *));
+    checks.output_lengths = mem_zalloc(MEM_SYMTAB, (n + 1) * sizeof(size_t));
+    checks.failed = mem_zalloc(MEM_SYMTAB, (n + 1) * sizeof(int));
+    checks.error_counts = mem_alloc(MEM_SYMTAB, (n + 1) * sizeof(int));
+    if (!checks.diagnostics || !checks.outputs || !checks.output_lengths || !checks.failed || !checks.error_counts) {
+        perror("Memory allocation failed");
+        k0_fail(4);
+    }
+    for (int i = 0; i < n; i++) {
+        checks.error_counts[i] = -1;
+    }
+    // the errors outside functions count toward the limit first, as they are reported first
+    checks.settled_errors = k0_get()->errors;
+    atomic_init(&checks.stop, n);
+    pthread_mutex_init(&checks.lock, NULL);
+    pool_run(threads, n, check_function_task, &checks);
+    pthread_mutex_destroy(&checks.lock);
+
+    // report in source order, as checking the functions one after another would have
+    int failed = 0;
+    for (int i = 0; i < n && !failed; i++) {
+        diag_replay(checks.diagnostics[i], checks.outputs[i], checks.output_lengths[i]);
+        checks.diagnostics[i] = NULL;
+        failed = checks.failed[i];
+    }
+    for (int i = 0; i < n; i++) {
+        diag_free(checks.diagnostics[i]);
+        free(checks.outputs[i]);
+    }
+    mem_free(MEM_SYMTAB, checks.functions);
+    mem_free(MEM_SYMTAB, checks.diagnostics);
+    mem_free(MEM_SYMTAB, checks.outputs);
+    mem_free(MEM_SYMTAB, checks.output_lengths);
+    mem_free(MEM_SYMTAB, checks.failed);
+    mem_free(MEM_SYMTAB, checks.error_counts);
+    if (failed) {
+        k0_fail(failed);
     }
 }
 
 void free_symtab(ListSymbolTables head)
 {
+    // k0_reset() frees the tables a failed compilation left, unless they are gone already
+    if (k0_get()->symtabs == head) k0_get()->symtabs = NULL;
     ListSymbolTables current = head;
     while (current != NULL)
     {
@@ -1967,23 +2305,23 @@ void free_symtab(ListSymbolTables head)
                 {
                     free_type(tempEntry->type);  // You already fixed this
                 }
-                free(tempEntry);
+                mem_free(MEM_SYMTAB, tempEntry);
             }
         }
-        free(temp->table->tbl);
-        free(temp->table);
-        free(temp);
+        mem_free(MEM_SYMTAB, temp->table->tbl);
+        mem_free(MEM_SYMTAB, temp->table);
+        mem_free(MEM_SYMTAB, temp);
     }
 }
 
 
 ListSymbolTables create_symtabs(struct tree *node, int print, int free)
 {
-    ListSymbolTables tables = malloc(sizeof(struct symbol_table_list));
+    ListSymbolTables tables = mem_alloc(MEM_SYMTAB, sizeof(struct symbol_table_list));
     if (tables == NULL)
     {
         perror("Memory allocation failed");
-        exit(4);
+        k0_fail(4);
     }
 
     SymbolTable global_tab = mksymtab(NULL);
@@ -1993,22 +2331,39 @@ ListSymbolTables create_symtabs(struct tree *node, int print, int free)
     tables->tab_count = 1;
     tables->table = global_tab;
     tables->next = NULL;
+    k0_get()->symtabs = tables;
 
     insert_predefined_symbols(global_tab);
     //insert_symbol(global_tab, "temp", create_nentry("temp", global_tab, unit_typeptr));
-    extract_symbols(node, global_tab, tables, node);
+    // code generation follows unless the tables are freed here, so its strings
+    // are collected in the same walk that extracts the symbols
+    struct scope_walk walk = {global_tab, tables};
+    struct guarded_visitor guard;
+    struct tree_visitor visitors[2] = {guard_visitor(&guard, (struct tree_visitor){extract_node, leave_scope, &walk})};
+    int nvisitors = 1;
+    if (!free) {
+        visitors[nvisitors++] = string_collector();
+    }
+    phase_begin(PHASE_EXTRACT_SYMBOLS);
+    walk_tree(node, visitors, nvisitors);
+    phase_end(PHASE_EXTRACT_SYMBOLS);
+    phase_begin(PHASE_CHECK_SYMBOLS);
     check_symbols(node, global_tab, tables, node);
+    phase_end(PHASE_CHECK_SYMBOLS);
+    diag_check();
     if (print) {
         print_tables(tables);
     }
-    if (free) {
-        free_symtab(tables);
-    }
-    // check for main func
-    if (find_symbol_table(tables, "main") == NULL) semantic_error(
+    // check for main func; with several input files only the link needs one
+    if (k0_get()->require_main && find_symbol_table(tables, "main") == NULL) semantic_error(
         NO_MAIN,
         0,
         NULL
     );
+    diag_check();
+    if (free) {
+        free_symtab(tables);
+        return NULL;
+    }
     return tables;
 }
\ No newline at end of file
@@ -82,6 +82,7 @@ SymbolTable find_symbol_table(ListSymbolTables list, char *name);
 int check_expression(struct tree *node, SymbolTable tab);
 // void check_functioncall_parameters(SymbolTableEntry function, struct tree *node, SymbolTable tab);
 void check_assignment(SymbolTableEntry var, struct tree *node, SymbolTable tab);
+void mark_tail_calls(struct tree *node, char *func_name, bool tail, bool tailrec);
 void check_symbols(struct tree *node, SymbolTable currentScope, ListSymbolTables list, struct tree *parent);
 void free_symtab(ListSymbolTables head);
 ListSymbolTables create_symtabs(struct tree *node, int print, int free);
@@ -5,8 +5,10 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include "tac.h"
+#include "k0ctx.h"
+#include "memstat.h"
 
-int labelcounter;
+#define labelcounter (k0_get()->labelcounter)
 
 char *regionnames[] = {
     "global",
@@ -82,8 +84,8 @@ struct addr genlabel() {
 struct instr *gen(int op, struct addr a1, struct addr a2, struct addr a3) {
   struct instr *rv = malloc(sizeof (struct instr));
   if (rv == NULL) {
-     fprintf(stderr, "out of memory\n");
-     exit(4);
+     fprintf(k0_diag(), "out of memory\n");
+     k0_fail(4);
      }
   rv->opcode = op;
   rv->dest = &a1;
@@ -169,7 +171,7 @@ void printaddr(struct addr a) {
 }
 
 struct data_decl *gen_decl(char *data_type, int byte_size, char *text, int memloc) {
-    struct data_decl *data = malloc(sizeof(struct data_decl));
+    struct data_decl *data = mem_alloc(MEM_IC, sizeof(struct data_decl));
     data->data_type = data_type;
     data->text = text;
     data->byte_size = byte_size;
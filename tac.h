@@ -66,6 +66,7 @@ struct data_decl {
 #define D_LABEL 3054
 #define D_END   3055
 #define D_PROT  3056 /* prototype "declaration" */
+#define D_TEXT  3057 /* IC already written out, spliced in from the function cache */
 
 struct instr *gen(int, struct addr, struct addr, struct addr);
 struct instr *concat(struct instr *, struct instr *);
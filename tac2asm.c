@@ -1,16 +1,60 @@
 #include "tac2asm.h"
+#include "k0ctx.h"
+#include "timing.h"
+#include "memstat.h"
+#include "pool.h"
 
-int CURR_PARM_NUM = 0;
-int TOTAL_PARMS = -1;
-int LOCAL_VAR_REG_NUM = 12;
-DataEntry *data_head = NULL;
-StringEntry *string_head = NULL;
+struct tac2asm_state {
+    int curr_parm_num;
+    int total_parms;
+    int local_var_reg_num;
+    DataEntry *data;
+    StringEntry *strings;
+    DoubleConst *doubles;
+    int double_pool_num;
+    int double_locs[MAX_DOUBLE_LOCS];
+    char *double_loc_spill[MAX_DOUBLE_LOCS];
+    int double_loc_count;
+    bool temp_is_double;
+    int double_parms;
+    int call_double_args;
+};
+
+// lowering state lives on the current context
+static struct tac2asm_state *t2a(void) {
+    k0_context *ctx = k0_get();
+    if (!ctx->tac2asm) {
+        ctx->tac2asm = calloc(1, sizeof(struct tac2asm_state));
+        if (!ctx->tac2asm) {
+            perror("tac2asm: Memory allocation failed");
+            k0_fail(4);
+        }
+        ctx->tac2asm->total_parms = -1;
+        ctx->tac2asm->local_var_reg_num = 12;
+        ctx->tac2asm->double_parms = -1;
+    }
+    return ctx->tac2asm;
+}
+
+#define CURR_PARM_NUM (t2a()->curr_parm_num)
+#define TOTAL_PARMS (t2a()->total_parms)
+#define LOCAL_VAR_REG_NUM (t2a()->local_var_reg_num)
+#define data_head (t2a()->data)
+#define string_head (t2a()->strings)
+#define double_pool (t2a()->doubles)
+#define DOUBLE_POOL_NUM (t2a()->double_pool_num)
+#define DOUBLE_LOCS (t2a()->double_locs)
+#define DOUBLE_LOC_SPILL (t2a()->double_loc_spill)
+#define DOUBLE_LOC_COUNT (t2a()->double_loc_count)
+#define TEMP_IS_DOUBLE (t2a()->temp_is_double)
+#define DOUBLE_PARMS (t2a()->double_parms)
+#define CALL_DOUBLE_ARGS (t2a()->call_double_args)
 
 FILE *open_file(char *file_name, char *mode) {
     FILE *fp = fopen(file_name, mode);
     if (!fp) {
         perror("tac2asm: Failed to open file");
-        exit(4);
+        k0_fail(4);
     }
     return fp;
 }
@@ -63,7 +107,7 @@ void read_data_section(FILE *ic) {
         if (matched == 4) {
             DataEntry *entry = malloc(sizeof(DataEntry));
             entry->loc = loc;
-            entry->type = type;
+            entry->type = strdup(type);
             entry->next = NULL;
 
             if (!data_head) {
@@ -81,9 +125,11 @@ void free_data_entries() {
     DataEntry *curr = data_head;
     while (curr != NULL) {
         DataEntry *next = curr->next;
+        free(curr->type);
         free(curr);
         curr = next;
     }
+    data_head = NULL;
 }
 
 void free_string_entries() {
@@ -95,13 +141,14 @@ void free_string_entries() {
         free(curr);
         curr = next;
     }
+    string_head = NULL;
 }
 
 // Frees a single operand
 void free_operand(operand op) {
     if (!op) return;
-    if (op->name) free(op->name);
-    free(op);
+    if (op->name) mem_free(MEM_TAC2ASM, op->name);
+    mem_free(MEM_TAC2ASM, op);
 }
 
 // Frees a linked list of instructions and their operands
@@ -112,8 +159,8 @@ void free_instruction_list(instruction head) {
         if (curr->op1) free_operand(curr->op1);
         if (curr->op2) free_operand(curr->op2);
         if (curr->op3) free_operand(curr->op3);
-        if (curr->label) free(curr->label);
-        free(curr);
+        if (curr->label) mem_free(MEM_TAC2ASM, curr->label);
+        mem_free(MEM_TAC2ASM, curr);
         curr = next;
     }
 }
@@ -128,18 +175,18 @@ void write_strings(FILE *of) {
     }
 }
 
-char *find_local_register() {
+x86_operand find_local_register() {
     switch (LOCAL_VAR_REG_NUM) {
         case 12:
-            return "\%r12";
+            return x86_reg(R12);
         case 13:
-            return "\%r13";
+            return x86_reg(R13);
         case 14:
-            return "\%r14";
+            return x86_reg(R14);
         case 15:
-            return "\%r15";
+            return x86_reg(R15);
     }
-    return "(rsp)";
+    return x86_mem(RSP, -1, 0, 0);
 }
 
 void read_string_section(FILE *ic) {
@@ -221,7 +268,7 @@ int get_opcode_from_string(const char *str) {
 
 operand create_operand(char *s) {
     if (s == NULL || strlen(s) == 0) return NULL;
-    operand noperand = malloc(sizeof(struct IC_OPERAND));
+    operand noperand = mem_alloc(MEM_TAC2ASM, sizeof(struct IC_OPERAND));
     memset(noperand, 0, sizeof(struct IC_OPERAND));
     noperand->name = NULL;
     char *loc = NULL;
@@ -230,7 +277,7 @@ operand create_operand(char *s) {
         loc += 6;
         
         if (loc[0] == 's') {
-            noperand->name = strdup(loc);
+            noperand->name = mem_strdup(MEM_TAC2ASM, loc);
             noperand->op_type = STRING_TYPE;
         } else if (strchr(loc, '.') != NULL) {
             noperand->d_val = atof(loc);
@@ -239,16 +286,16 @@ operand create_operand(char *s) {
             noperand->i_val = atoi(loc);
             noperand->op_type = INT_TYPE;
         } else {
-            noperand->name = strdup(loc);
+            noperand->name = mem_strdup(MEM_TAC2ASM, loc);
             noperand->op_type = STRING_TYPE;
         }
     } else if (s[0] == 's') {
         noperand->immediate = false;
-        noperand->name = strdup(s);
+        noperand->name = mem_strdup(MEM_TAC2ASM, s);
         noperand->op_type = STRING_TYPE;
     } else {
         noperand->immediate = false;
-        noperand->name = strdup(s);
+        noperand->name = mem_strdup(MEM_TAC2ASM, s);
         noperand->op_type = INT_TYPE;
     }
     
@@ -256,7 +303,7 @@ operand create_operand(char *s) {
 }
 
 instruction create_instruction(char *opcode, char *o1, char *o2, char *o3) {
-    instruction ninst = malloc(sizeof(struct IC_INSTRUCTION));
+    instruction ninst = mem_alloc(MEM_TAC2ASM, sizeof(struct IC_INSTRUCTION));
     memset(ninst, 0, sizeof(struct IC_INSTRUCTION));
     
     if (opcode == NULL || strcmp(opcode, "label") == 0) {
@@ -288,7 +335,7 @@ instruction process_line(char *line) {
         char label[64];
         sscanf(line, "%s", label);
         ninst = create_instruction("label", NULL, NULL, NULL);
-        ninst->label = strdup(label);
+        ninst->label = mem_strdup(MEM_TAC2ASM, label);
         return ninst;
     }
     
@@ -307,271 +354,688 @@ instruction process_line(char *line) {
     return create_instruction(opcode, operand1, operand2, operand3);
 }
 
-void format_operands(FILE *S, operand op, bool as_source) {
+char *add_double_entry(double value, bool writable) {
+    DoubleConst *entry = malloc(sizeof(DoubleConst));
+    entry->name = malloc(16);
+    sprintf(entry->name, writable ? ".LDS%d" : ".LD%d", DOUBLE_POOL_NUM++);
+    entry->value = value;
+    entry->writable = writable;
+    entry->next = NULL;
+    if (!double_pool) {
+        double_pool = entry;
+    } else {
+        DoubleConst *tail = double_pool;
+        while (tail->next) tail = tail->next;
+        tail->next = entry;
+    }
+    return entry->name;
+}
+
+// .rodata literal holding value, shared by every use of the same constant
+char *double_literal(double value) {
+    for (DoubleConst *curr = double_pool; curr != NULL; curr = curr->next) {
+        if (!curr->writable && memcmp(&curr->value, &value, sizeof(double)) == 0) {
+            return curr->name;
+        }
+    }
+    return add_double_entry(value, false);
+}
+
+void write_double_section(FILE *S, bool writable) {
+    bool header = false;
+    for (DoubleConst *curr = double_pool; curr != NULL; curr = curr->next) {
+        if (curr->writable != writable) continue;
+        if (!header) {
+            fprintf(S, writable ? ".section .data\n" : ".section .rodata\n");
+            fprintf(S, "\t.align 8\n");
+            header = true;
+        }
+        unsigned long long bits;
+        memcpy(&bits, &curr->value, sizeof(bits));
+        fprintf(S, "%s:\n", curr->name);
+        fprintf(S, "\t.quad\t0x%016llx\t\t# %g\n", bits, curr->value);
+    }
+}
+
+void write_double_pool(FILE *S) {
+    write_double_section(S, false);
+    write_double_section(S, true);
+}
+
+static void free_double_list(DoubleConst *curr) {
+    while (curr != NULL) {
+        DoubleConst *next = curr->next;
+        free(curr->name);
+        free(curr);
+        curr = next;
+    }
+}
+
+void free_double_pool() {
+    free_double_list(double_pool);
+    double_pool = NULL;
+}
+
+bool is_temp_operand(operand op) {
+    return op && op->name && strcmp(op->name, "temp") == 0;
+}
+
+bool is_loc_operand(operand op) {
+    return op && op->name && strstr(op->name, "loc");
+}
+
+int loc_number(char *name) {
+    char *colon = strchr(name, ':');
+    return colon ? atoi(colon + 1) : -1;
+}
+
+int double_loc_slot(int loc) {
+    for (int i = 0; i < DOUBLE_LOC_COUNT; i++) {
+        if (DOUBLE_LOCS[i] == loc) return i;
+    }
+    return -1;
+}
+
+void mark_double_loc(int loc) {
+    if (double_loc_slot(loc) >= 0) return;
+    if (DOUBLE_LOC_COUNT == MAX_DOUBLE_LOCS) {
+        fprintf(k0_diag(), "tac2asm: too many Double locals in one function\n");
+        k0_fail(4);
+    }
+    int slot = DOUBLE_LOC_COUNT++;
+    DOUBLE_LOCS[slot] = loc;
+    DOUBLE_LOC_SPILL[slot] = slot < DOUBLE_LOC_REGS ? NULL : add_double_entry(0.0, true);
+}
+
+x86_operand double_loc_operand(int slot) {
+    if (slot < DOUBLE_LOC_REGS) return x86_reg(XMM8 + slot);
+    return x86_sym(DOUBLE_LOC_SPILL[slot]);
+}
+
+// Float is carried in double precision like Double
+bool is_double_type_name(char *type) {
+    return strncmp(type, "Double", 6) == 0 || strncmp(type, "Float", 5) == 0;
+}
+
+bool is_double_operand(operand op) {
+    if (op == NULL) return false;
+    if (op->immediate) return op->op_type == DOUBLE_TYPE;
+    if (is_temp_operand(op)) return TEMP_IS_DOUBLE;
+    return is_loc_operand(op) && double_loc_slot(loc_number(op->name)) >= 0;
+}
+
+// branch labels come from create_label_name(); anything else starts a function
+bool is_function_label(instruction instr) {
+    int n;
+    char c;
+    return instr->opcode == O_LABEL && instr->label &&
+           sscanf(instr->label, "label%d%c", &n, &c) != 1;
+}
+
+// .data only lists locals by offset, so a loc is seeded as Double when every entry agrees
+void seed_double_locals() {
+    for (DataEntry *e = data_head; e != NULL; e = e->next) {
+        if (!is_double_type_name(e->type)) continue;
+        bool all_double = true;
+        for (DataEntry *o = data_head; o != NULL; o = o->next) {
+            if (o->loc == e->loc && !is_double_type_name(o->type)) all_double = false;
+        }
+        if (all_double) mark_double_loc(e->loc);
+    }
+}
+
+// find the locals of this function that hold a Double by following what gets stored into them
+void scan_double_locals(instruction start) {
+    DOUBLE_LOC_COUNT = 0;
+    seed_double_locals();
+    // a second pass picks up locals read before they are assigned, e.g. in loops
+    for (int pass = 0; pass < 2; pass++) {
+        TEMP_IS_DOUBLE = false;
+        for (instruction i = start; i != NULL && !is_function_label(i); i = i->next) {
+            bool result_double;
+            switch (i->opcode) {
+                case O_ADD:
+                case O_SUB:
+                case O_MUL:
+                case O_DIV:
+                    result_double = is_double_operand(i->op2) || is_double_operand(i->op3);
+                    break;
+                case O_ASN:
+                case O_ADDR:
+                    result_double = is_double_operand(i->op2);
+                    break;
+                case O_BLT:
+                case O_BLE:
+                case O_BGT:
+                case O_BGE:
+                case O_BEQ:
+                case O_BNE:
+                    result_double = false;
+                    break;
+                default:
+                    continue;
+            }
+            if (is_temp_operand(i->op1)) TEMP_IS_DOUBLE = result_double;
+            else if (result_double && is_loc_operand(i->op1)) mark_double_loc(loc_number(i->op1->name));
+        }
+    }
+    TEMP_IS_DOUBLE = false;
+}
+
+x86_operand format_operands(operand op) {
     if (op == NULL) {
-        fprintf(S, "NULL");
-        return;
+        return x86_none();
     }
     
     if (op->name) {
         if (strstr(op->name, "loc")) {
-            fprintf(S, "%s", find_local_register());
-            return;
+            int slot = double_loc_slot(loc_number(op->name));
+            if (slot >= 0) return double_loc_operand(slot);
+            return find_local_register();
         }
         if (strcmp(op->name, "temp") == 0) {
-            fprintf(S, "%%rax");
-            return;
+            return x86_reg(TEMP_IS_DOUBLE ? XMM0 : TMP_REG);
         }
     }
 
     if (op->immediate) {
         if (op->op_type == INT_TYPE) {
-            fprintf(S, "$%d", op->i_val);
+            return x86_imm(op->i_val);
         } else if (op->op_type == DOUBLE_TYPE) {
-            fprintf(S, "$%lf", op->d_val);
-        } else if (op->op_type == STRING_TYPE) {
-            fprintf(S, "%s", op->name);
-        }
-    } else {
-        if (as_source) {
-            fprintf(S, "%s", op->name);
-        } else {
-            fprintf(S, "%s", op->name);
+            return x86_sym(double_literal(op->d_val));
         }
     }
+    return x86_sym(op->name);
 }
 
-const char* get_param_register(int param_num) {
+int get_param_register(int param_num) {
     switch (TOTAL_PARMS) {
         case 1: TOTAL_PARMS--; return ARG1_REG;
         case 2: TOTAL_PARMS--; return ARG2_REG;
         case 3: TOTAL_PARMS--; return ARG3_REG;
         case 4: TOTAL_PARMS--; return ARG4_REG;
-        default: return NULL;
+        default: return -1;
     }
 }
 
 int find_param_count(instruction instr) {
     int count = 0;
     while (instr->opcode != O_CALL) {
+        if (instr->opcode == O_PARM && !is_double_operand(instr->op1)) count++;
         instr = instr->next;
-        count++;
     }
     return count;
 }
 
-void handle_label_instruction(FILE *S, instruction current) {
+int find_double_param_count(instruction instr) {
+    int count = 0;
+    while (instr->opcode != O_CALL) {
+        if (instr->opcode == O_PARM && is_double_operand(instr->op1)) count++;
+        instr = instr->next;
+    }
+    return count;
+}
+
+// integer constant operand that fits an instruction's 32-bit immediate field
+bool int_constant(operand op, long *value) {
+    if (op == NULL || !op->immediate || op->op_type != INT_TYPE) return false;
+    *value = op->i_val;
+    return true;
+}
+
+// SSE source for op: an xmm register or memory, converting Int values on the way
+x86_operand load_double(x86_list *text, operand op, int scratch) {
+    long value;
+    if (int_constant(op, &value)) return x86_sym(double_literal((double)value));
+    if (is_double_operand(op)) return format_operands(op);
+    x86_emit(text, X86_CVTSI2SDQ, format_operands(op), x86_reg(scratch));
+    return x86_reg(scratch);
+}
+
+void move_to_xmm(x86_list *text, x86_operand src, int reg) {
+    if (x86_is_reg(&src, reg)) return;
+    x86_emit(text, X86_MOVSD, src, x86_reg(reg));
+}
+
+// the result in %xmm0 goes to dst, truncated toward zero when dst holds an Int
+void store_double(x86_list *text, operand dst) {
+    if (is_temp_operand(dst)) {
+        TEMP_IS_DOUBLE = true;
+        return;
+    }
+    if (is_double_operand(dst)) {
+        x86_emit(text, X86_MOVSD, x86_reg(XMM0), format_operands(dst));
+        return;
+    }
+    x86_emit(text, X86_CVTTSD2SIQ, x86_reg(XMM0), x86_reg(RAX));
+    x86_emit(text, X86_MOVQ, x86_reg(RAX), format_operands(dst));
+}
+
+// writes to temp decide whether it currently lives in %rax or %xmm0
+void set_temp_int(operand dst) {
+    if (is_temp_operand(dst)) TEMP_IS_DOUBLE = false;
+}
+
+bool writes_double(operand dst, operand src) {
+    return is_double_operand(src) || (!is_temp_operand(dst) && is_double_operand(dst));
+}
+
+void handle_double_move(x86_list *text, instruction current) {
+    move_to_xmm(text, load_double(text, current->op2, XMM0), XMM0);
+    store_double(text, current->op1);
+}
+
+void handle_double_arithmetic(x86_list *text, instruction current, int opcode) {
+    x86_operand rhs = load_double(text, current->op3, XMM1);
+    // loading the left operand would clobber a right operand held in temp
+    if (x86_is_reg(&rhs, XMM0)) {
+        x86_emit(text, X86_MOVSD, rhs, x86_reg(XMM1));
+        rhs = x86_reg(XMM1);
+    }
+    move_to_xmm(text, load_double(text, current->op2, XMM0), XMM0);
+
+    int sse;
+    switch (opcode) {
+        case O_ADD: sse = X86_ADDSD; break;
+        case O_SUB: sse = X86_SUBSD; break;
+        case O_MUL: sse = X86_MULSD; break;
+        default: sse = X86_DIVSD; break;
+    }
+    x86_emit(text, sse, rhs, x86_reg(XMM0));
+    store_double(text, current->op1);
+}
+
+void handle_double_comparison(x86_list *text, instruction current, int opcode) {
+    operand left = current->op2;
+    operand right = current->op3;
+    // test lt/le as gt/ge with the operands swapped so NaN compares false (CF is set when unordered)
+    if (opcode == O_BLT || opcode == O_BLE) {
+        left = current->op3;
+        right = current->op2;
+    }
+    x86_operand rhs = load_double(text, right, XMM1);
+    if (x86_is_reg(&rhs, XMM0)) {
+        x86_emit(text, X86_MOVSD, rhs, x86_reg(XMM1));
+        rhs = x86_reg(XMM1);
+    }
+    x86_operand lhs = load_double(text, left, XMM0);
+    if (!x86_is_xmm(&lhs)) {
+        move_to_xmm(text, lhs, XMM0);
+        lhs = x86_reg(XMM0);
+    }
+    x86_emit(text, X86_UCOMISD, rhs, lhs);
+
+    switch (opcode) {
+        case O_BLT:
+        case O_BGT:
+            x86_emit(text, X86_SETA, x86_none(), x86_reg_sized(RAX, 1));
+            break;
+        case O_BLE:
+        case O_BGE:
+            x86_emit(text, X86_SETAE, x86_none(), x86_reg_sized(RAX, 1));
+            break;
+        case O_BEQ:
+            x86_emit(text, X86_SETE, x86_none(), x86_reg_sized(RAX, 1));
+            x86_emit(text, X86_SETNP, x86_none(), x86_reg_sized(RDX, 1));
+            x86_emit(text, X86_ANDB, x86_reg_sized(RDX, 1), x86_reg_sized(RAX, 1));
+            break;
+        default:
+            x86_emit(text, X86_SETNE, x86_none(), x86_reg_sized(RAX, 1));
+            x86_emit(text, X86_SETP, x86_none(), x86_reg_sized(RDX, 1));
+            x86_emit(text, X86_ORB, x86_reg_sized(RDX, 1), x86_reg_sized(RAX, 1));
+            break;
+    }
+    x86_emit(text, X86_MOVZBQ, x86_reg_sized(RAX, 1), x86_reg(RAX));
+    set_temp_int(current->op1);
+    x86_emit(text, X86_MOVQ, x86_reg(RAX), format_operands(current->op1));
+}
+
+void handle_label_instruction(x86_list *text, instruction current) {
     if (current->label) {
-        fprintf(S, "%s:\n", current->label);
+        x86_emit_label(text, current->label);
     }
 }
 
-void handle_parameter_instruction(FILE *S, instruction current) {
+void handle_parameter_instruction(x86_list *text, instruction current) {
     if (TOTAL_PARMS == -1) {
         TOTAL_PARMS = find_param_count(current);
+        DOUBLE_PARMS = CALL_DOUBLE_ARGS = find_double_param_count(current);
     }
-    if (CURR_PARM_NUM < 6) {
-        const char* reg = get_param_register(CURR_PARM_NUM + 1);
-        if (current->op1 && current->op1->op_type == STRING_TYPE) {
-            fprintf(S, "\tlea\t");
-            format_operands(S, current->op1, true);
-            fprintf(S, ", %s\n", reg);
-        } else if (current->op2 && current->op2->op_type == STRING_TYPE) {
-            fprintf(S, "\tlea\t");
-            format_operands(S, current->op2, true);
-            fprintf(S, ", %s\n", reg);
-        } else if (current->op3 && current->op3->op_type == STRING_TYPE) {
-            fprintf(S, "\tlea\t");
-            format_operands(S, current->op3, true);
-            fprintf(S, ", %s\n", reg);
-        } else {
-            fprintf(S, "\tmovq\t");
-            if (current->op1) {
-                format_operands(S, current->op1, true);
-                fprintf(S, ", %s\n", reg);
-            }
+    if (is_double_operand(current->op1)) {
+        // parms arrive last argument first, like the integer registers
+        DOUBLE_PARMS--;
+        if (DOUBLE_PARMS >= 8) {
+            fprintf(k0_diag(), "tac2asm: more than 8 Double arguments in one call\n");
+            k0_fail(4);
         }
-    } else {
-        fprintf(S, "\tpushq\t");
+        move_to_xmm(text, load_double(text, current->op1, XMM0 + DOUBLE_PARMS), XMM0 + DOUBLE_PARMS);
+        return;
+    }
+    int reg = get_param_register(CURR_PARM_NUM + 1);
+    if (reg < 0) {
         if (current->op1) {
-            format_operands(S, current->op1, true);
+            x86_emit(text, X86_PUSHQ, x86_none(), format_operands(current->op1));
         }
-        fprintf(S, "\n");
+        return;
+    }
+    if (current->op1 && current->op1->op_type == STRING_TYPE) {
+        x86_emit(text, X86_LEAQ, format_operands(current->op1), x86_reg(reg));
+    } else if (current->op2 && current->op2->op_type == STRING_TYPE) {
+        x86_emit(text, X86_LEAQ, format_operands(current->op2), x86_reg(reg));
+    } else if (current->op3 && current->op3->op_type == STRING_TYPE) {
+        x86_emit(text, X86_LEAQ, format_operands(current->op3), x86_reg(reg));
+    } else if (current->op1) {
+        x86_emit(text, X86_MOVQ, format_operands(current->op1), x86_reg(reg));
     }
 }
 
-void handle_call_instruction(FILE *S, instruction current) {
+void handle_call_instruction(x86_list *text, instruction current) {
     TOTAL_PARMS = -1;
     if (current->op1) {
-        fprintf(S, "\tsubq\t$8, %%rsp\t\t# Align stack\n");
-        fprintf(S, "\tcall\t%s\n", current->op1->name);
-        fprintf(S, "\taddq\t$8, %%rsp\t\t# Restore stack\n");
+        // every xmm register is caller-saved, so Double locals are kept on the stack across the call
+        int saved = DOUBLE_LOC_COUNT < DOUBLE_LOC_REGS ? DOUBLE_LOC_COUNT : DOUBLE_LOC_REGS;
+        int frame = 8 + (saved * 8 + 15) / 16 * 16;
+        x86_set_comment(x86_emit(text, X86_SUBQ, x86_imm(frame), x86_reg(RSP)), "Align stack");
+        for (int i = 0; i < saved; i++) {
+            x86_emit(text, X86_MOVSD, x86_reg(XMM8 + i), x86_mem(RSP, -1, 0, 8 * i));
+        }
+        if (strcmp(current->op1->name, "printf") == 0) {
+            x86_set_comment(x86_emit(text, X86_MOVL, x86_imm(CALL_DOUBLE_ARGS), x86_reg_sized(RAX, 4)),
+                            "Vector registers used by varargs");
+        }
+        x86_emit(text, X86_CALL, x86_none(), x86_label(current->op1->name));
+        for (int i = 0; i < saved; i++) {
+            x86_emit(text, X86_MOVSD, x86_mem(RSP, -1, 0, 8 * i), x86_reg(XMM8 + i));
+        }
+        x86_set_comment(x86_emit(text, X86_ADDQ, x86_imm(frame), x86_reg(RSP)), "Restore stack");
     }
+    CALL_DOUBLE_ARGS = 0;
 }
 
-void handle_return_instruction(FILE *S, instruction current) {
-    if (current->op1) {
-        fprintf(S, "\tmovq\t");
-        format_operands(S, current->op1, true);
-        fprintf(S, ", %%rax\n");
+void handle_return_instruction(x86_list *text, instruction current) {
+    if (current->op1 && is_double_operand(current->op1)) {
+        move_to_xmm(text, load_double(text, current->op1, XMM0), XMM0);
+    } else if (current->op1) {
+        x86_emit(text, X86_MOVQ, format_operands(current->op1), x86_reg(RAX));
     }
-    fprintf(S, "\tret\n");
+    x86_emit(text, X86_RET, x86_none(), x86_none());
+}
+
+// n for value == 2^n, otherwise -1
+int exact_log2(long value) {
+    if (value <= 0 || (value & (value - 1)) != 0) return -1;
+    int n = 0;
+    while ((1L << n) != value) n++;
+    return n;
+}
+
+// register the result is built in: the destination itself when it is a register
+x86_operand select_work_register(x86_operand *dst) {
+    return dst->kind == X_REG ? *dst : x86_reg(RAX);
 }
 
-void handle_arithmetic_instruction(FILE *S, instruction current, int opcode) {
+void store_result(x86_list *text, x86_operand work, x86_operand dst) {
+    if (x86_operand_equal(&work, &dst)) {
+        x86_clear_operand(&dst);
+        return;
+    }
+    x86_emit(text, X86_MOVQ, work, dst);
+}
+
+// dst = src + value, using inc/dec, an immediate add or a lea
+void select_add_immediate(x86_list *text, x86_operand src, long value, x86_operand dst) {
+    if (value != 0 && src.kind == X_REG && dst.kind == X_REG && src.reg != dst.reg) {
+        x86_emit(text, X86_LEAQ, x86_mem(src.reg, -1, 0, value), dst);
+        return;
+    }
+    x86_operand work = select_work_register(&dst);
+    x86_emit(text, X86_MOVQ, src, work);
+    if (value == 1) x86_emit(text, X86_INCQ, x86_none(), work);
+    else if (value == -1) x86_emit(text, X86_DECQ, x86_none(), work);
+    else if (value > 0) x86_emit(text, X86_ADDQ, x86_imm(value), work);
+    else if (value < 0) x86_emit(text, X86_SUBQ, x86_imm(-value), work);
+    store_result(text, work, dst);
+}
+
+// dst = src * value, using shifts and lea before falling back to imulq $imm
+void select_mul_immediate(x86_list *text, x86_operand src, long value, x86_operand dst) {
+    if (value == 0) {
+        x86_clear_operand(&src);
+        x86_emit(text, X86_MOVQ, x86_imm(0), dst);
+        return;
+    }
+    x86_operand work = select_work_register(&dst);
+    int shift = exact_log2(value);
+    if ((value == 3 || value == 5 || value == 9) && src.kind == X_REG) {
+        // lea computes base + index * scale in one instruction
+        x86_emit(text, X86_LEAQ, x86_mem(src.reg, src.reg, value - 1, 0), work);
+        store_result(text, work, dst);
+        return;
+    }
+    x86_emit(text, X86_MOVQ, src, work);
+    if (value == 3 || value == 5 || value == 9) {
+        x86_emit(text, X86_LEAQ, x86_mem(work.reg, work.reg, value - 1, 0), work);
+    } else if (value == -1) {
+        x86_emit(text, X86_NEGQ, x86_none(), work);
+    } else if (shift > 0) {
+        x86_emit(text, X86_SHLQ, x86_imm(shift), work);
+    } else if (shift != 0) {
+        x86_emit(text, X86_IMULQ, x86_imm(value), work);
+    }
+    store_result(text, work, dst);
+}
+
+// dst = src / 2^shift, rounding toward zero like idivq
+void select_div_pow2(x86_list *text, x86_operand src, int shift, x86_operand dst) {
+    x86_emit(text, X86_MOVQ, src, x86_reg(RAX));
+    if (shift > 0) {
+        // bias negative dividends by 2^shift - 1 before the arithmetic shift
+        x86_emit(text, X86_MOVQ, x86_reg(RAX), x86_reg(RDX));
+        if (shift > 1) x86_emit(text, X86_SARQ, x86_imm(63), x86_reg(RDX));
+        x86_emit(text, X86_SHRQ, x86_imm(64 - shift), x86_reg(RDX));
+        x86_emit(text, X86_ADDQ, x86_reg(RDX), x86_reg(RAX));
+        x86_emit(text, X86_SARQ, x86_imm(shift), x86_reg(RAX));
+    }
+    store_result(text, x86_reg(RAX), dst);
+}
+
+// both operands are constants, so the result is too
+bool fold_constant_arithmetic(int opcode, long lhs, long rhs, long *result) {
+    switch (opcode) {
+        case O_ADD: *result = lhs + rhs; return true;
+        case O_SUB: *result = lhs - rhs; return true;
+        case O_MUL: *result = lhs * rhs; return true;
+        case O_DIV:
+            if (rhs == 0) return false;
+            *result = lhs / rhs;
+            return true;
+    }
+    return false;
+}
+
+void handle_arithmetic_instruction(x86_list *text, instruction current, int opcode) {
     if (current->op1 && current->op2 && current->op3) {
-        fprintf(S, "\tmovq\t");
-        format_operands(S, current->op2, true);
-        fprintf(S, ", %%rax\n");
+        if (writes_double(current->op1, current->op2) || is_double_operand(current->op3)) {
+            handle_double_arithmetic(text, current, opcode);
+            return;
+        }
+        set_temp_int(current->op1);
+        operand lhs = current->op2;
+        operand rhs = current->op3;
+        long lval, rval, result;
+        bool lconst = int_constant(lhs, &lval);
+        bool rconst = int_constant(rhs, &rval);
+
+        if (lconst && rconst && fold_constant_arithmetic(opcode, lval, rval, &result) &&
+            result >= INT32_MIN && result <= INT32_MAX) {
+            x86_emit(text, X86_MOVQ, x86_imm(result), format_operands(current->op1));
+            return;
+        }
+        // keep the constant on the right for the commutative operators
+        if (lconst && !rconst && (opcode == O_ADD || opcode == O_MUL)) {
+            lhs = current->op3;
+            rhs = current->op2;
+            rval = lval;
+            rconst = true;
+        }
+        // negating INT32_MIN for subq would overflow the immediate field
+        if (rconst && rval != INT32_MIN) {
+            switch (opcode) {
+                case O_ADD:
+                    select_add_immediate(text, format_operands(lhs), rval, format_operands(current->op1));
+                    return;
+                case O_SUB:
+                    select_add_immediate(text, format_operands(lhs), -rval, format_operands(current->op1));
+                    return;
+                case O_MUL:
+                    select_mul_immediate(text, format_operands(lhs), rval, format_operands(current->op1));
+                    return;
+                case O_DIV:
+                    if (exact_log2(rval) >= 0) {
+                        select_div_pow2(text, format_operands(lhs), exact_log2(rval), format_operands(current->op1));
+                        return;
+                    }
+                    break;
+            }
+        }
+
+        x86_emit(text, X86_MOVQ, format_operands(lhs), x86_reg(RAX));
         
         switch (opcode) {
             case O_ADD:
-                fprintf(S, "\taddq\t");
+                x86_emit(text, X86_ADDQ, format_operands(rhs), x86_reg(RAX));
                 break;
             case O_SUB:
-                fprintf(S, "\tsubq\t");
+                x86_emit(text, X86_SUBQ, format_operands(rhs), x86_reg(RAX));
                 break;
             case O_MUL:
-                fprintf(S, "\timulq\t");
+                x86_emit(text, X86_IMULQ, format_operands(rhs), x86_reg(RAX));
                 break;
             case O_DIV:
-                fprintf(S, "\tcdq\n");
-                fprintf(S, "\tidivq\t");
+                x86_emit(text, X86_CQTO, x86_none(), x86_none());
+                if (rconst) {
+                    // idivq has no immediate form
+                    x86_emit(text, X86_MOVQ, x86_imm(rval), x86_reg(R11));
+                    x86_emit(text, X86_IDIVQ, x86_none(), x86_reg(R11));
+                } else {
+                    x86_emit(text, X86_IDIVQ, x86_none(), format_operands(rhs));
+                }
                 break;
         }
         
-        format_operands(S, current->op3, true);
-        if (opcode != O_DIV) fprintf(S, ", %%rax");
-        fprintf(S, "\n");
-        
-        fprintf(S, "\tmovq\t%%rax, ");
-        format_operands(S, current->op1, false);
-        fprintf(S, "\n");
+        x86_emit(text, X86_MOVQ, x86_reg(RAX), format_operands(current->op1));
     }
 }
 
-void handle_assignment_instruction(FILE *S, instruction current) {
-    if (current->op1 && current->op2) {
-        fprintf(S, "\tmovq\t");
-        format_operands(S, current->op2, true);
-        fprintf(S, ", %%rax\n");
-        
-        fprintf(S, "\tmovq\t%%rax, ");
-        format_operands(S, current->op1, false);
-        fprintf(S, "\n");
+void handle_assignment_instruction(x86_list *text, instruction current) {
+    if (current->op1 && current->op2 && writes_double(current->op1, current->op2)) {
+        handle_double_move(text, current);
+    } else if (current->op1 && current->op2) {
+        set_temp_int(current->op1);
+        x86_emit(text, X86_MOVQ, format_operands(current->op2), x86_reg(RAX));
+        x86_emit(text, X86_MOVQ, x86_reg(RAX), format_operands(current->op1));
     }
 }
 
 
-void handle_address_instruction(FILE *S, instruction current) {
-    if (current->op1 && current->op2) {
-        if (current->op2->op_type == STRING_TYPE) fprintf(S, "\tleaq\t");
-        else fprintf(S, "\tmovq\t");
-        format_operands(S, current->op2, false);
-        fprintf(S, ", %%rax\n");
-        
-        fprintf(S, "\tmovq\t%%rax, ");
-        //format_operands(S, current->op1, false);
-        fprintf(S, "%s", find_local_register(LOCAL_VAR_REG_NUM));
-        fprintf(S, "\n");
+void handle_address_instruction(x86_list *text, instruction current) {
+    if (current->op1 && current->op2 && writes_double(current->op1, current->op2)) {
+        handle_double_move(text, current);
+    } else if (current->op1 && current->op2) {
+        set_temp_int(current->op1);
+        if (current->op2->op_type == STRING_TYPE) x86_emit(text, X86_LEAQ, format_operands(current->op2), x86_reg(RAX));
+        else x86_emit(text, X86_MOVQ, format_operands(current->op2), x86_reg(RAX));
+        x86_emit(text, X86_MOVQ, x86_reg(RAX), find_local_register());
     }
 }
 
-void handle_goto_instruction(FILE *S, instruction current) {
+void handle_goto_instruction(x86_list *text, instruction current) {
     if (current->op1) {
-        fprintf(S, "\tjmp\t%s\n", current->op1->name);
+        x86_emit(text, X86_JMP, x86_none(), x86_label(current->op1->name));
     }
 }
 
-void handle_conditional_jump_instruction(FILE *S, instruction current, int opcode) {
+void handle_conditional_jump_instruction(x86_list *text, instruction current, int opcode) {
     if (opcode == O_BIF && current->op1 && current->op2) {
-        fprintf(S, "\tcmpq\t$0, ");
-        format_operands(S, current->op1, true);
-        fprintf(S, "\n");
-        fprintf(S, "\tjne\t%s\n", current->op2->name);
+        x86_emit(text, X86_CMPQ, x86_imm(0), format_operands(current->op1));
+        x86_emit(text, X86_JNE, x86_none(), x86_label(current->op2->name));
     }
     else if (opcode == O_BNIF && current->op1 && current->op2) {
-        fprintf(S, "\tcmpq\t$0, ");
-        format_operands(S, current->op1, true);
-        fprintf(S, "\n");
-        fprintf(S, "\tje\t%s\n", current->op2->name);
+        x86_emit(text, X86_CMPQ, x86_imm(0), format_operands(current->op1));
+        x86_emit(text, X86_JE, x86_none(), x86_label(current->op2->name));
     }
 }
 
-void handle_comparison_instruction(FILE *S, instruction current, int opcode) {
-    if (current->op1 && current->op2 && current->op3) {
-        fprintf(S, "\tmovq\t");
-        format_operands(S, current->op2, true);
-        fprintf(S, ", %%rax\n");
+void handle_comparison_instruction(x86_list *text, instruction current, int opcode) {
+    if (current->op1 && current->op2 && current->op3 &&
+        (is_double_operand(current->op2) || is_double_operand(current->op3))) {
+        handle_double_comparison(text, current, opcode);
+    } else if (current->op1 && current->op2 && current->op3) {
+        set_temp_int(current->op1);
+        x86_emit(text, X86_MOVQ, format_operands(current->op2), x86_reg(RAX));
+        x86_emit(text, X86_CMPQ, format_operands(current->op3), x86_reg(RAX));
         
-        fprintf(S, "\tcmpq\t");
-        format_operands(S, current->op3, true);
-        fprintf(S, ", %%rax\n");
-        
-        const char* setcc;
+        int setcc;
         switch (opcode) {
-            case O_BLT: setcc = "setl"; break;
-            case O_BLE: setcc = "setle"; break;
-            case O_BGT: setcc = "setg"; break;
-            case O_BGE: setcc = "setge"; break;
-            case O_BEQ: setcc = "sete"; break;
-            case O_BNE: setcc = "setne"; break;
-            default: setcc = "set"; break;
+            case O_BLT: setcc = X86_SETL; break;
+            case O_BLE: setcc = X86_SETLE; break;
+            case O_BGT: setcc = X86_SETG; break;
+            case O_BGE: setcc = X86_SETGE; break;
+            case O_BEQ: setcc = X86_SETE; break;
+            default: setcc = X86_SETNE; break;
         }
         
-        fprintf(S, "\t%s\t%%al\n", setcc);
-        fprintf(S, "\tmovzbq\t%%al, %%rax\n");
-        
-        fprintf(S, "\tmovq\t%%rax, ");
-        format_operands(S, current->op1, false);
-        fprintf(S, "\n");
+        x86_emit(text, setcc, x86_none(), x86_reg_sized(RAX, 1));
+        x86_emit(text, X86_MOVZBQ, x86_reg_sized(RAX, 1), x86_reg(RAX));
+        x86_emit(text, X86_MOVQ, x86_reg(RAX), format_operands(current->op1));
     }
 }
 
-void write_instruction(FILE *S, instruction instr) {
+void write_instruction(x86_list *text, instruction instr) {
     if (instr == NULL) return;
     
     instruction current = instr;
     while (current != NULL) {
         switch (current->opcode) {
             case O_LABEL:
-                handle_label_instruction(S, current);
+                if (is_function_label(current)) scan_double_locals(current->next);
+                handle_label_instruction(text, current);
                 break;
                 
             case O_PARM:
-                handle_parameter_instruction(S, current);
+                handle_parameter_instruction(text, current);
                 break;
                 
             case O_CALL:
-                handle_call_instruction(S, current);
+                handle_call_instruction(text, current);
                 break;
                 
             case O_RET:
-                handle_return_instruction(S, current);
+                handle_return_instruction(text, current);
                 break;
                 
             case O_ADD:
             case O_SUB:
             case O_MUL:
             case O_DIV:
-                handle_arithmetic_instruction(S, current, current->opcode);
+                handle_arithmetic_instruction(text, current, current->opcode);
                 break;
                 
             case O_ASN:
-                handle_assignment_instruction(S, current);
+                handle_assignment_instruction(text, current);
                 break;
                 
             case O_ADDR:
-                handle_address_instruction(S, current);
+                handle_address_instruction(text, current);
                 break;
                 
             case O_GOTO:
-                handle_goto_instruction(S, current);
+                handle_goto_instruction(text, current);
                 break;
                 
             case O_BIF:
             case O_BNIF:
-                handle_conditional_jump_instruction(S, current, current->opcode);
+                handle_conditional_jump_instruction(text, current, current->opcode);
                 break;
                 
             case O_BLT:
@@ -580,11 +1044,11 @@ void write_instruction(FILE *S, instruction instr) {
             case O_BGE:
             case O_BEQ:
             case O_BNE:
-                handle_comparison_instruction(S, current, current->opcode);
+                handle_comparison_instruction(text, current, current->opcode);
                 break;
                 
             default:
-                fprintf(S, "\t# Unhandled opcode: %d\n", current->opcode);
+                fprintf(k0_diag(), "tac2asm: unhandled opcode %d\n", current->opcode);
                 break;
         }
         
@@ -592,37 +1056,220 @@ void write_instruction(FILE *S, instruction instr) {
     }
 }
 
-void append_to_list(instruction list, instruction inst) {
-    while (list->next != NULL) {
-        list = list->next;
+/*
+ * With -j on one file, the functions are lowered on the pool. The IC is cut
+ * before every function label, and each thread lowers its pieces with the
+ * .data entries of the file and a Double pool of its own. The pieces are put
+ * back together in order, their Double constants renamed to what lowering
+ * the file in one go would have called them. Peephole runs on the whole
+ * text afterwards, as it looks past the end of a function.
+ */
+struct lowered_function {
+    instruction start;
+    instruction end;
+    x86_list text;
+    DoubleConst *doubles;   // numbered from 0 by the thread
+    char *messages;         // what the thread wrote to k0_diag(), replayed in order
+    int failed;             // exit code lowering stopped with, or 0
+};
+
+struct lowering {
+    struct lowered_function *functions;
+    int count;
+    DataEntry *data;
+};
+
+// lower one piece of the IC on a pool thread
+static void lower_function_task(int i, void *arg) {
+    struct lowering *low = arg;
+    struct lowered_function *f = &low->functions[i];
+    k0_context *ctx = k0_get();
+    size_t length;
+    ctx->diag = open_memstream(&f->messages, &length);
+    data_head = low->data;
+    // every piece starts where lowering the file in one go reaches it: after a call, with no Double in use
+    DOUBLE_LOC_COUNT = 0;
+    TEMP_IS_DOUBLE = false;
+    TOTAL_PARMS = -1;
+    CALL_DOUBLE_ARGS = 0;
+    ctx->recovering = true;
+    int code = setjmp(ctx->recover);
+    if (code == 0) {
+        write_instruction(&f->text, f->start);
     }
-    list->next = inst;
+    ctx->recovering = false;
+    f->failed = code;
+    data_head = NULL;
+    f->doubles = double_pool;
+    double_pool = NULL;
+    DOUBLE_POOL_NUM = 0;
+    fclose(ctx->diag);
+    ctx->diag = NULL;
 }
 
-void text_section(FILE *ics, FILE *S) {
-    fprintf(S, ".section .text\n");
-    fprintf(S, "\t.global main\n");
+static void rename_double(x86_operand *op, char **names, int n) {
+    int k, end = 0;
+    if (op->kind != X_SYM || !op->sym) return;
+    if ((sscanf(op->sym, ".LDS%d%n", &k, &end) == 1 || sscanf(op->sym, ".LD%d%n", &k, &end) == 1) &&
+        op->sym[end] == '\0' && k < n) {
+        free(op->sym);
+        op->sym = strdup(names[k]);
+    }
+}
+
+// add a piece's Double constants to the file's pool in the order it made them, and use their names there
+static void rename_doubles(struct lowered_function *f) {
+    int n = 0;
+    for (DoubleConst *d = f->doubles; d != NULL; d = d->next) n++;
+    char **names = malloc((n + 1) * sizeof(char *));
+    if (!names) {
+        perror("tac2asm: Memory allocation failed");
+        k0_fail(4);
+    }
+    n = 0;
+    for (DoubleConst *d = f->doubles; d != NULL; d = d->next) {
+        names[n++] = d->writable ? add_double_entry(d->value, true) : double_literal(d->value);
+    }
+    for (x86_instr i = f->text.head; i != NULL; i = i->next) {
+        rename_double(&i->src, names, n);
+        rename_double(&i->dst, names, n);
+    }
+    free(names);
+    free_double_list(f->doubles);
+    f->doubles = NULL;
+}
+
+static void lower_functions(instruction head, x86_list *text, int threads) {
+    struct lowering low = { NULL, 0, data_head };
+    int max = 1;
+    for (instruction i = head; i != NULL; i = i->next) {
+        if (is_function_label(i)) max++;
+    }
+    low.functions = calloc(max, sizeof(struct lowered_function));
+    if (!low.functions) {
+        perror("tac2asm: Memory allocation failed");
+        k0_fail(4);
+    }
+    for (instruction i = head, prev = NULL; i != NULL; prev = i, i = i->next) {
+        if (i != head && !is_function_label(i)) continue;
+        if (prev) {
+            prev->next = NULL;
+            low.functions[low.count - 1].end = prev;
+        }
+        low.functions[low.count++].start = i;
+    }
+    pool_run(threads, low.count, lower_function_task, &low);
+
+    int failed = 0;
+    for (int i = 0; i < low.count; i++) {
+        struct lowered_function *f = &low.functions[i];
+        // joined again for free_instruction_list()
+        if (f->end) f->end->next = low.functions[i + 1].start;
+        if (!failed) {
+            fputs(f->messages, k0_diag());
+            failed = f->failed;
+        }
+        if (!failed) {
+            rename_doubles(f);
+            x86_append_list(text, &f->text);
+        }
+        x86_free_list(&f->text);
+        free(f->messages);
+        free_double_list(f->doubles);
+    }
+    free(low.functions);
+    if (failed) {
+        k0_fail(failed);
+    }
+}
+
+// lower the rest of the .ic file to an optimized x86 instruction list
+void build_text(FILE *ics, x86_list *text) {
     char line[MAX_LINE];
-    instruction head = NULL;
+    instruction head = NULL, tail = NULL;
     while (!feof(ics)) {
         read_line(ics, line);
         instruction cinstr = process_line(line);
         if (cinstr) {
-            if (!head) head = cinstr; else {
-                append_to_list(head, cinstr);
-            } 
+            if (!head) head = cinstr;
+            else tail->next = cinstr;
+            tail = cinstr;
         }
         strcpy(line, "\n");
     }
-    write_instruction(S, head);
+    int threads = k0_get()->threads;
+    if (threads > 1 && head) {
+        lower_functions(head, text, threads);
+    } else {
+        write_instruction(text, head);
+    }
     free_instruction_list(head);
+    peephole(text);
+    long lines = 0;
+    for (x86_instr i = text->head; i; i = i->next) lines++;
+    count_event(COUNT_ASM_LINES, lines);
 }
 
-void tac2asm(char *file_name) {
-    FILE *ic_file = open_file(file_name, "r");
-    char *assembly_file_name = gen_file_name(file_name);
-    FILE *assembly_file = open_file(assembly_file_name, "w+");
-    
+void text_section(FILE *ics, FILE *S) {
+    fprintf(S, ".section .text\n");
+    fprintf(S, "\t.global main\n");
+    x86_list text = { NULL, NULL, 0 };
+    build_text(ics, &text);
+    x86_print_list(S, &text);
+    x86_free_list(&text);
+}
+
+// decode the escapes gas accepts inside .asciz
+size_t unescape_string(const char *text, unsigned char *out) {
+    size_t len = 0;
+    for (const char *p = text; *p; p++) {
+        if (*p != '\\' || p[1] == '\0') {
+            out[len++] = *p;
+            continue;
+        }
+        p++;
+        if (*p >= '0' && *p <= '7') {
+            int value = 0;
+            for (int i = 0; i < 3 && *p >= '0' && *p <= '7'; i++, p++) value = value * 8 + (*p - '0');
+            p--;
+            out[len++] = value;
+            continue;
+        }
+        switch (*p) {
+            case 'n': out[len++] = '\n'; break;
+            case 't': out[len++] = '\t'; break;
+            case 'r': out[len++] = '\r'; break;
+            case 'b': out[len++] = '\b'; break;
+            case 'f': out[len++] = '\f'; break;
+            default: out[len++] = *p; break;
+        }
+    }
+    return len;
+}
+
+// the same bytes write_strings() and write_double_pool() describe to the assembler
+void data_sections(elf_object *obj) {
+    for (StringEntry *curr = string_head; curr != NULL; curr = curr->next) {
+        unsigned char *bytes = malloc(strlen(curr->text) + 2);
+        size_t len = unescape_string(curr->text, bytes);
+        bytes[len++] = '\n';
+        bytes[len++] = '\0';
+        elf_define_symbol(obj, curr->name, ELF_DATA, obj->data.size, false);
+        elf_append(&obj->data, bytes, len);
+        free(bytes);
+    }
+    for (DoubleConst *curr = double_pool; curr != NULL; curr = curr->next) {
+        int section = curr->writable ? ELF_DATA : ELF_RODATA;
+        elf_buffer *buf = elf_section(obj, section);
+        elf_align(buf, 8);
+        elf_define_symbol(obj, curr->name, section, buf->size, false);
+        elf_append(buf, &curr->value, sizeof(double));
+    }
+}
+
+// lower the IC read from ic_file to assembly written to assembly_file
+void tac2asm_stream(FILE *ic_file, FILE *assembly_file) {
+    phase_begin(PHASE_TAC2ASM);
     fprintf(assembly_file, ".section .note.GNU-stack, \"\", @progbits\n");
     
     fprintf(assembly_file, ".section .data\n");
@@ -630,9 +1277,76 @@ void tac2asm(char *file_name) {
     write_strings(assembly_file);
     read_data_section(ic_file);
     text_section(ic_file, assembly_file);
+    write_double_pool(assembly_file);
 
     free_string_entries();
     free_data_entries();
+    free_double_pool();
+    phase_end(PHASE_TAC2ASM);
+}
+
+void tac2asm(char *file_name) {
+    FILE *ic_file = open_file(file_name, "r");
+    char *assembly_file_name = gen_file_name(file_name);
+    FILE *assembly_file = open_file(assembly_file_name, "w+");
+    tac2asm_stream(ic_file, assembly_file);
     fclose(ic_file);
     fclose(assembly_file);
-}
\ No newline at end of file
+}
+
+// same lowering as tac2asm_stream(), but encoded into an in-memory object
+void tac2elf_stream(FILE *ic_file, elf_object *obj) {
+    phase_begin(PHASE_TAC2ASM);
+    read_string_section(ic_file);
+    read_data_section(ic_file);
+    x86_list text = { NULL, NULL, 0 };
+    build_text(ic_file, &text);
+
+    x86_encode(&text, obj);
+    data_sections(obj);
+
+    x86_free_list(&text);
+    free_string_entries();
+    free_data_entries();
+    free_double_pool();
+    phase_end(PHASE_TAC2ASM);
+}
+
+void tac2elf(char *ic_name, elf_object *obj) {
+    FILE *ic_file = open_file(ic_name, "r");
+    tac2elf_stream(ic_file, obj);
+    fclose(ic_file);
+}
+
+void tac2obj(char *ic_name, char *obj_name) {
+    elf_object obj;
+    elf_init(&obj);
+    tac2elf(ic_name, &obj);
+    elf_write(&obj, obj_name);
+    elf_free(&obj);
+}
+
+// release whatever a compilation that stopped part way left behind
+void tac2asm_state_free(struct tac2asm_state *state) {
+    if (!state) return;
+    while (state->data) {
+        DataEntry *next = state->data->next;
+        free(state->data->type);
+        free(state->data);
+        state->data = next;
+    }
+    while (state->strings) {
+        StringEntry *next = state->strings->next;
+        free(state->strings->name);
+        free(state->strings->text);
+        free(state->strings);
+        state->strings = next;
+    }
+    while (state->doubles) {
+        DoubleConst *next = state->doubles->next;
+        free(state->doubles->name);
+        free(state->doubles);
+        state->doubles = next;
+    }
+    free(state);
+}
@@ -4,13 +4,20 @@
 #include <string.h>
 #include <ctype.h>
 #include <unistd.h>
+#include <stdint.h>
+#include "x86.h"
+#include "peephole.h"
+#include "x86enc.h"
+#include "elfobj.h"
 
 #define MAX_LINE 256
-#define TMP_REG "\%rax"
-#define ARG1_REG "\%rdi"
-#define ARG2_REG "\%rsi"
-#define ARG3_REG "\%rdx"
-#define ARG4_REG "\%rcx"
+#define MAX_DOUBLE_LOCS 64
+#define DOUBLE_LOC_REGS 8 /* Double locals live in %xmm8-%xmm15, then spill */
+#define TMP_REG RAX
+#define ARG1_REG RDI
+#define ARG2_REG RSI
+#define ARG3_REG RDX
+#define ARG4_REG RCX
 #define O_LABEL 3000
 #define O_ADD   3001
 #define O_SUB   3002
@@ -66,4 +73,11 @@ typedef struct StringEntry {
     char *name;
     char *text;
     struct StringEntry *next;
-} StringEntry;
\ No newline at end of file
+} StringEntry;
+
+typedef struct DoubleConst {
+    char *name;
+    double value;
+    bool writable; /* spill slot in .data rather than a .rodata literal */
+    struct DoubleConst *next;
+} DoubleConst;
@@ -6,6 +6,9 @@ LEX_ARG=-lexer
 SYN_ARG=-tree
 SEM_ARG=-symtab
 
+# failed tests over every section, for the exit status
+failures=0
+
 
 valgrind_check() {
     local file=$1
@@ -32,8 +35,7 @@ fail=0
 
 echo "==== Running invalid lexical tests ===="
 
-# for file in tests/errors/lex/literals/lex*.kt; do
-for file in $(find tests/errors/lex/literals/lex*.kt -type f -name 'lex*.kt'); do
+for file in $(find tests/errors/lex/ -type f -name '*.kt'); do
     [[ -f "$file" ]] || continue
     testname=$(basename "$file")
     # read the token from the file
@@ -99,6 +101,7 @@ echo "==== Lexical Test Summary ===="
 echo "Passed: $pass"
 echo "Failed: $fail"
 echo "Total: $((pass + fail))"
+((failures += fail))
 
 
 # SYNTAX
@@ -151,6 +154,7 @@ echo "==== Syntax Test Summary ===="
 echo "Passed: $pass"
 echo "Failed: $fail"
 echo "Total: $((pass + fail))"
+((failures += fail))
 
 # SEMANTICS
 
@@ -177,6 +181,27 @@ for file in tests/errors/sem*.kt; do
     fi
 done
 
+echo ""
+echo "==== Running invalid tests with every error reported ===="
+
+# going on past the first error must not change the outcome
+for file in tests/errors/syn*.kt tests/errors/sem*.kt; do
+    [[ -f "$file" ]] || continue
+    testname=$(basename "$file")
+    expected=$([[ $testname == syn* ]] && echo 2 || echo 3)
+
+    $COMPILER -ferror-limit=0 $SEM_ARG "$file" > /dev/null 2>&1
+    result=$?
+
+    if [[ "$result" -eq "$expected" ]]; then
+        echo "[O] file: $testname... passed (expected $expected, got $result)"
+        ((pass++))
+    else
+        echo "[X] file: $testname... failed (expected $expected, got $result)"
+        ((fail++))
+    fi
+done
+
 echo ""
 echo "==== Running valid semantics tests ===="
 
@@ -196,8 +221,269 @@ for file in tests/k0/sem*.kt; do
     fi
 done
 
+echo ""
+echo "==== Running valid tests with every error reported ===="
+
+# a file accepted by default must be accepted with no error limit too; the
+# heap is filled with junk so a flag left unset cannot pass by chance
+for file in tests/k0/syn*.kt tests/k0/sem*.kt; do
+    [[ -f "$file" ]] || continue
+    testname=$(basename "$file")
+    $COMPILER $SEM_ARG "$file" > /dev/null 2>&1 || continue
+
+    MALLOC_PERTURB_=165 $COMPILER -ferror-limit=0 $SEM_ARG "$file" > /dev/null 2>&1
+    result=$?
+
+    if [[ "$result" -eq 0 ]]; then
+        echo "[O] file: $testname... passed (expected 0, got $result)"
+        ((pass++))
+    else
+        echo "[X] file: $testname... failed (expected 0, got $result)"
+        ((fail++))
+    fi
+done
+
 echo ""
 echo "==== Semantics Test Summary ===="
 echo "Passed: $pass"
 echo "Failed: $fail"
 echo "Total: $((pass + fail))"
+((failures += fail))
+
+# THREADS
+
+# counters
+pass=0
+fail=0
+
+echo ""
+echo "==== Running semantic checks on several threads ===="
+
+# checking functions on four threads must print what checking them on one
+# does, errors and the checks' own output alike, wherever the limit stops it
+for file in tests/errors/sem*.kt; do
+    [[ -f "$file" ]] || continue
+    testname=$(basename "$file")
+
+    for limit in 1 2 0; do
+        expected=$($COMPILER -j 1 -ferror-limit=$limit $SEM_ARG "$file" 2>&1; echo "exit $?")
+        actual=$($COMPILER -j 4 -ferror-limit=$limit $SEM_ARG "$file" 2>&1; echo "exit $?")
+
+        if [[ "$actual" == "$expected" ]]; then
+            echo "[O] file: $testname (limit $limit)... passed"
+            ((pass++))
+        else
+            echo "[X] file: $testname (limit $limit)... failed (output differs from -j 1)"
+            ((fail++))
+        fi
+    done
+done
+
+echo ""
+echo "==== Threads Test Summary ===="
+echo "Passed: $pass"
+echo "Failed: $fail"
+echo "Total: $((pass + fail))"
+((failures += fail))
+
+# ENCODER
+
+# counters
+pass=0
+fail=0
+
+echo ""
+echo "==== Running encoder tests ===="
+
+# the built-in encoder must produce the instructions and relocations as does
+workdir=$(mktemp -d)
+for file in tests/k0/*.kt tests/hw6/*.kt bench/programs/*.kt; do
+    [[ -f "$file" ]] || continue
+    testname=$(basename "$file")
+    base="$workdir/${testname%.kt}"
+    cp "$file" "$base.kt"
+
+    # only the files that compile to an object at all
+    $COMPILER -c "$base.kt" > /dev/null 2>&1 || continue
+    mv "$base.o" "$base.enc.o"
+    $COMPILER -via-as -c "$base.kt" > /dev/null 2>&1
+
+    if diff <(objdump -dr "$base.enc.o" | tail -n +3) <(objdump -dr "$base.o" 2>&1 | tail -n +3) > /dev/null; then
+        echo "[O] file: $testname... passed"
+        ((pass++))
+    else
+        echo "[X] file: $testname... failed (object differs from the one as writes)"
+        ((fail++))
+    fi
+done
+rm -rf "$workdir"
+
+echo ""
+echo "==== Encoder Test Summary ===="
+echo "Passed: $pass"
+echo "Failed: $fail"
+echo "Total: $((pass + fail))"
+((failures += fail))
+
+# BUILD CACHE
+
+# counters
+pass=0
+fail=0
+
+echo ""
+echo "==== Running build cache tests ===="
+
+# a build from the cache must end as a cold build of the same command does;
+# tests/cache/lib.kt has no main, which only a compile with other files may lack
+workdir=$(mktemp -d)
+export K0_CACHE_DIR="$workdir/cache"
+cp tests/cache/*.kt "$workdir"
+for step in "multi 0 $workdir/lib.kt $workdir/main.kt" "single 3 $workdir/lib.kt"; do
+    read -r testname expected files <<< "$step"
+
+    $COMPILER -cache -c $files > /dev/null 2>&1
+    result=$?
+
+    if [[ "$result" -eq "$expected" ]]; then
+        echo "[O] cache: $testname... passed (expected $expected, got $result)"
+        ((pass++))
+    else
+        echo "[X] cache: $testname... failed (expected $expected, got $result)"
+        ((fail++))
+    fi
+done
+unset K0_CACHE_DIR
+rm -rf "$workdir"
+
+echo ""
+echo "==== Build Cache Test Summary ===="
+echo "Passed: $pass"
+echo "Failed: $fail"
+echo "Total: $((pass + fail))"
+((failures += fail))
+
+# LIBRARY
+
+# counters
+pass=0
+fail=0
+
+echo ""
+echo "==== Running library tests ===="
+
+# each tests/lib/*.c is a program built against libk0.a by make check
+for src in tests/lib/*.c; do
+    prog="${src%.c}"
+    testname=$(basename "$prog")
+
+    if [[ ! -x "$prog" ]]; then
+        echo "[X] library: $testname... failed (not built; run make check)"
+        ((fail++))
+        continue
+    fi
+
+    output=$("$prog" 2>&1)
+    result=$?
+
+    if [[ "$result" -eq 0 ]]; then
+        echo "[O] library: $testname... passed ($(tail -n 1 <<< "$output"))"
+        ((pass++))
+    else
+        echo "[X] library: $testname... failed ($(tail -n 1 <<< "$output"))"
+        ((fail++))
+    fi
+done
+
+echo ""
+echo "==== Library Test Summary ===="
+echo "Passed: $pass"
+echo "Failed: $fail"
+echo "Total: $((pass + fail))"
+((failures += fail))
+
+# INTERPRETER
+
+# counters
+pass=0
+fail=0
+
+echo ""
+echo "==== Running interpreter tests ===="
+
+# each file lists the lines it must print as "// expect: <line>" comments
+for file in tests/k0/run*.kt; do
+    [[ -f "$file" ]] || continue
+    testname=$(basename "$file")
+    expected=$(sed -n 's#^// expect: ##p' "$file")
+
+    output=$($COMPILER -interp "$file" 2>/dev/null)
+    result=$?
+    actual=$(echo "$output" | grep -x -F -f <(echo "$expected"))
+
+    if [[ "$result" -eq 0 && "$actual" == "$expected" ]]; then
+        echo "[O] file: $testname... passed"
+        ((pass++))
+    else
+        echo "[X] file: $testname... failed (exit $result, output differs from the expect lines)"
+        ((fail++))
+    fi
+done
+
+echo ""
+echo "==== Interpreter Test Summary ===="
+echo "Passed: $pass"
+echo "Failed: $fail"
+echo "Total: $((pass + fail))"
+((failures += fail))
+
+# LEXER ENGINES
+
+# counters
+pass=0
+fail=0
+
+echo ""
+echo "==== Running lexer engine differential tests ===="
+
+# -lexer-engine=fast must print the tokens, texts, lines and errors flex does
+for file in $(find tests/ -type f -name '*.kt'); do
+    testname=$(basename "$file")
+
+    expected=$($COMPILER -ferror-limit=0 -tokens "$file" 2>&1; echo "exit $?")
+    actual=$($COMPILER -lexer-engine=fast -ferror-limit=0 -tokens "$file" 2>&1; echo "exit $?")
+
+    if [[ "$actual" == "$expected" ]]; then
+        echo "[O] file: $testname... passed"
+        ((pass++))
+    else
+        echo "[X] file: $testname... failed (tokens differ from flex)"
+        ((fail++))
+    fi
+done
+
+# and on standard input, for the invalid lexemes the lexical tests feed it
+for file in $(find tests/errors/lex/ tests/kotlin/ -type f -name '*.kt'); do
+    testname=$(basename "$file")
+    input=$(cat "$file")
+
+    expected=$(echo "$input" | $COMPILER -ferror-limit=0 $LEX_ARG 2>&1; echo "exit $?")
+    actual=$(echo "$input" | $COMPILER -lexer-engine=fast -ferror-limit=0 $LEX_ARG 2>&1; echo "exit $?")
+
+    if [[ "$actual" == "$expected" ]]; then
+        echo "[O] file: $testname (stdin)... passed"
+        ((pass++))
+    else
+        echo "[X] file: $testname (stdin)... failed (tokens differ from flex)"
+        ((fail++))
+    fi
+done
+
+echo ""
+echo "==== Lexer Engine Test Summary ===="
+echo "Passed: $pass"
+echo "Failed: $fail"
+echo "Total: $((pass + fail))"
+((failures += fail))
+
+[[ "$failures" -eq 0 ]]
@@ -0,0 +1,3 @@
+fun one(): Int {
+    return 1
+}
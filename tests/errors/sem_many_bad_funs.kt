@@ -0,0 +1,29 @@
+fun add(a: Int, b: Int): Int {
+    return a + b
+}
+
+fun first() {
+    add(1, true)
+}
+
+fun second() {
+    add(2, 3)
+    add(4, false)
+}
+
+fun third() {
+    add(5, 6)
+    add(7, "eight")
+}
+
+fun fourth() {
+    add(9, 10)
+    add(11, 'c')
+}
+
+fun main() {
+    first()
+    second()
+    third()
+    fourth()
+}
@@ -0,0 +1,12 @@
+fun half(a: Double): Double {
+    return a / 2.0
+}
+
+fun main() {
+    val x: Int = 5
+    val y: Double = x
+    println(z)
+    half("Hello")
+    var x: Int = 6
+    val w: String = 3
+}
@@ -0,0 +1,10 @@
+tailrec fun fact(n : Int) : Int {
+    if (n == 0) {
+        return 1
+    }
+    return n * fact(n - 1)
+}
+
+fun main() {
+    var s : Int = fact(5)
+}
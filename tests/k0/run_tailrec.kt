@@ -0,0 +1,31 @@
+// expect: count ok
+// expect: wide ok
+// tail self-calls run in constant stack, however many arguments they pass
+tailrec fun count(n : Int) {
+    if (n == 0) {
+        println("count ok");
+    } else {
+        count(n - 1);
+    }
+}
+
+fun check(last : Int) {
+    if (last == 1000033) {
+        println("wide ok");
+    } else {
+        println("wide wrong");
+    }
+}
+
+tailrec fun wide(a0 : Int, a1 : Int, a2 : Int, a3 : Int, a4 : Int, a5 : Int, a6 : Int, a7 : Int, a8 : Int, a9 : Int, a10 : Int, a11 : Int, a12 : Int, a13 : Int, a14 : Int, a15 : Int, a16 : Int, a17 : Int, a18 : Int, a19 : Int, a20 : Int, a21 : Int, a22 : Int, a23 : Int, a24 : Int, a25 : Int, a26 : Int, a27 : Int, a28 : Int, a29 : Int, a30 : Int, a31 : Int, a32 : Int, a33 : Int) {
+    if (a0 == 0) {
+        check(a33);
+    } else {
+        wide(a0 - 1, a1 + 1, a2 + 1, a3 + 1, a4 + 1, a5 + 1, a6 + 1, a7 + 1, a8 + 1, a9 + 1, a10 + 1, a11 + 1, a12 + 1, a13 + 1, a14 + 1, a15 + 1, a16 + 1, a17 + 1, a18 + 1, a19 + 1, a20 + 1, a21 + 1, a22 + 1, a23 + 1, a24 + 1, a25 + 1, a26 + 1, a27 + 1, a28 + 1, a29 + 1, a30 + 1, a31 + 1, a32 + 1, a33 + 1);
+    }
+}
+
+fun main() {
+    count(1000000);
+    wide(1000000, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33);
+}
@@ -0,0 +1,12 @@
+fun main() {
+    var a : Int = 7
+    var b : Int = a + 1
+    b = b - 1
+    b = a * 8
+    b = a * 5
+    b = a * 7
+    b = a / 4
+    b = a / 3
+    b = 3 + 4
+    b = 2 * a
+}
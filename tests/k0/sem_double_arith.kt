@@ -0,0 +1,13 @@
+fun main() {
+    var x : Double = 1.5
+    var n : Int = 3
+    var y : Double = x * 2.0
+    y = y + 3.0
+    y = y / 4.0
+    if (y <= x) {
+        n = n + 1
+    }
+    if (y == x) {
+        n = n * 5
+    }
+}
@@ -0,0 +1,18 @@
+fun step(n : Int) : Int {
+    return n + 3
+}
+
+fun main() {
+    var i : Int = 0
+    var s : Int = 0
+    while (i < 1000) {
+        i = i + 1
+        s = s + 3
+    }
+    step(s)
+    if (s == 3000) {
+        println("ok")
+    } else {
+        println("wrong")
+    }
+}
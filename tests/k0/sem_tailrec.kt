@@ -0,0 +1,17 @@
+tailrec fun sum(n : Int, acc : Int) : Int {
+    if (n == 0) {
+        return acc
+    }
+    return sum(n - 1, acc + n)
+}
+
+fun count(n : Int) {
+    if (n > 0) {
+        count(n - 1)
+    }
+}
+
+fun main() {
+    var s : Int = sum(10, 0)
+    count(5)
+}
@@ -0,0 +1,23 @@
+import java.util.Random
+import java.lang.Math
+import java.io.File
+
+val A : Int = 1
+val B : Int = 2
+val C : Int = 3
+
+fun sum12(a : Int, b : Int, c : Int, d : Int, e : Int, f : Int, g : Int, h : Int, i : Int, j : Int, k : Int, l : Int) : Int {
+    var s : Int = a + b + c + d + e + f + g + h + i + j + k + l
+    return s
+}
+
+fun main() {
+    var x : Int = sum12(1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12)
+    var y : Int = sum12(x, A, B, C, x, A, B, C, x, A, B, C)
+    x = x + 1
+    y = y + 1
+    x = x + y
+    y = x + y
+    println(x)
+    println(y)
+}
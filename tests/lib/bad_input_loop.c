@@ -0,0 +1,58 @@
+/*
+ * libk0 test: compile invalid source again and again on one context, as a
+ * compile server's worker does, and check that the heap stays flat. Exits
+ * 1 if a compile gives the wrong exit code or the heap grows.
+ *
+ *   bad_input_loop [rounds]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include "k0.h"
+
+// growth over the measured rounds still taken as flat, for allocator noise
+#define SLACK (64 * 1024)
+
+static const struct {
+    const char *source;
+    int code;
+} inputs[] = {
+    // stops the lexer, and with it the parse, part way through the file
+    {"fun main() {\n    var x: Int = 0b101\n    var y: Int = 2\n}\n", 1},
+    {"fun main() {\n    var x: Int = (1 + 2\n    x = x *\n}\n", 2},
+    {"fun add(a: Int, b: Int): Int {\n    return a + b\n}\n\nfun main() {\n    add(5)\n}\n", 3},
+};
+#define NINPUTS (int)(sizeof(inputs) / sizeof(inputs[0]))
+
+// one compile of every input; false if one ends with the wrong code
+static int compile_all(k0_context *ctx) {
+    for (int i = 0; i < NINPUTS; i++) {
+        int code = k0_compile(ctx, "bad.kt", inputs[i].source, strlen(inputs[i].source), K0_EMIT_IC);
+        if (code != inputs[i].code) {
+            fprintf(stderr, "input %d: expected exit %d, got %d\n", i, inputs[i].code, code);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    int rounds = argc > 1 ? atoi(argv[1]) : 500;
+    k0_context *ctx = k0_create();
+
+    // the first rounds grow the allocator's caches and the context's buffers
+    for (int i = 0; i < 20; i++) {
+        if (!compile_all(ctx)) return 1;
+    }
+    size_t before = mallinfo2().uordblks;
+    for (int i = 0; i < rounds; i++) {
+        if (!compile_all(ctx)) return 1;
+    }
+    size_t after = mallinfo2().uordblks;
+    k0_destroy(ctx);
+
+    long growth = (long)after - (long)before;
+    printf("heap grew %ld bytes over %d failed compiles\n", growth, rounds * NINPUTS);
+    return growth > SLACK;
+}
@@ -0,0 +1,123 @@
+#include <stdlib.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "timing.h"
+#include "k0ctx.h"
+
+struct timing_state {
+    double start_wall;
+    double wall[NPHASES];
+    double cpu[NPHASES];
+    double begin_wall[NPHASES];
+    double begin_cpu[NPHASES];
+    long counts[NCOUNTERS];
+};
+
+static const char *phase_names[NPHASES] = {
+    "parse", "lower", "extract_symbols", "check_symbols", "collect_strings",
+    "generate_code", "write_ic", "tac2asm", "assemble", "link"
+};
+
+static const char *counter_names[NCOUNTERS] = {
+    "tokens", "tree_nodes", "symbols", "ic_instructions", "asm_lines"
+};
+
+static double wall_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// CPU time of this process and of the children it has waited for
+static double cpu_seconds(void) {
+    struct timespec ts;
+    struct rusage children;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    getrusage(RUSAGE_CHILDREN, &children);
+    return ts.tv_sec + ts.tv_nsec / 1e9 +
+           children.ru_utime.tv_sec + children.ru_utime.tv_usec / 1e6 +
+           children.ru_stime.tv_sec + children.ru_stime.tv_usec / 1e6;
+}
+
+void timing_enable(struct k0_context *ctx) {
+    if (ctx->timing) return;
+    ctx->timing = calloc(1, sizeof(struct timing_state));
+    if (!ctx->timing) {
+        perror("Memory allocation failed");
+        k0_fail(4);
+    }
+    ctx->timing->start_wall = wall_seconds();
+}
+
+void phase_begin(int phase) {
+    struct timing_state *t = k0_get()->timing;
+    if (!t) return;
+    t->begin_wall[phase] = wall_seconds();
+    t->begin_cpu[phase] = cpu_seconds();
+}
+
+void phase_end(int phase) {
+    struct timing_state *t = k0_get()->timing;
+    if (!t) return;
+    t->wall[phase] += wall_seconds() - t->begin_wall[phase];
+    t->cpu[phase] += cpu_seconds() - t->begin_cpu[phase];
+}
+
+void count_event(int counter, long n) {
+    struct timing_state *t = k0_get()->timing;
+    if (t) t->counts[counter] += n;
+}
+
+long count_value(struct k0_context *ctx, int counter) {
+    return ctx->timing ? ctx->timing->counts[counter] : 0;
+}
+
+// write s as a JSON string
+static void json_string(FILE *fp, const char *s) {
+    fputc('"', fp);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') fprintf(fp, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20) fprintf(fp, "\\u%04x", *s);
+        else fputc(*s, fp);
+    }
+    fputc('"', fp);
+}
+
+void time_report(struct k0_context *ctx, FILE *fp, bool json) {
+    struct timing_state *t = ctx->timing;
+    if (!t) return;
+    double total = wall_seconds() - t->start_wall;
+    const char *file = ctx->current_file ? ctx->current_file : "";
+
+    if (json) {
+        fprintf(fp, "{\"file\": ");
+        json_string(fp, file);
+        fprintf(fp, ", \"total_wall_ms\": %.3f, \"phases\": {", total * 1e3);
+        for (int i = 0; i < NPHASES; i++) {
+            fprintf(fp, "%s\"%s\": {\"wall_ms\": %.3f, \"cpu_ms\": %.3f}", i ? ", " : "",
+                    phase_names[i], t->wall[i] * 1e3, t->cpu[i] * 1e3);
+        }
+        fprintf(fp, "}, \"counters\": {");
+        for (int i = 0; i < NCOUNTERS; i++) {
+            fprintf(fp, "%s\"%s\": %ld", i ? ", " : "", counter_names[i], t->counts[i]);
+        }
+        fprintf(fp, "}}\n");
+        return;
+    }
+
+    fprintf(fp, "Time report for %s\n", *file ? file : "(link)");
+    fprintf(fp, "  %-18s %12s %7s %12s\n", "phase", "wall (ms)", "wall %", "cpu (ms)");
+    for (int i = 0; i < NPHASES; i++) {
+        if (t->wall[i] == 0 && t->cpu[i] == 0) continue;
+        fprintf(fp, "  %-18s %12.3f %6.1f%% %12.3f\n", phase_names[i], t->wall[i] * 1e3,
+                total > 0 ? 100 * t->wall[i] / total : 0.0, t->cpu[i] * 1e3);
+    }
+    fprintf(fp, "  %-18s %12.3f\n", "total", total * 1e3);
+    for (int i = 0; i < NCOUNTERS; i++) {
+        fprintf(fp, "  %-18s %12ld\n", counter_names[i], t->counts[i]);
+    }
+}
+
+void timing_state_free(struct timing_state *state) {
+    free(state);
+}
@@ -0,0 +1,53 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+struct k0_context;
+struct timing_state;
+
+/*
+ * Per-phase timing for -ftime-report. Phases and counters are recorded on
+ * the current context once timing_enable() has been called on it; until
+ * then every call below is a no-op. CPU time includes child processes, so
+ * the assemble and link phases account for the gcc they run.
+ */
+
+enum time_phase {
+    PHASE_PARSE,            /* yyparse(), lexing included */
+    PHASE_LOWER,            /* parse tree to the slim tree */
+    PHASE_EXTRACT_SYMBOLS,
+    PHASE_CHECK_SYMBOLS,
+    PHASE_COLLECT_STRINGS,
+    PHASE_GENERATE_CODE,
+    PHASE_WRITE_IC,         /* string, data and code sections */
+    PHASE_TAC2ASM,          /* IC to x86, printed or encoded */
+    PHASE_ASSEMBLE,         /* gcc -c, with -via-as */
+    PHASE_LINK,             /* gcc */
+    NPHASES
+};
+
+enum time_counter {
+    COUNT_TOKENS,
+    COUNT_TREE_NODES,
+    COUNT_SYMBOLS,
+    COUNT_IC_INSTRS,
+    COUNT_ASM_LINES,
+    NCOUNTERS
+};
+
+/* Start recording on ctx; the report's total runs from here */
+void timing_enable(struct k0_context *ctx);
+
+void phase_begin(int phase);
+void phase_end(int phase);
+void count_event(int counter, long n);
+
+/* What ctx has counted so far, to add a pool thread's counts to its caller's */
+long count_value(struct k0_context *ctx, int counter);
+
+/* Print what ctx recorded as a table, or as one JSON object */
+void time_report(struct k0_context *ctx, FILE *fp, bool json);
+
+#endif
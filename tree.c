@@ -5,10 +5,12 @@
 #include <string.h>
 #include "tree.h"
 #include "k0gram.h"
+#include "k0ctx.h"
+#include "timing.h"
+#include "memstat.h"
 
-extern YYSTYPE yylval;
 extern const char *token_name(int t);
-int serial = 0;
+#define serial (k0_get()->serial)
 
 char *escape(char *s)
 {
@@ -39,70 +41,221 @@ char *escape(char *s)
     return ns;
 }
 
+// token text is copied into blocks of this size, so lexing a token does not call malloc
+#define TEXT_BLOCK_SIZE 65536
+
+struct text_block {
+    struct text_block *next;
+    size_t used;
+    size_t size;
+    char text[];
+};
+
+// a NUL-terminated copy of the length bytes at text, in the blocks of ctx
+static char *keep_text(struct k0_context *ctx, const char *text, size_t length)
+{
+    struct text_block *block = ctx->token_text;
+    if (!block || block->size - block->used < length + 1)
+    {
+        size_t size = length + 1 > TEXT_BLOCK_SIZE ? length + 1 : TEXT_BLOCK_SIZE;
+        block = mem_alloc(MEM_TREE, sizeof(struct text_block) + size);
+        if (!block)
+        {
+            fprintf(k0_diag(), "Memory allocation failed for token text\n");
+            k0_fail(4);
+        }
+        block->next = ctx->token_text;
+        block->used = 0;
+        block->size = size;
+        ctx->token_text = block;
+    }
+    char *copy = block->text + block->used;
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    block->used += length + 1;
+    return copy;
+}
+
+struct text_block *take_token_text(void)
+{
+    k0_context *ctx = k0_get();
+    struct text_block *blocks = ctx->token_text;
+    ctx->token_text = NULL;
+    ctx->token_file = NULL;
+    return blocks;
+}
+
+void keep_token_text(struct text_block *blocks)
+{
+    if (!blocks)
+    {
+        return;
+    }
+    k0_context *ctx = k0_get();
+    struct text_block *last = blocks;
+    while (last->next)
+    {
+        last = last->next;
+    }
+    last->next = ctx->token_text;
+    ctx->token_text = blocks;
+}
+
+void free_token_text(struct text_block *blocks)
+{
+    while (blocks)
+    {
+        struct text_block *next = blocks->next;
+        mem_free(MEM_TREE, blocks);
+        blocks = next;
+    }
+}
+
+// list node among the nodes of the parse running on ctx, if one is
+static void track_node(struct k0_context *ctx, struct tree *node)
+{
+    if (!ctx->tracking_nodes)
+    {
+        return;
+    }
+    if (ctx->nparse_nodes == ctx->maxparse_nodes)
+    {
+        int max = ctx->maxparse_nodes ? ctx->maxparse_nodes * 2 : 1024;
+        struct tree **nodes = mem_alloc(MEM_TREE, max * sizeof(struct tree *));
+        if (!nodes)
+        {
+            fprintf(k0_diag(), "Memory allocation failed for tree node\n");
+            k0_fail(4);
+        }
+        if (ctx->nparse_nodes > 0)
+        {
+            memcpy(nodes, ctx->parse_nodes, ctx->nparse_nodes * sizeof(struct tree *));
+        }
+        mem_free(MEM_TREE, ctx->parse_nodes);
+        ctx->parse_nodes = nodes;
+        ctx->maxparse_nodes = max;
+    }
+    node->parse_slot = ctx->nparse_nodes;
+    ctx->parse_nodes[ctx->nparse_nodes++] = node;
+}
+
+// take a freed node off the list, moving the last one into its slot
+static void untrack_node(struct k0_context *ctx, struct tree *node)
+{
+    int slot = node->parse_slot;
+    if (!ctx->tracking_nodes || slot < 0 || slot >= ctx->nparse_nodes || ctx->parse_nodes[slot] != node)
+    {
+        return;
+    }
+    struct tree *last = ctx->parse_nodes[--ctx->nparse_nodes];
+    ctx->parse_nodes[slot] = last;
+    last->parse_slot = slot;
+}
+
+void track_parse_nodes(struct k0_context *ctx)
+{
+    ctx->tracking_nodes = true;
+    ctx->nparse_nodes = 0;
+}
+
+void untrack_parse_nodes(struct k0_context *ctx)
+{
+    mem_free(MEM_TREE, ctx->parse_nodes);
+    ctx->parse_nodes = NULL;
+    ctx->nparse_nodes = ctx->maxparse_nodes = 0;
+    ctx->tracking_nodes = false;
+}
+
+// each node on its own: their kids are on the list too
+void free_parse_nodes(struct k0_context *ctx)
+{
+    for (int i = 0; i < ctx->nparse_nodes; i++)
+    {
+        struct tree *node = ctx->parse_nodes[i];
+        mem_free(MEM_TREE, node->kids);
+        mem_free(MEM_TREE, node->symbolname);
+        free_token(node->leaf);
+        mem_free(MEM_TREE, node);
+    }
+    // the root is set by the last reduction, so it is one of them if the parse got that far
+    if (ctx->nparse_nodes > 0)
+    {
+        ctx->root = NULL;
+    }
+    untrack_parse_nodes(ctx);
+}
+
 // create leaf/token
-int alctoken(int category, char *text, int lineno, char *current_file)
+int alctoken(struct k0_context *ctx, struct tree **leaf, int category, char *text, int lineno)
 {
+    ctx->last_token = category;
+    count_event(COUNT_TOKENS, 1);
     // for lexer mode
-    if (current_file == NULL) {
+    if (ctx->current_file == NULL) {
         return category;
     }
 
-    // NL tokens are needed for grammar but not the tree
+    // NL tokens are needed for grammar but not the tree; no value for
+    // the parser to free if it drops one while recovering from an error
     else if (category == NL) {
+        *leaf = NULL;
         return category;
     }
     
-    yylval.treeptr = malloc(sizeof(struct tree));
-    if (!yylval.treeptr)
+    // the token shares its node's allocation, and its text is kept in the context's blocks;
+    // zeroed like alctree's nodes, since the later phases read flags such as erroneous
+    struct tree *node = mem_zalloc(MEM_TREE, sizeof(struct tree) + sizeof(struct token));
+    if (!node)
     {
-        fprintf(stderr, "Memory allocation failed for tree node (alctoken).\n");
-        exit(4);
+        fprintf(k0_diag(), "Memory allocation failed for tree node (alctoken).\n");
+        k0_fail(4);
     }
-    yylval.treeptr->prodrule = category;
-    yylval.treeptr->symbolname = NULL; // not needed for terminals
-    yylval.treeptr->nkids = 0;         // no children since it's a token
-    yylval.treeptr->id = serial;
+    count_event(COUNT_TREE_NODES, 1);
+    track_node(ctx, node);
+    node->prodrule = category;
+    node->symbolname = NULL; // not needed for terminals
+    node->nkids = 0;         // no children since it's a token
+    node->maxkids = 0;
+    node->kids = NULL;
+    node->id = serial;
     serial++;
-    yylval.treeptr->leaf = malloc(sizeof(struct token));
-    if (!yylval.treeptr->leaf)
+    node->leaf = (struct token *)(node + 1);
+    node->leaf->category = category;
+    node->leaf->text = keep_text(ctx, text, strlen(text));
+    node->leaf->lineno = lineno;
+    if (!ctx->token_file)
     {
-        fprintf(stderr, "Memory allocation failed for leaf (alctoken).\n");
-        free(yylval.treeptr);
-        exit(4);
+        ctx->token_file = keep_text(ctx, ctx->current_file, strlen(ctx->current_file));
     }
-    yylval.treeptr->leaf->category = category;
-    yylval.treeptr->leaf->text = strdup(text);
-    yylval.treeptr->leaf->lineno = lineno;
-    yylval.treeptr->leaf->filename = strdup(current_file);
+    node->leaf->filename = ctx->token_file;
+    node->leaf->sval = NULL;
     switch (category)
     {
     case IntegerLiteral:
-        yylval.treeptr->leaf->ival = atoi(text);
+        node->leaf->ival = atoi(text);
         break;
     case DoubleLiteral:
     case FloatLiteral:
-        yylval.treeptr->leaf->dval = atof(text);
-        break;
-    case StringLiteral:
-    {
-        char *temp_string = malloc(strlen(text));
-        strncpy(temp_string, text + 1, strlen(text) - 2);
-        temp_string[strlen(text) - 2] = '\0';
-        yylval.treeptr->leaf->sval = escape(temp_string);
-        free(temp_string);
+        node->leaf->dval = atof(text);
         break;
     }
-    case MultilineStringLiteral:
+    *leaf = node;
+    return category;
+}
+
+// string literals are decoded when first asked for, not while lexing
+const char *token_sval(struct token *tok)
+{
+    if (!tok->sval && (tok->category == StringLiteral || tok->category == MultilineStringLiteral))
     {
-        char *temp_string = malloc(strlen(text));
-        strncpy(temp_string, text + 1, strlen(text) - 2);
-        temp_string[strlen(text) - 2] = '\0';
-        yylval.treeptr->leaf->sval = escape(temp_string);
+        size_t len = strlen(tok->text);
+        char *temp_string = malloc(len);
+        strncpy(temp_string, tok->text + 1, len - 2);
+        temp_string[len - 2] = '\0';
+        tok->sval = escape(temp_string);
         free(temp_string);
-        break;
     }
-    }
-    return category;
+    return tok->sval;
 }
 
 // create tree
@@ -110,15 +263,24 @@ struct tree *alctree(int prodrule, char *symbolname, int nkids, ...)
 {
     // struct tree *node = (struct tree *)malloc(sizeof(struct tree));
     // struct tree *node = malloc(sizeof(struct tree));
-    struct tree *node = calloc(1, sizeof(struct tree));
+    struct tree *node = mem_zalloc(MEM_TREE, sizeof(struct tree));
     if (!node)
     {
-        fprintf(stderr, "Memory allocation failed for tree node\n");
-        exit(4);
+        fprintf(k0_diag(), "Memory allocation failed for tree node\n");
+        k0_fail(4);
     }
+    count_event(COUNT_TREE_NODES, 1);
+    track_node(k0_get(), node);
     node->prodrule = prodrule;
-    node->symbolname = strdup(symbolname);
+    node->symbolname = mem_strdup(MEM_TREE, symbolname);
     node->nkids = nkids;
+    node->maxkids = nkids;
+    node->kids = nkids > 0 ? mem_alloc(MEM_TREE, nkids * sizeof(struct tree *)) : NULL;
+    if (nkids > 0 && !node->kids)
+    {
+        fprintf(k0_diag(), "Memory allocation failed for tree node\n");
+        k0_fail(4);
+    }
     node->leaf = NULL; // initialize as NULL (only used for leaves)
     node->id = serial;
     serial++;
@@ -126,61 +288,164 @@ struct tree *alctree(int prodrule, char *symbolname, int nkids, ...)
     va_list args;
     va_start(args, nkids);
     for (int i = 0; i < nkids; i++) {
-        if (i >= 10) {
-            fprintf(stderr, "Too many children in alctree: max 10 allowed.\n");
-            exit(4);
-        }
         node->kids[i] = va_arg(args, struct tree *);
     }    
     va_end(args);
     return node;
 }
 
+// append kids to a list node, so a list of any length stays one level deep
+struct tree *addkids(struct tree *list, int nkids, ...)
+{
+    if (list->nkids + nkids > list->maxkids)
+    {
+        int maxkids = list->maxkids < 4 ? 8 : list->maxkids * 2;
+        while (maxkids < list->nkids + nkids)
+        {
+            maxkids *= 2;
+        }
+        struct tree **kids = mem_alloc(MEM_TREE, maxkids * sizeof(struct tree *));
+        if (!kids)
+        {
+            fprintf(k0_diag(), "Memory allocation failed for tree node\n");
+            k0_fail(4);
+        }
+        if (list->nkids > 0)
+        {
+            memcpy(kids, list->kids, list->nkids * sizeof(struct tree *));
+        }
+        mem_free(MEM_TREE, list->kids);
+        list->kids = kids;
+        list->maxkids = maxkids;
+    }
+    va_list args;
+    va_start(args, nkids);
+    for (int i = 0; i < nkids; i++) {
+        list->kids[list->nkids++] = va_arg(args, struct tree *);
+    }
+    va_end(args);
+    return list;
+}
+
 // free leaf
+// the token is freed with its node and its text with the context; only a decoded string is its own
 void free_token(struct token *leaf)
 {
     if (!leaf)
     {
         return;
     }
-    free(leaf->text);
-    free(leaf->filename);
-    if (leaf->category == StringLiteral || leaf->category == MultilineStringLiteral)
+    free(leaf->sval);
+}
+
+// a node on the walk_tree() stack
+struct walk_frame {
+    struct tree *node;
+    int next;              // index of the next child to visit
+    unsigned entered;      // visitors whose pre ran on node
+    unsigned descend;      // visitors that go on into the children
+};
+
+// push node onto the walk stack and run the pre callbacks of the visitors in active
+static void walk_enter(struct walk_frame **stack, int *top, int *max, struct walk_frame *local,
+                       struct tree *node, unsigned active, struct tree_visitor *visitors, int nvisitors)
+{
+    if (*top == *max)
+    {
+        // nesting deeper than the local frames; move the stack to the heap
+        struct walk_frame *frames = mem_alloc(MEM_TREE, *max * 2 * sizeof(struct walk_frame));
+        if (!frames)
+        {
+            fprintf(k0_diag(), "Memory allocation failed for tree walk\n");
+            k0_fail(4);
+        }
+        memcpy(frames, *stack, *top * sizeof(struct walk_frame));
+        if (*stack != local)
+        {
+            mem_free(MEM_TREE, *stack);
+        }
+        *stack = frames;
+        *max *= 2;
+    }
+    unsigned descend = 0;
+    for (int i = 0; i < nvisitors; i++)
     {
-        free(leaf->sval); // Free the allocated sval for string literals
+        if ((active & (1u << i)) && (!visitors[i].pre || visitors[i].pre(node, *top, visitors[i].arg)))
+        {
+            descend |= 1u << i;
+        }
     }
-    free(leaf);
+    (*stack)[(*top)++] = (struct walk_frame){node, 0, active, descend};
 }
 
-// free the syntax tree
-void free_tree(struct tree *node)
+// walk the tree depth first with an explicit stack, running several visitors in the one traversal
+void walk_tree(struct tree *root, struct tree_visitor *visitors, int nvisitors)
 {
-    if (!node)
+    if (!root || nvisitors <= 0)
     {
         return;
     }
-    // recursively free child nodes
-    for (int i = 0; i < node->nkids; i++)
+    if (nvisitors > MAX_VISITORS)
+    {
+        fprintf(k0_diag(), "Too many visitors for one tree walk\n");
+        k0_fail(4);
+    }
+    struct walk_frame local[64];
+    struct walk_frame *stack = local;
+    int top = 0, max = 64;
+    unsigned all = nvisitors == MAX_VISITORS ? ~0u : (1u << nvisitors) - 1;
+
+    walk_enter(&stack, &top, &max, local, root, all, visitors, nvisitors);
+    while (top > 0)
+    {
+        struct walk_frame *frame = &stack[top - 1];
+        if (frame->descend && frame->next < frame->node->nkids)
+        {
+            struct tree *kid = frame->node->kids[frame->next++];
+            if (kid)
+            {
+                walk_enter(&stack, &top, &max, local, kid, frame->descend, visitors, nvisitors);
+            }
+            continue;
+        }
+        // children done; post callbacks in reverse so fused passes nest
+        top--;
+        struct tree *node = frame->node;
+        unsigned entered = frame->entered;
+        for (int i = nvisitors - 1; i >= 0; i--)
+        {
+            if ((entered & (1u << i)) && visitors[i].post)
+            {
+                visitors[i].post(node, top, visitors[i].arg);
+            }
+        }
+    }
+    if (stack != local)
     {
-        free_tree(node->kids[i]);
+        mem_free(MEM_TREE, stack);
     }
-    free(node->symbolname);
-    // if (node->leaf->category == StringLiteral || node->leaf->category == MultilineStringLiteral) {
-    //     free(node->leaf->sval);
-    // }
+}
+
+static void free_node(struct tree *node, int depth, void *arg)
+{
+    untrack_node(arg, node);
+    mem_free(MEM_TREE, node->kids);
+    mem_free(MEM_TREE, node->symbolname);
     free_token(node->leaf);
-    free(node);
+    mem_free(MEM_TREE, node);
 }
 
-// print the syntax tree
-void print_tree(struct tree *node, int depth)
+// free the syntax tree
+void free_tree(struct tree *node)
+{
+    struct tree_visitor visitor = {NULL, free_node, k0_get()};
+    walk_tree(node, &visitor, 1);
+}
+
+static bool print_node(struct tree *node, int depth, void *arg)
 {
-    if (node == NULL)
-    {
-        return;
-    }
     // indentation based on depth
-    for (int i = 0; i < depth; i++)
+    for (int i = 0; i < depth + *(int *)arg; i++)
     {
         printf("  ");
     }
@@ -196,11 +461,14 @@ void print_tree(struct tree *node, int depth)
                node->prodrule,
                node->nkids);
     }
-    // recursively print child nodes
-    for (int i = 0; i < node->nkids; i++)
-    {
-        print_tree(node->kids[i], depth + 1);
-    }
+    return true;
+}
+
+// print the syntax tree
+void print_tree(struct tree *node, int depth)
+{
+    struct tree_visitor visitor = {print_node, NULL, &depth};
+    walk_tree(node, &visitor, 1);
 }
 
 char *pretty_print_name(struct tree *t)
@@ -277,8 +545,8 @@ void print_graph(struct tree *t, char *file_name)
     FILE *fptr = fopen(file_name, "w");
     if (fptr == NULL)
     {
-        fprintf(stderr, "Cannot open file\n");
-        exit(4);
+        fprintf(k0_diag(), "Cannot open file\n");
+        k0_fail(4);
     }
     fprintf(fptr, "digraph {\n");
     write_graph(t, fptr);
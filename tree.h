@@ -43,7 +43,8 @@ struct tree {
    int prodrule;
    char *symbolname;
    int nkids;
-   struct tree *kids[10]; /* if nkids > 0 */
+   int maxkids;          /* room in kids; list nodes grow it with addkids() */
+   struct tree **kids;   /* if nkids > 0 */
    struct token *leaf;   /* if nkids == 0; NULL for ε productions */
    int id;
 
@@ -58,25 +59,122 @@ struct tree {
    bool has_follow;
    bool has_onTrue;
    bool has_onFalse;
-};
 
-extern int serial; // for tree id
+   // self-call in tail position; lowered to a jump by ic.c
+   bool tail_call;
+
+   // semantic checks stopped on an error here; later walks skip the node
+   bool erroneous;
+
+   // index in the context's parse_nodes while the parse that made it runs
+   int parse_slot;
+};
 
 struct token {
    int category;     /* the integer code returned by yylex */
-   char *text;     /* the actual string (lexeme) matched */
+   char *text;     /* the actual string (lexeme) matched, kept with the context */
    int lineno;     /* the line number on which the token occurs */
    char *filename; /* the source file in which the token occurs */
    int ival;       /* for integer constants, store binary value here */
    double dval;    /* for real constants, store binary value here */
-   char *sval;     /* for string constants, malloc space, de-escape, store */
-                  /*    the string (less quotes and after escapes) here */
+   char *sval;     /* for string constants, the string less quotes and after */
+                  /*    escapes; NULL until token_sval() decodes it */
+};
+
+/*
+ * Children of the syntax tree after lower_tree(). Punctuation, keywords that
+ * only steer the parser, statement terminators, and the Statement,
+ * ControlStructure, condition and parenthesis wrappers are gone:
+ *
+ *   FunctionDeclaration   FUN Identifier FuncParamSection typeDeclaration Block
+ *   typeDeclaration       type, or nothing
+ *   Block                 Statements
+ *   IfStruc               condition Block ElseIf Else
+ *   ElseIf                ElseIf condition Block, or nothing
+ *   Else                  Block, or nothing
+ *   WhileLoop             condition Block
+ *   ForLoop               Range Block
+ *   Range                 Identifier from [RANGE|RANGE_UNTIL to]
+ *   Return                RETURN expression
+ *   Declaration           VAR|VAL Identifier typeDeclaration [Assignment]
+ *   Assignment            Identifier [index] expression; a declaration's is just expression
+ *   FunctionCall          Identifier arguments [SAFE_CALL]
+ *   FuncArgList           expression...
+ *
+ * A single call argument is the bare expression, as in the parse tree.
+ */
+#define FUNC_KEYWORD(t)    ((t)->kids[0])
+#define FUNC_NAME(t)       ((t)->kids[1])
+#define FUNC_PARAMS(t)     ((t)->kids[2])
+#define FUNC_TYPE(t)       ((t)->kids[3])
+#define FUNC_BODY(t)       ((t)->kids[4])
+#define PARAM_NAME(t)      ((t)->kids[0])
+#define PARAM_TYPE(t)      ((t)->kids[1])
+#define TYPE_NAME(t)       ((t)->nkids > 0 ? (t)->kids[0] : NULL)
+#define BLOCK_BODY(t)      ((t)->kids[0])
+#define IF_COND(t)         ((t)->kids[0])
+#define IF_BODY(t)         ((t)->kids[1])
+#define IF_ELSEIFS(t)      ((t)->kids[2])
+#define IF_ELSE(t)         ((t)->kids[3])
+#define ELSEIF_PREV(t)     ((t)->kids[0])
+#define ELSEIF_COND(t)     ((t)->kids[1])
+#define ELSEIF_BODY(t)     ((t)->kids[2])
+#define ELSE_BODY(t)       ((t)->kids[0])
+#define LOOP_COND(t)       ((t)->kids[0])
+#define LOOP_BODY(t)       ((t)->kids[1])
+#define FOR_RANGE(t)       ((t)->kids[0])
+#define RANGE_VAR(t)       ((t)->kids[0])
+#define RANGE_FROM(t)      ((t)->kids[1])
+#define RANGE_TO(t)        ((t)->nkids > 3 ? (t)->kids[3] : NULL)
+#define RETURN_KEYWORD(t)  ((t)->kids[0])
+#define RETURN_VALUE(t)    ((t)->kids[1])
+#define DECL_KIND(t)       ((t)->kids[0])
+#define DECL_NAME(t)       ((t)->kids[1])
+#define DECL_TYPE(t)       ((t)->kids[2])
+#define DECL_INIT(t)       ((t)->nkids > 3 ? (t)->kids[3] : NULL)
+#define ASSIGN_TARGET(t)   ((t)->kids[0])
+#define ASSIGN_VALUE(t)    ((t)->kids[(t)->nkids - 1])
+#define CALL_NAME(t)       ((t)->kids[0])
+#define CALL_ARGS(t)       ((t)->kids[1])
+#define EXPR_LEFT(t)       ((t)->nkids > 0 ? (t)->kids[0] : NULL)
+#define EXPR_RIGHT(t)      ((t)->nkids > 2 ? (t)->kids[2] : NULL)
+#define UNARY_OPERAND(t)   ((t)->kids[1])
+
+struct k0_context;
+
+/* One pass over the tree for walk_tree(). pre runs on the way down and
+   returns false to keep this visitor out of the node's children; post runs
+   once they are done, and may free the node. Either may be NULL. */
+struct tree_visitor {
+   bool (*pre)(struct tree *node, int depth, void *arg);
+   void (*post)(struct tree *node, int depth, void *arg);
+   void *arg;
 };
+#define MAX_VISITORS 32
 
-int alctoken(int category, char *text, int lineno, char *current_file);
+int alctoken(struct k0_context *ctx, struct tree **leaf, int category, char *text, int lineno);
 struct tree* alctree(int prodrule, char *symbolname, int nkids, ...);
+struct tree *addkids(struct tree *list, int nkids, ...);
 void free_token(struct token *tok);
+const char *token_sval(struct token *tok);
+
+/* Token text is copied into blocks of the context that lexed it and lives
+   until the context is reset, so no token mallocs its own. A pool thread
+   hands its blocks to the caller's context with take_ and keep_token_text. */
+struct text_block;
+struct text_block *take_token_text(void);
+void keep_token_text(struct text_block *blocks);
+void free_token_text(struct text_block *blocks);
+
+/* A parse stopped by k0_fail() leaves its nodes on bison's stack, out of
+   reach of ctx->root. Nodes made between track_ and untrack_parse_nodes are
+   listed on the context, and free_parse_nodes frees the ones left when a
+   parse ended early; after untrack_parse_nodes the tree owns them. */
+void track_parse_nodes(struct k0_context *ctx);
+void untrack_parse_nodes(struct k0_context *ctx);
+void free_parse_nodes(struct k0_context *ctx);
 void free_tree(struct tree *node);
 void print_tree(struct tree *node, int depth);
+void walk_tree(struct tree *root, struct tree_visitor *visitors, int nvisitors);
 
 #endif
@@ -1,4 +1,6 @@
 #include "type.h"
+#include "k0ctx.h"
+#include "memstat.h"
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
@@ -123,11 +125,11 @@ typeptr alctype(int base) {
     // else if (base == FUNC_TYPE) return func_typeptr;
     else {
         if (base != FUNC_TYPE ) {
-            fprintf(stderr, "Debug: Unknown base given in alctype: %s\n", typeint_to_name(base));
-            exit(4);
+            fprintf(k0_diag(), "Debug: Unknown base given in alctype: %s\n", typeint_to_name(base));
+            k0_fail(4);
         }
     }
-    rv = (typeptr) calloc(1, sizeof(struct typeinfo));
+    rv = (typeptr) mem_zalloc(MEM_TYPE, sizeof(struct typeinfo));
     if (rv == NULL) return rv;
     rv->basetype = base;
     return rv;
@@ -135,7 +137,7 @@ typeptr alctype(int base) {
 
 typeptr clone_type(typeptr t) {
     if (!t) return NULL;
-    typeptr newt = malloc(sizeof(struct typeinfo));
+    typeptr newt = mem_alloc(MEM_TYPE, sizeof(struct typeinfo));
     *newt = *t; // shallow copy
     if (t->basetype == FUNC_TYPE) {
         // Deep copy return type
@@ -143,7 +145,7 @@ typeptr clone_type(typeptr t) {
         // Deep copy param list
         paramlist src = t->u.f.parameters, *dst = &newt->u.f.parameters;
         while (src) {
-            *dst = malloc(sizeof(struct param));
+            *dst = mem_alloc(MEM_TYPE, sizeof(struct param));
             (*dst)->name = src->name;
             (*dst)->type = clone_type(src->type);
             (*dst)->next = NULL;
@@ -195,7 +197,7 @@ void free_paramlist(paramlist head) {
             free_type(head->type);
             head->type = NULL;
         }
-        free(head);
+        mem_free(MEM_TYPE, head);
         head = next;
     }
 }
@@ -213,7 +215,7 @@ void free_type(typeptr t) {
             t->u.f.returntype = NULL;
         }
     }
-    free(t);
+    mem_free(MEM_TYPE, t);
 }
 
 int typeptr_to_size(typeptr t) {
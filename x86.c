@@ -0,0 +1,447 @@
+#include <stdlib.h>
+#include <string.h>
+#include "x86.h"
+#include "k0ctx.h"
+
+static const char *reg_names_64[] = {
+    "%rax", "%rcx", "%rdx", "%rbx", "%rsp", "%rbp", "%rsi", "%rdi",
+    "%r8", "%r9", "%r10", "%r11", "%r12", "%r13", "%r14", "%r15"
+};
+
+static const char *reg_names_32[] = {
+    "%eax", "%ecx", "%edx", "%ebx", "%esp", "%ebp", "%esi", "%edi",
+    "%r8d", "%r9d", "%r10d", "%r11d", "%r12d", "%r13d", "%r14d", "%r15d"
+};
+
+static const char *reg_names_8[] = {
+    "%al", "%cl", "%dl", "%bl", "%spl", "%bpl", "%sil", "%dil",
+    "%r8b", "%r9b", "%r10b", "%r11b", "%r12b", "%r13b", "%r14b", "%r15b"
+};
+
+static const char *xmm_names[] = {
+    "%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm4", "%xmm5", "%xmm6", "%xmm7",
+    "%xmm8", "%xmm9", "%xmm10", "%xmm11", "%xmm12", "%xmm13", "%xmm14", "%xmm15"
+};
+
+static const char *mnemonics[] = {
+    "",
+    "movq",
+    "movl",
+    "leaq",
+    "addq",
+    "subq",
+    "imulq",
+    "idivq",
+    "shlq",
+    "sarq",
+    "shrq",
+    "incq",
+    "decq",
+    "negq",
+    "cqto",
+    "xorl",
+    "cmpq",
+    "setl",
+    "setle",
+    "setg",
+    "setge",
+    "sete",
+    "setne",
+    "movzbq",
+    "jmp",
+    "je",
+    "jne",
+    "call",
+    "ret",
+    "pushq",
+    "movsd",
+    "addsd",
+    "subsd",
+    "mulsd",
+    "divsd",
+    "ucomisd",
+    "cvtsi2sdq",
+    "cvttsd2siq",
+    "seta",
+    "setae",
+    "setp",
+    "setnp",
+    "andb",
+    "orb"
+};
+
+/* registers a call may read (arguments, %al for varargs) and clobbers */
+static const int call_reads[] = {
+    RDI, RSI, RDX, RCX, R8, R9, RAX, RSP,
+    XMM0, XMM1, XMM2, XMM3, XMM4, XMM5, XMM6, XMM7
+};
+static const int call_writes[] = {
+    RAX, RCX, RDX, RSI, RDI, R8, R9, R10, R11, FLAGS,
+    XMM0, XMM1, XMM2, XMM3, XMM4, XMM5, XMM6, XMM7,
+    XMM8, XMM9, XMM10, XMM11, XMM12, XMM13, XMM14, XMM15
+};
+/* the return values plus everything the caller expects preserved */
+static const int ret_reads[] = { RAX, XMM0, RSP, RBX, RBP, R12, R13, R14, R15 };
+
+x86_operand x86_none() {
+    x86_operand op;
+    memset(&op, 0, sizeof(op));
+    op.kind = X_NONE;
+    return op;
+}
+
+x86_operand x86_reg(int reg) {
+    return x86_reg_sized(reg, 8);
+}
+
+x86_operand x86_reg_sized(int reg, int size) {
+    x86_operand op = x86_none();
+    op.kind = X_REG;
+    op.reg = reg;
+    op.size = size;
+    return op;
+}
+
+x86_operand x86_imm(long value) {
+    x86_operand op = x86_none();
+    op.kind = X_IMM;
+    op.imm = value;
+    return op;
+}
+
+x86_operand x86_dimm(double value) {
+    x86_operand op = x86_none();
+    op.kind = X_DIMM;
+    op.dval = value;
+    return op;
+}
+
+x86_operand x86_sym(const char *name) {
+    x86_operand op = x86_none();
+    op.kind = X_SYM;
+    op.sym = strdup(name);
+    return op;
+}
+
+x86_operand x86_label(const char *name) {
+    x86_operand op = x86_none();
+    op.kind = X_LABEL;
+    op.sym = strdup(name);
+    return op;
+}
+
+x86_operand x86_mem(int base, int index, int scale, long disp) {
+    x86_operand op = x86_none();
+    op.kind = X_MEM;
+    op.base = base;
+    op.index = index;
+    op.scale = scale;
+    op.imm = disp;
+    return op;
+}
+
+bool x86_operand_equal(x86_operand *a, x86_operand *b) {
+    if (a->kind != b->kind) return false;
+    switch (a->kind) {
+        case X_NONE:
+            return true;
+        case X_REG:
+            return a->reg == b->reg && a->size == b->size;
+        case X_IMM:
+            return a->imm == b->imm;
+        case X_DIMM:
+            return a->dval == b->dval;
+        case X_SYM:
+        case X_LABEL:
+            return strcmp(a->sym, b->sym) == 0;
+        case X_MEM:
+            return a->base == b->base && a->index == b->index &&
+                   a->scale == b->scale && a->imm == b->imm;
+    }
+    return false;
+}
+
+bool x86_is_reg(x86_operand *op, int reg) {
+    return op->kind == X_REG && op->reg == reg;
+}
+
+bool x86_is_xmm(x86_operand *op) {
+    return op->kind == X_REG && op->reg >= XMM0 && op->reg <= XMM15;
+}
+
+bool x86_is_memory(x86_operand *op) {
+    return op->kind == X_SYM || op->kind == X_MEM;
+}
+
+x86_instr x86_emit(x86_list *list, int opcode, x86_operand src, x86_operand dst) {
+    x86_instr instr = calloc(1, sizeof(struct x86_instr));
+    if (!instr) {
+        fprintf(k0_diag(), "Memory allocation failed for x86 instruction\n");
+        k0_fail(4);
+    }
+    instr->opcode = opcode;
+    instr->src = src;
+    instr->dst = dst;
+    instr->prev = list->tail;
+    if (list->tail) list->tail->next = instr;
+    else list->head = instr;
+    list->tail = instr;
+    list->count++;
+    return instr;
+}
+
+// move the instructions of more to the end of list, leaving more empty
+void x86_append_list(x86_list *list, x86_list *more) {
+    if (!more->head) return;
+    more->head->prev = list->tail;
+    if (list->tail) list->tail->next = more->head;
+    else list->head = more->head;
+    list->tail = more->tail;
+    list->count += more->count;
+    more->head = more->tail = NULL;
+    more->count = 0;
+}
+
+x86_instr x86_emit_label(x86_list *list, const char *name) {
+    return x86_emit(list, X86_LABEL, x86_none(), x86_label(name));
+}
+
+void x86_set_comment(x86_instr instr, const char *comment) {
+    free(instr->comment);
+    instr->comment = comment ? strdup(comment) : NULL;
+}
+
+void x86_clear_operand(x86_operand *op) {
+    if (op->kind == X_SYM || op->kind == X_LABEL) {
+        free(op->sym);
+        op->sym = NULL;
+    }
+    op->kind = X_NONE;
+}
+
+void x86_remove(x86_list *list, x86_instr instr) {
+    if (instr->prev) instr->prev->next = instr->next;
+    else list->head = instr->next;
+    if (instr->next) instr->next->prev = instr->prev;
+    else list->tail = instr->prev;
+    list->count--;
+    x86_clear_operand(&instr->src);
+    x86_clear_operand(&instr->dst);
+    free(instr->comment);
+    free(instr);
+}
+
+void x86_free_list(x86_list *list) {
+    while (list->head) {
+        x86_remove(list, list->head);
+    }
+}
+
+const char *x86_mnemonic(int opcode) {
+    if (opcode < 0 || opcode >= X86_NOPCODES) return "??";
+    return mnemonics[opcode];
+}
+
+bool x86_is_jump(int opcode) {
+    return opcode == X86_JMP || opcode == X86_JE || opcode == X86_JNE;
+}
+
+// register operand, or a register used to form an address
+static bool operand_uses(x86_operand *op, int reg) {
+    if (op->kind == X_MEM) return op->base == reg || op->index == reg;
+    return op->kind == X_REG && op->reg == reg;
+}
+
+static bool operand_defines(x86_operand *op, int reg) {
+    return op->kind == X_REG && op->reg == reg;
+}
+
+static bool in_set(const int *set, int n, int reg) {
+    for (int i = 0; i < n; i++) {
+        if (set[i] == reg) return true;
+    }
+    return false;
+}
+
+// does the instruction read the (whole or partial) register before writing it
+bool x86_reads(x86_instr instr, int reg) {
+    switch (instr->opcode) {
+        case X86_LABEL:
+        case X86_JMP:
+            return false;
+        case X86_MOVQ:
+        case X86_MOVL:
+        case X86_LEAQ:
+        case X86_MOVZBQ:
+        case X86_MOVSD:
+        case X86_CVTSI2SDQ:
+        case X86_CVTTSD2SIQ:
+            return operand_uses(&instr->src, reg) ||
+                   (x86_is_memory(&instr->dst) && operand_uses(&instr->dst, reg));
+        case X86_XORL:
+            // zero idiom does not depend on the old value
+            if (x86_operand_equal(&instr->src, &instr->dst)) return false;
+            return operand_uses(&instr->src, reg) || operand_uses(&instr->dst, reg);
+        case X86_ADDQ:
+        case X86_SUBQ:
+        case X86_IMULQ:
+        case X86_SHLQ:
+        case X86_SARQ:
+        case X86_SHRQ:
+        case X86_CMPQ:
+        case X86_ADDSD:
+        case X86_SUBSD:
+        case X86_MULSD:
+        case X86_DIVSD:
+        case X86_UCOMISD:
+        case X86_ANDB:
+        case X86_ORB:
+            return operand_uses(&instr->src, reg) || operand_uses(&instr->dst, reg);
+        case X86_INCQ:
+        case X86_DECQ:
+        case X86_NEGQ:
+            return operand_uses(&instr->dst, reg);
+        case X86_SETL:
+        case X86_SETLE:
+        case X86_SETG:
+        case X86_SETGE:
+        case X86_SETE:
+        case X86_SETNE:
+        case X86_SETA:
+        case X86_SETAE:
+        case X86_SETP:
+        case X86_SETNP:
+            // byte write keeps the upper bits
+            return reg == FLAGS || operand_uses(&instr->dst, reg);
+        case X86_IDIVQ:
+            return reg == RAX || reg == RDX || operand_uses(&instr->dst, reg);
+        case X86_CQTO:
+            return reg == RAX;
+        case X86_JE:
+        case X86_JNE:
+            return reg == FLAGS;
+        case X86_CALL:
+            return in_set(call_reads, sizeof(call_reads) / sizeof(int), reg);
+        case X86_RET:
+            return in_set(ret_reads, sizeof(ret_reads) / sizeof(int), reg);
+        case X86_PUSHQ:
+            return reg == RSP || operand_uses(&instr->dst, reg);
+    }
+    return true;
+}
+
+bool x86_writes(x86_instr instr, int reg) {
+    switch (instr->opcode) {
+        case X86_LABEL:
+        case X86_JMP:
+        case X86_JE:
+        case X86_JNE:
+        case X86_RET:
+            return false;
+        case X86_MOVQ:
+        case X86_MOVL:
+        case X86_LEAQ:
+        case X86_MOVZBQ:
+        case X86_MOVSD:
+        case X86_ADDSD:
+        case X86_SUBSD:
+        case X86_MULSD:
+        case X86_DIVSD:
+        case X86_CVTSI2SDQ:
+        case X86_CVTTSD2SIQ:
+            return operand_defines(&instr->dst, reg);
+        case X86_ADDQ:
+        case X86_SUBQ:
+        case X86_IMULQ:
+        case X86_SHLQ:
+        case X86_SARQ:
+        case X86_SHRQ:
+        case X86_INCQ:
+        case X86_DECQ:
+        case X86_NEGQ:
+        case X86_XORL:
+        case X86_ANDB:
+        case X86_ORB:
+            return reg == FLAGS || operand_defines(&instr->dst, reg);
+        case X86_CMPQ:
+        case X86_UCOMISD:
+            return reg == FLAGS;
+        case X86_SETL:
+        case X86_SETLE:
+        case X86_SETG:
+        case X86_SETGE:
+        case X86_SETE:
+        case X86_SETNE:
+        case X86_SETA:
+        case X86_SETAE:
+        case X86_SETP:
+        case X86_SETNP:
+            return operand_defines(&instr->dst, reg);
+        case X86_IDIVQ:
+            return reg == RAX || reg == RDX || reg == FLAGS;
+        case X86_CQTO:
+            return reg == RDX;
+        case X86_CALL:
+            return in_set(call_writes, sizeof(call_writes) / sizeof(int), reg);
+        case X86_PUSHQ:
+            return reg == RSP;
+    }
+    return true;
+}
+
+void x86_print_operand(FILE *S, x86_operand *op) {
+    switch (op->kind) {
+        case X_REG:
+            if (op->reg >= XMM0) fprintf(S, "%s", xmm_names[op->reg - XMM0]);
+            else if (op->size == 1) fprintf(S, "%s", reg_names_8[op->reg]);
+            else if (op->size == 4) fprintf(S, "%s", reg_names_32[op->reg]);
+            else fprintf(S, "%s", reg_names_64[op->reg]);
+            break;
+        case X_IMM:
+            fprintf(S, "$%ld", op->imm);
+            break;
+        case X_DIMM:
+            fprintf(S, "$%lf", op->dval);
+            break;
+        case X_SYM:
+        case X_LABEL:
+            fprintf(S, "%s", op->sym);
+            break;
+        case X_MEM:
+            if (op->imm != 0) fprintf(S, "%ld", op->imm);
+            fprintf(S, "(");
+            if (op->base >= 0) fprintf(S, "%s", reg_names_64[op->base]);
+            if (op->index >= 0) fprintf(S, ",%s,%d", reg_names_64[op->index], op->scale);
+            fprintf(S, ")");
+            break;
+        default:
+            fprintf(S, "NULL");
+    }
+}
+
+void x86_print_instr(FILE *S, x86_instr instr) {
+    if (instr->opcode == X86_LABEL) {
+        fprintf(S, "%s:\n", instr->dst.sym);
+        return;
+    }
+    fprintf(S, "\t%s", x86_mnemonic(instr->opcode));
+    if (instr->src.kind != X_NONE) {
+        fprintf(S, "\t");
+        x86_print_operand(S, &instr->src);
+        fprintf(S, ", ");
+        x86_print_operand(S, &instr->dst);
+    } else if (instr->dst.kind != X_NONE) {
+        fprintf(S, "\t");
+        x86_print_operand(S, &instr->dst);
+    }
+    if (instr->comment) {
+        fprintf(S, "\t\t# %s", instr->comment);
+    }
+    fprintf(S, "\n");
+}
+
+void x86_print_list(FILE *S, x86_list *list) {
+    for (x86_instr instr = list->head; instr != NULL; instr = instr->next) {
+        x86_print_instr(S, instr);
+    }
+}
@@ -0,0 +1,132 @@
+#ifndef X86_H
+#define X86_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+/* Registers, numbered by their x86-64 encoding (XMMn encodes as n) */
+enum x86_reg {
+    RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11, R12, R13, R14, R15,
+    XMM0, XMM1, XMM2, XMM3, XMM4, XMM5, XMM6, XMM7,
+    XMM8, XMM9, XMM10, XMM11, XMM12, XMM13, XMM14, XMM15,
+    X86_NREGS,
+    FLAGS = X86_NREGS /* pseudo-register for def/use tracking */
+};
+
+/* Operand kinds */
+#define X_NONE  0
+#define X_REG   1 /* register, 8/4/1 byte view */
+#define X_IMM   2 /* $immediate */
+#define X_DIMM  3 /* floating point immediate */
+#define X_SYM   4 /* memory at a symbol (absolute, non-pie) */
+#define X_LABEL 5 /* jump/call target */
+#define X_MEM   6 /* disp(base,index,scale), used by lea */
+
+typedef struct x86_operand {
+    int kind;
+    int reg;
+    int size;
+    long imm;   /* immediate, or displacement for X_MEM */
+    double dval;
+    char *sym;
+    int base;   /* X_MEM registers, -1 when absent */
+    int index;
+    int scale;
+} x86_operand;
+
+/* Opcodes */
+enum x86_opcode {
+    X86_LABEL,
+    X86_MOVQ,
+    X86_MOVL,
+    X86_LEAQ,
+    X86_ADDQ,
+    X86_SUBQ,
+    X86_IMULQ,
+    X86_IDIVQ,
+    X86_SHLQ,
+    X86_SARQ,
+    X86_SHRQ,
+    X86_INCQ,
+    X86_DECQ,
+    X86_NEGQ,
+    X86_CQTO,
+    X86_XORL,
+    X86_CMPQ,
+    X86_SETL,
+    X86_SETLE,
+    X86_SETG,
+    X86_SETGE,
+    X86_SETE,
+    X86_SETNE,
+    X86_MOVZBQ,
+    X86_JMP,
+    X86_JE,
+    X86_JNE,
+    X86_CALL,
+    X86_RET,
+    X86_PUSHQ,
+    X86_MOVSD,
+    X86_ADDSD,
+    X86_SUBSD,
+    X86_MULSD,
+    X86_DIVSD,
+    X86_UCOMISD,
+    X86_CVTSI2SDQ,
+    X86_CVTTSD2SIQ,
+    X86_SETA,
+    X86_SETAE,
+    X86_SETP,
+    X86_SETNP,
+    X86_ANDB,
+    X86_ORB,
+    X86_NOPCODES
+};
+
+/* AT&T order: op src, dst */
+typedef struct x86_instr {
+    int opcode;
+    x86_operand src;
+    x86_operand dst;
+    char *comment;
+    struct x86_instr *prev;
+    struct x86_instr *next;
+} *x86_instr;
+
+typedef struct x86_list {
+    x86_instr head;
+    x86_instr tail;
+    int count;
+} x86_list;
+
+x86_operand x86_none();
+x86_operand x86_reg(int reg);
+x86_operand x86_reg_sized(int reg, int size);
+x86_operand x86_imm(long value);
+x86_operand x86_dimm(double value);
+x86_operand x86_sym(const char *name);
+x86_operand x86_label(const char *name);
+x86_operand x86_mem(int base, int index, int scale, long disp);
+bool x86_operand_equal(x86_operand *a, x86_operand *b);
+bool x86_is_reg(x86_operand *op, int reg);
+bool x86_is_xmm(x86_operand *op);
+bool x86_is_memory(x86_operand *op);
+
+x86_instr x86_emit(x86_list *list, int opcode, x86_operand src, x86_operand dst);
+x86_instr x86_emit_label(x86_list *list, const char *name);
+void x86_clear_operand(x86_operand *op);
+void x86_set_comment(x86_instr instr, const char *comment);
+void x86_remove(x86_list *list, x86_instr instr);
+void x86_free_list(x86_list *list);
+void x86_append_list(x86_list *list, x86_list *more);
+
+const char *x86_mnemonic(int opcode);
+bool x86_is_jump(int opcode);
+bool x86_reads(x86_instr instr, int reg);
+bool x86_writes(x86_instr instr, int reg);
+void x86_print_operand(FILE *S, x86_operand *op);
+void x86_print_instr(FILE *S, x86_instr instr);
+void x86_print_list(FILE *S, x86_list *list);
+
+#endif
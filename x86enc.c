@@ -0,0 +1,493 @@
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <elf.h>
+#include "x86enc.h"
+#include "k0ctx.h"
+
+#define REX_W 0x08
+#define REX_R 0x04
+#define REX_X 0x02
+#define REX_B 0x01
+
+static void encode_error(x86_instr instr, const char *why) {
+    fprintf(k0_diag(), "Error: cannot encode %s: %s\n", x86_mnemonic(instr->opcode), why);
+    k0_fail(4);
+}
+
+static void put(x86_code *code, unsigned char byte) {
+    code->bytes[code->len++] = byte;
+}
+
+static void put32(x86_code *code, long value) {
+    for (int i = 0; i < 4; i++) put(code, (value >> (8 * i)) & 0xff);
+}
+
+static bool fits8(long value) {
+    return value >= -128 && value <= 127;
+}
+
+static bool fits32(long value) {
+    return value >= -2147483648L && value <= 2147483647L;
+}
+
+// hardware register number: rax..r15 are 0..15, xmm registers count from 0 again
+static int reg_code(int reg) {
+    return reg >= XMM0 ? reg - XMM0 : reg;
+}
+
+// %spl/%bpl/%sil/%dil only exist with a REX prefix; without one they mean %ah..%bh
+static bool needs_byte_rex(x86_operand *op) {
+    return op->kind == X_REG && op->size == 1 && op->reg >= RSP && op->reg <= RDI;
+}
+
+static bool valid_symbol(const char *name) {
+    if (!name || !(isalpha((unsigned char)name[0]) || name[0] == '_' || name[0] == '.')) return false;
+    for (const char *p = name; *p; p++) {
+        if (!isalnum((unsigned char)*p) && *p != '_' && *p != '.' && *p != '$') return false;
+    }
+    return true;
+}
+
+static int scale_bits(int scale) {
+    switch (scale) {
+        case 2: return 1;
+        case 4: return 2;
+        case 8: return 3;
+    }
+    return 0;
+}
+
+/*
+ * [prefix] [REX] opcode ModRM [SIB] [disp]
+ * reg is the ModRM.reg field: a register number or an opcode extension.
+ */
+static void encode_modrm(x86_instr instr, x86_code *code, int prefix, int rex,
+                         const unsigned char *opcode, int oplen, int reg, x86_operand *rm) {
+    if (rm->kind == X_SYM && !valid_symbol(rm->sym)) encode_error(instr, "operand is not a symbol");
+    if (rm->kind != X_REG && rm->kind != X_MEM && rm->kind != X_SYM) encode_error(instr, "bad operand");
+
+    if (reg & 8) rex |= REX_R;
+    if (rm->kind == X_REG && (reg_code(rm->reg) & 8)) rex |= REX_B;
+    if (rm->kind == X_MEM && rm->base >= 0 && (rm->base & 8)) rex |= REX_B;
+    if (rm->kind == X_MEM && rm->index >= 0 && (rm->index & 8)) rex |= REX_X;
+
+    if (prefix) put(code, prefix);
+    if (rex) put(code, 0x40 | (rex & 0x0f));
+    for (int i = 0; i < oplen; i++) put(code, opcode[i]);
+
+    int r = reg & 7;
+    if (rm->kind == X_REG) {
+        put(code, 0xc0 | (r << 3) | (reg_code(rm->reg) & 7));
+        return;
+    }
+    if (rm->kind == X_SYM) {
+        // absolute disp32 through a SIB byte with no base or index, as gas does for non-pie code
+        put(code, 0x04 | (r << 3));
+        put(code, 0x25);
+        code->reloc_at = code->len;
+        code->reloc_symbol = rm->sym;
+        code->reloc_type = R_X86_64_32S;
+        put32(code, 0);
+        return;
+    }
+
+    long disp = rm->imm;
+    if (rm->base < 0) {
+        put(code, 0x04 | (r << 3));
+        put(code, (scale_bits(rm->scale) << 6) | ((rm->index >= 0 ? rm->index & 7 : 4) << 3) | 5);
+        put32(code, disp);
+        return;
+    }
+    int base = rm->base & 7;
+    int mod;
+    // rbp/r13 as a base have no disp-less form
+    if (disp == 0 && base != 5) mod = 0;
+    else if (fits8(disp)) mod = 1;
+    else mod = 2;
+
+    if (rm->index >= 0 || base == 4) {
+        put(code, (mod << 6) | (r << 3) | 4);
+        put(code, (scale_bits(rm->scale) << 6) | ((rm->index >= 0 ? rm->index & 7 : 4) << 3) | base);
+    } else {
+        put(code, (mod << 6) | (r << 3) | base);
+    }
+    if (mod == 1) put(code, disp & 0xff);
+    else if (mod == 2) put32(code, disp);
+}
+
+static void encode_op1(x86_instr instr, x86_code *code, int prefix, int rex,
+                       unsigned char opcode, int reg, x86_operand *rm) {
+    encode_modrm(instr, code, prefix, rex, &opcode, 1, reg, rm);
+}
+
+static void encode_op2(x86_instr instr, x86_code *code, int prefix, int rex,
+                       unsigned char op1, unsigned char op2, int reg, x86_operand *rm) {
+    unsigned char opcode[2] = { op1, op2 };
+    encode_modrm(instr, code, prefix, rex, opcode, 2, reg, rm);
+}
+
+static bool is_gpr(x86_operand *op) {
+    return op->kind == X_REG && op->reg < XMM0;
+}
+
+static bool is_rm(x86_operand *op) {
+    return is_gpr(op) || x86_is_memory(op);
+}
+
+// add/sub/cmp share one encoding scheme: /ext for immediates, op_mr and op_rm otherwise.
+// Like as, an imm32 into %rax takes the one byte shorter accumulator form, op_mr + 4
+static void encode_alu(x86_instr instr, x86_code *code, int ext, unsigned char op_mr, unsigned char op_rm) {
+    x86_operand *src = &instr->src, *dst = &instr->dst;
+    if (src->kind == X_IMM && is_rm(dst)) {
+        if (!fits32(src->imm)) encode_error(instr, "immediate does not fit in 32 bits");
+        if (fits8(src->imm)) {
+            encode_op1(instr, code, 0, REX_W, 0x83, ext, dst);
+            put(code, src->imm & 0xff);
+        } else if (is_gpr(dst) && dst->reg == RAX) {
+            put(code, 0x40 | REX_W);
+            put(code, op_mr + 4);
+            put32(code, src->imm);
+        } else {
+            encode_op1(instr, code, 0, REX_W, 0x81, ext, dst);
+            put32(code, src->imm);
+        }
+    } else if (is_gpr(src) && is_rm(dst)) {
+        encode_op1(instr, code, 0, REX_W, op_mr, reg_code(src->reg), dst);
+    } else if (is_rm(src) && is_gpr(dst)) {
+        encode_op1(instr, code, 0, REX_W, op_rm, reg_code(dst->reg), src);
+    } else {
+        encode_error(instr, "unsupported operands");
+    }
+}
+
+static void encode_shift(x86_instr instr, x86_code *code, int ext) {
+    if (instr->src.kind != X_IMM || !is_rm(&instr->dst)) encode_error(instr, "unsupported operands");
+    if (instr->src.imm == 1) {
+        encode_op1(instr, code, 0, REX_W, 0xd1, ext, &instr->dst);
+    } else {
+        encode_op1(instr, code, 0, REX_W, 0xc1, ext, &instr->dst);
+        put(code, instr->src.imm & 0xff);
+    }
+}
+
+static void encode_movq(x86_instr instr, x86_code *code) {
+    x86_operand *src = &instr->src, *dst = &instr->dst;
+    if (src->kind == X_IMM && is_gpr(dst) && !fits32(src->imm)) {
+        // movabs
+        int r = reg_code(dst->reg);
+        put(code, 0x40 | REX_W | ((r & 8) ? REX_B : 0));
+        put(code, 0xb8 + (r & 7));
+        put32(code, src->imm);
+        put32(code, src->imm >> 32);
+    } else if (src->kind == X_IMM && is_rm(dst)) {
+        if (!fits32(src->imm)) encode_error(instr, "immediate does not fit in 32 bits");
+        encode_op1(instr, code, 0, REX_W, 0xc7, 0, dst);
+        put32(code, src->imm);
+    } else if (is_gpr(src) && is_rm(dst)) {
+        encode_op1(instr, code, 0, REX_W, 0x89, reg_code(src->reg), dst);
+    } else if (is_rm(src) && is_gpr(dst)) {
+        encode_op1(instr, code, 0, REX_W, 0x8b, reg_code(dst->reg), src);
+    } else if (x86_is_xmm(src) && is_rm(dst)) {
+        encode_op2(instr, code, 0x66, REX_W, 0x0f, 0x7e, reg_code(src->reg), dst);
+    } else if (is_rm(src) && x86_is_xmm(dst)) {
+        encode_op2(instr, code, 0x66, REX_W, 0x0f, 0x6e, reg_code(dst->reg), src);
+    } else {
+        encode_error(instr, "unsupported operands");
+    }
+}
+
+static void encode_setcc(x86_instr instr, x86_code *code, unsigned char cc) {
+    if (!is_gpr(&instr->dst)) encode_error(instr, "unsupported operands");
+    encode_op2(instr, code, 0, needs_byte_rex(&instr->dst) ? 0x40 : 0, 0x0f, cc, 0, &instr->dst);
+}
+
+static void encode_byte_alu(x86_instr instr, x86_code *code, unsigned char op) {
+    if (!is_gpr(&instr->src) || !is_gpr(&instr->dst)) encode_error(instr, "unsupported operands");
+    int rex = (needs_byte_rex(&instr->src) || needs_byte_rex(&instr->dst)) ? 0x40 : 0;
+    encode_op1(instr, code, 0, rex, op, reg_code(instr->src.reg), &instr->dst);
+}
+
+static void encode_sse(x86_instr instr, x86_code *code, int prefix, unsigned char op) {
+    if (!x86_is_xmm(&instr->dst) || !(x86_is_xmm(&instr->src) || x86_is_memory(&instr->src))) {
+        encode_error(instr, "unsupported operands");
+    }
+    encode_op2(instr, code, prefix, 0, 0x0f, op, reg_code(instr->dst.reg), &instr->src);
+}
+
+// everything except labels, jumps and calls, whose encoding depends on layout
+void x86_encode_instr(x86_instr instr, x86_code *code) {
+    memset(code, 0, sizeof(*code));
+    code->reloc_at = -1;
+    x86_operand *src = &instr->src, *dst = &instr->dst;
+
+    switch (instr->opcode) {
+        case X86_LABEL:
+            break;
+        case X86_MOVQ:
+            encode_movq(instr, code);
+            break;
+        case X86_MOVL:
+            if (src->kind == X_IMM && is_gpr(dst)) {
+                int r = reg_code(dst->reg);
+                if (r & 8) put(code, 0x40 | REX_B);
+                put(code, 0xb8 + (r & 7));
+                put32(code, src->imm);
+            } else if (is_gpr(src) && is_rm(dst)) {
+                encode_op1(instr, code, 0, 0, 0x89, reg_code(src->reg), dst);
+            } else {
+                encode_error(instr, "unsupported operands");
+            }
+            break;
+        case X86_LEAQ:
+            if (!x86_is_memory(src) || !is_gpr(dst)) encode_error(instr, "unsupported operands");
+            encode_op1(instr, code, 0, REX_W, 0x8d, reg_code(dst->reg), src);
+            break;
+        case X86_ADDQ:
+            encode_alu(instr, code, 0, 0x01, 0x03);
+            break;
+        case X86_SUBQ:
+            encode_alu(instr, code, 5, 0x29, 0x2b);
+            break;
+        case X86_CMPQ:
+            encode_alu(instr, code, 7, 0x39, 0x3b);
+            break;
+        case X86_IMULQ:
+            if (!is_gpr(dst)) encode_error(instr, "unsupported operands");
+            if (src->kind == X_IMM) {
+                if (!fits32(src->imm)) encode_error(instr, "immediate does not fit in 32 bits");
+                if (fits8(src->imm)) {
+                    encode_op1(instr, code, 0, REX_W, 0x6b, reg_code(dst->reg), dst);
+                    put(code, src->imm & 0xff);
+                } else {
+                    encode_op1(instr, code, 0, REX_W, 0x69, reg_code(dst->reg), dst);
+                    put32(code, src->imm);
+                }
+            } else {
+                encode_op2(instr, code, 0, REX_W, 0x0f, 0xaf, reg_code(dst->reg), src);
+            }
+            break;
+        case X86_IDIVQ:
+            if (!is_rm(dst)) encode_error(instr, "unsupported operands");
+            encode_op1(instr, code, 0, REX_W, 0xf7, 7, dst);
+            break;
+        case X86_SHLQ:
+            encode_shift(instr, code, 4);
+            break;
+        case X86_SARQ:
+            encode_shift(instr, code, 7);
+            break;
+        case X86_SHRQ:
+            encode_shift(instr, code, 5);
+            break;
+        case X86_INCQ:
+            encode_op1(instr, code, 0, REX_W, 0xff, 0, dst);
+            break;
+        case X86_DECQ:
+            encode_op1(instr, code, 0, REX_W, 0xff, 1, dst);
+            break;
+        case X86_NEGQ:
+            encode_op1(instr, code, 0, REX_W, 0xf7, 3, dst);
+            break;
+        case X86_CQTO:
+            put(code, 0x48);
+            put(code, 0x99);
+            break;
+        case X86_XORL:
+            if (!is_gpr(src) || !is_rm(dst)) encode_error(instr, "unsupported operands");
+            encode_op1(instr, code, 0, 0, 0x31, reg_code(src->reg), dst);
+            break;
+        case X86_SETL:  encode_setcc(instr, code, 0x9c); break;
+        case X86_SETLE: encode_setcc(instr, code, 0x9e); break;
+        case X86_SETG:  encode_setcc(instr, code, 0x9f); break;
+        case X86_SETGE: encode_setcc(instr, code, 0x9d); break;
+        case X86_SETE:  encode_setcc(instr, code, 0x94); break;
+        case X86_SETNE: encode_setcc(instr, code, 0x95); break;
+        case X86_SETA:  encode_setcc(instr, code, 0x97); break;
+        case X86_SETAE: encode_setcc(instr, code, 0x93); break;
+        case X86_SETP:  encode_setcc(instr, code, 0x9a); break;
+        case X86_SETNP: encode_setcc(instr, code, 0x9b); break;
+        case X86_MOVZBQ:
+            if (!is_gpr(src) || !is_gpr(dst)) encode_error(instr, "unsupported operands");
+            encode_op2(instr, code, 0, REX_W, 0x0f, 0xb6, reg_code(dst->reg), src);
+            break;
+        case X86_ANDB:
+            encode_byte_alu(instr, code, 0x20);
+            break;
+        case X86_ORB:
+            encode_byte_alu(instr, code, 0x08);
+            break;
+        case X86_RET:
+            put(code, 0xc3);
+            break;
+        case X86_PUSHQ:
+            if (is_gpr(dst)) {
+                int r = reg_code(dst->reg);
+                if (r & 8) put(code, 0x40 | REX_B);
+                put(code, 0x50 + (r & 7));
+            } else if (dst->kind == X_IMM && fits8(dst->imm)) {
+                put(code, 0x6a);
+                put(code, dst->imm & 0xff);
+            } else if (dst->kind == X_IMM && fits32(dst->imm)) {
+                put(code, 0x68);
+                put32(code, dst->imm);
+            } else if (x86_is_memory(dst)) {
+                encode_op1(instr, code, 0, 0, 0xff, 6, dst);
+            } else {
+                encode_error(instr, "unsupported operands");
+            }
+            break;
+        case X86_MOVSD:
+            if (x86_is_xmm(dst)) encode_sse(instr, code, 0xf2, 0x10);
+            else if (x86_is_xmm(src) && x86_is_memory(dst)) {
+                encode_op2(instr, code, 0xf2, 0, 0x0f, 0x11, reg_code(src->reg), dst);
+            } else encode_error(instr, "unsupported operands");
+            break;
+        case X86_ADDSD: encode_sse(instr, code, 0xf2, 0x58); break;
+        case X86_MULSD: encode_sse(instr, code, 0xf2, 0x59); break;
+        case X86_SUBSD: encode_sse(instr, code, 0xf2, 0x5c); break;
+        case X86_DIVSD: encode_sse(instr, code, 0xf2, 0x5e); break;
+        case X86_UCOMISD: encode_sse(instr, code, 0x66, 0x2e); break;
+        case X86_CVTSI2SDQ:
+            if (!x86_is_xmm(dst) || !is_rm(src)) encode_error(instr, "unsupported operands");
+            encode_op2(instr, code, 0xf2, REX_W, 0x0f, 0x2a, reg_code(dst->reg), src);
+            break;
+        case X86_CVTTSD2SIQ:
+            if (!is_gpr(dst) || !(x86_is_xmm(src) || x86_is_memory(src))) encode_error(instr, "unsupported operands");
+            encode_op2(instr, code, 0xf2, REX_W, 0x0f, 0x2c, reg_code(dst->reg), src);
+            break;
+        default:
+            encode_error(instr, "no encoding");
+    }
+}
+
+/* label name -> instruction index, open addressing */
+typedef struct label_slot {
+    const char *name;
+    int index;
+} label_slot;
+
+static unsigned long hash_label(const char *s) {
+    unsigned long h = 5381;
+    while (*s) h = h * 33 + (unsigned char)*s++;
+    return h;
+}
+
+static label_slot *find_label(label_slot *table, size_t cap, const char *name) {
+    size_t i = hash_label(name) & (cap - 1);
+    while (table[i].name && strcmp(table[i].name, name) != 0) i = (i + 1) & (cap - 1);
+    return &table[i];
+}
+
+static int jcc_code(int opcode) {
+    return opcode == X86_JE ? 0x84 : 0x85;
+}
+
+/*
+ * Lay out and encode the list into obj->text. Jumps start short and are
+ * widened until every displacement fits, then labels become .text symbols
+ * and calls to functions not defined here get PLT relocations.
+ */
+void x86_encode(x86_list *list, elf_object *obj) {
+    int n = list->count;
+    x86_instr *instrs = calloc(n + 1, sizeof(x86_instr));
+    x86_code *codes = calloc(n + 1, sizeof(x86_code));
+    size_t *offsets = calloc(n + 1, sizeof(size_t));
+    bool *wide = calloc(n + 1, sizeof(bool));
+    size_t cap = 64;
+    while (cap < 2 * (size_t)(n + 1)) cap *= 2;
+    label_slot *labels = calloc(cap, sizeof(label_slot));
+    if (!instrs || !codes || !offsets || !wide || !labels) {
+        fprintf(k0_diag(), "Memory allocation failed for x86 encoder\n");
+        k0_fail(4);
+    }
+
+    int i = 0;
+    for (x86_instr instr = list->head; instr != NULL; instr = instr->next, i++) {
+        instrs[i] = instr;
+        if (instr->opcode == X86_LABEL) {
+            label_slot *slot = find_label(labels, cap, instr->dst.sym);
+            if (slot->name) {
+                fprintf(k0_diag(), "Error: label '%s' is already defined\n", instr->dst.sym);
+                k0_fail(4);
+            }
+            slot->name = instr->dst.sym;
+            slot->index = i;
+        }
+        if (!x86_is_jump(instr->opcode) && instr->opcode != X86_CALL) {
+            x86_encode_instr(instr, &codes[i]);
+        }
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        size_t offset = 0;
+        for (i = 0; i < n; i++) {
+            offsets[i] = offset;
+            int op = instrs[i]->opcode;
+            if (op == X86_JMP) offset += wide[i] ? 5 : 2;
+            else if (x86_is_jump(op)) offset += wide[i] ? 6 : 2;
+            else if (op == X86_CALL) offset += 5;
+            else offset += codes[i].len;
+        }
+        offsets[n] = offset;
+        for (i = 0; i < n; i++) {
+            if (!x86_is_jump(instrs[i]->opcode) || wide[i]) continue;
+            label_slot *slot = find_label(labels, cap, instrs[i]->dst.sym);
+            if (!slot->name) {
+                fprintf(k0_diag(), "Error: jump to undefined label '%s'\n", instrs[i]->dst.sym);
+                k0_fail(4);
+            }
+            long disp = (long)offsets[slot->index] - (long)(offsets[i] + 2);
+            if (!fits8(disp)) {
+                wide[i] = true;
+                changed = true;
+            }
+        }
+    }
+
+    size_t base = obj->text.size;
+    for (i = 0; i < n; i++) {
+        x86_instr instr = instrs[i];
+        x86_code *code = &codes[i];
+        if (instr->opcode == X86_LABEL) {
+            elf_define_symbol(obj, instr->dst.sym, ELF_TEXT, base + offsets[i], strcmp(instr->dst.sym, "main") == 0);
+            continue;
+        }
+        if (x86_is_jump(instr->opcode)) {
+            long target = offsets[find_label(labels, cap, instr->dst.sym)->index];
+            code->len = 0;
+            if (!wide[i]) {
+                put(code, instr->opcode == X86_JMP ? 0xeb : jcc_code(instr->opcode) - 0x10);
+                put(code, (target - (long)(offsets[i] + 2)) & 0xff);
+            } else if (instr->opcode == X86_JMP) {
+                put(code, 0xe9);
+                put32(code, target - (long)(offsets[i] + 5));
+            } else {
+                put(code, 0x0f);
+                put(code, jcc_code(instr->opcode));
+                put32(code, target - (long)(offsets[i] + 6));
+            }
+        } else if (instr->opcode == X86_CALL) {
+            label_slot *slot = find_label(labels, cap, instr->dst.sym);
+            code->len = 0;
+            put(code, 0xe8);
+            if (slot->name) {
+                put32(code, (long)offsets[slot->index] - (long)(offsets[i] + 5));
+            } else {
+                elf_add_reloc(obj, base + offsets[i] + 1, instr->dst.sym, R_X86_64_PLT32, -4);
+                put32(code, 0);
+            }
+        } else if (code->reloc_at >= 0) {
+            elf_add_reloc(obj, base + offsets[i] + code->reloc_at, code->reloc_symbol, code->reloc_type, 0);
+        }
+        elf_append(&obj->text, code->bytes, code->len);
+    }
+
+    free(instrs);
+    free(codes);
+    free(offsets);
+    free(wide);
+    free(labels);
+}
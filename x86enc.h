@@ -0,0 +1,21 @@
+#ifndef X86ENC_H
+#define X86ENC_H
+
+#include "x86.h"
+#include "elfobj.h"
+
+#define X86_MAX_INSTR_LEN 16
+
+/* Machine code for one instruction, plus at most one symbol reference */
+typedef struct x86_code {
+    unsigned char bytes[X86_MAX_INSTR_LEN];
+    int len;
+    int reloc_at;      /* offset of the 32-bit field to relocate, -1 if none */
+    const char *reloc_symbol;
+    int reloc_type;
+} x86_code;
+
+void x86_encode_instr(x86_instr instr, x86_code *code);
+void x86_encode(x86_list *list, elf_object *obj);
+
+#endif